@@ -41,6 +41,14 @@ return {
 				title = "ldb_core:new_drawbuffer(w,h,px_fmt)",
 				file = "new_drawbuffer.md",
 			},
+			{
+				title = "ldb_core:new_drawbuffer_from_pointer(ptr,w,h,px_fmt,stride,keepalive)",
+				file = "new_drawbuffer_from_pointer.md",
+			},
+			{
+				title = "Memory pool",
+				file = "memory_pool.md",
+			},
 			{
 				title = "drawbuffer:bytes_len()",
 				file = "drawbuffer_bytes_len.md",
@@ -53,10 +61,22 @@ return {
 				title = "drawbuffer:close()",
 				file = "drawbuffer_close.md",
 			},
+			{
+				title = "drawbuffer:convert_into(other)",
+				file = "drawbuffer_convert_into.md",
+			},
+			{
+				title = "Damage tracking",
+				file = "drawbuffer_damage.md",
+			},
 			{
 				title = "drawbuffer:dump_data()",
 				file = "drawbuffer_dump_data.md",
 			},
+			{
+				title = "drawbuffer:get_pointer()",
+				file = "drawbuffer_get_pointer.md",
+			},
 			{
 				title = "drawbuffer:get_px(x,y)",
 				file = "drawbuffer_get_px.md",
@@ -77,14 +97,66 @@ return {
 				title = "drawbuffer:set_px(x,y,r,g,b,a)",
 				file = "drawbuffer_set_px.md",
 			},
+			{
+				title = "drawbuffer:stride()",
+				file = "drawbuffer_stride.md",
+			},
 			{
 				title = "drawbuffer:tostring()",
 				file = "drawbuffer_tostring.md",
 			},
+			{
+				title = "drawbuffer:view(x,y,w,h)",
+				file = "drawbuffer_view.md",
+			},
 			{
 				title = "drawbuffer:width()",
 				file = "drawbuffer_width.md",
 			},
 		}
-	}
+	},
+	{
+		title = "ldb_gfx command lists",
+		file = "command_list.md",
+	},
+	{
+		title = "ldb_gfx compositing",
+		file = "compositing.md",
+	},
+	{
+		title = "ldb_gfx resampling",
+		file = "resampling.md",
+	},
+	{
+		title = "ldb_gfx blurring",
+		file = "blur.md",
+	},
+	{
+		title = "ldb_gfx convolution and morphology",
+		file = "convolution.md",
+	},
+	{
+		title = "ldb_gfx dithering",
+		file = "dithering.md",
+	},
+	{
+		title = "ldb_gfx affine transformations",
+		file = "transform_blit.md",
+	},
+	{
+		title = "ldb_gfx circles, ellipses and rings",
+		file = "circles.md",
+	},
+	{
+		title = "ldb_gfx polygon filling",
+		file = "polygon.md",
+	},
+	{
+		title = "ldb_gfx polylines",
+		file = "polyline.md",
+	},
+	{
+		title = "ldb_gfx triangle meshes",
+		file = "mesh.md",
+	},
 }
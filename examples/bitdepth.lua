@@ -42,6 +42,22 @@ for _, bpp in pairs({16,8,1}) do
 	table.insert(drawbuffers, {"Dithered to " .. bpp .. "bpp", drawbuffer})
 end
 
+-- same using ordered dithering
+for _, bpp in pairs({16,8,1}) do
+	local drawbuffer = assert(ldb.new_drawbuffer(w,h, ldb.pixel_formats.rgb888))
+	draw_colors(drawbuffer)
+	drawbuffer:ordered_dither(bpp, "bayer8")
+	table.insert(drawbuffers, {"Ordered dithered to " .. bpp .. "bpp", drawbuffer})
+end
+
+-- same using error diffusion with a larger kernel
+for _, bpp in pairs({16,8,1}) do
+	local drawbuffer = assert(ldb.new_drawbuffer(w,h, ldb.pixel_formats.rgb888))
+	draw_colors(drawbuffer)
+	drawbuffer:error_diffusion(bpp, "jarvis")
+	table.insert(drawbuffers, {"Jarvis error diffusion to " .. bpp .. "bpp", drawbuffer})
+end
+
 -- draw each drawbuffer for 5 seconds
 local timeout = 5
 local remaining = 0
@@ -99,7 +99,8 @@ if method == "simple" then
 elseif method == "ffi" then
 	renderer = px_f.multithread_pixel_function_ffi(render_w,render_h,3,threads,stride,per_worker_ffi)
 elseif method == "ffi_shared_buf" then
-	renderer = px_f.multithread_pixel_function_ffi_shared_buf(render_w,render_h,3,threads,stride,per_worker_ffi)
+	-- render directly into the render_db memory(no copy)
+	renderer = px_f.multithread_pixel_function_ffi_shared_buf(render_w,render_h,3,threads,stride,per_worker_ffi, nil, render_db)
 end
 renderer.start()
 
@@ -196,7 +197,9 @@ function cio:on_update(dt)
 	-- render the frame
 	local frame = renderer.get_frame() -- blocking wait for a frame
 	renderer.send_requests() -- send request for a new frame
-	render_db:load_data(frame) -- load the returned rendered image data into the render_db
+	if frame ~= render_db then
+		render_db:load_data(frame) -- load the returned rendered image data into the render_db
+	end
 end
 
 function cio:on_close()
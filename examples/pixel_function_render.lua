@@ -43,7 +43,7 @@ local lines_done = 0
 local frames_rendered = 0
 local border = 50
 local gui_h = 120
-local frame_w,frame_h = w*preview_scale,h*preview_scale
+local frame_w,frame_h = math.floor(w*preview_scale),math.floor(h*preview_scale)
 if disable_preview then
 	frame_w,frame_h = 500,0
 	gui_h = gui_h-border
@@ -196,15 +196,11 @@ function cio:on_draw(db)
 
 	if not disable_preview then
 		db:rectangle(border-1,border-1,frame_w+1,frame_h+1, 0,0,0,255)
-		if preview_scale>=1 then
+		if (preview_scale>=1) and (preview_scale==math.floor(preview_scale)) then
 			target_db:origin_to_target(db, border,border, nil,nil,nil,nil,preview_scale,preview_scale)
 		elseif preview_scale>0 then
-			for y=0, frame_h do
-				for x=0,frame_w do
-					local r,g,b,a = target_db:get_px(x*(1/preview_scale),y*(1/preview_scale))
-					db:set_px(x+border,y+border,r,g,b,a)
-				end
-			end
+			-- box-filter downscaled previews, interpolate upscaled previews
+			target_db:resample(db, nil,nil,nil,nil, border,border,frame_w,frame_h, (preview_scale<1) and "area" or "bilinear")
 		end
 	end
 
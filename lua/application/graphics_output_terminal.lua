@@ -52,6 +52,8 @@ function app:new_output_terminal(config)
 	w = (tonumber(config.terminal_force_width) or w or 80)*pixels_per_char_x
 
 	local drawbuffer = ldb_core.new_drawbuffer(w,h)
+	-- only redraw the terminal if the drawbuffer changed
+	drawbuffer:track_damage(true)
 
 
 	function output:before_draw()
@@ -60,6 +62,13 @@ function app:new_output_terminal(config)
 		self.app.output_ev_client:push_event("internal_terminal_raw_event", self, resolved, chars)
 	end
 	function output:after_draw()
+		-- nothing was drawn since the last frame, the terminal is still up to date
+		local damage = self.drawbuffer:get_damage()
+		if damage and (#damage == 0) then
+			return
+		end
+		self.drawbuffer:reset_damage()
+
 		-- TODO: Draw using braile etc.
 		self.terminal:reset_all()
 		self.terminal:set_cursor()
@@ -15,8 +15,9 @@ function BMPFont.new_bmpfont(config)
 	font.scale = tonumber(config.scale) or 1
 
 	-- always copy drawbuffer, because we need alpha channel, and we modify
+	-- (premultiplied alpha makes drawing with alphablending faster)
 	assert(config.db)
-	font.db = ldb_core.new_drawbuffer(config.db:width(), config.db:height(), "rgba8888")
+	font.db = ldb_core.new_drawbuffer(config.db:width(), config.db:height(), config.premultiplied and "rgba8888_premul" or "rgba8888")
 	ldb_gfx.origin_to_target(config.db, font.db)
 
 	font.char_w = assert(tonumber(config.char_w))
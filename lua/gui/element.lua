@@ -186,6 +186,23 @@ return function(gui)
 			end
 		end
 
+		-- get a view of the w,h region at x,y in the surface(shares the surface memory), or nil if the region is not inside the surface.
+		-- The last view is cached, so it's only re-created if the surface or region changes.
+		function element:get_surface_view(surface, x,y, w,h)
+			local cache = self.surface_view_cache
+			if cache and (cache.surface==surface) and (cache.x==x) and (cache.y==y) and (cache.w==w) and (cache.h==h) then
+				return cache.view
+			end
+			if (x<0) or (y<0) or (x+w>surface:width()) or (y+h>surface:height()) then
+				return
+			end
+			local view = surface:view(x,y,w,h)
+			if view then
+				self.surface_view_cache = { surface = surface, x = x, y = y, w = w, h = h, view = view }
+			end
+			return view
+		end
+
 		-- get the position of the element in the root window
 		function element:get_absolute_position()
 			if self.parent then
@@ -43,9 +43,11 @@ return function(gui)
 			self.vertical_slider.drag_element.w = self.scrollbar_width
 			self.vertical_slider.drag_element.h = (self.h/self.scroll_content.h)*(self.h-self.scrollbar_width)
 
-			if (not self.scroll_content.surface) or (self.scroll_content.surface:width()~=window_w) or (self.scroll_content.surface:height()~=window_h) then
-				local pxfmt = self.scroll_content.surface and self.scroll_content.surface:pixel_format()
-				self.scroll_content.surface = ldb_core.new_drawbuffer(window_w, window_h, pxfmt)
+			local window_surface = self.scroll_content.window_surface
+			if (not window_surface) or (window_surface:width()~=window_w) or (window_surface:height()~=window_h) then
+				local pxfmt = window_surface and window_surface:pixel_format()
+				self.scroll_content.window_surface = ldb_core.new_drawbuffer(window_w, window_h, pxfmt)
+				self.scroll_content.surface = self.scroll_content.window_surface
 			end
 		end
 
@@ -76,6 +78,12 @@ return function(gui)
 		end
 
 		function scroll_content_element:handle_draw()
+			-- draw directly into the window region of the parent surface if possible(no blit needed)
+			local parent_surface, parent_ox, parent_oy = self.parent:get_surface()
+			local window_w, window_h = self.window_surface:width(), self.window_surface:height()
+			local view = self:get_surface_view(parent_surface, parent_ox, parent_oy, window_w, window_h)
+			self.surface = view or self.window_surface
+
 			local targete_surface, target_ox,target_oy = self:get_surface()
 			if self.parent.bg_color then
 				local r,g,b,a = unpack(self.parent.bg_color)
@@ -85,8 +93,9 @@ return function(gui)
 			for _,child in ipairs(self.children) do
 				child:handle_draw()
 			end
-			local parent_surface, parent_ox, parent_oy = self.parent:get_surface()
-			self.surface:origin_to_target(parent_surface, parent_ox, parent_oy)
+			if not view then
+				self.surface:origin_to_target(parent_surface, parent_ox, parent_oy)
+			end
 		end
 
 		scroll_container_element:update(container_w,container_h, scroll_content_w, scroll_content_h)
@@ -12,12 +12,25 @@ local db_mt = getmetatable(ldb_core.new_drawbuffer(1,1))
 local db_gfx_functions = {
 	"pixel_function",
 	"origin_to_target",
+	"resample",
+	"blur",
+	"convolve",
+	"morphology",
+	"transform_blit",
 	"line",
 	"rectangle",
 	"triangle",
+	"polygon",
+	"polyline",
+	"draw_mesh",
+	"draw_textured_mesh",
 	"set_px_alphablend",
 	"circle",
-	"floyd_steinberg"
+	"ellipse",
+	"ring",
+	"floyd_steinberg",
+	"ordered_dither",
+	"error_diffusion"
 }
 for _,name in ipairs(db_gfx_functions) do
 	db_mt.__index[name] = ldb_gfx[name]
@@ -39,8 +39,10 @@ function input_output.new_base(config)
 	base.output_width = base.target_width -- output size, might be overwritten by driver to actual size
 	base.output_height = base.target_height
 	base.output_dither = config.output_dither -- use dithering to reduce colors to output pixel format?
+	base.output_dither_matrix = config.output_dither_matrix -- threshold matrix for output_dither(see ldb_gfx.ordered_dither, default bayer8)
 	base.output_scale_x = config.output_scale_x or 1 -- scale the target db this ammount when drawing to the output
 	base.output_scale_y = config.output_scale_y or 1
+	base.output_filter = config.output_filter -- resampling filter(see ldb_gfx.resample), used for non-integer scales(default bilinear)
 	base.output_ox = 0 -- draw the target db at this offset in the output
 	base.output_oy = 0
 	base.output_format = "abgr8888" -- pixel format the output supports
@@ -162,14 +164,21 @@ function input_output.new_base(config)
 		end
 
 		-- apply dither on the target db, so that when we copy to the output
-		-- with a lower bpp, no information is lost.
+		-- with a lower bpp, no information is lost. Ordered dithering produces
+		-- the same pattern every frame for static content, and uses all CPUs.
 		if self.output_dither then
-			self.target_db:floyd_steinberg(self.output_dither)
+			self.target_db:ordered_dither(self.output_dither, self.output_dither_matrix, 0)
 		end
 
 		-- copy the target_db to the output_db
 		if self.output_copy then
-			self.target_db:origin_to_target(self.output_db, self.output_ox, self.output_oy, 0,0, self.target_width, self.target_height, self.output_scale_x, self.output_scale_y)
+			local scale_x, scale_y = self.output_scale_x, self.output_scale_y
+			if (not self.output_filter) and (scale_x==math.floor(scale_x)) and (scale_y==math.floor(scale_y)) then
+				self.target_db:origin_to_target(self.output_db, self.output_ox, self.output_oy, 0,0, self.target_width, self.target_height, scale_x, scale_y)
+			else
+				local w,h = math.floor(self.target_width*scale_x), math.floor(self.target_height*scale_y)
+				self.target_db:resample(self.output_db, 0,0, self.target_width, self.target_height, self.output_ox, self.output_oy, w,h, self.output_filter)
+			end
 		end
 
 		-- call the driver on_output_draw, to draw the output_db to the output device(screen etc.)
@@ -271,8 +280,8 @@ function input_output.new_sdl2fb(config)
 	local sdlio = input_output.new_base(config)
 
 	function sdlio:on_init()
-		self.output_width = self.target_width*self.output_scale_x
-		self.output_height = self.target_height*self.output_scale_y
+		self.output_width = math.floor(self.target_width*self.output_scale_x)
+		self.output_height = math.floor(self.target_height*self.output_scale_y)
 
 		self.sdl2fb = ldb_sdl.new_sdl2fb(self.output_width, self.output_height, self.title)
 		self.target_format = "abgr8888" -- for fastpath
@@ -408,7 +417,9 @@ function input_output.new_from_args(config, args)
 			--output_scale=number(>0, scale along both axis)
 			--output_scale_x=number(>0, scale along x axis)
 			--output_scale_y=number(>0, scale along y axis)
+			--output_filter=text(filter for non-integer scales: bilinear, bicubic, lanczos, area)
 			--dither=number(dither target bpp)
+			--dither_matrix=text(threshold matrix for dithering: bayer2, bayer4, bayer8)
 			--limit_fps=number(Limit to target fps)
 		--sdl
 			--width=number
@@ -421,7 +432,9 @@ function input_output.new_from_args(config, args)
 	local output_scale_x = config.output_scale_x or 1
 	local output_scale_y = config.output_scale_y or 1
 	local dither = config.output_dither
+	local dither_matrix = args_parse.get_arg_str(args, "dither_matrix", config.output_dither_matrix)
 	local limit_fps = config.limit_fps
+	local output_filter = args_parse.get_arg_str(args, "output_filter", config.output_filter)
 
 	if args_parse.get_arg_num(args, "output_scale") then
 		local scale = args_parse.get_arg_num(args, "output_scale")
@@ -469,7 +482,9 @@ function input_output.new_from_args(config, args)
 		return input_output.new_sdl2fb({
 			output_scale_x = output_scale_x,
 			output_scale_y = output_scale_y,
+			output_filter = output_filter,
 			output_dither = dither,
+			output_dither_matrix = dither_matrix,
 			limit_fps = limit_fps,
 
 			target_width = width,
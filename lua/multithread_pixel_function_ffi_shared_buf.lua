@@ -1,9 +1,11 @@
 local wrap_cb = require("lua-db.wrap_cb")
 
 -- multithreaded, ffi and stride, using shared memory(optimized hotloop for luajit, no memory copy)
--- usage is the same as multithread_pixel_function_ffi, except the new parameter no_string.
+-- usage is the same as multithread_pixel_function_ffi, except the new parameters no_string and target_db.
 -- if no_string is truethy the result is not stringified, but returned as the ffi buffer and it's length.
-local function multithread_pixel_function_ffi_shared_buf(w,h, bytes_per_pixel, threads, stride, per_worker, no_string)
+-- if target_db is a drawbuffer, the workers write directly into the drawbuffer memory(w,h must match),
+-- and the drawbuffer is returned as the frame data.
+local function multithread_pixel_function_ffi_shared_buf(w,h, bytes_per_pixel, threads, stride, per_worker, no_string, target_db)
 	local effil = require("effil")
 
 	-- check arguments/use default values
@@ -49,8 +51,21 @@ local function multithread_pixel_function_ffi_shared_buf(w,h, bytes_per_pixel, t
 		return buf
 	end
 
-	local buf_len = w*h*bytes_per_pixel
-	local buf_ptr = calloc_buf(buf_len, "uint8_t")
+	local buf_len, buf_ptr
+	local row_len = w*bytes_per_pixel
+	if target_db then
+		-- render directly into the drawbuffer memory
+		assert((target_db:width()==w) and (target_db:height()==h), "target_db dimensions must match w,h")
+		local target_ptr, target_len, target_stride = target_db:get_pointer()
+		assert(target_ptr, "target_db must be a valid drawbuffer")
+		assert(target_len >= (h-1)*target_stride+row_len, "target_db pixel format must have bytes_per_pixel bytes per pixel")
+		buf_ptr = ffi.cast("uint8_t*", target_ptr)
+		buf_len = target_len
+		row_len = target_stride
+	else
+		buf_len = w*h*bytes_per_pixel
+		buf_ptr = calloc_buf(buf_len, "uint8_t")
+	end
 	local buf_ptr_str = pointer_to_str(ffi, buf_ptr)
 
 	-- return the buffer content as a lua string
@@ -96,7 +111,7 @@ local function multithread_pixel_function_ffi_shared_buf(w,h, bytes_per_pixel, t
 				for x=0, w-1 do
 					-- call per_pixel_cb for every pixel in every line
 					-- TODO: optimize this into a single loop? e.g. for y do for x do buf[i]=px; i++; end end
-					local i = (y+o)*w*bytes_per_pixel+x*bytes_per_pixel
+					local i = (y+o)*row_len+x*bytes_per_pixel
 					per_pixel_cb(x,y+o,thread_buf_ptr,i,per_frame)
 				end
 			end
@@ -153,7 +168,10 @@ local function multithread_pixel_function_ffi_shared_buf(w,h, bytes_per_pixel, t
 		local frame_ready,frame_seq = frame_channel:pop(t)
 		if frame_ready then
 			request_ready = true
-			if no_string then
+			if target_db then
+				target_db:add_damage() -- pixels are already in the drawbuffer, written using the pointer
+				return target_db,frame_seq
+			elseif no_string then
 				return buf_ptr,buf_len,frame_seq -- return only ffi ptr
 			else
 				return buffer_to_str(),frame_seq -- serialize buffer as str
@@ -202,6 +220,7 @@ local function multithread_pixel_function_ffi_shared_buf(w,h, bytes_per_pixel, t
 		frame_channel = frame_channel,
 		progress_channel = progress_channel,
 		buffer_to_str = buffer_to_str,
+		target_db = target_db, -- keep the drawbuffer alive while the workers write to it
 		buf_ptr = buf_ptr -- this is important:
 		-- if this reference is deleted the main thread GC thinks there is no
 		-- reference to buf_ptr anymore and calls it's __gc metamethod that
@@ -19,7 +19,8 @@ For usage information on the different implementations, see the comments below.
 
  * per_pixel_cb modifies a buffer in all implementations(except the common interface, which uses a wrapper that does).
  * frame_data is always a string of length w*h*bytes_per_pixel,
-   expect for multithread_pixel_function_ffi_shared_buf() with the no_string argument. (returns a ffi buffer)
+   expect for multithread_pixel_function_ffi_shared_buf() with the no_string argument(returns a ffi buffer),
+   or with the target_db argument(renders directly into the drawbuffer memory, returns the drawbuffer)
  * the multithreaded implementations also support a sequence number in get_progress, get_frame, render, per_frame_cb
  * the multithreaded implementations only support a single worker_arg(single-threaded supports vararg)
  * the multithread_pixel_function_ffi is never selected by pixel_function.auto unless forced via config
@@ -96,7 +97,7 @@ pixel_function.multithread_pixel_function_ffi = require("lua-db.multithread_pixe
 
 
 pixel_function.multithread_pixel_function_ffi_shared_buf = require("lua-db.multithread_pixel_function_ffi_shared_buf")
--- renderer = multithread_pixel_function_ffi_shared_buf(w,h, bytes_per_pixel, threads,stride, per_worker, no_string)
+-- renderer = multithread_pixel_function_ffi_shared_buf(w,h, bytes_per_pixel, threads,stride, per_worker, no_string, target_db)
 -- w,h,bytes_per_pixel define the pixel data format
 --   renderer.start(worker_arg)
 --   renderer.send_requests()
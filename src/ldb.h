@@ -2,25 +2,27 @@
 #define LUA_LDB_H
 
 #include <stdint.h>
+#include <string.h>
 
 #define LDB_VERSION "3.0"
 #define LDB_UDATA_NAME "drawbuffer"
 
 // check if a Lua stack index contains a valid drawbuffer, return to lua with an error if not.
-#define LUA_LDB_CHECK_DB(L, I, D) D=(drawbuffer_t *)luaL_checkudata(L, I, LDB_UDATA_NAME); if ((D==NULL) || (!D->data)) { lua_pushnil(L); lua_pushfstring(L, "Argument %d must be a drawbuffer", I); return 2; }
+// A drawbuffer is invalid if it was closed, or if it's a view and the parent drawbuffer was closed.
+#define LUA_LDB_CHECK_DB(L, I, D) D=(drawbuffer_t *)luaL_checkudata(L, I, LDB_UDATA_NAME); if ((D==NULL) || (!db_is_valid(D))) { lua_pushnil(L); lua_pushfstring(L, "Argument %d must be a drawbuffer", I); return 2; }
 
 // "unpack" the internal pixel value to seperate r,g,b,a uint8_t variables.
 #define UNPACK_RGB(P, R, G, B) R = unpack_pixel_r(P); G = unpack_pixel_g(P); B = unpack_pixel_b(P);
 #define UNPACK_RGBA(P, R, G, B, A) R = unpack_pixel_r(P); G = unpack_pixel_g(P); B = unpack_pixel_b(P); A = unpack_pixel_a(P);
 
-// Copy the pixel bytes A,B,C,D to the data pointer.
-#define SET_DATA2(DATA, X, Y, W, A,B) DATA[(Y*W+X)*2] = A; DATA[(Y*W+X)*2+1] = B;
-#define SET_DATA3(DATA, X, Y, W, A,B,C) DATA[(Y*W+X)*3] = A; DATA[(Y*W+X)*3+1] = B; DATA[(Y*W+X)*3+2] = C;
-#define SET_DATA4(DATA, X, Y, W, A,B,C,D) DATA[(Y*W+X)*4] = A; DATA[(Y*W+X)*4+1] = B; DATA[(Y*W+X)*4+2] = C; DATA[(Y*W+X)*4+3] = D;
+// Copy the pixel bytes A,B,C,D to the data pointer. S is the stride(bytes per row).
+#define SET_DATA2(DATA, X, Y, S, A,B) DATA[(Y)*(S)+(X)*2] = A; DATA[(Y)*(S)+(X)*2+1] = B;
+#define SET_DATA3(DATA, X, Y, S, A,B,C) DATA[(Y)*(S)+(X)*3] = A; DATA[(Y)*(S)+(X)*3+1] = B; DATA[(Y)*(S)+(X)*3+2] = C;
+#define SET_DATA4(DATA, X, Y, S, A,B,C,D) DATA[(Y)*(S)+(X)*4] = A; DATA[(Y)*(S)+(X)*4+1] = B; DATA[(Y)*(S)+(X)*4+2] = C; DATA[(Y)*(S)+(X)*4+3] = D;
 
-#define GET_DATA2(DATA, X, Y, W, A,B) A = DATA[(Y*W+X)*2]; B = DATA[(Y*W+X)*2+1];
-#define GET_DATA3(DATA, X, Y, W, A,B,C) A = DATA[(Y*W+X)*3]; B = DATA[(Y*W+X)*3+1]; C = DATA[(Y*W+X)*3+2];
-#define GET_DATA4(DATA, X, Y, W, A,B,C,D) A = DATA[(Y*W+X)*4]; B = DATA[(Y*W+X)*4+1]; C = DATA[(Y*W+X)*4+2]; D = DATA[(Y*W+X)*4+3];
+#define GET_DATA2(DATA, X, Y, S, A,B) A = DATA[(Y)*(S)+(X)*2]; B = DATA[(Y)*(S)+(X)*2+1];
+#define GET_DATA3(DATA, X, Y, S, A,B,C) A = DATA[(Y)*(S)+(X)*3]; B = DATA[(Y)*(S)+(X)*3+1]; C = DATA[(Y)*(S)+(X)*3+2];
+#define GET_DATA4(DATA, X, Y, S, A,B,C,D) A = DATA[(Y)*(S)+(X)*4]; B = DATA[(Y)*(S)+(X)*4+1]; C = DATA[(Y)*(S)+(X)*4+2]; D = DATA[(Y)*(S)+(X)*4+3];
 
 // supported pixel formats.
 // append new formats to bottom of same BPP group.
@@ -40,6 +42,8 @@ typedef enum {
 	LDB_PXFMT_32BPP_ARGB,
 	LDB_PXFMT_32BPP_ABGR,
 	LDB_PXFMT_32BPP_BGRA,
+	LDB_PXFMT_32BPP_RGBA_PREMUL, // same as RGBA, but the r,g,b values are premultiplied with the alpha value
+	LDB_PXFMT_32BPP_BGRA_PREMUL,
 
 	LDB_PXFMT_MAX,
 } PIX_FMT;
@@ -47,18 +51,42 @@ typedef enum {
 // function called when the drawbuffer is closed with the drawbuffer data as argument.
 typedef void (*db_close_func_t)(void *);
 
-// this struct holds all info for accessing a drawbuffer. Also used as the backing for the Lua userdata.
+// maximum number of rectangles in a damage region, further damage is merged into the existing rectangles
+#define LDB_DAMAGE_MAX_RECTS 8
+
+// a rectangular region of pixels(x1, y1 are exclusive)
+typedef struct {
+	int x0, y0, x1, y1;
+} db_rect_t;
+
+// the region of a drawbuffer that was changed since the damage was last reset
 typedef struct {
+	int enabled;
+	int count;
+	db_rect_t rects[LDB_DAMAGE_MAX_RECTS];
+} db_damage_t;
+
+// this struct holds all info for accessing a drawbuffer. Also used as the backing for the Lua userdata.
+// stride is the number of bytes between the start of two rows(at least get_stride(pxfmt, w)).
+// If parent is set, this drawbuffer is a view into the parent drawbuffer memory, and does not own data.
+// If damage.enabled is set, the changed regions are recorded in damage(changes to a view are also recorded in the parent).
+typedef struct drawbuffer_t {
     int w, h;
     void* data;
 	PIX_FMT pxfmt;
 	db_close_func_t close_func;
 	void* close_data;
+	int stride;
+	struct drawbuffer_t* parent;
+	db_damage_t damage;
 } drawbuffer_t;
 
 // This function is used to set the metatable for a drawbuffer userdata object.
 void lua_set_ldb_meta(lua_State *, int);
 
+// add the rectangle x,y,w,h to the damage region of the drawbuffer and it's parent(use db_add_damage).
+void db_add_damage_rect(drawbuffer_t* db, int x, int y, int w, int h);
+
 // below are inline utillity functions that are usefull in all lua-db modules
 
 // get the bits per pixel for the specified pixel format
@@ -79,15 +107,75 @@ static inline size_t get_bpp(PIX_FMT fmt) {
 		case LDB_PXFMT_32BPP_ARGB:
 		case LDB_PXFMT_32BPP_ABGR:
 		case LDB_PXFMT_32BPP_BGRA:
+		case LDB_PXFMT_32BPP_RGBA_PREMUL:
+		case LDB_PXFMT_32BPP_BGRA_PREMUL:
 			return 32;
 		default:
 			return 0;
 	}
 }
 
-// get the size of the data region for the specified pixel format and dimensions
+// get the minimum stride(bytes per row) for the specified pixel format and width. 1bpp rows are padded to a full byte.
+static inline size_t get_stride(PIX_FMT fmt, int w) {
+	return ((size_t)w*get_bpp(fmt)+7)/8;
+}
+
+// get the size of the data region for the specified pixel format and dimensions, using the minimum stride
 static inline size_t get_data_size(PIX_FMT fmt, int w, int h) {
-	return (w*h*get_bpp(fmt))/8;
+	return get_stride(fmt, w)*h;
+}
+
+// check if the drawbuffer(and all parent drawbuffers, if it's a view) are still open
+static inline int db_is_valid(const drawbuffer_t* db) {
+	while (db) {
+		if (!db->data) {
+			return 0;
+		}
+		db = db->parent;
+	}
+	return 1;
+}
+
+// check if the rows of the drawbuffer are stored without padding in between
+static inline int db_is_contiguous(const drawbuffer_t* db) {
+	return (size_t)db->stride == get_stride(db->pxfmt, db->w);
+}
+
+// record a change of the rectangle x,y,w,h of the drawbuffer, if damage tracking is enabled
+static inline void db_add_damage(drawbuffer_t* db, int x, int y, int w, int h) {
+	if (db->damage.enabled || (db->parent && db->parent->damage.enabled)) {
+		db_add_damage_rect(db, x, y, w, h);
+	}
+}
+
+// record a change of the pixels between the corners x0,y0 and x1,y1(inclusive, in any order), if damage tracking is enabled
+static inline void db_add_damage_corners(drawbuffer_t* db, int x0, int y0, int x1, int y1) {
+	int x_min = (x0<x1) ? x0 : x1;
+	int y_min = (y0<y1) ? y0 : y1;
+	int x_max = (x0>x1) ? x0 : x1;
+	int y_max = (y0>y1) ? y0 : y1;
+	db_add_damage(db, x_min, y_min, x_max-x_min+1, y_max-y_min+1);
+}
+
+// record a change of the entire drawbuffer, if damage tracking is enabled
+static inline void db_add_damage_all(drawbuffer_t* db) {
+	db_add_damage(db, 0, 0, db->w, db->h);
+}
+
+// get the regions of the drawbuffer that need to be copied to an output into rects(LDB_DAMAGE_MAX_RECTS entries).
+// If damage tracking is disabled, this is the entire drawbuffer. Returns the number of rectangles.
+static inline int db_get_damage_rects(const drawbuffer_t* db, db_rect_t* rects) {
+	if (!db->damage.enabled) {
+		rects[0] = (db_rect_t){ 0, 0, db->w, db->h };
+		return 1;
+	}
+	memcpy(rects, db->damage.rects, db->damage.count*sizeof(db_rect_t));
+	return db->damage.count;
+}
+
+// clear the damage region(e.g. after the drawbuffer was copied to an output)
+static inline void db_reset_damage(drawbuffer_t* db) {
+	db->damage.count = 0;
 }
 
 
@@ -114,96 +202,165 @@ static inline uint8_t unpack_pixel_a(uint32_t p) {
 	return p & 0xff;
 }
 
+// mix the color of src into dst using the alpha value of src, keep the alpha value of dst.
+// Uses exact integer math((x*a + y*(255-a) + 128)/255, rounded), r and b are computed in parallel.
+static inline uint32_t blend_pixel(uint32_t dst, uint32_t src) {
+	uint32_t a = src & 0xff;
+	if (a == 0) {
+		return dst;
+	} else if (a == 0xff) {
+		return (src & 0xffffff00) | (dst & 0xff);
+	}
+	uint32_t ia = 255-a;
+	uint32_t rb = ((src>>8) & 0x00ff00ff)*a + ((dst>>8) & 0x00ff00ff)*ia + 0x00800080;
+	uint32_t g = ((src>>16) & 0xff)*a + ((dst>>16) & 0xff)*ia + 0x80;
+	rb = ((rb + ((rb>>8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+	g = ((g + (g>>8)) >> 8) & 0xff;
+	return (rb<<8) | (g<<16) | (dst & 0xff);
+}
+
+// mix the premultiplied pixel src into the premultiplied pixel dst using the "over" operator(d = s + d*(255-a)/255 for all channels)
+static inline uint32_t blend_pixel_premul(uint32_t dst, uint32_t src) {
+	uint32_t ia = 255 - (src & 0xff);
+	uint32_t rb = ((dst>>8) & 0x00ff00ff)*ia + 0x00800080;
+	uint32_t ga = (dst & 0x00ff00ff)*ia + 0x00800080;
+	rb = ((rb + ((rb>>8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+	ga = ((ga + ((ga>>8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+	// add the source, saturate invalid(color>alpha) values
+	rb += (src>>8) & 0x00ff00ff;
+	ga += src & 0x00ff00ff;
+	rb = (rb | (((rb>>8) & 0x00010001)*0xff)) & 0x00ff00ff;
+	ga = (ga | (((ga>>8) & 0x00010001)*0xff)) & 0x00ff00ff;
+	return (rb<<8) | ga;
+}
+
+// multiply the r,g,b values with the alpha value(for premultiplied pixel formats)
+static inline uint32_t premultiply_pixel(uint32_t p) {
+	uint32_t a = p & 0xff;
+	uint32_t rb = ((p>>8) & 0x00ff00ff)*a + 0x00800080;
+	uint32_t g = ((p>>16) & 0xff)*a + 0x80;
+	rb = ((rb + ((rb>>8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+	g = ((g + (g>>8)) >> 8) & 0xff;
+	return (rb<<8) | (g<<16) | a;
+}
+
+// divide the r,g,b values by the alpha value(inverse of premultiply_pixel)
+static inline uint32_t unpremultiply_pixel(uint32_t p) {
+	uint32_t a = p & 0xff;
+	if (a == 0xff) {
+		return p;
+	} else if (a == 0) {
+		return 0;
+	}
+	uint32_t r = ((p>>24)*255 + a/2) / a;
+	uint32_t g = (((p>>16) & 0xff)*255 + a/2) / a;
+	uint32_t b = (((p>>8) & 0xff)*255 + a/2) / a;
+	r = (r>255) ? 255 : r;
+	g = (g>255) ? 255 : g;
+	b = (b>255) ? 255 : b;
+	return (r<<24) | (g<<16) | (b<<8) | a;
+}
+
 
 
 // internal functions to set a pixel in memory
-static inline void set_px_1bpp(uint8_t* data, int w, int x, int y, uint32_t p) {
-	uint8_t j = data[(y*w+x)/8];
+static inline void set_px_1bpp(uint8_t* data, int stride, int x, int y, uint32_t p) {
+	uint8_t j = data[y*stride+x/8];
 	uint8_t i = 1<<(x%8);
 	if (p) {
 		j = j | i;
 	} else {
 		j = j & (~i);
 	}
-	data[(y*w+x)/8] = j;
+	data[y*stride+x/8] = j;
 }
-static inline void set_px_8bpp(uint8_t* data, int w, int x, int y, uint32_t p) {
-	data[y*w+x] = p&0xff;
+static inline void set_px_8bpp(uint8_t* data, int stride, int x, int y, uint32_t p) {
+	data[y*stride+x] = p&0xff;
 }
-static inline void set_px_8bpp_rgb332(uint8_t* data, int w, int x, int y, uint32_t p) {
+static inline void set_px_8bpp_rgb332(uint8_t* data, int stride, int x, int y, uint32_t p) {
 	uint8_t r,g,b;
 	UNPACK_RGB(p, r,g,b)
 	uint8_t v = (r&0xe0) | ((g&0xe0)>>3) | ((b&0xc0)>>6);
-	data[y*w+x] = v;
+	data[y*stride+x] = v;
 }
-static inline void set_px_16bpp_rgb565(uint8_t* data, int w, int x, int y, uint32_t p) {
+static inline void set_px_16bpp_rgb565(uint8_t* data, int stride, int x, int y, uint32_t p) {
 	uint8_t r,g,b;
 	UNPACK_RGB(p, r,g,b)
 	uint8_t v1 = (r&0xF8) | ((g&0xE0)>>5);
-	uint8_t v2 = ((g&0x1C)<<3) | ((b&0xF8)>>2);
-	SET_DATA2(data,x,y,w, v1,v2)
+	uint8_t v2 = ((g&0x1C)<<3) | ((b&0xF8)>>3);
+	SET_DATA2(data,x,y,stride, v1,v2)
 }
-static inline void set_px_16bpp_bgr565(uint8_t* data, int w, int x, int y, uint32_t p) {
+static inline void set_px_16bpp_bgr565(uint8_t* data, int stride, int x, int y, uint32_t p) {
 	uint8_t r,g,b;
 	UNPACK_RGB(p, r,g,b)
 	uint8_t v1 = (b&0xF8) | ((g&0xE0)>>5);
-	uint8_t v2 = ((g&0x1C)<<3) | ((r&0xF8)>>2);
-	SET_DATA2(data,x,y,w,  v1,v2)
+	uint8_t v2 = ((g&0x1C)<<3) | ((r&0xF8)>>3);
+	SET_DATA2(data,x,y,stride,  v1,v2)
 }
-static inline void set_px_24bpp_rgb(uint8_t* data, int w, int x, int y, uint32_t p) {
+static inline void set_px_24bpp_rgb(uint8_t* data, int stride, int x, int y, uint32_t p) {
 	uint8_t r,g,b;
 	UNPACK_RGB(p, r,g,b)
-	SET_DATA3(data,x,y,w, r,g,b)
+	SET_DATA3(data,x,y,stride, r,g,b)
 }
-static inline void set_px_24bpp_bgr(uint8_t* data, int w, int x, int y, uint32_t p) {
+static inline void set_px_24bpp_bgr(uint8_t* data, int stride, int x, int y, uint32_t p) {
 	uint8_t r,g,b;
 	UNPACK_RGB(p, r,g,b)
-	SET_DATA3(data,x,y,w, b,g,r)
+	SET_DATA3(data,x,y,stride, b,g,r)
 }
-static inline void set_px_32bpp_rgba(uint8_t* data, int w, int x, int y, uint32_t p) {
+static inline void set_px_32bpp_rgba(uint8_t* data, int stride, int x, int y, uint32_t p) {
 	uint8_t r,g,b,a;
 	UNPACK_RGBA(p, r,g,b,a)
-	SET_DATA4(data,x,y,w, r,g,b,a)
+	SET_DATA4(data,x,y,stride, r,g,b,a)
 }
-static inline void set_px_32bpp_argb(uint8_t* data, int w, int x, int y, uint32_t p) {
+static inline void set_px_32bpp_argb(uint8_t* data, int stride, int x, int y, uint32_t p) {
 	uint8_t r,g,b,a;
 	UNPACK_RGBA(p, r,g,b,a)
-	SET_DATA4(data,x,y,w, a,r,g,b)
+	SET_DATA4(data,x,y,stride, a,r,g,b)
 }
-static inline void set_px_32bpp_abgr(uint8_t* data, int w, int x, int y, uint32_t p) {
+static inline void set_px_32bpp_abgr(uint8_t* data, int stride, int x, int y, uint32_t p) {
 	uint8_t r,g,b,a;
 	UNPACK_RGBA(p, r,g,b,a)
-	SET_DATA4(data,x,y,w, a,b,g,r)
+	SET_DATA4(data,x,y,stride, a,b,g,r)
 }
-static inline void set_px_32bpp_bgra(uint8_t* data, int w, int x, int y, uint32_t p) {
+static inline void set_px_32bpp_bgra(uint8_t* data, int stride, int x, int y, uint32_t p) {
 	uint8_t r,g,b,a;
 	UNPACK_RGBA(p, r,g,b,a)
-	SET_DATA4(data,x,y,w, b,g,r,a)
+	SET_DATA4(data,x,y,stride, b,g,r,a)
+}
+static inline void set_px_32bpp_rgba_premul(uint8_t* data, int stride, int x, int y, uint32_t p) {
+	set_px_32bpp_rgba(data, stride, x, y, premultiply_pixel(p));
 }
-static inline void set_px(uint8_t* data, int w, int x, int y, uint32_t p, PIX_FMT fmt) {
+static inline void set_px_32bpp_bgra_premul(uint8_t* data, int stride, int x, int y, uint32_t p) {
+	set_px_32bpp_bgra(data, stride, x, y, premultiply_pixel(p));
+}
+static inline void set_px(uint8_t* data, int stride, int x, int y, uint32_t p, PIX_FMT fmt) {
 	switch (fmt) {
 		case LDB_PXFMT_1BPP:
-			set_px_1bpp(data, w, x, y, p); break;
+			set_px_1bpp(data, stride, x, y, p); break;
 		case LDB_PXFMT_8BPP:
-			set_px_8bpp(data, w, x, y, p); break;
+			set_px_8bpp(data, stride, x, y, p); break;
 		case LDB_PXFMT_8BPP_RGB332:
-			set_px_8bpp_rgb332(data, w, x, y, p); break;
+			set_px_8bpp_rgb332(data, stride, x, y, p); break;
 		case LDB_PXFMT_16BPP_RGB565:
-			set_px_16bpp_rgb565(data, w, x, y, p); break;
+			set_px_16bpp_rgb565(data, stride, x, y, p); break;
 		case LDB_PXFMT_16BPP_BGR565:
-			set_px_16bpp_bgr565(data, w, x, y, p); break;
+			set_px_16bpp_bgr565(data, stride, x, y, p); break;
 		case LDB_PXFMT_24BPP_RGB:
-			set_px_24bpp_rgb(data, w, x, y, p); break;
+			set_px_24bpp_rgb(data, stride, x, y, p); break;
 		case LDB_PXFMT_24BPP_BGR:
-			set_px_24bpp_rgb(data, w, x, y, p); break;
+			set_px_24bpp_bgr(data, stride, x, y, p); break;
 		case LDB_PXFMT_32BPP_RGBA:
-			set_px_32bpp_rgba(data, w, x, y, p); break;
+			set_px_32bpp_rgba(data, stride, x, y, p); break;
 		case LDB_PXFMT_32BPP_ARGB:
-			set_px_32bpp_argb(data, w, x, y, p); break;
+			set_px_32bpp_argb(data, stride, x, y, p); break;
 		case LDB_PXFMT_32BPP_ABGR:
-			set_px_32bpp_abgr(data, w, x, y, p); break;
+			set_px_32bpp_abgr(data, stride, x, y, p); break;
 		case LDB_PXFMT_32BPP_BGRA:
-			set_px_32bpp_bgra(data, w, x, y, p); break;
+			set_px_32bpp_bgra(data, stride, x, y, p); break;
+		case LDB_PXFMT_32BPP_RGBA_PREMUL:
+			set_px_32bpp_rgba_premul(data, stride, x, y, p); break;
+		case LDB_PXFMT_32BPP_BGRA_PREMUL:
+			set_px_32bpp_bgra_premul(data, stride, x, y, p); break;
 		default:
 			break;
 	}
@@ -212,7 +369,7 @@ static inline void db_set_px(const drawbuffer_t* db, int x, int y, uint32_t p) {
 	if ((x<0) || (y<0) || (x>=db->w) || (y>=db->h) || (!db->data)) {
 		return;
 	}
-	set_px(db->data, db->w, x, y, p, db->pxfmt);
+	set_px(db->data, db->stride, x, y, p, db->pxfmt);
 }
 static inline void db_set_px_rgba(const drawbuffer_t* db, int x, int y, uint8_t r,uint8_t g,uint8_t b,uint8_t a) {
 	uint32_t p = pack_pixel_rgba(r,g,b,a);
@@ -220,85 +377,95 @@ static inline void db_set_px_rgba(const drawbuffer_t* db, int x, int y, uint8_t
 }
 
 // internal functions to get a pixel from memory
-static inline uint32_t get_px_1bpp(const uint8_t* data, int w, int x, int y) {
-	uint8_t v = data[(y*w+x)/8];
+static inline uint32_t get_px_1bpp(const uint8_t* data, int stride, int x, int y) {
+	uint8_t v = data[y*stride+x/8];
 	if (v&(1<<(x&7))) {
 		return pack_pixel_rgba(0xff, 0xff, 0xff, 0xff);
 	}
 	return pack_pixel_rgba(0,0,0,0);
 }
-static inline uint32_t get_px_8bpp(const uint8_t* data, int w, int x, int y) {
-	uint8_t v = data[y*w+x];
+static inline uint32_t get_px_8bpp(const uint8_t* data, int stride, int x, int y) {
+	uint8_t v = data[y*stride+x];
 	return pack_pixel_rgba(v,v,v,v);
 }
-static inline uint32_t get_px_8bpp_rgb332(const uint8_t* data, int w, int x, int y) {
-	uint8_t v = data[y*w+x];
+static inline uint32_t get_px_8bpp_rgb332(const uint8_t* data, int stride, int x, int y) {
+	uint8_t v = data[y*stride+x];
 	return pack_pixel_rgb(v&0xe0, (v&0x1c)<<3, (v&0x03)<<6);
 }
-static inline uint32_t get_px_16bpp_rgb565(const uint8_t* data, int w, int x, int y) {
+static inline uint32_t get_px_16bpp_rgb565(const uint8_t* data, int stride, int x, int y) {
 	uint8_t v1,v2;
-	GET_DATA2(data,x,y,w, v1,v2)
+	GET_DATA2(data,x,y,stride, v1,v2)
 	return pack_pixel_rgb(v1&0xF8, ((v1&0x07)<<5) | ((v2&0xE0)>>3), (v2&0x1f)<<3);
 }
-static inline uint32_t get_px_16bpp_bgr565(const uint8_t* data, int w, int x, int y) {
+static inline uint32_t get_px_16bpp_bgr565(const uint8_t* data, int stride, int x, int y) {
 	uint8_t v1,v2;
-	GET_DATA2(data,x,y,w, v1,v2)
+	GET_DATA2(data,x,y,stride, v1,v2)
 	return pack_pixel_rgb((v2&0x1f)<<3, ((v1&0x07)<<5) | ((v2&0xE0)>>3), v1&0xF8);
 }
-static inline uint32_t get_px_24bpp_rgb(const uint8_t* data, int w, int x, int y) {
+static inline uint32_t get_px_24bpp_rgb(const uint8_t* data, int stride, int x, int y) {
 	uint8_t r,g,b;
-	GET_DATA3(data,x,y,w, r,g,b)
+	GET_DATA3(data,x,y,stride, r,g,b)
 	return pack_pixel_rgb(r,g,b);
 }
-static inline uint32_t get_px_24bpp_bgr(const uint8_t* data, int w, int x, int y) {
+static inline uint32_t get_px_24bpp_bgr(const uint8_t* data, int stride, int x, int y) {
 	uint8_t r,g,b;
-	GET_DATA3(data,x,y,w, b,g,r)
+	GET_DATA3(data,x,y,stride, b,g,r)
 	return pack_pixel_rgb(r,g,b);
 }
-static inline uint32_t get_px_32bpp_rgba(const uint8_t* data, int w, int x, int y) {
+static inline uint32_t get_px_32bpp_rgba(const uint8_t* data, int stride, int x, int y) {
 	uint8_t r,g,b,a;
-	GET_DATA4(data,x,y,w, r,g,b,a)
+	GET_DATA4(data,x,y,stride, r,g,b,a)
 	return pack_pixel_rgba(r,g,b,a);
 }
-static inline uint32_t get_px_32bpp_argb(const uint8_t* data, int w, int x, int y) {
+static inline uint32_t get_px_32bpp_argb(const uint8_t* data, int stride, int x, int y) {
 	uint8_t r,g,b,a;
-	GET_DATA4(data,x,y,w, a,r,g,b)
+	GET_DATA4(data,x,y,stride, a,r,g,b)
 	return pack_pixel_rgba(r,g,b,a);
 }
-static inline uint32_t get_px_32bpp_abgr(const uint8_t* data, int w, int x, int y) {
+static inline uint32_t get_px_32bpp_abgr(const uint8_t* data, int stride, int x, int y) {
 	uint8_t r,g,b,a;
-	GET_DATA4(data,x,y,w, a,b,g,r)
+	GET_DATA4(data,x,y,stride, a,b,g,r)
 	return pack_pixel_rgba(r,g,b,a);
 }
-static inline uint32_t get_px_32bpp_bgra(const uint8_t* data, int w, int x, int y) {
+static inline uint32_t get_px_32bpp_bgra(const uint8_t* data, int stride, int x, int y) {
 	uint8_t r,g,b,a;
-	GET_DATA4(data,x,y,w, b,g,r,a)
+	GET_DATA4(data,x,y,stride, b,g,r,a)
 	return pack_pixel_rgba(r,g,b,a);
 }
-static inline uint32_t get_px(const uint8_t* data, int w, int x, int y, PIX_FMT fmt) {
+static inline uint32_t get_px_32bpp_rgba_premul(const uint8_t* data, int stride, int x, int y) {
+	return unpremultiply_pixel(get_px_32bpp_rgba(data, stride, x, y));
+}
+static inline uint32_t get_px_32bpp_bgra_premul(const uint8_t* data, int stride, int x, int y) {
+	return unpremultiply_pixel(get_px_32bpp_bgra(data, stride, x, y));
+}
+static inline uint32_t get_px(const uint8_t* data, int stride, int x, int y, PIX_FMT fmt) {
 	switch (fmt) {
 		case LDB_PXFMT_1BPP:
-			return get_px_1bpp(data, w, x, y);
+			return get_px_1bpp(data, stride, x, y);
 		case LDB_PXFMT_8BPP:
-			return get_px_8bpp(data, w, x, y);
+			return get_px_8bpp(data, stride, x, y);
 		case LDB_PXFMT_8BPP_RGB332:
-			return get_px_8bpp_rgb332(data, w, x, y);
+			return get_px_8bpp_rgb332(data, stride, x, y);
 		case LDB_PXFMT_16BPP_RGB565:
-			return get_px_16bpp_rgb565(data, w, x, y);
+			return get_px_16bpp_rgb565(data, stride, x, y);
 		case LDB_PXFMT_16BPP_BGR565:
-			return get_px_16bpp_bgr565(data, w, x, y);
+			return get_px_16bpp_bgr565(data, stride, x, y);
 		case LDB_PXFMT_24BPP_RGB:
-			return get_px_24bpp_rgb(data, w, x, y);
+			return get_px_24bpp_rgb(data, stride, x, y);
 		case LDB_PXFMT_24BPP_BGR:
-			return get_px_24bpp_rgb(data, w, x, y);
+			return get_px_24bpp_bgr(data, stride, x, y);
 		case LDB_PXFMT_32BPP_RGBA:
-			return get_px_32bpp_rgba(data, w, x, y);
+			return get_px_32bpp_rgba(data, stride, x, y);
 		case LDB_PXFMT_32BPP_ARGB:
-			return get_px_32bpp_argb(data, w, x, y);
+			return get_px_32bpp_argb(data, stride, x, y);
 		case LDB_PXFMT_32BPP_ABGR:
-			return get_px_32bpp_abgr(data, w, x, y);
+			return get_px_32bpp_abgr(data, stride, x, y);
 		case LDB_PXFMT_32BPP_BGRA:
-			return get_px_32bpp_bgra(data, w, x, y);
+			return get_px_32bpp_bgra(data, stride, x, y);
+		case LDB_PXFMT_32BPP_RGBA_PREMUL:
+			return get_px_32bpp_rgba_premul(data, stride, x, y);
+		case LDB_PXFMT_32BPP_BGRA_PREMUL:
+			return get_px_32bpp_bgra_premul(data, stride, x, y);
 		default:
 			return 0;
 	}
@@ -307,7 +474,387 @@ static inline uint32_t db_get_px(const drawbuffer_t* db, int x, int y) {
 	if ((x<0) || (y<0) || (x>=db->w) || (y>=db->h) || (!db->data)) {
 		return 0;
 	}
-	return get_px(db->data, db->w, x, y, db->pxfmt);
+	return get_px(db->data, db->stride, x, y, db->pxfmt);
+}
+
+
+
+// row conversion kernels. These convert a run of n pixels of a single row
+// from/to the internal uint32_t pixel format, so that hot loops only need to
+// select a kernel once per row instead of switching on the pixel format for
+// every pixel. x is the index of the first pixel in the row(needed for 1bpp).
+
+// maximum number of pixels converted at once using a temporary buffer on the stack
+#define LDB_ROW_CHUNK 256
+
+// unpack n pixels starting at x in row to the internal pixel format in out
+typedef void (*unpack_row_func_t)(const uint8_t* row, int x, uint32_t* out, int n);
+// pack n pixels in the internal pixel format from in into row, starting at x
+typedef void (*pack_row_func_t)(uint8_t* row, int x, const uint32_t* in, int n);
+
+// native 32-bit word access to a possibly unaligned little-endian pixel
+static inline uint32_t load_le32(const uint8_t* p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+static inline void store_le32(uint8_t* p, uint32_t v) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	memcpy(p, &v, 4);
+}
+// the 32bpp pixel format that has the same memory layout as a row in the internal pixel format
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define LDB_PXFMT_32BPP_INTERNAL LDB_PXFMT_32BPP_RGBA
+#else
+#define LDB_PXFMT_32BPP_INTERNAL LDB_PXFMT_32BPP_ABGR
+#endif
+static inline uint32_t rotl32(uint32_t v, int n) {
+	return (v<<n) | (v>>(32-n));
+}
+static inline uint32_t rotr32(uint32_t v, int n) {
+	return (v>>n) | (v<<(32-n));
+}
+
+static inline void unpack_row_1bpp(const uint8_t* row, int x, uint32_t* out, int n) {
+	for (int i=0; i<n; i++) {
+		out[i] = (row[(x+i)>>3] & (1<<((x+i)&7))) ? 0xffffffff : 0;
+	}
+}
+static inline void unpack_row_8bpp(const uint8_t* row, int x, uint32_t* out, int n) {
+	row += x;
+	for (int i=0; i<n; i++) {
+		out[i] = row[i]*0x01010101u;
+	}
+}
+static inline void unpack_row_8bpp_rgb332(const uint8_t* row, int x, uint32_t* out, int n) {
+	row += x;
+	for (int i=0; i<n; i++) {
+		uint32_t v = row[i];
+		out[i] = (v&0xe0)<<24 | (v&0x1c)<<19 | (v&0x03)<<14;
+	}
+}
+static inline void unpack_row_16bpp_rgb565(const uint8_t* row, int x, uint32_t* out, int n) {
+	row += x*2;
+	for (int i=0; i<n; i++) {
+		uint32_t v = (uint32_t)row[i*2]<<8 | row[i*2+1];
+		out[i] = (v&0xf800)<<16 | (v&0x07e0)<<13 | (v&0x001f)<<11;
+	}
+}
+static inline void unpack_row_16bpp_bgr565(const uint8_t* row, int x, uint32_t* out, int n) {
+	row += x*2;
+	for (int i=0; i<n; i++) {
+		uint32_t v = (uint32_t)row[i*2]<<8 | row[i*2+1];
+		out[i] = (v&0x001f)<<27 | (v&0x07e0)<<13 | (v&0xf800);
+	}
+}
+static inline void unpack_row_24bpp_rgb(const uint8_t* row, int x, uint32_t* out, int n) {
+	row += x*3;
+	for (int i=0; i<n; i++) {
+		out[i] = pack_pixel_rgb(row[i*3], row[i*3+1], row[i*3+2]);
+	}
+}
+static inline void unpack_row_24bpp_bgr(const uint8_t* row, int x, uint32_t* out, int n) {
+	row += x*3;
+	for (int i=0; i<n; i++) {
+		out[i] = pack_pixel_rgb(row[i*3+2], row[i*3+1], row[i*3]);
+	}
+}
+static inline void unpack_row_32bpp_rgba(const uint8_t* row, int x, uint32_t* out, int n) {
+	row += x*4;
+	for (int i=0; i<n; i++) {
+		out[i] = __builtin_bswap32(load_le32(row+i*4));
+	}
+}
+static inline void unpack_row_32bpp_argb(const uint8_t* row, int x, uint32_t* out, int n) {
+	row += x*4;
+	for (int i=0; i<n; i++) {
+		out[i] = rotl32(__builtin_bswap32(load_le32(row+i*4)), 8);
+	}
+}
+static inline void unpack_row_32bpp_abgr(const uint8_t* row, int x, uint32_t* out, int n) {
+	row += x*4;
+	for (int i=0; i<n; i++) {
+		out[i] = load_le32(row+i*4);
+	}
+}
+static inline void unpack_row_32bpp_bgra(const uint8_t* row, int x, uint32_t* out, int n) {
+	row += x*4;
+	for (int i=0; i<n; i++) {
+		out[i] = rotl32(load_le32(row+i*4), 8);
+	}
+}
+
+static inline void unpack_row_32bpp_rgba_premul(const uint8_t* row, int x, uint32_t* out, int n) {
+	unpack_row_32bpp_rgba(row, x, out, n);
+	for (int i=0; i<n; i++) {
+		out[i] = unpremultiply_pixel(out[i]);
+	}
+}
+static inline void unpack_row_32bpp_bgra_premul(const uint8_t* row, int x, uint32_t* out, int n) {
+	unpack_row_32bpp_bgra(row, x, out, n);
+	for (int i=0; i<n; i++) {
+		out[i] = unpremultiply_pixel(out[i]);
+	}
+}
+
+static inline void pack_row_1bpp(uint8_t* row, int x, const uint32_t* in, int n) {
+	for (int i=0; i<n; i++) {
+		uint8_t m = 1<<((x+i)&7);
+		if (in[i]) {
+			row[(x+i)>>3] |= m;
+		} else {
+			row[(x+i)>>3] &= ~m;
+		}
+	}
+}
+static inline void pack_row_8bpp(uint8_t* row, int x, const uint32_t* in, int n) {
+	row += x;
+	for (int i=0; i<n; i++) {
+		row[i] = in[i]&0xff;
+	}
+}
+static inline void pack_row_8bpp_rgb332(uint8_t* row, int x, const uint32_t* in, int n) {
+	row += x;
+	for (int i=0; i<n; i++) {
+		uint32_t p = in[i];
+		row[i] = (p>>24 & 0xe0) | (p>>19 & 0x1c) | (p>>14 & 0x03);
+	}
+}
+static inline void pack_row_16bpp_rgb565(uint8_t* row, int x, const uint32_t* in, int n) {
+	row += x*2;
+	for (int i=0; i<n; i++) {
+		uint32_t p = in[i];
+		uint32_t v = (p>>16 & 0xf800) | (p>>13 & 0x07e0) | (p>>11 & 0x001f);
+		row[i*2] = v>>8;
+		row[i*2+1] = v&0xff;
+	}
+}
+static inline void pack_row_16bpp_bgr565(uint8_t* row, int x, const uint32_t* in, int n) {
+	row += x*2;
+	for (int i=0; i<n; i++) {
+		uint32_t p = in[i];
+		uint32_t v = (p & 0xf800) | (p>>13 & 0x07e0) | (p>>27 & 0x001f);
+		row[i*2] = v>>8;
+		row[i*2+1] = v&0xff;
+	}
+}
+static inline void pack_row_24bpp_rgb(uint8_t* row, int x, const uint32_t* in, int n) {
+	row += x*3;
+	for (int i=0; i<n; i++) {
+		row[i*3] = unpack_pixel_r(in[i]);
+		row[i*3+1] = unpack_pixel_g(in[i]);
+		row[i*3+2] = unpack_pixel_b(in[i]);
+	}
+}
+static inline void pack_row_24bpp_bgr(uint8_t* row, int x, const uint32_t* in, int n) {
+	row += x*3;
+	for (int i=0; i<n; i++) {
+		row[i*3] = unpack_pixel_b(in[i]);
+		row[i*3+1] = unpack_pixel_g(in[i]);
+		row[i*3+2] = unpack_pixel_r(in[i]);
+	}
+}
+static inline void pack_row_32bpp_rgba(uint8_t* row, int x, const uint32_t* in, int n) {
+	row += x*4;
+	for (int i=0; i<n; i++) {
+		store_le32(row+i*4, __builtin_bswap32(in[i]));
+	}
+}
+static inline void pack_row_32bpp_argb(uint8_t* row, int x, const uint32_t* in, int n) {
+	row += x*4;
+	for (int i=0; i<n; i++) {
+		store_le32(row+i*4, __builtin_bswap32(rotr32(in[i], 8)));
+	}
+}
+static inline void pack_row_32bpp_abgr(uint8_t* row, int x, const uint32_t* in, int n) {
+	row += x*4;
+	for (int i=0; i<n; i++) {
+		store_le32(row+i*4, in[i]);
+	}
+}
+static inline void pack_row_32bpp_bgra(uint8_t* row, int x, const uint32_t* in, int n) {
+	row += x*4;
+	for (int i=0; i<n; i++) {
+		store_le32(row+i*4, rotr32(in[i], 8));
+	}
+}
+
+static inline void pack_row_32bpp_rgba_premul(uint8_t* row, int x, const uint32_t* in, int n) {
+	row += x*4;
+	for (int i=0; i<n; i++) {
+		store_le32(row+i*4, __builtin_bswap32(premultiply_pixel(in[i])));
+	}
+}
+static inline void pack_row_32bpp_bgra_premul(uint8_t* row, int x, const uint32_t* in, int n) {
+	row += x*4;
+	for (int i=0; i<n; i++) {
+		store_le32(row+i*4, rotr32(premultiply_pixel(in[i]), 8));
+	}
+}
+
+// get the row kernels for a pixel format(NULL for unknown formats)
+static inline unpack_row_func_t get_unpack_row_func(PIX_FMT fmt) {
+	switch (fmt) {
+		case LDB_PXFMT_1BPP: return unpack_row_1bpp;
+		case LDB_PXFMT_8BPP: return unpack_row_8bpp;
+		case LDB_PXFMT_8BPP_RGB332: return unpack_row_8bpp_rgb332;
+		case LDB_PXFMT_16BPP_RGB565: return unpack_row_16bpp_rgb565;
+		case LDB_PXFMT_16BPP_BGR565: return unpack_row_16bpp_bgr565;
+		case LDB_PXFMT_24BPP_RGB: return unpack_row_24bpp_rgb;
+		case LDB_PXFMT_24BPP_BGR: return unpack_row_24bpp_bgr;
+		case LDB_PXFMT_32BPP_RGBA: return unpack_row_32bpp_rgba;
+		case LDB_PXFMT_32BPP_ARGB: return unpack_row_32bpp_argb;
+		case LDB_PXFMT_32BPP_ABGR: return unpack_row_32bpp_abgr;
+		case LDB_PXFMT_32BPP_BGRA: return unpack_row_32bpp_bgra;
+		case LDB_PXFMT_32BPP_RGBA_PREMUL: return unpack_row_32bpp_rgba_premul;
+		case LDB_PXFMT_32BPP_BGRA_PREMUL: return unpack_row_32bpp_bgra_premul;
+		default: return NULL;
+	}
+}
+static inline pack_row_func_t get_pack_row_func(PIX_FMT fmt) {
+	switch (fmt) {
+		case LDB_PXFMT_1BPP: return pack_row_1bpp;
+		case LDB_PXFMT_8BPP: return pack_row_8bpp;
+		case LDB_PXFMT_8BPP_RGB332: return pack_row_8bpp_rgb332;
+		case LDB_PXFMT_16BPP_RGB565: return pack_row_16bpp_rgb565;
+		case LDB_PXFMT_16BPP_BGR565: return pack_row_16bpp_bgr565;
+		case LDB_PXFMT_24BPP_RGB: return pack_row_24bpp_rgb;
+		case LDB_PXFMT_24BPP_BGR: return pack_row_24bpp_bgr;
+		case LDB_PXFMT_32BPP_RGBA: return pack_row_32bpp_rgba;
+		case LDB_PXFMT_32BPP_ARGB: return pack_row_32bpp_argb;
+		case LDB_PXFMT_32BPP_ABGR: return pack_row_32bpp_abgr;
+		case LDB_PXFMT_32BPP_BGRA: return pack_row_32bpp_bgra;
+		case LDB_PXFMT_32BPP_RGBA_PREMUL: return pack_row_32bpp_rgba_premul;
+		case LDB_PXFMT_32BPP_BGRA_PREMUL: return pack_row_32bpp_bgra_premul;
+		default: return NULL;
+	}
+}
+
+// check if the r,g,b values of a pixel format are premultiplied with the alpha value
+static inline int is_premultiplied(PIX_FMT fmt) {
+	return (fmt == LDB_PXFMT_32BPP_RGBA_PREMUL) || (fmt == LDB_PXFMT_32BPP_BGRA_PREMUL);
+}
+
+// check if unpacked pixels of a format have a meaningful alpha value. The rgb formats unpack with alpha 0,
+// the grayscale formats use the gray value as alpha.
+static inline int has_alpha(PIX_FMT fmt) {
+	switch (fmt) {
+		case LDB_PXFMT_8BPP_RGB332:
+		case LDB_PXFMT_16BPP_RGB565:
+		case LDB_PXFMT_16BPP_BGR565:
+		case LDB_PXFMT_24BPP_RGB:
+		case LDB_PXFMT_24BPP_BGR:
+			return 0;
+		default:
+			return 1;
+	}
+}
+
+// set the alpha value of the n pixels in row to 255
+static inline void set_row_opaque(uint32_t* row, int n) {
+	for (int i=0; i<n; i++) {
+		row[i] |= 0xff;
+	}
+}
+
+// check if all pixels have an alpha value of 255(premultiplying would not change them)
+static inline int row_is_opaque(const uint32_t* row, int n) {
+	// independent accumulators, so the loop is not limited by the latency of a single one
+	uint32_t a0 = 0xff, a1 = 0xff, a2 = 0xff, a3 = 0xff;
+	int i = 0;
+	for (; i+4<=n; i+=4) {
+		a0 &= row[i];
+		a1 &= row[i+1];
+		a2 &= row[i+2];
+		a3 &= row[i+3];
+	}
+	for (; i<n; i++) {
+		a0 &= row[i];
+	}
+	return (a0 & a1 & a2 & a3 & 0xff) == 0xff;
+}
+
+// same as unpremultiply_pixel for each pixel, but multiplies by a reciprocal instead of dividing.
+// (c*255 + a/2)*ceil(2^24/a) >> 24 is exact, because c*255 + a/2 < 2^16.
+static inline void unpremultiply_row(uint32_t* row, int n, const uint32_t recip[256]) {
+	for (int i=0; i<n; i++) {
+		uint32_t p = row[i], a = p & 0xff;
+		if ((a == 0xff) || (a == 0)) {
+			row[i] = a ? p : 0;
+			continue;
+		}
+		uint64_t m = recip[a];
+		uint32_t r = (uint32_t)((((p>>24)*255 + a/2)*m) >> 24);
+		uint32_t g = (uint32_t)(((((p>>16) & 0xff)*255 + a/2)*m) >> 24);
+		uint32_t b = (uint32_t)(((((p>>8) & 0xff)*255 + a/2)*m) >> 24);
+		r = (r>255) ? 255 : r;
+		g = (g>255) ? 255 : g;
+		b = (b>255) ? 255 : b;
+		row[i] = (r<<24) | (g<<16) | (b<<8) | a;
+	}
+}
+
+// get the pixel format with the same memory layout, but without premultiplied alpha.
+// Used to access the premultiplied values directly.
+static inline PIX_FMT get_straight_pxfmt(PIX_FMT fmt) {
+	switch (fmt) {
+		case LDB_PXFMT_32BPP_RGBA_PREMUL: return LDB_PXFMT_32BPP_RGBA;
+		case LDB_PXFMT_32BPP_BGRA_PREMUL: return LDB_PXFMT_32BPP_BGRA;
+		default: return fmt;
+	}
+}
+
+// get a pointer to the first byte of row y
+static inline uint8_t* get_row_ptr(uint8_t* data, int stride, int y) {
+	return data + (size_t)y*stride;
+}
+static inline uint8_t* db_get_row_ptr(const drawbuffer_t* db, int y) {
+	return get_row_ptr(db->data, db->stride, y);
+}
+
+// unpack n pixels of row y, starting at x. Coordinates must be valid.
+static inline void db_unpack_row(const drawbuffer_t* db, int x, int y, uint32_t* out, int n) {
+	get_unpack_row_func(db->pxfmt)(db_get_row_ptr(db, y), x, out, n);
+}
+// pack n pixels into row y, starting at x. Coordinates must be valid.
+static inline void db_pack_row(const drawbuffer_t* db, int x, int y, const uint32_t* in, int n) {
+	get_pack_row_func(db->pxfmt)(db_get_row_ptr(db, y), x, in, n);
+}
+
+// convert n pixels from one row to another, possibly with different pixel formats
+static inline void convert_row(const uint8_t* src_row, int sx, PIX_FMT src_fmt, uint8_t* dst_row, int dx, PIX_FMT dst_fmt, int n) {
+	if ((src_fmt == dst_fmt) && (get_bpp(src_fmt)>=8)) {
+		size_t bytes_per_px = get_bpp(src_fmt)/8;
+		memmove(dst_row+dx*bytes_per_px, src_row+sx*bytes_per_px, n*bytes_per_px);
+		return;
+	}
+	unpack_row_func_t unpack_row = get_unpack_row_func(src_fmt);
+	pack_row_func_t pack_row = get_pack_row_func(dst_fmt);
+	uint32_t tmp[LDB_ROW_CHUNK];
+	for (int i=0; i<n; i+=LDB_ROW_CHUNK) {
+		int len = ((n-i) < LDB_ROW_CHUNK) ? (n-i) : LDB_ROW_CHUNK;
+		unpack_row(src_row, sx+i, tmp, len);
+		pack_row(dst_row, dx+i, tmp, len);
+	}
+}
+
+// set n pixels of a row to the pixel value p, starting at x
+static inline void fill_row(uint8_t* row, int x, PIX_FMT fmt, uint32_t p, int n) {
+	pack_row_func_t pack_row = get_pack_row_func(fmt);
+	uint32_t tmp[LDB_ROW_CHUNK];
+	int len = (n < LDB_ROW_CHUNK) ? n : LDB_ROW_CHUNK;
+	for (int i=0; i<len; i++) {
+		tmp[i] = p;
+	}
+	for (int i=0; i<n; i+=LDB_ROW_CHUNK) {
+		len = ((n-i) < LDB_ROW_CHUNK) ? (n-i) : LDB_ROW_CHUNK;
+		pack_row(row, x+i, tmp, len);
+	}
 }
 
 
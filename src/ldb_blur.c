@@ -0,0 +1,329 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "lua.h"
+
+#include "ldb.h"
+#include "ldb_convert.h"
+#include "ldb_threads.h"
+#include "ldb_blur.h"
+
+// Separable blurring.
+// The rows of the region are filtered horizontally into a temporary buffer,
+// then the columns of that buffer are filtered vertically into the target.
+// The rows are split into bands and the columns into strips, so both passes
+// can run in parallel. The whole region is read before anything is written,
+// so the target can be the source.
+// The box blur uses running sums for each channel, so the cost per pixel does
+// not depend on the radius. The fast gaussian blur runs three box blurs, with
+// sizes chosen to approximate the standard deviation(see box_radii), and the
+// gaussian blur uses the resampling filter kernels with a sampled gaussian.
+// Pixels are converted to the internal pixel format(in memory order) using the
+// SIMD conversion kernels, and premultiplied if needed.
+
+// number of rows in a band of the horizontal pass
+#define BLUR_BAND_H 32
+
+// number of columns in a strip of the vertical pass. Strips start at multiples
+// of this in the target, so two strips never write to the same byte.
+#define BLUR_STRIP_W 256
+
+// number of box blurs for the fast gaussian blur
+#define BLUR_BOXES 3
+
+static const char* blur_names[LDB_BLUR_MAX] = { "box", "fast_gaussian", "gaussian" };
+
+typedef struct {
+	const drawbuffer_t* src_db;
+	const drawbuffer_t* dst_db;
+	int x, y, w, h; // region
+	int boxes; // number of box blurs, 0 for the gaussian blur
+	int radii[BLUR_BOXES]; // radius of each box blur
+	int16_t* weights; // gaussian filter weights(see LDB_FILTER_BITS)
+	int taps; // number of weights, always even(the last weight is 0)
+	int pad; // number of pixels needed left and right of a row
+	uint32_t* tmp; // w*h pixels, result of the horizontal pass
+	uint32_t* tmp2; // w*h pixels, for the vertical box blurs
+	int strip_x; // x offset of the first strip relative to the region(<= 0)
+	uint32_t recip[256]; // ceil(2^24/a) for unpremultiply_row
+	int translucent; // set if a row of the horizontal pass was not opaque
+	int failed;
+} blur_job_t;
+
+
+
+// approximate a gaussian with standard deviation sigma by n box blurs. The box sizes
+// are the odd values around sqrt(12*sigma^2/n + 1), so that the variances sum up to sigma^2.
+static void box_radii(double sigma, int n, int* radii) {
+	double w_ideal = sqrt(12*sigma*sigma/n + 1);
+	int wl = (int)floor(w_ideal);
+	wl = (wl % 2) ? wl : wl-1;
+	int m = (int)floor((12*sigma*sigma - n*wl*wl - 4*n*wl - 3*n) / (-4*wl - 4) + 0.5);
+	for (int i=0; i<n; i++) {
+		radii[i] = (i < m) ? (wl-1)/2 : (wl+1)/2;
+	}
+}
+
+// sample a gaussian with standard deviation sigma to 2*ceil(3*sigma)+1 weights that sum up to exactly 1.
+// Returns the number of taps(rounded up to even), or 0 on allocation failure.
+static int gaussian_weights(double sigma, int16_t** weights) {
+	int r = (int)ceil(3*sigma);
+	int taps = 2*r+2;
+	*weights = calloc(taps, sizeof(int16_t));
+	if (!*weights) {
+		return 0;
+	}
+	if (r == 0) {
+		(*weights)[0] = 1<<LDB_FILTER_BITS;
+		return taps;
+	}
+	double sum = 0;
+	for (int k=-r; k<=r; k++) {
+		sum += exp(-(k*k) / (2*sigma*sigma));
+	}
+	int total = 0;
+	for (int k=-r; k<=r; k++) {
+		int q = (int)floor(exp(-(k*k) / (2*sigma*sigma)) / sum * (1<<LDB_FILTER_BITS) + 0.5);
+		(*weights)[k+r] = (int16_t)q;
+		total += q;
+	}
+	(*weights)[r] += (1<<LDB_FILTER_BITS) - total;
+	return taps;
+}
+
+// repeat the first and last of the w pixels in row pad times to the left and pad+1 times to the right
+static inline void pad_row(uint32_t* row, int w, int pad) {
+	for (int i=1; i<=pad; i++) {
+		row[-i] = row[0];
+	}
+	for (int i=0; i<=pad; i++) {
+		row[w+i] = row[w-1];
+	}
+}
+
+static inline int clamp_row(int y, int h) {
+	return (y < 0) ? 0 : ((y > h-1) ? h-1 : y);
+}
+
+// horizontal pass for the rows of a band
+static void blur_band_h(void* arg, int index) {
+	blur_job_t* job = (blur_job_t*)arg;
+	int w = job->w;
+	int y0 = index*BLUR_BAND_H;
+	int y1 = (y0+BLUR_BAND_H < job->h) ? y0+BLUR_BAND_H : job->h;
+
+	size_t row_len = w + 2*job->pad + 1;
+	uint32_t* bufs = malloc(2*row_len*sizeof(uint32_t));
+	const uint32_t** rows = malloc(job->taps*sizeof(uint32_t*));
+	if ((!bufs) || ((job->taps > 0) && (!rows))) {
+		free(bufs);
+		free(rows);
+		__atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	// premultiplied formats are blurred as they are, others are premultiplied first.
+	// Formats without alpha are opaque.
+	const drawbuffer_t* src_db = job->src_db;
+	int src_premul = is_premultiplied(src_db->pxfmt);
+	int src_alpha = has_alpha(src_db->pxfmt);
+	PIX_FMT src_fmt = get_straight_pxfmt(src_db->pxfmt);
+
+	for (int y=y0; y<y1; y++) {
+		uint32_t* in = bufs + job->pad;
+		uint32_t* other = bufs + row_len + job->pad;
+		uint32_t* out = job->tmp + (size_t)y*w;
+		ldb_convert_row(db_get_row_ptr(src_db, job->y+y), job->x, src_fmt, (uint8_t*)in, 0, LDB_PXFMT_32BPP_INTERNAL, w);
+		if (!src_alpha) {
+			set_row_opaque(in, w);
+		} else if (!row_is_opaque(in, w)) {
+			__atomic_store_n(&job->translucent, 1, __ATOMIC_RELAXED);
+			if (!src_premul) {
+				for (int i=0; i<w; i++) {
+					in[i] = premultiply_pixel(in[i]);
+				}
+			}
+		}
+		pad_row(in, w, job->pad);
+
+		if (job->boxes == 0) {
+			// the vertical filter kernel on pointers to consecutive pixels filters horizontally
+			int r = job->taps/2-1;
+			for (int k=0; k<job->taps; k++) {
+				rows[k] = in-r+k;
+			}
+			ldb_filter_row_v(out, rows, job->weights, job->taps, w);
+			continue;
+		}
+		for (int b=0; b<job->boxes; b++) {
+			int last = (b == job->boxes-1);
+			ldb_box_row_h(last ? out : other, in-job->radii[b], job->radii[b], w);
+			if (!last) {
+				pad_row(other, w, job->pad);
+				uint32_t* t = in;
+				in = other;
+				other = t;
+			}
+		}
+	}
+
+	free(rows);
+	free(bufs);
+}
+
+// convert an output row of a strip to the target format and store it
+static void blur_store_row(blur_job_t* job, uint32_t* row, int y, int x0, int n) {
+	const drawbuffer_t* dst_db = job->dst_db;
+	// the blurred pixels of opaque rows are opaque
+	if (job->translucent && (!is_premultiplied(dst_db->pxfmt)) && (!row_is_opaque(row, n))) {
+		unpremultiply_row(row, n, job->recip);
+	}
+	ldb_convert_row((const uint8_t*)row, 0, LDB_PXFMT_32BPP_INTERNAL, db_get_row_ptr(dst_db, job->y+y), job->x+x0, get_straight_pxfmt(dst_db->pxfmt), n);
+}
+
+// vertical pass for the columns of a strip
+static void blur_strip_v(void* arg, int index) {
+	blur_job_t* job = (blur_job_t*)arg;
+	int w = job->w, h = job->h;
+	int x0 = job->strip_x + index*BLUR_STRIP_W;
+	int x1 = (x0+BLUR_STRIP_W < w) ? x0+BLUR_STRIP_W : w;
+	x0 = (x0 < 0) ? 0 : x0;
+	int n = x1-x0;
+
+	uint32_t* out_row = malloc(n*sizeof(uint32_t));
+	uint32_t* sums = malloc((size_t)n*4*sizeof(uint32_t));
+	const uint32_t** rows = malloc(job->taps*sizeof(uint32_t*));
+	if ((!out_row) || (!sums) || ((job->taps > 0) && (!rows))) {
+		free(out_row);
+		free(sums);
+		free(rows);
+		__atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	if (job->boxes == 0) {
+		int r = job->taps/2-1;
+		for (int y=0; y<h; y++) {
+			for (int k=0; k<job->taps; k++) {
+				rows[k] = job->tmp + (size_t)clamp_row(y-r+k, h)*w + x0;
+			}
+			ldb_filter_row_v(out_row, rows, job->weights, job->taps, n);
+			blur_store_row(job, out_row, y, x0, n);
+		}
+	}
+
+	// the box blurs alternate between the two temporary buffers
+	uint32_t* in = job->tmp;
+	uint32_t* other = job->tmp2;
+	for (int b=0; b<job->boxes; b++) {
+		int r = job->radii[b];
+		int last = (b == job->boxes-1);
+		memset(sums, 0, (size_t)n*4*sizeof(uint32_t));
+		for (int k=-r; k<=r; k++) {
+			const uint32_t* p = in + (size_t)clamp_row(k, h)*w + x0;
+			for (int i=0; i<n; i++) {
+				for (int c=0; c<4; c++) {
+					sums[i*4+c] += (p[i] >> (c*8)) & 0xff;
+				}
+			}
+		}
+		for (int y=0; y<h; y++) {
+			uint32_t* out = last ? out_row : other + (size_t)y*w + x0;
+			const uint32_t* add = in + (size_t)clamp_row(y+r+1, h)*w + x0;
+			const uint32_t* sub = in + (size_t)clamp_row(y-r, h)*w + x0;
+			ldb_box_row_v(out, sums, add, sub, r, n);
+			if (last) {
+				blur_store_row(job, out_row, y, x0, n);
+			}
+		}
+		uint32_t* t = in;
+		in = other;
+		other = t;
+	}
+
+	free(rows);
+	free(sums);
+	free(out_row);
+}
+
+
+
+LDB_BLUR ldb_blur_from_str(const char* str) {
+	for (int i=0; i<LDB_BLUR_MAX; i++) {
+		if (strcmp(str, blur_names[i])==0) {
+			return (LDB_BLUR)i;
+		}
+	}
+	return LDB_BLUR_MAX;
+}
+
+int ldb_blur(const drawbuffer_t* src_db, const drawbuffer_t* dst_db, int x, int y, int w, int h, double radius, LDB_BLUR kind, int num_threads) {
+	if ((!src_db->data) || (!dst_db->data) || (w <= 0) || (h <= 0) || (kind >= LDB_BLUR_MAX)) {
+		return 1;
+	}
+	radius = (radius < 0) ? 0 : ((radius > LDB_BLUR_MAX_RADIUS) ? LDB_BLUR_MAX_RADIUS : radius);
+
+	// clip the region to both drawbuffers
+	blur_job_t job = { .src_db = src_db, .dst_db = dst_db };
+	job.x = (x < 0) ? 0 : x;
+	job.y = (y < 0) ? 0 : y;
+	int x1 = (int64_t)x+w, y1 = (int64_t)y+h;
+	x1 = (x1 > src_db->w) ? src_db->w : x1;
+	x1 = (x1 > dst_db->w) ? dst_db->w : x1;
+	y1 = (y1 > src_db->h) ? src_db->h : y1;
+	y1 = (y1 > dst_db->h) ? dst_db->h : y1;
+	job.w = x1-job.x;
+	job.h = y1-job.y;
+	if ((job.w <= 0) || (job.h <= 0)) {
+		return 1;
+	}
+
+	if (kind == LDB_BLUR_GAUSSIAN) {
+		job.taps = gaussian_weights(radius, &job.weights);
+		if (!job.taps) {
+			return 0;
+		}
+		job.pad = job.taps/2-1;
+	} else {
+		if (kind == LDB_BLUR_BOX) {
+			job.boxes = 1;
+			job.radii[0] = (int)radius;
+		} else {
+			job.boxes = BLUR_BOXES;
+			box_radii(radius, BLUR_BOXES, job.radii);
+		}
+		for (int b=0; b<job.boxes; b++) {
+			job.pad = (job.radii[b] > job.pad) ? job.radii[b] : job.pad;
+		}
+	}
+
+	job.tmp = malloc((size_t)job.w*job.h*sizeof(uint32_t));
+	if (job.boxes > 1) {
+		job.tmp2 = malloc((size_t)job.w*job.h*sizeof(uint32_t));
+	}
+	if ((!job.tmp) || ((job.boxes > 1) && (!job.tmp2))) {
+		free(job.tmp);
+		free(job.tmp2);
+		free(job.weights);
+		return 0;
+	}
+
+	for (int a=1; a<256; a++) {
+		job.recip[a] = ((1<<24) + a-1) / a;
+	}
+
+	int bands = (job.h + BLUR_BAND_H-1) / BLUR_BAND_H;
+	ldb_threads_run(num_threads, bands, blur_band_h, &job);
+	if (!job.failed) {
+		job.strip_x = (job.x / BLUR_STRIP_W)*BLUR_STRIP_W - job.x;
+		int strips = (job.w - job.strip_x + BLUR_STRIP_W-1) / BLUR_STRIP_W;
+		ldb_threads_run(num_threads, strips, blur_strip_v, &job);
+	}
+
+	free(job.tmp);
+	free(job.tmp2);
+	free(job.weights);
+	return !job.failed;
+}
@@ -0,0 +1,30 @@
+#ifndef LUA_LDB_BLUR_H
+#define LUA_LDB_BLUR_H
+
+#include "ldb.h"
+
+// maximum blur radius
+#define LDB_BLUR_MAX_RADIUS 1024
+
+// blur kinds
+typedef enum {
+	LDB_BLUR_BOX,
+	LDB_BLUR_FAST_GAUSSIAN,
+	LDB_BLUR_GAUSSIAN,
+
+	LDB_BLUR_MAX,
+} LDB_BLUR;
+
+// get a blur kind by name("box", "fast_gaussian", "gaussian"). Returns LDB_BLUR_MAX if unknown.
+LDB_BLUR ldb_blur_from_str(const char* str);
+
+// blur the region x,y,w,h of src_db into the same region of dst_db(can be src_db), using up to num_threads threads.
+// For a box blur, each pixel is the average of the (2*radius+1)^2 pixels around it(radius is rounded down).
+// For the gaussian blurs, radius is the standard deviation. The fast gaussian blur is approximated by three box blurs.
+// Blurring is done on premultiplied values, so transparent pixels don't bleed their color.
+// Pixels outside the region are clamped to the edge of the region, the region is clipped to both drawbuffers.
+// Returns 0 if memory could not be allocated.
+int ldb_blur(const drawbuffer_t* src_db, const drawbuffer_t* dst_db, int x, int y, int w, int h, double radius, LDB_BLUR kind, int num_threads);
+
+
+#endif
@@ -0,0 +1,1183 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "ldb.h"
+#include "ldb_convert.h"
+
+// Pixel format conversion engine.
+// For every pair of pixel formats a row conversion kernel is selected once,
+// based on the CPU features detected at runtime. The SIMD kernels are compiled
+// using function target attributes, so the library itself can still be built
+// for a generic x86 CPU.
+// Pairs without a specialized kernel use the scalar row kernels from ldb.h.
+// The alpha-blending row kernels(ldb_blend_row*) and the resampling filter
+// kernels(ldb_filter_row_*), the ordered dithering kernel(ldb_dither_row), the box blur kernels(ldb_box_row_*)
+// and the convolution and morphology kernels(ldb_conv_row*, ldb_morph_row) are selected the same way.
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define LDB_CONVERT_X86
+#include <immintrin.h>
+#endif
+
+
+static int convert_initialized = 0;
+static SIMD_LEVEL convert_level = LDB_SIMD_SCALAR;
+static SIMD_LEVEL convert_max_level = LDB_SIMD_SCALAR;
+static convert_row_func_t convert_funcs[LDB_PXFMT_MAX][LDB_PXFMT_MAX];
+
+typedef void (*blend_row_func_t)(uint32_t* dst, const uint32_t* src, int n);
+typedef void (*blend_row_color_func_t)(uint32_t* dst, uint32_t p, int n);
+static blend_row_func_t blend_row_func;
+static blend_row_color_func_t blend_row_color_func;
+typedef void (*blend_row_premul_func_t)(uint32_t* dst, const uint32_t* src, int n, int keep_alpha);
+static blend_row_premul_func_t blend_row_premul_func;
+typedef void (*filter_row_h_func_t)(uint32_t* dst, const uint32_t* src, const int* offsets, const int16_t* weights, int taps, int n);
+typedef void (*filter_row_v_func_t)(uint32_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int x, int n);
+static filter_row_h_func_t filter_row_h_func;
+static filter_row_v_func_t filter_row_v_func;
+
+// per-channel factors for ordered dithering(lowest byte first, the alpha channel is kept)
+typedef struct {
+	uint16_t levels[4]; // 2^bits-1
+	uint16_t scale[4]; // 2^(8-bits)
+} dither_levels_t;
+typedef void (*dither_row_func_t)(uint32_t* dst, const uint32_t* src, const uint8_t* thresholds, const dither_levels_t* l, int x, int n);
+static dither_row_func_t dither_row_func;
+typedef void (*box_row_h_func_t)(uint32_t* dst, const uint32_t* src, int radius, float inv, int n);
+typedef void (*box_row_v_func_t)(uint32_t* dst, uint32_t* sums, const uint32_t* add, const uint32_t* sub, float inv, int x, int n);
+static box_row_h_func_t box_row_h_func;
+static box_row_v_func_t box_row_v_func;
+typedef void (*conv_row_func_t)(uint32_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int x, int n);
+typedef void (*conv_row_to_s16_func_t)(int16_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int x, int n);
+typedef void (*conv_row_from_s16_func_t)(uint32_t* dst, const int16_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int x, int n);
+typedef void (*morph_row_func_t)(uint8_t* dst, const uint8_t* const* rows, int count, int dilate, int x, int n);
+static conv_row_func_t conv_row_func;
+static conv_row_to_s16_func_t conv_row_to_s16_func;
+static conv_row_from_s16_func_t conv_row_from_s16_func;
+static morph_row_func_t morph_row_func;
+
+
+
+// scalar fallback. Same pixel format is a memmove, everything else goes through the internal pixel format.
+static void convert_row_scalar(const uint8_t* src_row, int sx, PIX_FMT src_fmt, uint8_t* dst_row, int dx, PIX_FMT dst_fmt, int n) {
+	convert_row(src_row, sx, src_fmt, dst_row, dx, dst_fmt, n);
+}
+
+static void blend_row_scalar(uint32_t* dst, const uint32_t* src, int n) {
+	for (int i=0; i<n; i++) {
+		dst[i] = blend_pixel(dst[i], src[i]);
+	}
+}
+
+static void blend_row_color_scalar(uint32_t* dst, uint32_t p, int n) {
+	for (int i=0; i<n; i++) {
+		dst[i] = blend_pixel(dst[i], p);
+	}
+}
+
+// round and clamp the filter sums of the 4 channels(lowest byte first) to a pixel
+static inline uint32_t filter_pack(int32_t c0, int32_t c1, int32_t c2, int32_t c3) {
+	int32_t c[4] = { c0>>LDB_FILTER_BITS, c1>>LDB_FILTER_BITS, c2>>LDB_FILTER_BITS, c3>>LDB_FILTER_BITS };
+	uint32_t p = 0;
+	for (int i=0; i<4; i++) {
+		p |= (uint32_t)((c[i] < 0) ? 0 : ((c[i] > 255) ? 255 : c[i])) << (i*8);
+	}
+	return p;
+}
+
+static void filter_row_h_scalar(uint32_t* dst, const uint32_t* src, const int* offsets, const int16_t* weights, int taps, int n) {
+	for (int i=0; i<n; i++) {
+		const uint32_t* s = src + offsets[i];
+		const int16_t* w = weights + i*taps;
+		int32_t c0 = 1<<(LDB_FILTER_BITS-1), c1 = c0, c2 = c0, c3 = c0;
+		for (int k=0; k<taps; k++) {
+			c0 += w[k]*(int32_t)(s[k] & 0xff);
+			c1 += w[k]*(int32_t)((s[k]>>8) & 0xff);
+			c2 += w[k]*(int32_t)((s[k]>>16) & 0xff);
+			c3 += w[k]*(int32_t)(s[k]>>24);
+		}
+		dst[i] = filter_pack(c0, c1, c2, c3);
+	}
+}
+
+static void filter_row_v_scalar(uint32_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int x, int n) {
+	for (; x<n; x++) {
+		int32_t c0 = 1<<(LDB_FILTER_BITS-1), c1 = c0, c2 = c0, c3 = c0;
+		for (int k=0; k<taps; k++) {
+			uint32_t p = rows[k][x];
+			c0 += weights[k]*(int32_t)(p & 0xff);
+			c1 += weights[k]*(int32_t)((p>>8) & 0xff);
+			c2 += weights[k]*(int32_t)((p>>16) & 0xff);
+			c3 += weights[k]*(int32_t)(p>>24);
+		}
+		dst[x] = filter_pack(c0, c1, c2, c3);
+	}
+}
+
+static void dither_row_scalar(uint32_t* dst, const uint32_t* src, const uint8_t* thresholds, const dither_levels_t* l, int x, int n) {
+	for (; x<n; x++) {
+		uint32_t p = src[x];
+		uint32_t q = p & 0xff;
+		for (int c=1; c<4; c++) {
+			uint32_t v = (p >> (c*8)) & 0xff;
+			q |= ((v*l->levels[c] + thresholds[x]) / 255 * l->scale[c]) << (c*8);
+		}
+		dst[x] = q;
+	}
+}
+
+// round the box sums of the 4 channels(lowest byte first) multiplied by inv to a pixel.
+// The SIMD kernels compute the same float operations.
+static inline uint32_t box_pack(const uint32_t* sums, float inv) {
+	uint32_t p = 0;
+	for (int c=0; c<4; c++) {
+		p |= (uint32_t)((float)sums[c]*inv + 0.5f) << (c*8);
+	}
+	return p;
+}
+
+// add the channels of add and subtract the channels of sub from the 4 box sums
+static inline void box_update(uint32_t* sums, uint32_t add, uint32_t sub) {
+	for (int c=0; c<4; c++) {
+		sums[c] += ((add >> (c*8)) & 0xff) - ((sub >> (c*8)) & 0xff);
+	}
+}
+
+static void box_row_h_scalar(uint32_t* dst, const uint32_t* src, int radius, float inv, int n) {
+	uint32_t sums[4] = { 0, 0, 0, 0 };
+	for (int k=0; k<2*radius+1; k++) {
+		box_update(sums, src[k], 0);
+	}
+	for (int i=0; i<n; i++) {
+		dst[i] = box_pack(sums, inv);
+		if (i+1 < n) {
+			box_update(sums, src[i+2*radius+1], src[i]);
+		}
+	}
+}
+
+static void box_row_v_scalar(uint32_t* dst, uint32_t* sums, const uint32_t* add, const uint32_t* sub, float inv, int x, int n) {
+	for (; x<n; x++) {
+		dst[x] = box_pack(sums + x*4, inv);
+		box_update(sums + x*4, add[x], sub[x]);
+	}
+}
+
+// sum of weights[k] times channel c of rows[k][x], plus offset, shifted right
+static inline int32_t conv_channel(const uint32_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int x, int c) {
+	int32_t acc = offset;
+	for (int k=0; k<taps; k++) {
+		acc += weights[k]*(int32_t)((rows[k][x] >> (c*8)) & 0xff);
+	}
+	return acc >> shift;
+}
+
+// same for rows with 16 bit channels(4 per pixel)
+static inline int32_t conv_channel_s16(const int16_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int x, int c) {
+	int32_t acc = offset;
+	for (int k=0; k<taps; k++) {
+		acc += weights[k]*(int32_t)rows[k][x*4+c];
+	}
+	return acc >> shift;
+}
+
+static inline uint32_t conv_clamp_u8(int32_t v) {
+	return (uint32_t)((v < 0) ? 0 : ((v > 255) ? 255 : v));
+}
+
+static void conv_row_scalar(uint32_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int x, int n) {
+	for (; x<n; x++) {
+		uint32_t p = 0;
+		for (int c=0; c<4; c++) {
+			p |= conv_clamp_u8(conv_channel(rows, weights, taps, shift, offset, x, c)) << (c*8);
+		}
+		dst[x] = p;
+	}
+}
+
+static void conv_row_to_s16_scalar(int16_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int x, int n) {
+	for (; x<n; x++) {
+		for (int c=0; c<4; c++) {
+			int32_t v = conv_channel(rows, weights, taps, shift, offset, x, c);
+			dst[x*4+c] = (int16_t)((v < -32768) ? -32768 : ((v > 32767) ? 32767 : v));
+		}
+	}
+}
+
+static void conv_row_from_s16_scalar(uint32_t* dst, const int16_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int x, int n) {
+	for (; x<n; x++) {
+		uint32_t p = 0;
+		for (int c=0; c<4; c++) {
+			p |= conv_clamp_u8(conv_channel_s16(rows, weights, taps, shift, offset, x, c)) << (c*8);
+		}
+		dst[x] = p;
+	}
+}
+
+static void morph_row_scalar(uint8_t* dst, const uint8_t* const* rows, int count, int dilate, int x, int n) {
+	for (; x<n; x++) {
+		uint8_t v = rows[0][x];
+		for (int k=1; k<count; k++) {
+			uint8_t r = rows[k][x];
+			v = dilate ? ((r > v) ? r : v) : ((r < v) ? r : v);
+		}
+		dst[x] = v;
+	}
+}
+
+// 32bpp formats that only differ in byte order(not premultiplied)
+static void blend_row_premul_scalar(uint32_t* dst, const uint32_t* src, int n, int keep_alpha) {
+	if (keep_alpha) {
+		for (int i=0; i<n; i++) {
+			dst[i] = (blend_pixel_premul(dst[i], src[i]) & 0xffffff00) | (dst[i] & 0xff);
+		}
+	} else {
+		for (int i=0; i<n; i++) {
+			dst[i] = blend_pixel_premul(dst[i], src[i]);
+		}
+	}
+}
+
+static inline int is_32bpp(PIX_FMT fmt) {
+	return (fmt >= LDB_PXFMT_32BPP_RGBA) && (fmt <= LDB_PXFMT_32BPP_BGRA);
+}
+static inline int is_16bpp(PIX_FMT fmt) {
+	return (fmt == LDB_PXFMT_16BPP_RGB565) || (fmt == LDB_PXFMT_16BPP_BGR565);
+}
+
+
+
+#ifdef LDB_CONVERT_X86
+
+// byte offset of the r,g,b,a channels in a pixel, for each 32bpp format
+static const uint8_t chan_pos_32bpp[4][4] = {
+	{ 0,1,2,3 }, // RGBA
+	{ 1,2,3,0 }, // ARGB
+	{ 3,2,1,0 }, // ABGR
+	{ 2,1,0,3 }, // BGRA
+};
+
+// for each byte of a destination pixel, get the byte offset in the source pixel
+static void get_byte_permutation(PIX_FMT src_fmt, PIX_FMT dst_fmt, uint8_t perm[4]) {
+	const uint8_t* src_pos = chan_pos_32bpp[src_fmt-LDB_PXFMT_32BPP_RGBA];
+	const uint8_t* dst_pos = chan_pos_32bpp[dst_fmt-LDB_PXFMT_32BPP_RGBA];
+	for (int c=0; c<4; c++) {
+		perm[dst_pos[c]] = src_pos[c];
+	}
+}
+
+// SSE2 has no byte shuffle, so the permutation is done using a shift and mask per byte
+typedef struct {
+	__m128i lshift[4];
+	__m128i rshift[4];
+	__m128i mask[4];
+} swizzle_sse2_t;
+
+__attribute__((target("sse2")))
+static void swizzle_sse2_prepare(swizzle_sse2_t* s, const uint8_t perm[4]) {
+	for (int j=0; j<4; j++) {
+		int shift = 8*(j-perm[j]);
+		s->lshift[j] = _mm_cvtsi32_si128((shift>0) ? shift : 0);
+		s->rshift[j] = _mm_cvtsi32_si128((shift<0) ? -shift : 0);
+		s->mask[j] = _mm_set1_epi32((int)(0xffu << (8*j)));
+	}
+}
+
+__attribute__((target("sse2")))
+static inline __m128i swizzle_sse2(const swizzle_sse2_t* s, __m128i v) {
+	__m128i r = _mm_setzero_si128();
+	for (int j=0; j<4; j++) {
+		__m128i t = _mm_srl_epi32(_mm_sll_epi32(v, s->lshift[j]), s->rshift[j]);
+		r = _mm_or_si128(r, _mm_and_si128(t, s->mask[j]));
+	}
+	return r;
+}
+
+// compose the 16bpp values(byte-swapped, as stored in memory) from pixels in the internal format
+__attribute__((target("sse2")))
+static inline __m128i internal_to_565_sse2(__m128i v, int bgr) {
+	__m128i m_hi = _mm_set1_epi32(0xf800);
+	__m128i m_mid = _mm_set1_epi32(0x07e0);
+	__m128i m_lo = _mm_set1_epi32(0x001f);
+	__m128i r;
+	if (bgr) {
+		r = _mm_and_si128(v, m_hi);
+		r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(v, 13), m_mid));
+		r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(v, 27), m_lo));
+	} else {
+		r = _mm_and_si128(_mm_srli_epi32(v, 16), m_hi);
+		r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(v, 13), m_mid));
+		r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(v, 11), m_lo));
+	}
+	// the high byte is stored first
+	r = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(r, 8), _mm_set1_epi32(0xff00)), _mm_srli_epi32(r, 8));
+	// sign-extend so that the signed saturating pack is exact
+	return _mm_srai_epi32(_mm_slli_epi32(r, 16), 16);
+}
+
+// expand byte-swapped 16bpp values(zero-extended to 32 bit) to the internal pixel format
+__attribute__((target("sse2")))
+static inline __m128i expand_565_sse2(__m128i v, int bgr) {
+	v = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(v, 8), _mm_set1_epi32(0xff00)), _mm_srli_epi32(v, 8));
+	__m128i g = _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x07e0)), 13);
+	__m128i r, b;
+	if (bgr) {
+		r = _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x001f)), 27);
+		b = _mm_and_si128(v, _mm_set1_epi32(0xf800));
+	} else {
+		r = _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xf800)), 16);
+		b = _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0x001f)), 11);
+	}
+	return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+// 32bpp -> 32bpp, 4 pixels per iteration
+__attribute__((target("sse2")))
+static void convert_32_32_sse2(const uint8_t* src_row, int sx, PIX_FMT src_fmt, uint8_t* dst_row, int dx, PIX_FMT dst_fmt, int n) {
+	uint8_t perm[4];
+	swizzle_sse2_t s;
+	get_byte_permutation(src_fmt, dst_fmt, perm);
+	swizzle_sse2_prepare(&s, perm);
+	const uint8_t* src = src_row + sx*4;
+	uint8_t* dst = dst_row + dx*4;
+	int i = 0;
+	for (; i+4<=n; i+=4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src+i*4));
+		_mm_storeu_si128((__m128i*)(dst+i*4), swizzle_sse2(&s, v));
+	}
+	convert_row(src_row, sx+i, src_fmt, dst_row, dx+i, dst_fmt, n-i);
+}
+
+// 32bpp -> rgb565/bgr565, 8 pixels per iteration
+__attribute__((target("sse2")))
+static void convert_32_16_sse2(const uint8_t* src_row, int sx, PIX_FMT src_fmt, uint8_t* dst_row, int dx, PIX_FMT dst_fmt, int n) {
+	uint8_t perm[4];
+	swizzle_sse2_t s;
+	get_byte_permutation(src_fmt, LDB_PXFMT_32BPP_ABGR, perm);
+	swizzle_sse2_prepare(&s, perm);
+	int bgr = (dst_fmt == LDB_PXFMT_16BPP_BGR565);
+	const uint8_t* src = src_row + sx*4;
+	uint8_t* dst = dst_row + dx*2;
+	int i = 0;
+	for (; i+8<=n; i+=8) {
+		__m128i a = swizzle_sse2(&s, _mm_loadu_si128((const __m128i*)(src+i*4)));
+		__m128i b = swizzle_sse2(&s, _mm_loadu_si128((const __m128i*)(src+i*4+16)));
+		__m128i r = _mm_packs_epi32(internal_to_565_sse2(a, bgr), internal_to_565_sse2(b, bgr));
+		_mm_storeu_si128((__m128i*)(dst+i*2), r);
+	}
+	convert_row(src_row, sx+i, src_fmt, dst_row, dx+i, dst_fmt, n-i);
+}
+
+// rgb565/bgr565 -> 32bpp, 8 pixels per iteration
+__attribute__((target("sse2")))
+static void convert_16_32_sse2(const uint8_t* src_row, int sx, PIX_FMT src_fmt, uint8_t* dst_row, int dx, PIX_FMT dst_fmt, int n) {
+	uint8_t perm[4];
+	swizzle_sse2_t s;
+	get_byte_permutation(LDB_PXFMT_32BPP_ABGR, dst_fmt, perm);
+	swizzle_sse2_prepare(&s, perm);
+	int bgr = (src_fmt == LDB_PXFMT_16BPP_BGR565);
+	const uint8_t* src = src_row + sx*2;
+	uint8_t* dst = dst_row + dx*4;
+	__m128i zero = _mm_setzero_si128();
+	int i = 0;
+	for (; i+8<=n; i+=8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src+i*2));
+		__m128i lo = expand_565_sse2(_mm_unpacklo_epi16(v, zero), bgr);
+		__m128i hi = expand_565_sse2(_mm_unpackhi_epi16(v, zero), bgr);
+		_mm_storeu_si128((__m128i*)(dst+i*4), swizzle_sse2(&s, lo));
+		_mm_storeu_si128((__m128i*)(dst+i*4+16), swizzle_sse2(&s, hi));
+	}
+	convert_row(src_row, sx+i, src_fmt, dst_row, dx+i, dst_fmt, n-i);
+}
+
+// get the pshufb control mask for a 32bpp permutation(repeated for 4 pixels)
+static void get_shuffle_mask(const uint8_t perm[4], uint8_t mask[16]) {
+	for (int i=0; i<16; i++) {
+		mask[i] = (i & ~3) + perm[i&3];
+	}
+}
+
+// 32bpp -> 32bpp using pshufb, 8 pixels per iteration
+__attribute__((target("ssse3")))
+static void convert_32_32_ssse3(const uint8_t* src_row, int sx, PIX_FMT src_fmt, uint8_t* dst_row, int dx, PIX_FMT dst_fmt, int n) {
+	uint8_t perm[4];
+	uint8_t mask_bytes[16];
+	get_byte_permutation(src_fmt, dst_fmt, perm);
+	get_shuffle_mask(perm, mask_bytes);
+	__m128i mask = _mm_loadu_si128((const __m128i*)mask_bytes);
+	const uint8_t* src = src_row + sx*4;
+	uint8_t* dst = dst_row + dx*4;
+	int i = 0;
+	for (; i+8<=n; i+=8) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(src+i*4));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src+i*4+16));
+		_mm_storeu_si128((__m128i*)(dst+i*4), _mm_shuffle_epi8(a, mask));
+		_mm_storeu_si128((__m128i*)(dst+i*4+16), _mm_shuffle_epi8(b, mask));
+	}
+	convert_row(src_row, sx+i, src_fmt, dst_row, dx+i, dst_fmt, n-i);
+}
+
+// 32bpp -> 32bpp using vpshufb, 16 pixels per iteration
+__attribute__((target("avx2")))
+static void convert_32_32_avx2(const uint8_t* src_row, int sx, PIX_FMT src_fmt, uint8_t* dst_row, int dx, PIX_FMT dst_fmt, int n) {
+	uint8_t perm[4];
+	uint8_t mask_bytes[16];
+	get_byte_permutation(src_fmt, dst_fmt, perm);
+	get_shuffle_mask(perm, mask_bytes);
+	__m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)mask_bytes));
+	const uint8_t* src = src_row + sx*4;
+	uint8_t* dst = dst_row + dx*4;
+	int i = 0;
+	for (; i+16<=n; i+=16) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(src+i*4));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(src+i*4+32));
+		_mm256_storeu_si256((__m256i*)(dst+i*4), _mm256_shuffle_epi8(a, mask));
+		_mm256_storeu_si256((__m256i*)(dst+i*4+32), _mm256_shuffle_epi8(b, mask));
+	}
+	convert_32_32_ssse3(src_row, sx+i, src_fmt, dst_row, dx+i, dst_fmt, n-i);
+}
+
+// compose the 16bpp values(see internal_to_565_sse2) for 8 pixels in the internal format
+__attribute__((target("avx2")))
+static inline __m256i internal_to_565_avx2(__m256i v, int bgr) {
+	__m256i m_hi = _mm256_set1_epi32(0xf800);
+	__m256i m_mid = _mm256_set1_epi32(0x07e0);
+	__m256i m_lo = _mm256_set1_epi32(0x001f);
+	__m256i r;
+	if (bgr) {
+		r = _mm256_and_si256(v, m_hi);
+		r = _mm256_or_si256(r, _mm256_and_si256(_mm256_srli_epi32(v, 13), m_mid));
+		r = _mm256_or_si256(r, _mm256_and_si256(_mm256_srli_epi32(v, 27), m_lo));
+	} else {
+		r = _mm256_and_si256(_mm256_srli_epi32(v, 16), m_hi);
+		r = _mm256_or_si256(r, _mm256_and_si256(_mm256_srli_epi32(v, 13), m_mid));
+		r = _mm256_or_si256(r, _mm256_and_si256(_mm256_srli_epi32(v, 11), m_lo));
+	}
+	r = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi32(r, 8), _mm256_set1_epi32(0xff00)), _mm256_srli_epi32(r, 8));
+	return _mm256_srai_epi32(_mm256_slli_epi32(r, 16), 16);
+}
+
+// 32bpp -> rgb565/bgr565, 16 pixels per iteration
+__attribute__((target("avx2")))
+static void convert_32_16_avx2(const uint8_t* src_row, int sx, PIX_FMT src_fmt, uint8_t* dst_row, int dx, PIX_FMT dst_fmt, int n) {
+	uint8_t perm[4];
+	uint8_t mask_bytes[16];
+	get_byte_permutation(src_fmt, LDB_PXFMT_32BPP_ABGR, perm);
+	get_shuffle_mask(perm, mask_bytes);
+	__m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)mask_bytes));
+	int bgr = (dst_fmt == LDB_PXFMT_16BPP_BGR565);
+	const uint8_t* src = src_row + sx*4;
+	uint8_t* dst = dst_row + dx*2;
+	int i = 0;
+	for (; i+16<=n; i+=16) {
+		__m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src+i*4)), mask);
+		__m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(src+i*4+32)), mask);
+		// packs works on 128-bit lanes, restore the pixel order afterwards
+		__m256i r = _mm256_packs_epi32(internal_to_565_avx2(a, bgr), internal_to_565_avx2(b, bgr));
+		r = _mm256_permute4x64_epi64(r, 0xd8);
+		_mm256_storeu_si256((__m256i*)(dst+i*2), r);
+	}
+	convert_32_16_sse2(src_row, sx+i, src_fmt, dst_row, dx+i, dst_fmt, n-i);
+}
+
+// Alpha-blending kernels. The pixels are expanded to 16 bit per channel(the alpha channel of a pixel is
+// the lowest byte), and (x*a + y*(255-a) + 128)/255 is computed as (t + (t>>8))>>8, which is exact for all inputs.
+
+// mix s into d using the alpha of each s pixel(16 bit per channel, the alpha is broadcast to all channels of a pixel)
+__attribute__((target("sse2")))
+static inline __m128i blend_16_sse2(__m128i s, __m128i d) {
+	__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0x00), 0x00);
+	__m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), a);
+	__m128i t = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, ia)), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+static void blend_row_sse2(uint32_t* dst, const uint32_t* src, int n) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i keep_a = _mm_set1_epi32(0xff);
+	int i = 0;
+	for (; i+4<=n; i+=4) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(src+i));
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst+i));
+		__m128i lo = blend_16_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+		__m128i hi = blend_16_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+		__m128i r = _mm_packus_epi16(lo, hi);
+		r = _mm_or_si128(_mm_andnot_si128(keep_a, r), _mm_and_si128(keep_a, d));
+		_mm_storeu_si128((__m128i*)(dst+i), r);
+	}
+	blend_row_scalar(dst+i, src+i, n-i);
+}
+
+__attribute__((target("sse2")))
+static void blend_row_color_sse2(uint32_t* dst, uint32_t p, int n) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i keep_a = _mm_set1_epi32(0xff);
+	uint32_t a = p & 0xff;
+	// p*a+128 for each channel, and 255-a
+	__m128i s = _mm_unpacklo_epi8(_mm_set1_epi32((int)p), zero);
+	__m128i c = _mm_add_epi16(_mm_mullo_epi16(s, _mm_set1_epi16((short)a)), _mm_set1_epi16(128));
+	__m128i ia = _mm_set1_epi16((short)(255-a));
+	int i = 0;
+	for (; i+4<=n; i+=4) {
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst+i));
+		__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ia), c);
+		__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ia), c);
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+		__m128i r = _mm_packus_epi16(lo, hi);
+		r = _mm_or_si128(_mm_andnot_si128(keep_a, r), _mm_and_si128(keep_a, d));
+		_mm_storeu_si128((__m128i*)(dst+i), r);
+	}
+	blend_row_color_scalar(dst+i, p, n-i);
+}
+
+// premultiplied "over": s + d*(255-a)/255 for each channel(16 bit per channel)
+__attribute__((target("sse2")))
+static inline __m128i blend_premul_16_sse2(__m128i s, __m128i d) {
+	__m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0x00), 0x00));
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(d, ia), _mm_set1_epi16(128));
+	return _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8), s);
+}
+
+__attribute__((target("sse2")))
+static void blend_row_premul_sse2(uint32_t* dst, const uint32_t* src, int n, int keep_alpha) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i keep_a = _mm_set1_epi32(keep_alpha ? 0xff : 0);
+	int i = 0;
+	for (; i+4<=n; i+=4) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(src+i));
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst+i));
+		__m128i lo = blend_premul_16_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+		__m128i hi = blend_premul_16_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+		// saturates invalid(color>alpha) values
+		__m128i r = _mm_packus_epi16(lo, hi);
+		r = _mm_or_si128(_mm_andnot_si128(keep_a, r), _mm_and_si128(keep_a, d));
+		_mm_storeu_si128((__m128i*)(dst+i), r);
+	}
+	blend_row_premul_scalar(dst+i, src+i, n-i, keep_alpha);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i blend_16_avx2(__m256i s, __m256i d) {
+	__m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0x00), 0x00);
+	__m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+	__m256i t = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, ia)), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static void blend_row_avx2(uint32_t* dst, const uint32_t* src, int n) {
+	__m256i zero = _mm256_setzero_si256();
+	__m256i keep_a = _mm256_set1_epi32(0xff);
+	int i = 0;
+	for (; i+8<=n; i+=8) {
+		__m256i s = _mm256_loadu_si256((const __m256i*)(src+i));
+		__m256i d = _mm256_loadu_si256((const __m256i*)(dst+i));
+		// unpack and pack work on 128-bit lanes, so the pixel order is kept
+		__m256i lo = blend_16_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+		__m256i hi = blend_16_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+		__m256i r = _mm256_packus_epi16(lo, hi);
+		r = _mm256_or_si256(_mm256_andnot_si256(keep_a, r), _mm256_and_si256(keep_a, d));
+		_mm256_storeu_si256((__m256i*)(dst+i), r);
+	}
+	// avoid the SSE/AVX transition penalty in the SSE2 kernel
+	_mm256_zeroupper();
+	blend_row_sse2(dst+i, src+i, n-i);
+}
+
+__attribute__((target("avx2")))
+static void blend_row_color_avx2(uint32_t* dst, uint32_t p, int n) {
+	__m256i zero = _mm256_setzero_si256();
+	__m256i keep_a = _mm256_set1_epi32(0xff);
+	uint32_t a = p & 0xff;
+	__m256i s = _mm256_unpacklo_epi8(_mm256_set1_epi32((int)p), zero);
+	__m256i c = _mm256_add_epi16(_mm256_mullo_epi16(s, _mm256_set1_epi16((short)a)), _mm256_set1_epi16(128));
+	__m256i ia = _mm256_set1_epi16((short)(255-a));
+	int i = 0;
+	for (; i+8<=n; i+=8) {
+		__m256i d = _mm256_loadu_si256((const __m256i*)(dst+i));
+		__m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), ia), c);
+		__m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), ia), c);
+		lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+		hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+		__m256i r = _mm256_packus_epi16(lo, hi);
+		r = _mm256_or_si256(_mm256_andnot_si256(keep_a, r), _mm256_and_si256(keep_a, d));
+		_mm256_storeu_si256((__m256i*)(dst+i), r);
+	}
+	_mm256_zeroupper();
+	blend_row_color_sse2(dst+i, p, n-i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i blend_premul_16_avx2(__m256i s, __m256i d) {
+	__m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255), _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0x00), 0x00));
+	__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(d, ia), _mm256_set1_epi16(128));
+	return _mm256_add_epi16(_mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8), s);
+}
+
+__attribute__((target("avx2")))
+static void blend_row_premul_avx2(uint32_t* dst, const uint32_t* src, int n, int keep_alpha) {
+	__m256i zero = _mm256_setzero_si256();
+	__m256i keep_a = _mm256_set1_epi32(keep_alpha ? 0xff : 0);
+	int i = 0;
+	for (; i+8<=n; i+=8) {
+		__m256i s = _mm256_loadu_si256((const __m256i*)(src+i));
+		__m256i d = _mm256_loadu_si256((const __m256i*)(dst+i));
+		__m256i lo = blend_premul_16_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+		__m256i hi = blend_premul_16_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+		__m256i r = _mm256_packus_epi16(lo, hi);
+		r = _mm256_or_si256(_mm256_andnot_si256(keep_a, r), _mm256_and_si256(keep_a, d));
+		_mm256_storeu_si256((__m256i*)(dst+i), r);
+	}
+	_mm256_zeroupper();
+	blend_row_premul_sse2(dst+i, src+i, n-i, keep_alpha);
+}
+
+// Resampling filter kernels. Two pixels(or rows) are multiplied with a pair of weights at once using madd,
+// by interleaving their 16 bit channels. The sums are rounded, and saturated to 0-255 by packs/packus.
+
+// a pair of 16 bit weights, for multiply-add with interleaved channels
+static inline int32_t filter_weight_pair(const int16_t* w) {
+	return (int32_t)((uint32_t)(uint16_t)w[0] | ((uint32_t)(uint16_t)w[1] << 16));
+}
+
+__attribute__((target("sse2")))
+static void filter_row_h_sse2(uint32_t* dst, const uint32_t* src, const int* offsets, const int16_t* weights, int taps, int n) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i round = _mm_set1_epi32(1<<(LDB_FILTER_BITS-1));
+	for (int i=0; i<n; i++) {
+		const uint32_t* s = src + offsets[i];
+		const int16_t* w = weights + i*taps;
+		__m128i acc = round;
+		int k = 0;
+		for (; k+4<=taps; k+=4) {
+			__m128i p = _mm_loadu_si128((const __m128i*)(s+k));
+			__m128i wk = _mm_loadl_epi64((const __m128i*)(w+k));
+			__m128i p01 = _mm_unpacklo_epi8(p, zero);
+			__m128i p23 = _mm_unpackhi_epi8(p, zero);
+			p01 = _mm_unpacklo_epi16(p01, _mm_srli_si128(p01, 8));
+			p23 = _mm_unpacklo_epi16(p23, _mm_srli_si128(p23, 8));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(p01, _mm_shuffle_epi32(wk, 0x00)));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(p23, _mm_shuffle_epi32(wk, 0x55)));
+		}
+		for (; k<taps; k+=2) {
+			__m128i p01 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(s+k)), zero);
+			p01 = _mm_unpacklo_epi16(p01, _mm_srli_si128(p01, 8));
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(p01, _mm_set1_epi32(filter_weight_pair(w+k))));
+		}
+		acc = _mm_srai_epi32(acc, LDB_FILTER_BITS);
+		acc = _mm_packs_epi32(acc, acc);
+		dst[i] = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(acc, acc));
+	}
+}
+
+// add the weighted channels of the 4 pixels at x of all rows to a0-a3(one pixel each).
+// The bytes of two rows are interleaved, so each madd multiplies a pair of taps.
+__attribute__((target("sse2")))
+static inline void filter_acc_sse2(const uint32_t* const* rows, const int16_t* weights, int taps, int x, __m128i* a0, __m128i* a1, __m128i* a2, __m128i* a3) {
+	__m128i zero = _mm_setzero_si128();
+	for (int k=0; k<taps; k+=2) {
+		__m128i wk = _mm_set1_epi32(filter_weight_pair(weights+k));
+		__m128i r0 = _mm_loadu_si128((const __m128i*)(rows[k]+x));
+		__m128i r1 = _mm_loadu_si128((const __m128i*)(rows[k+1]+x));
+		__m128i lo = _mm_unpacklo_epi8(r0, r1);
+		__m128i hi = _mm_unpackhi_epi8(r0, r1);
+		*a0 = _mm_add_epi32(*a0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), wk));
+		*a1 = _mm_add_epi32(*a1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), wk));
+		*a2 = _mm_add_epi32(*a2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), wk));
+		*a3 = _mm_add_epi32(*a3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), wk));
+	}
+}
+
+__attribute__((target("sse2")))
+static void filter_row_v_sse2(uint32_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int x, int n) {
+	__m128i round = _mm_set1_epi32(1<<(LDB_FILTER_BITS-1));
+	for (; x+4<=n; x+=4) {
+		__m128i a0 = round, a1 = round, a2 = round, a3 = round;
+		filter_acc_sse2(rows, weights, taps, x, &a0, &a1, &a2, &a3);
+		__m128i lo = _mm_packs_epi32(_mm_srai_epi32(a0, LDB_FILTER_BITS), _mm_srai_epi32(a1, LDB_FILTER_BITS));
+		__m128i hi = _mm_packs_epi32(_mm_srai_epi32(a2, LDB_FILTER_BITS), _mm_srai_epi32(a3, LDB_FILTER_BITS));
+		_mm_storeu_si128((__m128i*)(dst+x), _mm_packus_epi16(lo, hi));
+	}
+	filter_row_v_scalar(dst, rows, weights, taps, x, n);
+}
+
+__attribute__((target("avx2")))
+static void filter_row_v_avx2(uint32_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int x, int n) {
+	__m256i zero = _mm256_setzero_si256();
+	__m256i round = _mm256_set1_epi32(1<<(LDB_FILTER_BITS-1));
+	for (; x+8<=n; x+=8) {
+		__m256i a0 = round, a1 = round, a2 = round, a3 = round;
+		for (int k=0; k<taps; k+=2) {
+			__m256i wk = _mm256_set1_epi32(filter_weight_pair(weights+k));
+			__m256i r0 = _mm256_loadu_si256((const __m256i*)(rows[k]+x));
+			__m256i r1 = _mm256_loadu_si256((const __m256i*)(rows[k+1]+x));
+			// unpack and pack work on 128-bit lanes, so the pixel order is kept
+			__m256i lo = _mm256_unpacklo_epi8(r0, r1);
+			__m256i hi = _mm256_unpackhi_epi8(r0, r1);
+			a0 = _mm256_add_epi32(a0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), wk));
+			a1 = _mm256_add_epi32(a1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), wk));
+			a2 = _mm256_add_epi32(a2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), wk));
+			a3 = _mm256_add_epi32(a3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), wk));
+		}
+		__m256i lo = _mm256_packs_epi32(_mm256_srai_epi32(a0, LDB_FILTER_BITS), _mm256_srai_epi32(a1, LDB_FILTER_BITS));
+		__m256i hi = _mm256_packs_epi32(_mm256_srai_epi32(a2, LDB_FILTER_BITS), _mm256_srai_epi32(a3, LDB_FILTER_BITS));
+		_mm256_storeu_si256((__m256i*)(dst+x), _mm256_packus_epi16(lo, hi));
+	}
+	_mm256_zeroupper();
+	filter_row_v_sse2(dst, rows, weights, taps, x, n);
+}
+
+// Ordered dithering kernel. The channels are expanded to 16 bit, v*levels + threshold fits in 16 bit,
+// and x/255 is computed as (x*0x8081)>>23, which is exact for all 16 bit values.
+__attribute__((target("sse2")))
+static void dither_row_sse2(uint32_t* dst, const uint32_t* src, const uint8_t* thresholds, const dither_levels_t* l, int x, int n) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i levels = _mm_set_epi16(l->levels[3], l->levels[2], l->levels[1], l->levels[0], l->levels[3], l->levels[2], l->levels[1], l->levels[0]);
+	__m128i scale = _mm_set_epi16(l->scale[3], l->scale[2], l->scale[1], l->scale[0], l->scale[3], l->scale[2], l->scale[1], l->scale[0]);
+	__m128i recip = _mm_set1_epi16((short)0x8081);
+	__m128i color_mask = _mm_set1_epi32((int)0xffffff00);
+	for (; x+4<=n; x+=4) {
+		// broadcast the threshold of each pixel to it's color channels
+		uint32_t t4;
+		memcpy(&t4, thresholds+x, 4);
+		__m128i t = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)t4), _mm_cvtsi32_si128((int)t4));
+		t = _mm_and_si128(_mm_unpacklo_epi16(t, t), color_mask);
+		__m128i p = _mm_loadu_si128((const __m128i*)(src+x));
+		__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(p, zero), levels), _mm_unpacklo_epi8(t, zero));
+		__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(p, zero), levels), _mm_unpackhi_epi8(t, zero));
+		lo = _mm_mullo_epi16(_mm_srli_epi16(_mm_mulhi_epu16(lo, recip), 7), scale);
+		hi = _mm_mullo_epi16(_mm_srli_epi16(_mm_mulhi_epu16(hi, recip), 7), scale);
+		_mm_storeu_si128((__m128i*)(dst+x), _mm_packus_epi16(lo, hi));
+	}
+	dither_row_scalar(dst, src, thresholds, l, x, n);
+}
+
+// Box blur kernels. The horizontal kernel keeps the 4 channel sums of the current pixel in a register,
+// the vertical kernel updates the sums of 4 pixels at once.
+__attribute__((target("sse2")))
+static inline __m128i box_widen_sse2(uint32_t p) {
+	__m128i zero = _mm_setzero_si128();
+	return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)p), zero), zero);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i box_avg_sse2(__m128i sums, __m128 inv) {
+	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(sums), inv), _mm_set1_ps(0.5f)));
+}
+
+// sign-extend the 16 bit differences in the low/high half of d to 32 bit
+#define BOX_DIFF_LO_SSE2(d) _mm_srai_epi32(_mm_unpacklo_epi16((d), (d)), 16)
+#define BOX_DIFF_HI_SSE2(d) _mm_srai_epi32(_mm_unpackhi_epi16((d), (d)), 16)
+
+__attribute__((target("sse2")))
+static void box_row_h_sse2(uint32_t* dst, const uint32_t* src, int radius, float inv, int n) {
+	__m128i zero = _mm_setzero_si128();
+	__m128 vinv = _mm_set1_ps(inv);
+	__m128i sums = zero;
+	for (int k=0; k<2*radius+1; k++) {
+		sums = _mm_add_epi32(sums, box_widen_sse2(src[k]));
+	}
+	// 4 pixels at once, the differences for the next 4 sums are computed together
+	int i = 0;
+	for (; i+5<=n; i+=4) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(src+i+2*radius+1));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src+i));
+		__m128i d_lo = _mm_sub_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+		__m128i d_hi = _mm_sub_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+		__m128i s0 = sums;
+		__m128i s1 = _mm_add_epi32(s0, BOX_DIFF_LO_SSE2(d_lo));
+		__m128i s2 = _mm_add_epi32(s1, BOX_DIFF_HI_SSE2(d_lo));
+		__m128i s3 = _mm_add_epi32(s2, BOX_DIFF_LO_SSE2(d_hi));
+		sums = _mm_add_epi32(s3, BOX_DIFF_HI_SSE2(d_hi));
+		__m128i lo = _mm_packs_epi32(box_avg_sse2(s0, vinv), box_avg_sse2(s1, vinv));
+		__m128i hi = _mm_packs_epi32(box_avg_sse2(s2, vinv), box_avg_sse2(s3, vinv));
+		_mm_storeu_si128((__m128i*)(dst+i), _mm_packus_epi16(lo, hi));
+	}
+	for (; i<n; i++) {
+		__m128i c = box_avg_sse2(sums, vinv);
+		c = _mm_packs_epi32(c, c);
+		dst[i] = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(c, c));
+		if (i+1 < n) {
+			sums = _mm_add_epi32(sums, _mm_sub_epi32(box_widen_sse2(src[i+2*radius+1]), box_widen_sse2(src[i])));
+		}
+	}
+}
+
+__attribute__((target("sse2")))
+static void box_row_v_sse2(uint32_t* dst, uint32_t* sums, const uint32_t* add, const uint32_t* sub, float inv, int x, int n) {
+	__m128i zero = _mm_setzero_si128();
+	__m128 vinv = _mm_set1_ps(inv);
+	for (; x+4<=n; x+=4) {
+		__m128i* s = (__m128i*)(sums + x*4);
+		__m128i s0 = _mm_loadu_si128(s), s1 = _mm_loadu_si128(s+1), s2 = _mm_loadu_si128(s+2), s3 = _mm_loadu_si128(s+3);
+		__m128i lo = _mm_packs_epi32(box_avg_sse2(s0, vinv), box_avg_sse2(s1, vinv));
+		__m128i hi = _mm_packs_epi32(box_avg_sse2(s2, vinv), box_avg_sse2(s3, vinv));
+		_mm_storeu_si128((__m128i*)(dst+x), _mm_packus_epi16(lo, hi));
+
+		__m128i a = _mm_loadu_si128((const __m128i*)(add+x));
+		__m128i b = _mm_loadu_si128((const __m128i*)(sub+x));
+		__m128i d_lo = _mm_sub_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+		__m128i d_hi = _mm_sub_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+		_mm_storeu_si128(s, _mm_add_epi32(s0, BOX_DIFF_LO_SSE2(d_lo)));
+		_mm_storeu_si128(s+1, _mm_add_epi32(s1, BOX_DIFF_HI_SSE2(d_lo)));
+		_mm_storeu_si128(s+2, _mm_add_epi32(s2, BOX_DIFF_LO_SSE2(d_hi)));
+		_mm_storeu_si128(s+3, _mm_add_epi32(s3, BOX_DIFF_HI_SSE2(d_hi)));
+	}
+	box_row_v_scalar(dst, sums, add, sub, inv, x, n);
+}
+
+// Convolution kernels, using the same interleaved multiply-add as the vertical resampling filter
+__attribute__((target("sse2")))
+static void conv_row_sse2(uint32_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int x, int n) {
+	__m128i off = _mm_set1_epi32(offset);
+	__m128i sh = _mm_cvtsi32_si128(shift);
+	for (; x+4<=n; x+=4) {
+		__m128i a0 = off, a1 = off, a2 = off, a3 = off;
+		filter_acc_sse2(rows, weights, taps, x, &a0, &a1, &a2, &a3);
+		__m128i lo = _mm_packs_epi32(_mm_sra_epi32(a0, sh), _mm_sra_epi32(a1, sh));
+		__m128i hi = _mm_packs_epi32(_mm_sra_epi32(a2, sh), _mm_sra_epi32(a3, sh));
+		_mm_storeu_si128((__m128i*)(dst+x), _mm_packus_epi16(lo, hi));
+	}
+	conv_row_scalar(dst, rows, weights, taps, shift, offset, x, n);
+}
+
+__attribute__((target("sse2")))
+static void conv_row_to_s16_sse2(int16_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int x, int n) {
+	__m128i off = _mm_set1_epi32(offset);
+	__m128i sh = _mm_cvtsi32_si128(shift);
+	for (; x+4<=n; x+=4) {
+		__m128i a0 = off, a1 = off, a2 = off, a3 = off;
+		filter_acc_sse2(rows, weights, taps, x, &a0, &a1, &a2, &a3);
+		_mm_storeu_si128((__m128i*)(dst+x*4), _mm_packs_epi32(_mm_sra_epi32(a0, sh), _mm_sra_epi32(a1, sh)));
+		_mm_storeu_si128((__m128i*)(dst+x*4+8), _mm_packs_epi32(_mm_sra_epi32(a2, sh), _mm_sra_epi32(a3, sh)));
+	}
+	conv_row_to_s16_scalar(dst, rows, weights, taps, shift, offset, x, n);
+}
+
+// The 16 bit channels of two rows are interleaved, two pixels(8 channels) are loaded from each row at once.
+__attribute__((target("sse2")))
+static void conv_row_from_s16_sse2(uint32_t* dst, const int16_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int x, int n) {
+	__m128i off = _mm_set1_epi32(offset);
+	__m128i sh = _mm_cvtsi32_si128(shift);
+	for (; x+4<=n; x+=4) {
+		__m128i a0 = off, a1 = off, a2 = off, a3 = off;
+		for (int k=0; k<taps; k+=2) {
+			__m128i wk = _mm_set1_epi32(filter_weight_pair(weights+k));
+			__m128i r0 = _mm_loadu_si128((const __m128i*)(rows[k]+x*4));
+			__m128i r1 = _mm_loadu_si128((const __m128i*)(rows[k+1]+x*4));
+			__m128i r2 = _mm_loadu_si128((const __m128i*)(rows[k]+x*4+8));
+			__m128i r3 = _mm_loadu_si128((const __m128i*)(rows[k+1]+x*4+8));
+			a0 = _mm_add_epi32(a0, _mm_madd_epi16(_mm_unpacklo_epi16(r0, r1), wk));
+			a1 = _mm_add_epi32(a1, _mm_madd_epi16(_mm_unpackhi_epi16(r0, r1), wk));
+			a2 = _mm_add_epi32(a2, _mm_madd_epi16(_mm_unpacklo_epi16(r2, r3), wk));
+			a3 = _mm_add_epi32(a3, _mm_madd_epi16(_mm_unpackhi_epi16(r2, r3), wk));
+		}
+		__m128i lo = _mm_packs_epi32(_mm_sra_epi32(a0, sh), _mm_sra_epi32(a1, sh));
+		__m128i hi = _mm_packs_epi32(_mm_sra_epi32(a2, sh), _mm_sra_epi32(a3, sh));
+		_mm_storeu_si128((__m128i*)(dst+x), _mm_packus_epi16(lo, hi));
+	}
+	conv_row_from_s16_scalar(dst, rows, weights, taps, shift, offset, x, n);
+}
+
+__attribute__((target("sse2")))
+static void morph_row_sse2(uint8_t* dst, const uint8_t* const* rows, int count, int dilate, int x, int n) {
+	for (; x+16<=n; x+=16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(rows[0]+x));
+		for (int k=1; k<count; k++) {
+			__m128i r = _mm_loadu_si128((const __m128i*)(rows[k]+x));
+			v = dilate ? _mm_max_epu8(v, r) : _mm_min_epu8(v, r);
+		}
+		_mm_storeu_si128((__m128i*)(dst+x), v);
+	}
+	morph_row_scalar(dst, rows, count, dilate, x, n);
+}
+
+#endif
+
+
+
+// fill the kernel table for the specified SIMD level
+static void convert_select(SIMD_LEVEL level) {
+	for (int s=0; s<LDB_PXFMT_MAX; s++) {
+		for (int d=0; d<LDB_PXFMT_MAX; d++) {
+			convert_row_func_t f = convert_row_scalar;
+#ifdef LDB_CONVERT_X86
+			if (s == d) {
+				// memmove in scalar kernel
+			} else if (is_32bpp(s) && is_32bpp(d)) {
+				if (level >= LDB_SIMD_AVX2) {
+					f = convert_32_32_avx2;
+				} else if (level >= LDB_SIMD_SSSE3) {
+					f = convert_32_32_ssse3;
+				} else if (level >= LDB_SIMD_SSE2) {
+					f = convert_32_32_sse2;
+				}
+			} else if (is_32bpp(s) && is_16bpp(d)) {
+				if (level >= LDB_SIMD_AVX2) {
+					f = convert_32_16_avx2;
+				} else if (level >= LDB_SIMD_SSE2) {
+					f = convert_32_16_sse2;
+				}
+			} else if (is_16bpp(s) && is_32bpp(d)) {
+				if (level >= LDB_SIMD_SSE2) {
+					f = convert_16_32_sse2;
+				}
+			}
+#endif
+			convert_funcs[s][d] = f;
+		}
+	}
+	blend_row_func = blend_row_scalar;
+	blend_row_color_func = blend_row_color_scalar;
+	blend_row_premul_func = blend_row_premul_scalar;
+	filter_row_h_func = filter_row_h_scalar;
+	filter_row_v_func = filter_row_v_scalar;
+	dither_row_func = dither_row_scalar;
+	box_row_h_func = box_row_h_scalar;
+	box_row_v_func = box_row_v_scalar;
+	conv_row_func = conv_row_scalar;
+	conv_row_to_s16_func = conv_row_to_s16_scalar;
+	conv_row_from_s16_func = conv_row_from_s16_scalar;
+	morph_row_func = morph_row_scalar;
+#ifdef LDB_CONVERT_X86
+	if (level >= LDB_SIMD_AVX2) {
+		blend_row_func = blend_row_avx2;
+		blend_row_color_func = blend_row_color_avx2;
+		blend_row_premul_func = blend_row_premul_avx2;
+		filter_row_h_func = filter_row_h_sse2;
+		filter_row_v_func = filter_row_v_avx2;
+		dither_row_func = dither_row_sse2;
+		box_row_h_func = box_row_h_sse2;
+		box_row_v_func = box_row_v_sse2;
+		conv_row_func = conv_row_sse2;
+		conv_row_to_s16_func = conv_row_to_s16_sse2;
+		conv_row_from_s16_func = conv_row_from_s16_sse2;
+		morph_row_func = morph_row_sse2;
+	} else if (level >= LDB_SIMD_SSE2) {
+		blend_row_func = blend_row_sse2;
+		blend_row_color_func = blend_row_color_sse2;
+		blend_row_premul_func = blend_row_premul_sse2;
+		filter_row_h_func = filter_row_h_sse2;
+		filter_row_v_func = filter_row_v_sse2;
+		dither_row_func = dither_row_sse2;
+		box_row_h_func = box_row_h_sse2;
+		box_row_v_func = box_row_v_sse2;
+		conv_row_func = conv_row_sse2;
+		conv_row_to_s16_func = conv_row_to_s16_sse2;
+		conv_row_from_s16_func = conv_row_from_s16_sse2;
+		morph_row_func = morph_row_sse2;
+	}
+#endif
+	convert_level = level;
+}
+
+void ldb_convert_init(void) {
+	if (convert_initialized) {
+		return;
+	}
+	convert_max_level = LDB_SIMD_SCALAR;
+#ifdef LDB_CONVERT_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		convert_max_level = LDB_SIMD_AVX2;
+	} else if (__builtin_cpu_supports("ssse3")) {
+		convert_max_level = LDB_SIMD_SSSE3;
+	} else if (__builtin_cpu_supports("sse2")) {
+		convert_max_level = LDB_SIMD_SSE2;
+	}
+#endif
+	convert_select(convert_max_level);
+	convert_initialized = 1;
+}
+
+SIMD_LEVEL ldb_convert_set_level(SIMD_LEVEL level) {
+	ldb_convert_init();
+	if ((level < LDB_SIMD_SCALAR) || (level > convert_max_level)) {
+		level = convert_max_level;
+	}
+	convert_select(level);
+	return level;
+}
+
+SIMD_LEVEL ldb_convert_get_level(void) {
+	ldb_convert_init();
+	return convert_level;
+}
+
+SIMD_LEVEL ldb_convert_get_max_level(void) {
+	ldb_convert_init();
+	return convert_max_level;
+}
+
+const char* ldb_simd_level_to_str(SIMD_LEVEL level) {
+	switch (level) {
+		case LDB_SIMD_SCALAR: return "scalar";
+		case LDB_SIMD_SSE2: return "sse2";
+		case LDB_SIMD_SSSE3: return "ssse3";
+		case LDB_SIMD_AVX2: return "avx2";
+		default: return "Unknown";
+	}
+}
+
+void ldb_convert_row(const uint8_t* src_row, int sx, PIX_FMT src_fmt, uint8_t* dst_row, int dx, PIX_FMT dst_fmt, int n) {
+	if (!convert_initialized) {
+		ldb_convert_init();
+	}
+	if (n <= 0) {
+		return;
+	}
+	convert_funcs[src_fmt][dst_fmt](src_row, sx, src_fmt, dst_row, dx, dst_fmt, n);
+}
+
+void ldb_blend_row(uint32_t* dst, const uint32_t* src, int n) {
+	if (!convert_initialized) {
+		ldb_convert_init();
+	}
+	if (n <= 0) {
+		return;
+	}
+	blend_row_func(dst, src, n);
+}
+
+void ldb_blend_row_color(uint32_t* dst, uint32_t p, int n) {
+	if (!convert_initialized) {
+		ldb_convert_init();
+	}
+	uint32_t a = p & 0xff;
+	if ((n <= 0) || (a == 0)) {
+		return;
+	} else if (a == 0xff) {
+		for (int i=0; i<n; i++) {
+			dst[i] = (p & 0xffffff00) | (dst[i] & 0xff);
+		}
+		return;
+	}
+	blend_row_color_func(dst, p, n);
+}
+
+void ldb_blend_row_premul(uint32_t* dst, const uint32_t* src, int n, int keep_alpha) {
+	if (!convert_initialized) {
+		ldb_convert_init();
+	}
+	if (n <= 0) {
+		return;
+	}
+	blend_row_premul_func(dst, src, n, keep_alpha);
+}
+
+void ldb_filter_row_h(uint32_t* dst, const uint32_t* src, const int* offsets, const int16_t* weights, int taps, int n) {
+	if (!convert_initialized) {
+		ldb_convert_init();
+	}
+	if (n <= 0) {
+		return;
+	}
+	filter_row_h_func(dst, src, offsets, weights, taps, n);
+}
+
+void ldb_filter_row_v(uint32_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int n) {
+	if (!convert_initialized) {
+		ldb_convert_init();
+	}
+	if (n <= 0) {
+		return;
+	}
+	filter_row_v_func(dst, rows, weights, taps, 0, n);
+}
+
+void ldb_dither_row(uint32_t* dst, const uint32_t* src, const uint8_t* thresholds, int r_bits, int g_bits, int b_bits, int n) {
+	if (!convert_initialized) {
+		ldb_convert_init();
+	}
+	if (n <= 0) {
+		return;
+	}
+	int bits[4] = { 8, b_bits, g_bits, r_bits };
+	dither_levels_t l;
+	for (int c=0; c<4; c++) {
+		int b = (bits[c] < 1) ? 1 : ((bits[c] > 8) ? 8 : bits[c]);
+		l.levels[c] = (1<<b)-1;
+		l.scale[c] = 1<<(8-b);
+	}
+	dither_row_func(dst, src, thresholds, &l, 0, n);
+}
+
+void ldb_box_row_h(uint32_t* dst, const uint32_t* src, int radius, int n) {
+	if (!convert_initialized) {
+		ldb_convert_init();
+	}
+	if (n <= 0) {
+		return;
+	}
+	box_row_h_func(dst, src, radius, 1.0f/(2*radius+1), n);
+}
+
+void ldb_box_row_v(uint32_t* dst, uint32_t* sums, const uint32_t* add, const uint32_t* sub, int radius, int n) {
+	if (!convert_initialized) {
+		ldb_convert_init();
+	}
+	if (n <= 0) {
+		return;
+	}
+	box_row_v_func(dst, sums, add, sub, 1.0f/(2*radius+1), 0, n);
+}
+
+void ldb_conv_row(uint32_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int n) {
+	if (!convert_initialized) {
+		ldb_convert_init();
+	}
+	if (n <= 0) {
+		return;
+	}
+	conv_row_func(dst, rows, weights, taps, shift, offset, 0, n);
+}
+
+void ldb_conv_row_to_s16(int16_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int n) {
+	if (!convert_initialized) {
+		ldb_convert_init();
+	}
+	if (n <= 0) {
+		return;
+	}
+	conv_row_to_s16_func(dst, rows, weights, taps, shift, offset, 0, n);
+}
+
+void ldb_conv_row_from_s16(uint32_t* dst, const int16_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int n) {
+	if (!convert_initialized) {
+		ldb_convert_init();
+	}
+	if (n <= 0) {
+		return;
+	}
+	conv_row_from_s16_func(dst, rows, weights, taps, shift, offset, 0, n);
+}
+
+void ldb_morph_row(uint8_t* dst, const uint8_t* const* rows, int count, int dilate, int n) {
+	if (!convert_initialized) {
+		ldb_convert_init();
+	}
+	if ((n <= 0) || (count <= 0)) {
+		return;
+	}
+	morph_row_func(dst, rows, count, dilate, 0, n);
+}
+
+int ldb_convert_db(const drawbuffer_t* src_db, const drawbuffer_t* dst_db) {
+	if ((src_db->w != dst_db->w) || (src_db->h != dst_db->h)) {
+		return 0;
+	}
+	if (db_is_contiguous(src_db) && db_is_contiguous(dst_db) && (get_bpp(src_db->pxfmt) >= 8) && (get_bpp(dst_db->pxfmt) >= 8)) {
+		// no padding between rows, convert as a single row
+		ldb_convert_row(src_db->data, 0, src_db->pxfmt, dst_db->data, 0, dst_db->pxfmt, src_db->w*src_db->h);
+		return 1;
+	}
+	for (int y=0; y<src_db->h; y++) {
+		ldb_convert_row(db_get_row_ptr(src_db, y), 0, src_db->pxfmt, db_get_row_ptr(dst_db, y), 0, dst_db->pxfmt, src_db->w);
+	}
+	return 1;
+}
@@ -0,0 +1,86 @@
+#ifndef LUA_LDB_CONVERT_H
+#define LUA_LDB_CONVERT_H
+
+// SIMD levels used by the conversion engine, in ascending order
+typedef enum {
+	LDB_SIMD_SCALAR,
+	LDB_SIMD_SSE2,
+	LDB_SIMD_SSSE3,
+	LDB_SIMD_AVX2,
+
+	LDB_SIMD_MAX,
+} SIMD_LEVEL;
+
+// function that converts n pixels from src_row(starting at pixel sx) to dst_row(starting at pixel dx)
+typedef void (*convert_row_func_t)(const uint8_t* src_row, int sx, PIX_FMT src_fmt, uint8_t* dst_row, int dx, PIX_FMT dst_fmt, int n);
+
+// detect the CPU features and select the conversion kernels. Only the first call has an effect.
+void ldb_convert_init(void);
+
+// select the kernels for the specified SIMD level(or the best supported level if it's not supported). Returns the selected level.
+SIMD_LEVEL ldb_convert_set_level(SIMD_LEVEL level);
+
+// get the SIMD level that is currently used, and the best level supported by the CPU
+SIMD_LEVEL ldb_convert_get_level(void);
+SIMD_LEVEL ldb_convert_get_max_level(void);
+
+// get the name of a SIMD level("scalar", "sse2", "ssse3", "avx2")
+const char* ldb_simd_level_to_str(SIMD_LEVEL level);
+
+// convert n pixels of a row from src_fmt to dst_fmt, using the fastest available kernel
+void ldb_convert_row(const uint8_t* src_row, int sx, PIX_FMT src_fmt, uint8_t* dst_row, int dx, PIX_FMT dst_fmt, int n);
+
+// mix the n pixels in src into the n pixels in dst(both in the internal pixel format), using the alpha value of each src pixel.
+// The alpha values of dst are kept(see blend_pixel).
+void ldb_blend_row(uint32_t* dst, const uint32_t* src, int n);
+
+// mix the pixel p into the n pixels in dst(internal pixel format), using the alpha value of p.
+void ldb_blend_row_color(uint32_t* dst, uint32_t p, int n);
+
+// mix the n premultiplied pixels in src into dst using the "over" operator(dst = src + dst*(255-a)/255 for each channel).
+// If dst is premultiplied, this is the correct result for all channels, otherwise set keep_alpha to keep the alpha values of dst.
+void ldb_blend_row_premul(uint32_t* dst, const uint32_t* src, int n, int keep_alpha);
+
+// number of fractional bits of the resampling filter weights(1<<LDB_FILTER_BITS is a weight of 1)
+#define LDB_FILTER_BITS 14
+
+// filter n pixels horizontally(internal pixel format, for each channel, rounded and clamped to 0-255):
+// dst[i] = sum(weights[i*taps+k] * src[offsets[i]+k]) for k=0..taps-1. taps must be even.
+void ldb_filter_row_h(uint32_t* dst, const uint32_t* src, const int* offsets, const int16_t* weights, int taps, int n);
+
+// filter n pixels vertically: dst[x] = sum(weights[k] * rows[k][x]) for k=0..taps-1. taps must be even.
+void ldb_filter_row_v(uint32_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int n);
+
+// quantize the r,g,b channels of n pixels(internal pixel format) to r_bits,g_bits,b_bits bits(1-8) for ordered dithering.
+// A channel value v becomes k<<(8-bits), with k = (v*(2^bits-1) + thresholds[i]) / 255. The thresholds must be 0-254.
+// The alpha values are kept. dst and src can be the same.
+void ldb_dither_row(uint32_t* dst, const uint32_t* src, const uint8_t* thresholds, int r_bits, int g_bits, int b_bits, int n);
+
+// box filter n pixels horizontally: each channel of dst[i] is the rounded average of src[i..i+2*radius].
+// src must contain n+2*radius pixels. radius must be less than 32768.
+void ldb_box_row_h(uint32_t* dst, const uint32_t* src, int radius, int n);
+
+// box filter n pixels vertically using running sums: channel c of dst[x] is sums[x*4+c]/(2*radius+1)(rounded),
+// then the channels of add[x] are added to the sums and those of sub[x] are subtracted.
+// dst must not be add or sub.
+void ldb_box_row_v(uint32_t* dst, uint32_t* sums, const uint32_t* add, const uint32_t* sub, int radius, int n);
+
+// convolve n pixels: each channel c of dst[x] is (sum(weights[k] * channel c of rows[k][x]) + offset) >> shift
+// for k=0..taps-1, clamped to 0-255. taps must be even.
+// The sum of the absolute weights times 255 must be less than 2^31.
+void ldb_conv_row(uint32_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int n);
+
+// same as ldb_conv_row, but the channels are saturated to 16 bit and stored in dst[x*4+c].
+void ldb_conv_row_to_s16(int16_t* dst, const uint32_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int n);
+
+// same as ldb_conv_row, but channel c of rows[k][x] is rows[k][x*4+c](16 bit).
+void ldb_conv_row_from_s16(uint32_t* dst, const int16_t* const* rows, const int16_t* weights, int taps, int shift, int32_t offset, int n);
+
+// dst[x] is the minimum(or maximum if dilate is set) of rows[k][x] for k=0..count-1, for n bytes.
+void ldb_morph_row(uint8_t* dst, const uint8_t* const* rows, int count, int dilate, int n);
+
+// convert all pixels of the src drawbuffer into the dst drawbuffer. Returns 0 if the dimensions don't match.
+int ldb_convert_db(const drawbuffer_t* src_db, const drawbuffer_t* dst_db);
+
+
+#endif
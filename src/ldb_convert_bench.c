@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "lua.h"
+
+#include "ldb.h"
+#include "ldb_convert.h"
+
+// Benchmark for the pixel format conversion engine.
+// Converts a 1920x1080 buffer for each pair of pixel formats and each
+// supported SIMD level, and reports the throughput in GB/s
+// (bytes read from the source + bytes written to the destination).
+
+#define BENCH_W 1920
+#define BENCH_H 1080
+#define BENCH_MIN_TIME 0.2
+
+static const char* fmt_names[LDB_PXFMT_MAX] = {
+	"bit", "byte", "rgb332", "rgb565", "bgr565", "rgb888", "bgr888",
+	"rgba8888", "argb8888", "abgr8888", "bgra8888", "rgba8888_premul", "bgra8888_premul"
+};
+
+static double get_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// run the conversion until BENCH_MIN_TIME has passed, return GB/s
+static double bench_pair(drawbuffer_t* src_db, drawbuffer_t* dst_db) {
+	size_t bytes = get_data_size(src_db->pxfmt, src_db->w, src_db->h) + get_data_size(dst_db->pxfmt, dst_db->w, dst_db->h);
+	ldb_convert_db(src_db, dst_db); // warm up
+	int iterations = 0;
+	double start = get_time();
+	double elapsed;
+	do {
+		ldb_convert_db(src_db, dst_db);
+		iterations++;
+		elapsed = get_time()-start;
+	} while (elapsed < BENCH_MIN_TIME);
+	return ((double)bytes*iterations) / elapsed / 1e9;
+}
+
+int main(int argc, char** argv) {
+	// optional arguments: source and destination pixel format name
+	const char* only_src = (argc>1) ? argv[1] : NULL;
+	const char* only_dst = (argc>2) ? argv[2] : NULL;
+
+	ldb_convert_init();
+	SIMD_LEVEL max_level = ldb_convert_get_max_level();
+
+	// separate source and destination buffers, so that same-format pairs don't alias
+	drawbuffer_t src_dbs[LDB_PXFMT_MAX];
+	drawbuffer_t dst_dbs[LDB_PXFMT_MAX];
+	for (int i=0; i<LDB_PXFMT_MAX; i++) {
+		size_t len = get_data_size(i, BENCH_W, BENCH_H);
+		src_dbs[i] = (drawbuffer_t){ .w=BENCH_W, .h=BENCH_H, .data=malloc(len), .pxfmt=i, .stride=get_stride(i, BENCH_W) };
+		dst_dbs[i] = (drawbuffer_t){ .w=BENCH_W, .h=BENCH_H, .data=calloc(1, len), .pxfmt=i, .stride=get_stride(i, BENCH_W) };
+		if ((!src_dbs[i].data) || (!dst_dbs[i].data)) {
+			fprintf(stderr, "Can't allocate memory!\n");
+			return 1;
+		}
+		for (size_t j=0; j<len; j++) {
+			((uint8_t*)src_dbs[i].data)[j] = rand();
+		}
+	}
+
+	printf("%-10s %-10s", "src", "dst");
+	for (int level=LDB_SIMD_SCALAR; level<=(int)max_level; level++) {
+		printf(" %8s", ldb_simd_level_to_str(level));
+	}
+	printf("   (GB/s, %dx%d)\n", BENCH_W, BENCH_H);
+
+	for (int s=0; s<LDB_PXFMT_MAX; s++) {
+		if (only_src && strcmp(only_src, fmt_names[s])) {
+			continue;
+		}
+		for (int d=0; d<LDB_PXFMT_MAX; d++) {
+			if (only_dst && strcmp(only_dst, fmt_names[d])) {
+				continue;
+			}
+			printf("%-10s %-10s", fmt_names[s], fmt_names[d]);
+			for (int level=LDB_SIMD_SCALAR; level<=(int)max_level; level++) {
+				ldb_convert_set_level(level);
+				printf(" %8.2f", bench_pair(&src_dbs[s], &dst_dbs[d]));
+				fflush(stdout);
+			}
+			printf("\n");
+		}
+	}
+
+	for (int i=0; i<LDB_PXFMT_MAX; i++) {
+		free(src_dbs[i].data);
+		free(dst_dbs[i].data);
+	}
+	return 0;
+}
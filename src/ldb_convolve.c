@@ -0,0 +1,531 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "lua.h"
+
+#include "ldb.h"
+#include "ldb_convert.h"
+#include "ldb_threads.h"
+#include "ldb_convolve.h"
+
+// Convolution and morphology.
+// The region of the source is first converted into a temporary buffer(in
+// bands, in parallel), so the target can be the source. The target region is
+// then processed in tiles, sized so that the source rows needed for a tile
+// fit in the L1 cache. Tiles are independent, and can run in parallel.
+// Convolution kernels are quantized to 16 bit fixed-point weights with as many
+// fractional bits as fit.
+// If the kernel is the product of a column and a row(rank 1, e.g. a gaussian
+// or a sobel kernel) it is separable: The rows are filtered horizontally into
+// 16 bit intermediate values, that are then filtered vertically. This needs
+// kw+kh instead of kw*kh multiplications for each channel.
+// Convolution works on the pixels as they are stored in the target: the source
+// is premultiplied or unpremultiplied when it is loaded if its pixel format
+// differs from the target's.
+// Morphology works on 8 bit values(1bpp drawbuffers are converted). Each row
+// of a structuring element is a horizontal span, so a row of the result is
+// the minimum(maximum) of the source rows filtered horizontally by the span
+// of the corresponding row. Each span width is only computed once per row.
+
+// number of rows in a band when converting the source region
+#define CONV_BAND_H 32
+
+// size of a tile for convolution and morphology. Tiles start at multiples of the
+// tile width in the target, so two tiles never write to the same byte.
+#define CONV_TILE_W 128
+#define CONV_TILE_H 16
+#define MORPH_TILE_W 256
+#define MORPH_TILE_H 16
+
+// maximum number of fractional bits of the weights
+#define CONV_MAX_BITS 16
+
+// maximum number of weights(kernel size rounded up to even for the SIMD kernels)
+#define CONV_MAX_TAPS (LDB_CONVOLVE_MAX_SIZE*LDB_CONVOLVE_MAX_SIZE+1)
+
+static const char* edge_names[LDB_EDGE_MAX] = { "clamp", "wrap", "zero" };
+static const char* shape_names[LDB_MORPH_MAX] = { "rect", "cross", "ellipse" };
+
+// source region, converted to a temporary buffer
+typedef struct {
+	const drawbuffer_t* src_db;
+	int x, y, w, h;
+	uint8_t* tmp; // w*h pixels in tmp_fmt
+	PIX_FMT src_fmt; // pixel format the source rows are read as
+	PIX_FMT tmp_fmt;
+	int px_size; // bytes per pixel in tmp
+	int opaque; // set the alpha values to 255(source format without alpha)
+	int premultiply; // premultiply the pixels(straight source, premultiplied target)
+} region_t;
+
+typedef struct {
+	region_t src;
+	const drawbuffer_t* dst_db;
+	LDB_EDGE edge;
+	int kw, kh;
+	int tile_x, tiles_x; // x offset of the first tile relative to the region(<= 0), tiles per row
+	int keep_alpha; // only the r,g,b channels are convolved
+	int separable;
+	// non-separable kernel
+	int16_t weights[CONV_MAX_TAPS];
+	int taps, shift;
+	int32_t offset;
+	// separable kernel: horizontal pass into 16 bit intermediate values, then vertical pass
+	int16_t h_weights[LDB_CONVOLVE_MAX_SIZE+1];
+	int16_t v_weights[LDB_CONVOLVE_MAX_SIZE+1];
+	int h_taps, h_shift, v_taps, v_shift;
+	int32_t h_offset, v_offset;
+	int failed;
+} conv_job_t;
+
+typedef struct {
+	region_t src;
+	const drawbuffer_t* dst_db;
+	LDB_EDGE edge;
+	int dilate;
+	int kw, kh;
+	int tile_x, tiles_x;
+	int span_index[LDB_CONVOLVE_MAX_SIZE]; // index in spans for each row of the structuring element
+	int spans[LDB_CONVOLVE_MAX_SIZE]; // distinct half widths of the rows
+	int span_count;
+	int max_span;
+	int failed;
+} morph_job_t;
+
+
+
+// map the coordinate v to 0..len-1 using the edge mode, or return -1 for a transparent black pixel
+static inline int edge_map(int v, int len, LDB_EDGE edge) {
+	if ((v >= 0) && (v < len)) {
+		return v;
+	}
+	switch (edge) {
+		case LDB_EDGE_WRAP:
+			v %= len;
+			return (v < 0) ? v+len : v;
+		case LDB_EDGE_ZERO:
+			return -1;
+		default:
+			return (v < 0) ? 0 : len-1;
+	}
+}
+
+// convert the rows of a band of the source region
+static void region_load_band(void* arg, int index) {
+	region_t* src = (region_t*)arg;
+	int y0 = index*CONV_BAND_H;
+	int y1 = (y0+CONV_BAND_H < src->h) ? y0+CONV_BAND_H : src->h;
+	for (int y=y0; y<y1; y++) {
+		uint8_t* row = src->tmp + (size_t)y*src->w*src->px_size;
+		ldb_convert_row(db_get_row_ptr(src->src_db, src->y+y), src->x, src->src_fmt, row, 0, src->tmp_fmt, src->w);
+		if (src->opaque) {
+			set_row_opaque((uint32_t*)row, src->w);
+		} else if (src->premultiply) {
+			uint32_t* px = (uint32_t*)row;
+			for (int i=0; i<src->w; i++) {
+				px[i] = premultiply_pixel(px[i]);
+			}
+		}
+	}
+}
+
+// clip the region to both drawbuffers and convert it to tmp_fmt. Returns 0 on allocation failure.
+static int region_load(region_t* src, const drawbuffer_t* dst_db, int x, int y, int w, int h, PIX_FMT tmp_fmt, int num_threads) {
+	const drawbuffer_t* src_db = src->src_db;
+	src->x = (x < 0) ? 0 : x;
+	src->y = (y < 0) ? 0 : y;
+	int x1 = (int64_t)x+w, y1 = (int64_t)y+h;
+	x1 = (x1 > src_db->w) ? src_db->w : x1;
+	x1 = (x1 > dst_db->w) ? dst_db->w : x1;
+	y1 = (y1 > src_db->h) ? src_db->h : y1;
+	y1 = (y1 > dst_db->h) ? dst_db->h : y1;
+	src->w = (x1 > src->x) ? x1-src->x : 0;
+	src->h = (y1 > src->y) ? y1-src->y : 0;
+	if ((src->w == 0) || (src->h == 0)) {
+		return 1;
+	}
+	src->tmp_fmt = tmp_fmt;
+	src->px_size = get_bpp(tmp_fmt)/8;
+	src->tmp = malloc((size_t)src->w*src->h*src->px_size);
+	if (!src->tmp) {
+		return 0;
+	}
+	int bands = (src->h + CONV_BAND_H-1) / CONV_BAND_H;
+	ldb_threads_run(num_threads, bands, region_load_band, src);
+	return 1;
+}
+
+// quantize n weights to 16 bit fixed-point with the largest number of fractional bits(up to max_bits)
+// that keeps them in range. The rounding error of the sum is added to the largest weight, so e.g. a
+// kernel that sums up to 1 keeps a constant color. Returns the number of bits.
+static int quantize_weights(const double* w, int n, int16_t* q, int max_bits) {
+	double max = 0, sum = 0;
+	int largest = 0;
+	for (int i=0; i<n; i++) {
+		if (fabs(w[i]) > max) {
+			max = fabs(w[i]);
+			largest = i;
+		}
+		sum += w[i];
+	}
+	int bits = max_bits;
+	while ((bits > 0) && (max*(1<<bits) + n > 32767)) {
+		bits--;
+	}
+	int total = 0;
+	for (int i=0; i<n; i++) {
+		q[i] = (int16_t)floor(w[i]*(1<<bits) + 0.5);
+		total += q[i];
+	}
+	q[largest] += (int16_t)((int)floor(sum*(1<<bits) + 0.5) - total);
+	return bits;
+}
+
+// offset for (acc + offset) >> shift to add bias and round to nearest
+static int32_t round_offset(double bias, int shift) {
+	return (int32_t)floor(bias*((int64_t)1<<shift) + 0.5) + ((shift > 0) ? (1<<(shift-1)) : 0);
+}
+
+// try to split the kernel into a column and a row, and set up the separable passes. Returns 0 if not separable.
+static int conv_setup_separable(conv_job_t* job, const double* kernel, double bias) {
+	int kw = job->kw, kh = job->kh;
+	if ((kw == 1) || (kh == 1)) {
+		return 0;
+	}
+
+	// the largest value is the pivot, so the column values are at most 1
+	int pivot = 0;
+	for (int i=1; i<kw*kh; i++) {
+		pivot = (fabs(kernel[i]) > fabs(kernel[pivot])) ? i : pivot;
+	}
+	double max = fabs(kernel[pivot]);
+	if (max == 0) {
+		return 0;
+	}
+	double row[LDB_CONVOLVE_MAX_SIZE], col[LDB_CONVOLVE_MAX_SIZE];
+	double row_sum = 0, col_sum = 0;
+	for (int i=0; i<kw; i++) {
+		row[i] = kernel[(pivot/kw)*kw + i];
+		row_sum += fabs(row[i]);
+	}
+	for (int j=0; j<kh; j++) {
+		col[j] = kernel[j*kw + pivot%kw] / kernel[pivot];
+		col_sum += fabs(col[j]);
+	}
+	for (int j=0; j<kh; j++) {
+		for (int i=0; i<kw; i++) {
+			if (fabs(kernel[j*kw+i] - col[j]*row[i]) > max*1e-6) {
+				return 0;
+			}
+		}
+	}
+
+	// the intermediate values have f fractional bits, and must fit in 16 bit
+	int f = CONV_MAX_BITS;
+	while ((f >= 0) && (255*row_sum*(1<<f) > 32000)) {
+		f--;
+	}
+	int h_bits = quantize_weights(row, kw, job->h_weights, CONV_MAX_BITS);
+	f = (f > h_bits) ? h_bits : f;
+	if (f < 0) {
+		return 0;
+	}
+
+	// the vertical sums(and the bias) must fit in 32 bit
+	int v_bits = CONV_MAX_BITS;
+	while ((v_bits >= 0) && ((col_sum*(1<<v_bits) + kh)*32768.0 + fabs(bias)*((int64_t)1<<(v_bits+f)) > 2147483647.0)) {
+		v_bits--;
+	}
+	if (v_bits < 0) {
+		return 0;
+	}
+	v_bits = quantize_weights(col, kh, job->v_weights, v_bits);
+
+	job->h_taps = (kw+1) & ~1;
+	job->h_weights[kw] = 0;
+	job->h_shift = h_bits-f;
+	job->h_offset = round_offset(0, job->h_shift);
+	job->v_taps = (kh+1) & ~1;
+	job->v_weights[kh] = 0;
+	job->v_shift = v_bits+f;
+	job->v_offset = round_offset(bias, job->v_shift);
+	return 1;
+}
+
+// convolve a tile of the target region
+static void conv_tile(void* arg, int index) {
+	conv_job_t* job = (conv_job_t*)arg;
+	const region_t* src = &job->src;
+	int kw = job->kw, kh = job->kh;
+	int x0 = job->tile_x + (index % job->tiles_x)*CONV_TILE_W;
+	int x1 = (x0+CONV_TILE_W < src->w) ? x0+CONV_TILE_W : src->w;
+	x0 = (x0 < 0) ? 0 : x0;
+	int y0 = (index / job->tiles_x)*CONV_TILE_H;
+	int y1 = (y0+CONV_TILE_H < src->h) ? y0+CONV_TILE_H : src->h;
+	int n = x1-x0, rows_n = y1-y0;
+	int src_w = n+kw-1, src_rows = rows_n+kh-1;
+
+	// source pixels for the tile, output row, intermediate values of the separable passes(4 16 bit channels)
+	uint32_t* in = malloc(((size_t)src_rows*src_w + n)*sizeof(uint32_t) + (job->separable ? (size_t)src_rows*n*4*sizeof(int16_t) : 0));
+	if (!in) {
+		__atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	uint32_t* out = in + (size_t)src_rows*src_w;
+	int16_t* inter = (int16_t*)(out + n);
+
+	const uint32_t* tmp = (const uint32_t*)src->tmp;
+	int sx0 = x0-kw/2;
+	for (int r=0; r<src_rows; r++) {
+		uint32_t* row = in + (size_t)r*src_w;
+		int sy = edge_map(y0-kh/2+r, src->h, job->edge);
+		if (sy < 0) {
+			memset(row, 0, src_w*sizeof(uint32_t));
+			continue;
+		}
+		const uint32_t* src_row = tmp + (size_t)sy*src->w;
+		if ((sx0 >= 0) && (sx0+src_w <= src->w)) {
+			memcpy(row, src_row+sx0, src_w*sizeof(uint32_t));
+		} else {
+			for (int i=0; i<src_w; i++) {
+				int sx = edge_map(sx0+i, src->w, job->edge);
+				row[i] = (sx < 0) ? 0 : src_row[sx];
+			}
+		}
+	}
+
+	const uint32_t* rows[CONV_MAX_TAPS];
+	const int16_t* inter_rows[LDB_CONVOLVE_MAX_SIZE+1];
+	if (job->separable) {
+		rows[job->h_taps-1] = in;
+		for (int r=0; r<src_rows; r++) {
+			for (int i=0; i<kw; i++) {
+				rows[i] = in + (size_t)r*src_w + i;
+			}
+			ldb_conv_row_to_s16(inter + (size_t)r*n*4, rows, job->h_weights, job->h_taps, job->h_shift, job->h_offset, n);
+		}
+		inter_rows[job->v_taps-1] = inter;
+	}
+
+	rows[job->taps-1] = in;
+	for (int y=0; y<rows_n; y++) {
+		if (job->separable) {
+			for (int j=0; j<kh; j++) {
+				inter_rows[j] = inter + (size_t)(y+j)*n*4;
+			}
+			ldb_conv_row_from_s16(out, inter_rows, job->v_weights, job->v_taps, job->v_shift, job->v_offset, n);
+		} else {
+			for (int j=0; j<kh; j++) {
+				for (int i=0; i<kw; i++) {
+					rows[j*kw+i] = in + (size_t)(y+j)*src_w + i;
+				}
+			}
+			ldb_conv_row(out, rows, job->weights, job->taps, job->shift, job->offset, n);
+		}
+
+		if (job->keep_alpha) {
+			const uint32_t* center = in + (size_t)(y+kh/2)*src_w + kw/2;
+			for (int i=0; i<n; i++) {
+				out[i] = (out[i] & 0xffffff00) | (center[i] & 0xff);
+			}
+		}
+		if (is_premultiplied(job->dst_db->pxfmt)) {
+			for (int i=0; i<n; i++) {
+				uint32_t p = out[i], a = p & 0xff;
+				uint32_t cr = p>>24, cg = (p>>16) & 0xff, cb = (p>>8) & 0xff;
+				out[i] = (((cr>a)?a:cr)<<24) | (((cg>a)?a:cg)<<16) | (((cb>a)?a:cb)<<8) | a;
+			}
+		}
+		ldb_convert_row((const uint8_t*)out, 0, LDB_PXFMT_32BPP_INTERNAL, db_get_row_ptr(job->dst_db, src->y+y0+y), src->x+x0, get_straight_pxfmt(job->dst_db->pxfmt), n);
+	}
+
+	free(in);
+}
+
+// erode or dilate a tile of the target region
+static void morph_tile(void* arg, int index) {
+	morph_job_t* job = (morph_job_t*)arg;
+	const region_t* src = &job->src;
+	int kh = job->kh, pad = job->max_span;
+	int x0 = job->tile_x + (index % job->tiles_x)*MORPH_TILE_W;
+	int x1 = (x0+MORPH_TILE_W < src->w) ? x0+MORPH_TILE_W : src->w;
+	x0 = (x0 < 0) ? 0 : x0;
+	int y0 = (index / job->tiles_x)*MORPH_TILE_H;
+	int y1 = (y0+MORPH_TILE_H < src->h) ? y0+MORPH_TILE_H : src->h;
+	int n = x1-x0, rows_n = y1-y0;
+	int src_rows = rows_n+kh-1;
+
+	// a padded source row, the rows filtered horizontally for each span, output row
+	uint8_t* in = malloc((n+2*pad) + (size_t)job->span_count*src_rows*n + n);
+	if (!in) {
+		__atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	uint8_t* spans = in + n+2*pad;
+	uint8_t* out = spans + (size_t)job->span_count*src_rows*n;
+
+	const uint8_t* rows[2*LDB_CONVOLVE_MAX_SIZE];
+	int sx0 = x0-pad;
+	for (int r=0; r<src_rows; r++) {
+		int sy = edge_map(y0-kh/2+r, src->h, job->edge);
+		if (sy < 0) {
+			memset(in, 0, n+2*pad);
+		} else {
+			const uint8_t* src_row = src->tmp + (size_t)sy*src->w;
+			if ((sx0 >= 0) && (sx0+n+2*pad <= src->w)) {
+				memcpy(in, src_row+sx0, n+2*pad);
+			} else {
+				for (int i=0; i<n+2*pad; i++) {
+					int sx = edge_map(sx0+i, src->w, job->edge);
+					in[i] = (sx < 0) ? 0 : src_row[sx];
+				}
+			}
+		}
+		for (int s=0; s<job->span_count; s++) {
+			int a = job->spans[s];
+			for (int k=0; k<=2*a; k++) {
+				rows[k] = in + pad-a+k;
+			}
+			ldb_morph_row(spans + ((size_t)s*src_rows + r)*n, rows, 2*a+1, job->dilate, n);
+		}
+	}
+
+	for (int y=0; y<rows_n; y++) {
+		for (int j=0; j<kh; j++) {
+			rows[j] = spans + ((size_t)job->span_index[j]*src_rows + y+j)*n;
+		}
+		ldb_morph_row(out, rows, kh, job->dilate, n);
+		// the gray value is a straight pixel, premultiplied for premultiplied targets
+		ldb_convert_row(out, 0, LDB_PXFMT_8BPP, db_get_row_ptr(job->dst_db, src->y+y0+y), src->x+x0, job->dst_db->pxfmt, n);
+	}
+
+	free(in);
+}
+
+
+
+LDB_EDGE ldb_edge_from_str(const char* str) {
+	for (int i=0; i<LDB_EDGE_MAX; i++) {
+		if (strcmp(str, edge_names[i])==0) {
+			return (LDB_EDGE)i;
+		}
+	}
+	return LDB_EDGE_MAX;
+}
+
+LDB_MORPH_SHAPE ldb_morph_shape_from_str(const char* str) {
+	for (int i=0; i<LDB_MORPH_MAX; i++) {
+		if (strcmp(str, shape_names[i])==0) {
+			return (LDB_MORPH_SHAPE)i;
+		}
+	}
+	return LDB_MORPH_MAX;
+}
+
+int ldb_convolve(const drawbuffer_t* src_db, const drawbuffer_t* dst_db, int x, int y, int w, int h, const double* kernel, int kw, int kh, double bias, LDB_EDGE edge, int num_threads) {
+	if ((!src_db->data) || (!dst_db->data) || (w <= 0) || (h <= 0) || (edge >= LDB_EDGE_MAX)) {
+		return 1;
+	}
+	if ((kw < 1) || (kh < 1) || (kw > LDB_CONVOLVE_MAX_SIZE) || (kh > LDB_CONVOLVE_MAX_SIZE) || (!(kw & 1)) || (!(kh & 1))) {
+		return 1;
+	}
+	bias = (bias < -LDB_CONVOLVE_MAX_BIAS) ? -LDB_CONVOLVE_MAX_BIAS : ((bias > LDB_CONVOLVE_MAX_BIAS) ? LDB_CONVOLVE_MAX_BIAS : bias);
+
+	conv_job_t* job = calloc(1, sizeof(conv_job_t));
+	if (!job) {
+		return 0;
+	}
+	job->dst_db = dst_db;
+	job->edge = edge;
+	job->kw = kw;
+	job->kh = kh;
+
+	// grayscale formats store the gray value as alpha, formats without alpha are opaque
+	PIX_FMT fmt = src_db->pxfmt;
+	job->keep_alpha = (fmt != LDB_PXFMT_1BPP) && (fmt != LDB_PXFMT_8BPP);
+	job->src.opaque = !has_alpha(fmt);
+
+	// the kernel is applied to the pixels as they are stored in the target, so a premultiplied
+	// source is unpremultiplied for a straight target, and a straight source is premultiplied for
+	// a premultiplied target.
+	int dst_premul = is_premultiplied(dst_db->pxfmt);
+	job->src.src_fmt = (is_premultiplied(fmt) && (!dst_premul)) ? fmt : get_straight_pxfmt(fmt);
+	job->src.premultiply = (!is_premultiplied(fmt)) && dst_premul;
+
+	job->separable = conv_setup_separable(job, kernel, bias);
+	if (!job->separable) {
+		job->shift = quantize_weights(kernel, kw*kh, job->weights, CONV_MAX_BITS);
+		job->offset = round_offset(bias, job->shift);
+		job->taps = (kw*kh+1) & ~1;
+		job->weights[kw*kh] = 0;
+	}
+	// unused, but the padding tap of the other pass is always set
+	job->taps = job->taps ? job->taps : 2;
+
+	job->src.src_db = src_db;
+	if (!region_load(&job->src, dst_db, x, y, w, h, LDB_PXFMT_32BPP_INTERNAL, num_threads)) {
+		free(job);
+		return 0;
+	}
+	if (job->src.tmp) {
+		job->tile_x = (job->src.x / CONV_TILE_W)*CONV_TILE_W - job->src.x;
+		job->tiles_x = (job->src.w - job->tile_x + CONV_TILE_W-1) / CONV_TILE_W;
+		int tiles_y = (job->src.h + CONV_TILE_H-1) / CONV_TILE_H;
+		ldb_threads_run(num_threads, job->tiles_x*tiles_y, conv_tile, job);
+	}
+
+	int ok = !job->failed;
+	free(job->src.tmp);
+	free(job);
+	return ok;
+}
+
+int ldb_morphology(const drawbuffer_t* src_db, const drawbuffer_t* dst_db, int x, int y, int w, int h, int dilate, int kw, int kh, LDB_MORPH_SHAPE shape, LDB_EDGE edge, int num_threads) {
+	if ((!src_db->data) || (!dst_db->data) || (w <= 0) || (h <= 0) || (edge >= LDB_EDGE_MAX) || (shape >= LDB_MORPH_MAX)) {
+		return 1;
+	}
+	if ((kw < 1) || (kh < 1) || (kw > LDB_CONVOLVE_MAX_SIZE) || (kh > LDB_CONVOLVE_MAX_SIZE) || (!(kw & 1)) || (!(kh & 1))) {
+		return 1;
+	}
+
+	morph_job_t job = { .dst_db = dst_db, .edge = edge, .dilate = dilate, .kw = kw, .kh = kh };
+
+	// half width of each row of the structuring element. The ellipse contains the pixels
+	// with (i/(kw/2+0.5))^2 + (j/(kh/2+0.5))^2 <= 1.
+	for (int j=0; j<kh; j++) {
+		int a = kw/2;
+		if (shape == LDB_MORPH_CROSS) {
+			a = (j == kh/2) ? kw/2 : 0;
+		} else if (shape == LDB_MORPH_ELLIPSE) {
+			double dy = (j-kh/2) / (kh/2+0.5);
+			a = (int)floor((kw/2+0.5)*sqrt(1-dy*dy));
+			a = (a > kw/2) ? kw/2 : a;
+		}
+		int s = 0;
+		while ((s < job.span_count) && (job.spans[s] != a)) {
+			s++;
+		}
+		if (s == job.span_count) {
+			job.spans[job.span_count++] = a;
+		}
+		job.span_index[j] = s;
+		job.max_span = (a > job.max_span) ? a : job.max_span;
+	}
+
+	job.src.src_db = src_db;
+	job.src.src_fmt = get_straight_pxfmt(src_db->pxfmt);
+	if (!region_load(&job.src, dst_db, x, y, w, h, LDB_PXFMT_8BPP, num_threads)) {
+		return 0;
+	}
+	if (job.src.tmp) {
+		job.tile_x = (job.src.x / MORPH_TILE_W)*MORPH_TILE_W - job.src.x;
+		job.tiles_x = (job.src.w - job.tile_x + MORPH_TILE_W-1) / MORPH_TILE_W;
+		int tiles_y = (job.src.h + MORPH_TILE_H-1) / MORPH_TILE_H;
+		ldb_threads_run(num_threads, job.tiles_x*tiles_y, morph_tile, &job);
+	}
+
+	free(job.src.tmp);
+	return !job.failed;
+}
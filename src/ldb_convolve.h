@@ -0,0 +1,54 @@
+#ifndef LUA_LDB_CONVOLVE_H
+#define LUA_LDB_CONVOLVE_H
+
+#include "ldb.h"
+
+// maximum width and height of a convolution kernel or structuring element
+#define LDB_CONVOLVE_MAX_SIZE 9
+
+// maximum absolute value of a convolution kernel value(after dividing by the divisor)
+#define LDB_CONVOLVE_MAX_VALUE 16384
+
+// maximum absolute value of the bias added to a convolved value
+#define LDB_CONVOLVE_MAX_BIAS 1024
+
+// how pixels outside of the filtered region are handled
+typedef enum {
+	LDB_EDGE_CLAMP, // repeat the pixels at the edge
+	LDB_EDGE_WRAP, // repeat the region
+	LDB_EDGE_ZERO, // transparent black
+
+	LDB_EDGE_MAX,
+} LDB_EDGE;
+
+// structuring elements for morphology
+typedef enum {
+	LDB_MORPH_RECT,
+	LDB_MORPH_CROSS,
+	LDB_MORPH_ELLIPSE,
+
+	LDB_MORPH_MAX,
+} LDB_MORPH_SHAPE;
+
+// get an edge mode by name("clamp", "wrap", "zero"). Returns LDB_EDGE_MAX if unknown.
+LDB_EDGE ldb_edge_from_str(const char* str);
+
+// get a structuring element shape by name("rect", "cross", "ellipse"). Returns LDB_MORPH_MAX if unknown.
+LDB_MORPH_SHAPE ldb_morph_shape_from_str(const char* str);
+
+// convolve the region x,y,w,h of src_db with the kw*kh kernel(row-major, kw and kh odd and at most LDB_CONVOLVE_MAX_SIZE),
+// add bias, and store the result in the same region of dst_db(can be src_db), using up to num_threads threads.
+// The r,g,b channels are convolved and the alpha values kept, except for grayscale formats(1bpp, 8bpp).
+// The kernel values must be at most LDB_CONVOLVE_MAX_VALUE, and are quantized to 16 bit fixed-point.
+// The region is clipped to both drawbuffers, pixels outside of it are handled according to edge.
+// Returns 0 if memory could not be allocated.
+int ldb_convolve(const drawbuffer_t* src_db, const drawbuffer_t* dst_db, int x, int y, int w, int h, const double* kernel, int kw, int kh, double bias, LDB_EDGE edge, int num_threads);
+
+// erode(or dilate if dilate is set) the region x,y,w,h of src_db(1bpp or 8bpp) with a kw*kh structuring element,
+// and store the result in the same region of dst_db(can be src_db), using up to num_threads threads.
+// Each result pixel is the minimum(maximum) of the pixels covered by the structuring element.
+// kw and kh must be odd and at most LDB_CONVOLVE_MAX_SIZE. Returns 0 if memory could not be allocated.
+int ldb_morphology(const drawbuffer_t* src_db, const drawbuffer_t* dst_db, int x, int y, int w, int h, int dilate, int kw, int kh, LDB_MORPH_SHAPE shape, LDB_EDGE edge, int num_threads);
+
+
+#endif
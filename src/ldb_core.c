@@ -1,11 +1,14 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "lua.h"
 #include "lauxlib.h"
 
 #include "ldb.h"
+#include "ldb_convert.h"
+#include "ldb_pool.h"
 
 
 
@@ -18,6 +21,138 @@
 
 
 
+// Pixel memory owned by drawbuffers is invisible to the Lua GC(a drawbuffer
+// userdata is only a few bytes), so it is tracked here per pixel format, and
+// reported to the GC on allocation.
+typedef struct {
+	size_t bytes;
+	size_t peak_bytes;
+} memory_stats_t;
+
+static pthread_mutex_t memory_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static memory_stats_t memory_stats_total;
+static memory_stats_t memory_stats_fmt[LDB_PXFMT_MAX];
+
+// add len bytes of pixel memory of the pixel format to the statistics
+static void memory_stats_add(PIX_FMT fmt, size_t len) {
+	pthread_mutex_lock(&memory_stats_mutex);
+	memory_stats_t* fmt_stats = &memory_stats_fmt[fmt];
+	fmt_stats->bytes += len;
+	fmt_stats->peak_bytes = (fmt_stats->bytes > fmt_stats->peak_bytes) ? fmt_stats->bytes : fmt_stats->peak_bytes;
+	memory_stats_total.bytes += len;
+	memory_stats_total.peak_bytes = (memory_stats_total.bytes > memory_stats_total.peak_bytes) ? memory_stats_total.bytes : memory_stats_total.peak_bytes;
+	pthread_mutex_unlock(&memory_stats_mutex);
+}
+
+// remove len bytes of pixel memory of the pixel format from the statistics
+static void memory_stats_sub(PIX_FMT fmt, size_t len) {
+	pthread_mutex_lock(&memory_stats_mutex);
+	memory_stats_t* fmt_stats = &memory_stats_fmt[fmt];
+	fmt_stats->bytes = (fmt_stats->bytes > len) ? fmt_stats->bytes-len : 0;
+	memory_stats_total.bytes = (memory_stats_total.bytes > len) ? memory_stats_total.bytes-len : 0;
+	pthread_mutex_unlock(&memory_stats_mutex);
+}
+
+// close function for drawbuffers with pixel memory from the pool.
+// Every module links its own copy of the pool and the statistics, and the drawbuffer
+// metatable(with __gc) might be registered by any of them, so the memory is returned
+// using this function, which always belongs to the module that allocated it.
+static void pool_db_close_func(void* data) {
+	drawbuffer_t *db = (drawbuffer_t *)data;
+	if (!db->data) {
+		return;
+	}
+	size_t len = get_data_size(db->pxfmt, db->w, db->h);
+	ldb_pool_free(db->data, len);
+	memory_stats_sub(db->pxfmt, len);
+	db->data = NULL;
+}
+
+
+
+// get the area of a rectangle
+static inline int64_t rect_area(db_rect_t r) {
+	return (int64_t)(r.x1-r.x0)*(int64_t)(r.y1-r.y0);
+}
+
+// get the smallest rectangle containing both rectangles
+static inline db_rect_t rect_union(db_rect_t a, db_rect_t b) {
+	return (db_rect_t){
+		(a.x0<b.x0) ? a.x0 : b.x0,
+		(a.y0<b.y0) ? a.y0 : b.y0,
+		(a.x1>b.x1) ? a.x1 : b.x1,
+		(a.y1>b.y1) ? a.y1 : b.y1
+	};
+}
+
+// clip a rectangle to the dimensions w,h. Returns 0 if nothing is left.
+static inline int rect_clip(db_rect_t* r, int w, int h) {
+	r->x0 = (r->x0<0) ? 0 : r->x0;
+	r->y0 = (r->y0<0) ? 0 : r->y0;
+	r->x1 = (r->x1>w) ? w : r->x1;
+	r->y1 = (r->y1>h) ? h : r->y1;
+	return (r->x0<r->x1) && (r->y0<r->y1);
+}
+
+// add a rectangle to a damage region.
+// A rectangle is merged with an existing one if that doesn't cover more pixels than both(overlapping or adjacent),
+// or if the list is full(with the one that grows the least).
+static void damage_add(db_damage_t* damage, db_rect_t r) {
+	while (1) {
+		int best = -1;
+		int64_t best_extra = INT64_MAX;
+		for (int i=0; i<damage->count; i++) {
+			db_rect_t u = rect_union(damage->rects[i], r);
+			int64_t u_area = rect_area(u);
+			if (u_area == rect_area(damage->rects[i])) {
+				// already covered
+				return;
+			}
+			int64_t extra = u_area - rect_area(damage->rects[i]) - rect_area(r);
+			if (extra < best_extra) {
+				best_extra = extra;
+				best = i;
+			}
+		}
+		if ((best < 0) || ((best_extra > 0) && (damage->count < LDB_DAMAGE_MAX_RECTS))) {
+			damage->rects[damage->count++] = r;
+			return;
+		}
+		// merge with the best rectangle, and try to add the merged rectangle again
+		r = rect_union(damage->rects[best], r);
+		damage->rects[best] = damage->rects[--damage->count];
+	}
+}
+
+void db_add_damage_rect(drawbuffer_t* db, int x, int y, int w, int h) {
+	db_rect_t r = { x, y, x+w, y+h };
+	if (!rect_clip(&r, db->w, db->h)) {
+		return;
+	}
+	if (db->damage.enabled) {
+		damage_add(&db->damage, r);
+	}
+
+	drawbuffer_t* parent = db->parent;
+	if (parent && parent->damage.enabled) {
+		// translate to parent coordinates using the offset of the view memory in the parent memory
+		ptrdiff_t offset = (uint8_t*)db->data - (uint8_t*)parent->data;
+		if ((parent->stride == db->stride) && (parent->pxfmt == db->pxfmt) && (offset >= 0)) {
+			int off_y = offset / parent->stride;
+			int off_x = ((offset % parent->stride)*8) / get_bpp(parent->pxfmt);
+			r = (db_rect_t){ r.x0+off_x, r.y0+off_y, r.x1+off_x, r.y1+off_y };
+		} else {
+			// unknown memory layout
+			r = (db_rect_t){ 0, 0, parent->w, parent->h };
+		}
+		if (rect_clip(&r, parent->w, parent->h)) {
+			damage_add(&parent->damage, r);
+		}
+	}
+}
+
+
+
 // get the cannoncial string representing the pixel format
 static const char* pixel_format_to_str(PIX_FMT fmt) {
 	switch(fmt) {
@@ -32,6 +167,8 @@ static const char* pixel_format_to_str(PIX_FMT fmt) {
 		case LDB_PXFMT_32BPP_ARGB: return "argb8888";
 		case LDB_PXFMT_32BPP_ABGR: return "abgr8888";
 		case LDB_PXFMT_32BPP_BGRA: return "bgra8888";
+		case LDB_PXFMT_32BPP_RGBA_PREMUL: return "rgba8888_premul";
+		case LDB_PXFMT_32BPP_BGRA_PREMUL: return "bgra8888_premul";
 		default: return "Unknown";
 	}
 }
@@ -49,6 +186,8 @@ static PIX_FMT str_to_pixel_format(const char* str) {
 	else if (strcmp(str, "argb8888")==0) { return LDB_PXFMT_32BPP_ARGB; }
 	else if (strcmp(str, "abgr8888")==0) { return LDB_PXFMT_32BPP_ABGR; }
 	else if (strcmp(str, "bgra8888")==0) { return LDB_PXFMT_32BPP_BGRA; }
+	else if (strcmp(str, "rgba8888_premul")==0) { return LDB_PXFMT_32BPP_RGBA_PREMUL; }
+	else if (strcmp(str, "bgra8888_premul")==0) { return LDB_PXFMT_32BPP_BGRA_PREMUL; }
 	return LDB_PXFMT_MAX;
 }
 
@@ -100,6 +239,12 @@ static int lua_drawbuffer_tostring(lua_State *L) {
 		case LDB_PXFMT_32BPP_BGRA:
 			lua_pushfstring(L, "32bpp BGRA Drawbuffer: %dx%d", db->w, db->h);
 			return 1;
+		case LDB_PXFMT_32BPP_RGBA_PREMUL:
+			lua_pushfstring(L, "32bpp premultiplied RGBA Drawbuffer: %dx%d", db->w, db->h);
+			return 1;
+		case LDB_PXFMT_32BPP_BGRA_PREMUL:
+			lua_pushfstring(L, "32bpp premultiplied BGRA Drawbuffer: %dx%d", db->w, db->h);
+			return 1;
 		default:
 			lua_pushfstring(L, "Unknown Drawbuffer: %dx%d", db->w, db->h);
 			return 1;
@@ -150,8 +295,8 @@ static int lua_drawbuffer_close(lua_State *L) {
 
 	if (db->close_func) {
 		db->close_func(db);
-	} else if (db->data) {
-		free(db->data);
+	} else {
+		// views don't own the memory
 		db->data = NULL;
 	}
 
@@ -173,7 +318,7 @@ static int lua_drawbuffer_get_px(lua_State *L) {
 		return 0;
 	}
 
-	uint32_t p = get_px(db->data, db->w, x,y, db->pxfmt);
+	uint32_t p = get_px(db->data, db->stride, x,y, db->pxfmt);
 
 	lua_pushinteger(L, unpack_pixel_r(p));
 	lua_pushinteger(L, unpack_pixel_g(p));
@@ -200,7 +345,8 @@ static int lua_drawbuffer_set_px(lua_State *L) {
 	}
 
 	uint32_t p = pack_pixel_rgba(r,g,b,a);
-	set_px(db->data, db->w, x,y, p, db->pxfmt);
+	set_px(db->data, db->stride, x,y, p, db->pxfmt);
+	db_add_damage(db, x,y,1,1);
 
 	lua_pushboolean(L, 1);
 	return 1;
@@ -220,16 +366,29 @@ static int lua_drawbuffer_clear(lua_State *L) {
 
 	uint32_t p = pack_pixel_rgba(r,g,b,a);
 
-	if ( (r==g) && (g==b) && (b==a) && (db->pxfmt>=LDB_PXFMT_24BPP_RGB) ) {
-		// fastpath
-		memset(db->data, r, get_data_size(db->pxfmt, db->w, db->h));
+	if ( (r==g) && (g==b) && (b==a) && (db->pxfmt>=LDB_PXFMT_24BPP_RGB) && (!is_premultiplied(db->pxfmt)) ) {
+		// fastpath(premultiplied formats store different r,g,b values)
+		if (db_is_contiguous(db)) {
+			memset(db->data, r, get_data_size(db->pxfmt, db->w, db->h));
+		} else {
+			for (int y = 0; y < db->h; y++) {
+				memset(db_get_row_ptr(db, y), r, get_stride(db->pxfmt, db->w));
+			}
+		}
+	} else if (get_bpp(db->pxfmt) >= 8) {
+		// pack the first row once, then replicate it
+		uint8_t* first_row = db_get_row_ptr(db, 0);
+		size_t row_len = get_stride(db->pxfmt, db->w);
+		fill_row(first_row, 0, db->pxfmt, p, db->w);
+		for (int y = 1; y < db->h; y++) {
+			memcpy(db_get_row_ptr(db, y), first_row, row_len);
+		}
 	} else {
 		for (int y = 0; y < db->h; y++) {
-			for (int x = 0; x < db->w; x++) {
-				set_px(db->data, db->w, x,y, p, db->pxfmt);
-			}
+			fill_row(db_get_row_ptr(db, y), 0, db->pxfmt, p, db->w);
 		}
 	}
+	db_add_damage_all(db);
 
 	lua_pushboolean(L, 1);
 	return 1;
@@ -240,7 +399,28 @@ static int lua_drawbuffer_dump_data(lua_State *L) {
 	drawbuffer_t *db = (drawbuffer_t *)lua_touserdata(L, 1);
 	LUA_LDB_CHECK_DB(L, 1, db)
 
-	lua_pushlstring(L, (char*)db->data, get_data_size(db->pxfmt, db->w, db->h));
+	// the last byte of a 1bpp row can contain pixels right of the drawbuffer(e.g. of the parent of a view)
+	int partial_bits = (get_bpp(db->pxfmt) < 8) ? (db->w % 8) : 0;
+	if (db_is_contiguous(db) && (!partial_bits)) {
+		lua_pushlstring(L, (char*)db->data, get_data_size(db->pxfmt, db->w, db->h));
+		return 1;
+	}
+
+	// copy the rows without the padding
+	luaL_Buffer buf;
+	luaL_buffinit(L, &buf);
+	size_t row_len = get_stride(db->pxfmt, db->w);
+	for (int y=0; y<db->h; y++) {
+		const uint8_t* row = db_get_row_ptr(db, y);
+		if (partial_bits) {
+			char last = row[row_len-1] & ((1<<partial_bits)-1);
+			luaL_addlstring(&buf, (const char*)row, row_len-1);
+			luaL_addlstring(&buf, &last, 1);
+		} else {
+			luaL_addlstring(&buf, (const char*)row, row_len);
+		}
+	}
+	luaL_pushresult(&buf);
 	return 1;
 }
 
@@ -259,7 +439,186 @@ static int lua_drawbuffer_load_data(lua_State *L) {
 		return 2;
 	}
 
-	memcpy(db->data, str, data_len);
+	// only the bits of the pixels inside the drawbuffer are changed in the last byte of a 1bpp row
+	int partial_bits = (get_bpp(db->pxfmt) < 8) ? (db->w % 8) : 0;
+	if (db_is_contiguous(db) && (!partial_bits)) {
+		memcpy(db->data, str, data_len);
+	} else {
+		size_t row_len = get_stride(db->pxfmt, db->w);
+		uint8_t mask = (1<<partial_bits)-1;
+		for (int y=0; y<db->h; y++) {
+			uint8_t* row = db_get_row_ptr(db, y);
+			const uint8_t* src = (const uint8_t*)str+y*row_len;
+			if (partial_bits) {
+				memcpy(row, src, row_len-1);
+				row[row_len-1] = (row[row_len-1] & ~mask) | (src[row_len-1] & mask);
+			} else {
+				memcpy(row, src, row_len);
+			}
+		}
+	}
+	db_add_damage_all(db);
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+// create a drawbuffer that shares the memory of a rectangular region of this drawbuffer.
+// The view keeps a reference to this drawbuffer, so it's not collected while the view is in use.
+static int lua_drawbuffer_view(lua_State *L) {
+	drawbuffer_t *db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	int x = lua_tointeger(L, 2);
+	int y = lua_tointeger(L, 3);
+	int w = luaL_optinteger(L, 4, db->w-x);
+	int h = luaL_optinteger(L, 5, db->h-y);
+
+	if ((x<0) || (y<0) || (w<0) || (h<0) || (x+w>db->w) || (y+h>db->h)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "View region must be inside the drawbuffer!");
+		return 2;
+	}
+	if ((get_bpp(db->pxfmt) < 8) && (x%8 != 0)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "View x coordinate must be a multiple of 8 for this pixel format!");
+		return 2;
+	}
+
+	// a view of a view references the drawbuffer that owns the memory
+	if (db->parent) {
+		lua_getfenv(L, 1);
+		lua_rawgeti(L, -1, 1);
+		lua_remove(L, -2);
+	} else {
+		lua_pushvalue(L, 1);
+	}
+
+	drawbuffer_t *view_db = (drawbuffer_t *)lua_newuserdata(L, sizeof(drawbuffer_t));
+	view_db->w = w;
+	view_db->h = h;
+	view_db->data = db_get_row_ptr(db, y) + (x*get_bpp(db->pxfmt))/8;
+	view_db->pxfmt = db->pxfmt;
+	view_db->close_func = NULL;
+	view_db->close_data = NULL;
+	view_db->stride = db->stride;
+	view_db->parent = db->parent ? db->parent : db;
+	view_db->damage.enabled = 0;
+	view_db->damage.count = 0;
+
+	// reference the parent drawbuffer in the userdata environment
+	lua_newtable(L);
+	lua_pushvalue(L, -3);
+	lua_rawseti(L, -2, 1);
+	lua_setfenv(L, -2);
+
+	lua_set_ldb_meta(L, -2);
+	return 1;
+}
+
+// return the number of bytes between the start of two rows
+static int lua_drawbuffer_stride(lua_State *L) {
+	drawbuffer_t *db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	lua_pushinteger(L, db->stride);
+	return 1;
+}
+
+// return the pixel data pointer(as lightuserdata), the length of the pixel data in bytes and the stride.
+// The pointer is only valid until the drawbuffer is closed.
+static int lua_drawbuffer_get_pointer(lua_State *L) {
+	drawbuffer_t *db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	// the last row of a view might not have a full stride of memory after it
+	size_t len = (db->h>0) ? (size_t)db->stride*(db->h-1) + get_stride(db->pxfmt, db->w) : 0;
+
+	lua_pushlightuserdata(L, db->data);
+	lua_pushinteger(L, len);
+	lua_pushinteger(L, db->stride);
+	return 3;
+}
+
+// convert the pixels of the drawbuffer into the pixel format of the other drawbuffer(of same dimensions)
+static int lua_drawbuffer_convert_into(lua_State *L) {
+	drawbuffer_t *src_db;
+	drawbuffer_t *dst_db;
+	LUA_LDB_CHECK_DB(L, 1, src_db)
+	LUA_LDB_CHECK_DB(L, 2, dst_db)
+
+	if (!ldb_convert_db(src_db, dst_db)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Drawbuffers must have the same dimensions!");
+		return 2;
+	}
+	db_add_damage_all(dst_db);
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// enable or disable recording the changed regions of the drawbuffer.
+// When enabled, the entire drawbuffer is marked as changed.
+static int lua_drawbuffer_track_damage(lua_State *L) {
+	drawbuffer_t *db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	int enable = lua_isnone(L, 2) || lua_toboolean(L, 2);
+	if (enable && !db->damage.enabled) {
+		db->damage.count = 1;
+		db->damage.rects[0] = (db_rect_t){ 0, 0, db->w, db->h };
+	}
+	db->damage.enabled = enable;
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// return a list of rectangles({x=,y=,w=,h=}) that were changed since the damage was reset
+static int lua_drawbuffer_get_damage(lua_State *L) {
+	drawbuffer_t *db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	if (!db->damage.enabled) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Damage tracking is not enabled!");
+		return 2;
+	}
+
+	lua_createtable(L, db->damage.count, 0);
+	for (int i=0; i<db->damage.count; i++) {
+		db_rect_t r = db->damage.rects[i];
+		lua_createtable(L, 0, 4);
+		LUA_T_PUSH_S_I("x", r.x0)
+		LUA_T_PUSH_S_I("y", r.y0)
+		LUA_T_PUSH_S_I("w", r.x1-r.x0)
+		LUA_T_PUSH_S_I("h", r.y1-r.y0)
+		lua_rawseti(L, -2, i+1);
+	}
+	return 1;
+}
+
+// mark the drawbuffer as unchanged
+static int lua_drawbuffer_reset_damage(lua_State *L) {
+	drawbuffer_t *db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	db_reset_damage(db);
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// mark a region of the drawbuffer as changed(e.g. after modifying the memory using get_pointer), default entire drawbuffer
+static int lua_drawbuffer_add_damage(lua_State *L) {
+	drawbuffer_t *db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	int x = luaL_optinteger(L, 2, 0);
+	int y = luaL_optinteger(L, 3, 0);
+	int w = luaL_optinteger(L, 4, db->w-x);
+	int h = luaL_optinteger(L, 5, db->h-y);
+	db_add_damage(db, x,y,w,h);
 
 	lua_pushboolean(L, 1);
 	return 1;
@@ -281,6 +640,14 @@ void lua_set_ldb_meta(lua_State *L, int i) {
 		LUA_T_PUSH_S_CF("clear", lua_drawbuffer_clear)
 		LUA_T_PUSH_S_CF("dump_data", lua_drawbuffer_dump_data)
 		LUA_T_PUSH_S_CF("load_data", lua_drawbuffer_load_data)
+		LUA_T_PUSH_S_CF("convert_into", lua_drawbuffer_convert_into)
+		LUA_T_PUSH_S_CF("view", lua_drawbuffer_view)
+		LUA_T_PUSH_S_CF("stride", lua_drawbuffer_stride)
+		LUA_T_PUSH_S_CF("get_pointer", lua_drawbuffer_get_pointer)
+		LUA_T_PUSH_S_CF("track_damage", lua_drawbuffer_track_damage)
+		LUA_T_PUSH_S_CF("get_damage", lua_drawbuffer_get_damage)
+		LUA_T_PUSH_S_CF("reset_damage", lua_drawbuffer_reset_damage)
+		LUA_T_PUSH_S_CF("add_damage", lua_drawbuffer_add_damage)
 		LUA_T_PUSH_S_CF("close", lua_drawbuffer_close)
 		LUA_T_PUSH_S_CF("tostring", lua_drawbuffer_tostring)
 		lua_settable(L, -3);
@@ -330,11 +697,18 @@ static int lua_new_drawbuffer(lua_State *L) {
 	// determine length of pixel buffer
 	size_t len = get_data_size(fmt, w, h);
 
+	// Let the GC do work proportional to the allocated pixel memory(in KiB),
+	// so that unreferenced drawbuffers are collected before the memory grows.
+	// This is done before allocating, so that collected memory can be reused from the pool.
+	if (len >= 1024) {
+		lua_gc(L, LUA_GCSTEP, (int)(len/1024));
+	}
+
 	// Create new userdata object
 	drawbuffer_t *db = (drawbuffer_t *)lua_newuserdata(L, sizeof(drawbuffer_t));
 
-	// Allocate space for pixels
-	db->data = malloc(len);
+	// Allocate space for pixels(64-byte aligned, recycled from the pool if possible)
+	db->data = ldb_pool_alloc(len);
 
 	// Check if we allocated memory
 	if (db->data == NULL) {
@@ -342,13 +716,18 @@ static int lua_new_drawbuffer(lua_State *L) {
 		lua_pushstring(L, "Can't allocate memory!");
 		return 2;
 	}
+	memory_stats_add(fmt, len);
 
 	// store info about drawbuffer in drawbuffer
 	db->w = w;
 	db->h = h;
 	db->pxfmt = fmt;
-	db->close_func = NULL;
+	db->close_func = &pool_db_close_func;
 	db->close_data = NULL;
+	db->stride = get_stride(fmt, w);
+	db->parent = NULL;
+	db->damage.enabled = 0;
+	db->damage.count = 0;
 
 	// Apply drawbuffer metatable to userdata object
 	lua_set_ldb_meta(L, -2);
@@ -359,16 +738,183 @@ static int lua_new_drawbuffer(lua_State *L) {
 
 
 
+// close function for drawbuffers that don't own their memory
+static void pointer_db_close_func(void* data) {
+	drawbuffer_t *db = (drawbuffer_t *)data;
+	db->data = NULL;
+}
+
+// create a new drawbuffer userdata object for existing pixel memory(e.g. from the LuaJIT FFI).
+// The memory is not copied and not free()'d when the drawbuffer is closed.
+static int lua_new_drawbuffer_from_pointer(lua_State *L) {
+	// pointer can be a lightuserdata or an integer address
+	void* ptr = NULL;
+	if (lua_islightuserdata(L, 1)) {
+		ptr = lua_touserdata(L, 1);
+	} else if (lua_isnumber(L, 1)) {
+		ptr = (void*)(uintptr_t)lua_tonumber(L, 1);
+	}
+	if (!ptr) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Argument 1 must be a pointer(lightuserdata or address)!");
+		return 2;
+	}
+
+	if (!lua_isnumber(L, 2) || !lua_isnumber(L, 3)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Argument 2 and 3 need to be width and height!");
+		return 2;
+	}
+	int w = lua_tointeger(L, 2);
+	int h = lua_tointeger(L, 3);
+	if ((w<0) || (h<0)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "width and height need to be >0");
+		return 2;
+	}
+
+	PIX_FMT fmt = LDB_PXFMT_32BPP_RGBA;
+	if (lua_isstring(L, 4)) {
+		fmt = str_to_pixel_format(lua_tostring(L, 4));
+	} else if (lua_isnumber(L, 4)) {
+		fmt = lua_tonumber(L, 4);
+	}
+	if ((fmt >= LDB_PXFMT_MAX) || (fmt<0)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Unknown format!");
+		return 2;
+	}
+
+	int stride = luaL_optinteger(L, 5, get_stride(fmt, w));
+	if ((stride < 0) || ((size_t)stride < get_stride(fmt, w))) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Stride is too small for width and pixel format!");
+		return 2;
+	}
+
+	// if the memory belongs to a drawbuffer, closing that drawbuffer invalidates this one
+	drawbuffer_t *parent = NULL;
+	if (lua_type(L, 6) == LUA_TUSERDATA) {
+		if (lua_getmetatable(L, 6)) {
+			luaL_getmetatable(L, LDB_UDATA_NAME);
+			if (lua_rawequal(L, -1, -2)) {
+				parent = (drawbuffer_t *)lua_touserdata(L, 6);
+				parent = parent->parent ? parent->parent : parent;
+			}
+			lua_pop(L, 2);
+		}
+	}
+
+	drawbuffer_t *db = (drawbuffer_t *)lua_newuserdata(L, sizeof(drawbuffer_t));
+	db->w = w;
+	db->h = h;
+	db->data = ptr;
+	db->pxfmt = fmt;
+	db->close_func = &pointer_db_close_func;
+	db->close_data = NULL;
+	db->stride = stride;
+	db->parent = parent;
+	db->damage.enabled = 0;
+	db->damage.count = 0;
+
+	// reference the keepalive value in the userdata environment, so it's not collected while the drawbuffer exists
+	lua_newtable(L);
+	lua_pushvalue(L, 6);
+	lua_rawseti(L, -2, 1);
+	lua_setfenv(L, -2);
+
+	lua_set_ldb_meta(L, -2);
+	return 1;
+}
+
+
+
+// return a table with statistics about the drawbuffer memory pool
+static int lua_pool_stats(lua_State *L) {
+	ldb_pool_stats_t stats;
+	ldb_pool_get_stats(&stats);
+
+	lua_newtable(L);
+	LUA_T_PUSH_S_N("hits", stats.hits)
+	LUA_T_PUSH_S_N("misses", stats.misses)
+	LUA_T_PUSH_S_N("hit_rate", (stats.hits+stats.misses) ? (double)stats.hits/(double)(stats.hits+stats.misses) : 0)
+	LUA_T_PUSH_S_N("bytes_held", stats.bytes_held)
+	LUA_T_PUSH_S_N("bytes_in_use", stats.bytes_in_use)
+	LUA_T_PUSH_S_N("max_bytes_held", stats.max_bytes_held)
+	return 1;
+}
+
+// return a table with the current and peak number of bytes of pixel memory owned by drawbuffers, in total and per pixel format
+static int lua_memory_stats(lua_State *L) {
+	memory_stats_t total;
+	memory_stats_t fmt_stats[LDB_PXFMT_MAX];
+	pthread_mutex_lock(&memory_stats_mutex);
+	total = memory_stats_total;
+	memcpy(fmt_stats, memory_stats_fmt, sizeof(fmt_stats));
+	pthread_mutex_unlock(&memory_stats_mutex);
+
+	lua_newtable(L);
+	LUA_T_PUSH_S_N("bytes", total.bytes)
+	LUA_T_PUSH_S_N("peak_bytes", total.peak_bytes)
+
+	lua_pushstring(L, "formats");
+	lua_newtable(L);
+	for (int i=0; i<LDB_PXFMT_MAX; i++) {
+		lua_pushstring(L, pixel_format_to_str(i));
+		lua_newtable(L);
+		LUA_T_PUSH_S_N("bytes", fmt_stats[i].bytes)
+		LUA_T_PUSH_S_N("peak_bytes", fmt_stats[i].peak_bytes)
+		lua_settable(L, -3);
+	}
+	lua_settable(L, -3);
+
+	return 1;
+}
+
+// set the maximum number of bytes kept in the memory pool for reuse(0 disables reuse)
+static int lua_pool_set_max_held(lua_State *L) {
+	lua_Number max_held = luaL_checknumber(L, 1);
+	if (max_held < 0) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Argument 1 must be >=0");
+		return 2;
+	}
+	ldb_pool_set_max_held((size_t)max_held);
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// release all memory kept in the memory pool
+static int lua_pool_trim(lua_State *L) {
+	ldb_pool_trim();
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+
+
 // when the module is require()'ed, return a table with the new_drawbuffer function, and some constants
 LUALIB_API int luaopen_ldb_core(lua_State *L) {
+	// select the pixel format conversion kernels for this CPU
+	ldb_convert_init();
+
 	lua_newtable(L);
 
 	LUA_T_PUSH_S_S("version", LDB_VERSION)
+	LUA_T_PUSH_S_S("simd", ldb_simd_level_to_str(ldb_convert_get_level()))
 	LUA_T_PUSH_S_CF("new_drawbuffer", lua_new_drawbuffer)
+	LUA_T_PUSH_S_CF("new_drawbuffer_from_pointer", lua_new_drawbuffer_from_pointer)
+	LUA_T_PUSH_S_CF("convert", lua_drawbuffer_convert_into)
+	LUA_T_PUSH_S_CF("pool_stats", lua_pool_stats)
+	LUA_T_PUSH_S_CF("pool_set_max_held", lua_pool_set_max_held)
+	LUA_T_PUSH_S_CF("pool_trim", lua_pool_trim)
+	LUA_T_PUSH_S_CF("memory_stats", lua_memory_stats)
 
 	lua_pushstring(L, "pixel_formats");
 	lua_newtable(L);
-
+	for (int i=0; i<LDB_PXFMT_MAX; i++) {
+		LUA_T_PUSH_S_I(pixel_format_to_str(i), i)
+	}
 	lua_settable(L, -3);
 
 	return 1;
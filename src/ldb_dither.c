@@ -0,0 +1,382 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+
+#include "lua.h"
+
+#include "ldb.h"
+#include "ldb_convert.h"
+#include "ldb_threads.h"
+#include "ldb_dither.h"
+
+// Ordered dithering and error diffusion.
+// Ordered dithering: Every pixel is compared against a threshold from a matrix
+// that is repeated over the drawbuffer, so each pixel is independent of it's
+// neighbours: The rows are split into bands that can run in parallel, and the
+// result does not change from frame to frame for a static image. Each channel
+// is quantized in a single step(see ldb_dither_row), then the row is converted
+// to the target pixel format directly, using the SIMD conversion kernels.
+// Error diffusion: The quantization error of a pixel is added to the following
+// pixels, weighted by the kernel. The weighted errors are summed up as integers
+// in error rows(one per image row in progress), and only divided when the pixel
+// is quantized. In raster order, a row only needs the errors of the rows above
+// it up to a few pixels to the right, so the rows are processed in parallel,
+// each staying behind the row above it(wavefront). ldb_threads_run takes the
+// tasks in ascending order, so the row above is always already in progress.
+
+// rows per band
+#define DITHER_BAND_H 16
+
+// maximum horizontal distance of an error diffusion weight, the error rows are padded by it
+#define DIFFUSION_PAD 2
+
+// pixels processed between synchronizing with the row above(wavefront)
+#define DIFFUSION_SYNC_W 64
+
+typedef struct {
+	const drawbuffer_t* src_db;
+	const drawbuffer_t* dst_db;
+	const uint8_t* tiles; // for each matrix row, the thresholds repeated to tile_w values
+	int mw, mh, tile_w;
+	int bits[3];
+	int gray;
+	uint32_t gray_alpha_mask; // alpha bits kept for black and white pixels
+} dither_job_t;
+
+// quantize n pixels to black or white based on their luminance
+static void dither_row_gray(uint32_t* row, const uint8_t* thresholds, uint32_t alpha_mask, int n) {
+	for (int i=0; i<n; i++) {
+		uint32_t p = row[i];
+		uint32_t y = (77*(p>>24) + 150*((p>>16) & 0xff) + 29*((p>>8) & 0xff) + 128) >> 8;
+		row[i] = (((y + thresholds[i]) / 255) ? 0xffffff00 : 0) | (p & alpha_mask);
+	}
+}
+
+// a weight of an error diffusion kernel, for the pixel at dx,dy relative to the current pixel
+typedef struct {
+	int dx, dy, weight;
+} diffusion_tap_t;
+
+typedef struct {
+	const char* name;
+	int divisor;
+	int rows; // rows the error is distributed to, including the current row
+	int tap_count;
+	diffusion_tap_t taps[12];
+} diffusion_kernel_t;
+
+static const diffusion_kernel_t diffusion_kernels[LDB_DIFFUSION_MAX] = {
+	{ "floyd_steinberg", 16, 2, 4, { {1,0,7}, {-1,1,3}, {0,1,5}, {1,1,1} } },
+	{ "atkinson", 8, 3, 6, { {1,0,1}, {2,0,1}, {-1,1,1}, {0,1,1}, {1,1,1}, {0,2,1} } },
+	{ "sierra", 32, 3, 10, { {1,0,5}, {2,0,3}, {-2,1,2}, {-1,1,4}, {0,1,5}, {1,1,4}, {2,1,2}, {-1,2,2}, {0,2,3}, {1,2,2} } },
+	{ "jarvis", 48, 3, 12, { {1,0,7}, {2,0,5}, {-2,1,3}, {-1,1,5}, {0,1,7}, {1,1,5}, {2,1,3}, {-2,2,1}, {-1,2,3}, {0,2,5}, {1,2,3}, {2,2,1} } },
+};
+
+typedef struct {
+	const drawbuffer_t* src_db;
+	const drawbuffer_t* dst_db;
+	const diffusion_kernel_t* kernel;
+	int serpentine;
+	int gray;
+	uint32_t gray_alpha_mask;
+	const uint32_t* palette;
+	int palette_len;
+	int palette_index; // store the palette index instead of the color
+	uint8_t quant[3][256]; // r,g,b output value(k<<(8-bits)) for each value
+	uint8_t level[3][256]; // value represented by the output value
+	int threads;
+	int ring; // number of rows in the row buffers below
+	int err_w; // values per error row(r,g,b for each pixel, including the padding)
+	int32_t* err; // weighted error sums
+	uint32_t* pixels; // pixels in the internal pixel format
+	int* progress; // pixels done in each row
+} diffusion_job_t;
+
+// a/d rounded, without a branch on the sign(|a| is at most 255*d)
+static inline int32_t div_round(int32_t a, int32_t d) {
+	return (a + d/2 + d*1024) / d - 1024;
+}
+
+// get the index of the palette color nearest to r,g,b
+static inline int palette_nearest(const uint32_t* palette, int palette_len, int r, int g, int b) {
+	int best = 0;
+	int best_dist = 0x7fffffff;
+	for (int i=0; i<palette_len; i++) {
+		int dr = r-(int)(palette[i]>>24);
+		int dg = g-(int)((palette[i]>>16) & 0xff);
+		int db = b-(int)((palette[i]>>8) & 0xff);
+		int dist = dr*dr + dg*dg + db*db;
+		if (dist < best_dist) {
+			best = i;
+			best_dist = dist;
+		}
+	}
+	return best;
+}
+
+static void diffusion_row(void* arg, int y) {
+	const diffusion_job_t* job = (const diffusion_job_t*)arg;
+	const diffusion_kernel_t* kernel = job->kernel;
+	int gray = job->gray;
+	int w = job->src_db->w;
+	uint32_t* row = job->pixels + (size_t)(y % job->ring)*w;
+	int32_t* err_rows[3];
+	for (int dy=0; dy<3; dy++) {
+		err_rows[dy] = job->err + (size_t)((y+dy) % job->ring)*job->err_w + DIFFUSION_PAD*3;
+	}
+
+	// the row buffers were last used by rows at least threads+1 rows above, wait until these are done
+	int wavefront = (!job->serpentine) && (y > 0);
+	if (wavefront && (y > job->threads)) {
+		while (__atomic_load_n(&job->progress[y-job->threads-1], __ATOMIC_ACQUIRE) < w) {
+			sched_yield();
+		}
+	}
+
+	// clear the last error row this row distributes to, the rows above already cleared the others
+	memset(job->err + (size_t)((y+kernel->rows-1) % job->ring)*job->err_w, 0, job->err_w*sizeof(int32_t));
+	ldb_convert_row(db_get_row_ptr(job->src_db, y), 0, job->src_db->pxfmt, (uint8_t*)row, 0, LDB_PXFMT_32BPP_INTERNAL, w);
+
+	int dir = (job->serpentine && (y & 1)) ? -1 : 1;
+	for (int i=0; i<w; i++) {
+		if (wavefront && (i % DIFFUSION_SYNC_W == 0)) {
+			// the row above must be done with all pixels that distribute errors to the next pixels of this row
+			int needed = i + DIFFUSION_SYNC_W + 2*DIFFUSION_PAD;
+			needed = (needed > w) ? w : needed;
+			while (__atomic_load_n(&job->progress[y-1], __ATOMIC_ACQUIRE) < needed) {
+				sched_yield();
+			}
+			__atomic_store_n(&job->progress[y], i, __ATOMIC_RELEASE);
+		}
+		int x = (dir > 0) ? i : w-1-i;
+		uint32_t p = row[x];
+		const int32_t* e = err_rows[0] + x*3;
+		int v[3] = { p>>24, (p>>16) & 0xff, (p>>8) & 0xff };
+		int channels = gray ? 1 : 3;
+		if (gray) {
+			v[0] = (77*v[0] + 150*v[1] + 29*v[2] + 128) >> 8;
+		}
+		for (int c=0; c<channels; c++) {
+			v[c] += div_round(e[c], kernel->divisor);
+			v[c] = (v[c] < 0) ? 0 : ((v[c] > 255) ? 255 : v[c]);
+		}
+
+		// quantize and get the error
+		if (gray) {
+			int q = (v[0] >= 128) ? 255 : 0;
+			row[x] = (q ? 0xffffff00 : 0) | (p & job->gray_alpha_mask);
+			v[0] -= q;
+		} else if (job->palette) {
+			int index = palette_nearest(job->palette, job->palette_len, v[0], v[1], v[2]);
+			uint32_t q = job->palette[index];
+			row[x] = job->palette_index ? (uint32_t)index*0x01010101 : ((q & 0xffffff00) | (p & 0xff));
+			v[0] -= q>>24;
+			v[1] -= (q>>16) & 0xff;
+			v[2] -= (q>>8) & 0xff;
+		} else {
+			row[x] = (uint32_t)job->quant[0][v[0]]<<24 | (uint32_t)job->quant[1][v[1]]<<16 | (uint32_t)job->quant[2][v[2]]<<8 | (p & 0xff);
+			for (int c=0; c<3; c++) {
+				v[c] -= job->level[c][v[c]];
+			}
+		}
+
+		// distribute the error, weights outside of the row end up in the padding
+		for (int t=0; t<kernel->tap_count; t++) {
+			const diffusion_tap_t* tap = &kernel->taps[t];
+			int32_t* d = err_rows[tap->dy] + (x + tap->dx*dir)*3;
+			for (int c=0; c<channels; c++) {
+				d[c] += v[c]*tap->weight;
+			}
+		}
+	}
+
+	ldb_convert_row((const uint8_t*)row, 0, LDB_PXFMT_32BPP_INTERNAL, db_get_row_ptr(job->dst_db, y), 0, job->dst_db->pxfmt, w);
+	__atomic_store_n(&job->progress[y], w, __ATOMIC_RELEASE);
+}
+
+static void dither_band(void* arg, int index) {
+	const dither_job_t* job = (const dither_job_t*)arg;
+	const drawbuffer_t* src_db = job->src_db;
+	const drawbuffer_t* dst_db = job->dst_db;
+	int y0 = index*DITHER_BAND_H;
+	int y1 = (y0+DITHER_BAND_H > src_db->h) ? src_db->h : y0+DITHER_BAND_H;
+	uint32_t row[LDB_ROW_CHUNK];
+
+	for (int y=y0; y<y1; y++) {
+		const uint8_t* src_row = db_get_row_ptr(src_db, y);
+		uint8_t* dst_row = db_get_row_ptr(dst_db, y);
+		const uint8_t* tile = job->tiles + (size_t)(y % job->mh)*job->tile_w;
+		for (int x=0; x<src_db->w; x+=LDB_ROW_CHUNK) {
+			int len = (src_db->w-x < LDB_ROW_CHUNK) ? src_db->w-x : LDB_ROW_CHUNK;
+			const uint8_t* thresholds = tile + (x % job->mw);
+			ldb_convert_row(src_row, x, src_db->pxfmt, (uint8_t*)row, 0, LDB_PXFMT_32BPP_INTERNAL, len);
+			if (job->gray) {
+				dither_row_gray(row, thresholds, job->gray_alpha_mask, len);
+			} else {
+				ldb_dither_row(row, row, thresholds, job->bits[0], job->bits[1], job->bits[2], len);
+			}
+			ldb_convert_row((const uint8_t*)row, 0, LDB_PXFMT_32BPP_INTERNAL, dst_row, x, dst_db->pxfmt, len);
+		}
+	}
+}
+
+
+
+int ldb_dither_bayer_size_from_str(const char* str) {
+	if (strcmp(str, "bayer2")==0) {
+		return 2;
+	} else if (strcmp(str, "bayer4")==0) {
+		return 4;
+	} else if (strcmp(str, "bayer8")==0) {
+		return 8;
+	}
+	return 0;
+}
+
+void ldb_dither_bayer(uint8_t* matrix, int size) {
+	int count = size*size;
+	for (int y=0; y<size; y++) {
+		for (int x=0; x<size; x++) {
+			// the lowest bits of x and y select the most significant bits of the index
+			int index = 0;
+			for (int bit=1; bit<size; bit<<=1) {
+				index = (index<<2) | (((x^y) & bit) ? 2 : 0) | ((y & bit) ? 1 : 0);
+			}
+			// thresholds at the center of each of the count intervals
+			matrix[y*size+x] = ((2*index+1)*255) / (2*count);
+		}
+	}
+}
+
+void ldb_dither_thresholds_from_db(const drawbuffer_t* db, uint8_t* matrix) {
+	uint32_t row[LDB_ROW_CHUNK];
+	for (int y=0; y<db->h; y++) {
+		for (int x=0; x<db->w; x+=LDB_ROW_CHUNK) {
+			int len = (db->w-x < LDB_ROW_CHUNK) ? db->w-x : LDB_ROW_CHUNK;
+			db_unpack_row(db, x, y, row, len);
+			for (int i=0; i<len; i++) {
+				matrix[(size_t)y*db->w+x+i] = ((2*(row[i]>>24)+1)*255) / 512;
+			}
+		}
+	}
+}
+
+LDB_DIFFUSION ldb_diffusion_from_str(const char* str) {
+	for (int i=0; i<LDB_DIFFUSION_MAX; i++) {
+		if (strcmp(str, diffusion_kernels[i].name)==0) {
+			return (LDB_DIFFUSION)i;
+		}
+	}
+	return LDB_DIFFUSION_MAX;
+}
+
+int ldb_dither_format_bits(PIX_FMT fmt, int bits[3]) {
+	bits[0] = 8;
+	bits[1] = 8;
+	bits[2] = 8;
+	switch (fmt) {
+		case LDB_PXFMT_1BPP:
+			return 1;
+		case LDB_PXFMT_8BPP_RGB332:
+			bits[0] = 3;
+			bits[1] = 3;
+			bits[2] = 2;
+			break;
+		case LDB_PXFMT_16BPP_RGB565:
+		case LDB_PXFMT_16BPP_BGR565:
+			bits[0] = 5;
+			bits[1] = 6;
+			bits[2] = 5;
+			break;
+		default:
+			break;
+	}
+	return 0;
+}
+
+int ldb_ordered_dither(const drawbuffer_t* src_db, const drawbuffer_t* dst_db, const int bits[3], int gray, const uint8_t* matrix, int mw, int mh, int num_threads) {
+	if ((!src_db->data) || (!dst_db->data) || (src_db->w <= 0) || (src_db->h <= 0) || (mw <= 0) || (mh <= 0)) {
+		return 1;
+	}
+
+	// repeat each matrix row, so the thresholds for a chunk of a row are contiguous
+	dither_job_t job = { .src_db = src_db, .dst_db = dst_db, .mw = mw, .mh = mh, .gray = gray };
+	job.tile_w = mw + LDB_ROW_CHUNK;
+	uint8_t* tiles = malloc((size_t)mh*job.tile_w);
+	if (!tiles) {
+		return 0;
+	}
+	for (int y=0; y<mh; y++) {
+		for (int x=0; x<job.tile_w; x++) {
+			tiles[(size_t)y*job.tile_w+x] = matrix[(size_t)y*mw + x%mw];
+		}
+	}
+	job.tiles = tiles;
+	for (int c=0; c<3; c++) {
+		job.bits[c] = bits[c];
+	}
+	job.gray_alpha_mask = (dst_db->pxfmt == LDB_PXFMT_1BPP) ? 0 : 0xff;
+
+	int bands = (src_db->h + DITHER_BAND_H-1) / DITHER_BAND_H;
+	ldb_threads_run(num_threads, bands, dither_band, &job);
+
+	free(tiles);
+	return 1;
+}
+
+int ldb_error_diffusion(const drawbuffer_t* src_db, const drawbuffer_t* dst_db, const int bits[3], int gray, const uint32_t* palette, int palette_len, LDB_DIFFUSION kernel, int serpentine, int num_threads) {
+	if ((!src_db->data) || (!dst_db->data) || (src_db->w <= 0) || (src_db->h <= 0) || (kernel >= LDB_DIFFUSION_MAX) || (palette && (palette_len <= 0))) {
+		return 1;
+	}
+
+	diffusion_job_t* job = calloc(1, sizeof(diffusion_job_t));
+	if (!job) {
+		return 0;
+	}
+	job->src_db = src_db;
+	job->dst_db = dst_db;
+	job->kernel = &diffusion_kernels[kernel];
+	job->serpentine = serpentine;
+	job->gray = gray;
+	job->gray_alpha_mask = (dst_db->pxfmt == LDB_PXFMT_1BPP) ? 0 : 0xff;
+	job->palette = palette;
+	job->palette_len = (palette_len > LDB_DITHER_PALETTE_MAX) ? LDB_DITHER_PALETTE_MAX : palette_len;
+	job->palette_index = (dst_db->pxfmt == LDB_PXFMT_8BPP);
+	for (int c=0; c<3; c++) {
+		int b = (bits[c] < 1) ? 1 : ((bits[c] > 8) ? 8 : bits[c]);
+		int levels = (1<<b)-1;
+		for (int v=0; v<256; v++) {
+			int k = (v*levels + 127) / 255;
+			job->quant[c][v] = k << (8-b);
+			job->level[c][v] = (k*255 + levels/2) / levels;
+		}
+	}
+
+	// serpentine rows depend on the entire row above
+	num_threads = serpentine ? 1 : num_threads;
+	num_threads = (num_threads < 1) ? 1 : ((num_threads > LDB_THREADS_MAX) ? LDB_THREADS_MAX : num_threads);
+
+	// at most num_threads rows are in progress
+	job->threads = num_threads;
+	job->ring = num_threads + job->kernel->rows;
+	job->err_w = (src_db->w + 2*DIFFUSION_PAD)*3;
+	job->err = calloc((size_t)job->ring*job->err_w, sizeof(int32_t));
+	job->pixels = malloc((size_t)job->ring*src_db->w*sizeof(uint32_t));
+	job->progress = calloc(src_db->h, sizeof(int));
+	if ((!job->err) || (!job->pixels) || (!job->progress)) {
+		free(job->err);
+		free(job->pixels);
+		free(job->progress);
+		free(job);
+		return 0;
+	}
+
+	ldb_threads_run(num_threads, src_db->h, diffusion_row, job);
+
+	free(job->err);
+	free(job->pixels);
+	free(job->progress);
+	free(job);
+	return 1;
+}
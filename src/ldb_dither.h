@@ -0,0 +1,51 @@
+#ifndef LUA_LDB_DITHER_H
+#define LUA_LDB_DITHER_H
+
+#include "ldb.h"
+
+// get the size of a Bayer matrix by name("bayer2", "bayer4", "bayer8"). Returns 0 if unknown.
+int ldb_dither_bayer_size_from_str(const char* str);
+
+// fill matrix with the size*size thresholds(0-254) of a Bayer matrix. size must be a power of 2.
+void ldb_dither_bayer(uint8_t* matrix, int size);
+
+// fill matrix with the thresholds(0-254) from the red channel of the pixels in db(e.g. a blue-noise texture).
+void ldb_dither_thresholds_from_db(const drawbuffer_t* db, uint8_t* matrix);
+
+// get the bits per channel(r,g,b) a pixel format can store. Returns 1 if the format has only black and white pixels.
+int ldb_dither_format_bits(PIX_FMT fmt, int bits[3]);
+
+// quantize the pixels of src_db to bits[0],bits[1],bits[2] bits for the r,g,b channels using ordered dithering,
+// and store them in dst_db(same size, can be src_db). The threshold matrix(mw*mh values, 0-254) is repeated over the drawbuffer.
+// If gray is set, the pixels are quantized to black or white based on their luminance.
+// The alpha values are kept, except for black and white pixels when dst_db is a 1bpp drawbuffer.
+// Rows are split into bands that are dithered by up to num_threads threads.
+// Returns 0 if memory could not be allocated.
+int ldb_ordered_dither(const drawbuffer_t* src_db, const drawbuffer_t* dst_db, const int bits[3], int gray, const uint8_t* matrix, int mw, int mh, int num_threads);
+
+// error diffusion kernels
+typedef enum {
+	LDB_DIFFUSION_FLOYD_STEINBERG,
+	LDB_DIFFUSION_ATKINSON,
+	LDB_DIFFUSION_SIERRA,
+	LDB_DIFFUSION_JARVIS,
+
+	LDB_DIFFUSION_MAX,
+} LDB_DIFFUSION;
+
+// maximum number of palette colors for ldb_error_diffusion
+#define LDB_DITHER_PALETTE_MAX 256
+
+// get an error diffusion kernel by name("floyd_steinberg", "atkinson", "sierra", "jarvis"). Returns LDB_DIFFUSION_MAX if unknown.
+LDB_DIFFUSION ldb_diffusion_from_str(const char* str);
+
+// quantize the pixels of src_db like ldb_ordered_dither, but distribute the quantization error of each pixel
+// to the following pixels using the kernel. If palette is not NULL, each pixel is replaced by the nearest of the
+// palette_len colors(internal pixel format) instead, and a 8bpp dst_db gets the palette index.
+// If serpentine is set, every other row is processed from right to left. Otherwise the rows are processed by up to
+// num_threads threads, each row staying behind the row above it(wavefront). The result is the same for any number of threads.
+// Returns 0 if memory could not be allocated.
+int ldb_error_diffusion(const drawbuffer_t* src_db, const drawbuffer_t* dst_db, const int bits[3], int gray, const uint32_t* palette, int palette_len, LDB_DIFFUSION kernel, int serpentine, int num_threads);
+
+
+#endif
@@ -19,6 +19,7 @@
 #include "lua.h"
 #include "lauxlib.h"
 #include "ldb.h"
+#include "ldb_convert.h"
 #include "ldb_drm.h"
 
 #define LUA_T_PUSH_S_N(S, N) lua_pushstring(L, S); lua_pushnumber(L, N); lua_settable(L, -3);
@@ -333,7 +334,7 @@ static int lua_drm_card_get_drawbuffer(lua_State *L) {
 	struct modeset_dev *found = NULL;
 	int i = 1;
 	for (iter = modeset_list; iter; iter = iter->next) {
-		if ((list_entry_index==i) && (iter->size!=get_data_size(iter->width, iter->height, LDB_PXFMT_32BPP_RGBA))) {
+		if (list_entry_index==i) {
 			found = iter;
 			break;
 		}
@@ -349,11 +350,15 @@ static int lua_drm_card_get_drawbuffer(lua_State *L) {
 	db->w = found->width;
 	db->h = found->height;
 
-	// TODO: Check pixel format and pitch from SDL surface for compabillity, maybe suppoprt all pixel formats supported by ldb.
+	// the dumb buffer is XRGB8888(BGRA in memory), rows are stride bytes apart
 	db->pxfmt = LDB_PXFMT_32BPP_BGRA;
 	db->data = found->map;
 	db->close_func = &drm_card_drawbuffer_close;
 	db->close_data = drm;
+	db->stride = found->stride;
+	db->parent = NULL;
+	db->damage.enabled = 0;
+	db->damage.count = 0;
 
 	// apply the drawbuffer metatable to it
 	lua_set_ldb_meta(L, -2);
@@ -370,28 +375,30 @@ static int lua_drm_card_copy_from_db(lua_State *L) {
 	drawbuffer_t *db;
 	LUA_LDB_CHECK_DB(L, 2, db)
 
-	size_t db_len = get_data_size(db->pxfmt, db->w, db->h);
-
 	int list_entry_index = lua_tonumber(L, 3);
 
 	int i = 1;
-	uint32_t sp;
-	uint8_t r, g, b;
 	struct modeset_dev *iter;
 	for (iter = modeset_list; iter; iter = iter->next) {
-		if ((list_entry_index==i) && (db_len == iter->size)) {
-			// TODO: This just assumes same geometry/pixel format
-			memcpy(iter->map, db->data, db_len);
+		if ((list_entry_index==i) && (db->pxfmt == LDB_PXFMT_32BPP_BGRA) && ((uint32_t)db->w == iter->width) && ((uint32_t)db->h == iter->height) && ((uint32_t)db->stride == iter->stride) && (!db->damage.enabled)) {
+			// same memory layout
+			memcpy(iter->map, db->data, (size_t)db->stride*(db->h-1) + get_stride(db->pxfmt, db->w));
 			lua_pushboolean(L, 1);
 			return 1;
 		} else if (list_entry_index==i) {
-			for (uint32_t y = 0; y < iter->height; ++y) {
-				for (uint32_t x = 0; x < iter->width; ++x) {
-					sp = get_px(db->data, db->w, x,y, db->pxfmt);
-					UNPACK_RGB(sp, r,g,b)
-					*(uint32_t*)&iter->map[iter->stride * y + x * 4] = (r << 16) | (g << 8) | b;
+			// convert a row at a time to the XRGB8888 dumb buffer(BGRA in memory), only the changed regions if damage tracking is enabled
+			int w = ((uint32_t)db->w < iter->width) ? db->w : (int)iter->width;
+			int h = ((uint32_t)db->h < iter->height) ? db->h : (int)iter->height;
+			db_rect_t rects[LDB_DAMAGE_MAX_RECTS];
+			int rect_count = db_get_damage_rects(db, rects);
+			for (int j=0; j<rect_count; j++) {
+				int x_max = (rects[j].x1 < w) ? rects[j].x1 : w;
+				int y_max = (rects[j].y1 < h) ? rects[j].y1 : h;
+				for (int y = rects[j].y0; y < y_max; ++y) {
+					ldb_convert_row(db_get_row_ptr(db, y), rects[j].x0, db->pxfmt, &iter->map[iter->stride * y], rects[j].x0, LDB_PXFMT_32BPP_BGRA, x_max-rects[j].x0);
 				}
 			}
+			db_reset_damage(db);
 			lua_pushboolean(L, 1);
 			return 1;
 		}
@@ -579,6 +586,8 @@ static int lua_drm_new_card(lua_State *L) {
 
 
 LUALIB_API int luaopen_ldb_drm(lua_State *L) {
+    ldb_convert_init();
+
     lua_newtable(L);
 
     LUA_T_PUSH_S_S("version", LDB_VERSION)
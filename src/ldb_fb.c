@@ -2,6 +2,7 @@
 #include "lauxlib.h"
 
 #include "ldb.h"
+#include "ldb_convert.h"
 #include "ldb_fb.h"
 
 #include <errno.h>
@@ -92,39 +93,39 @@ static int lua_framebuffer_copy_from_db(lua_State *L) {
 	drawbuffer_t *db;
 	LUA_LDB_CHECK_DB(L, 2, db)
 
-	uint32_t sp;
-	int cx,cy;
-	int i;
+	int cy;
 
 	// TODO: Support other pixel packing formats(planes, etc.)
 	if (fb->finfo.type != FB_TYPE_PACKED_PIXELS) {
 		lua_pushnil(L);
-		lua_pushfstring(L, "Only FB_TYPE_PACKED_PIXELS supported!", fb->vinfo.bits_per_pixel);
+		lua_pushstring(L, "Only FB_TYPE_PACKED_PIXELS supported!");
+		return 2;
 	}
 
 	// TODO: Support drawbuffers with other dimensions
 	if ((db->w != (int)fb->vinfo.xres)  || (db->h != (int)fb->vinfo.yres)) {
 		lua_pushnil(L);
 		lua_pushfstring(L, "Drawbuffer must be of dimensions %dx%d", fb->vinfo.xres, fb->vinfo.yres);
+		return 2;
 	}
 
 	// TODO: Chech for correct pixel formats
-	if ((fb->vinfo.bits_per_pixel == 32) && (db->pxfmt == LDB_PXFMT_32BPP_BGRA)) {
+	if ((fb->vinfo.bits_per_pixel == 32) && (db->pxfmt == LDB_PXFMT_32BPP_BGRA) && db_is_contiguous(db) && (fb->finfo.line_length == (uint32_t)db->w*4) && (!db->damage.enabled)) {
 		size_t db_data_len = db->w*db->h*4;
 		if (fb->finfo.smem_len >= db_data_len) {
 			memcpy(fb->data, db->data, db_data_len);
 		}
 	} else if (fb->vinfo.bits_per_pixel == 32) {
-		for (cy=0; cy < db->h; cy++) {
-			for (cx=0; cx < db->w; cx++) {
-				sp = get_px(db->data, db->w, cx,cy, db->pxfmt);
-				// TODO: Support all pixel formats for the frambebuffer
-				i = (cy*db->w+cx)*4;
-				((uint8_t*)fb->data)[i] = (uint8_t)((sp&0x0000FF00)>>8);
-				((uint8_t*)fb->data)[i+1] = (uint8_t)((sp&0x00FF0000)>>16);
-				((uint8_t*)fb->data)[i+2] = (uint8_t)((sp&0xFF000000)>>24);
+		// convert a row at a time into the framebuffer memory, only the changed regions if damage tracking is enabled
+		// TODO: Support all pixel formats for the frambebuffer
+		db_rect_t rects[LDB_DAMAGE_MAX_RECTS];
+		int rect_count = db_get_damage_rects(db, rects);
+		for (int i=0; i<rect_count; i++) {
+			for (cy=rects[i].y0; cy < rects[i].y1; cy++) {
+				ldb_convert_row(db_get_row_ptr(db, cy), rects[i].x0, db->pxfmt, fb->data + cy*fb->finfo.line_length, rects[i].x0, LDB_PXFMT_32BPP_BGRA, rects[i].x1-rects[i].x0);
 			}
 		}
+		db_reset_damage(db);
 	} else {
 		lua_pushnil(L);
 		lua_pushfstring(L, "Only 16 & 32 bpp are supported, not: %d", fb->vinfo.bits_per_pixel);
@@ -212,6 +213,10 @@ static int lua_framebuffer_get_drawbuffer(lua_State *L) {
 	db->data = fb->data;
 	db->close_func = &framebuffer_db_close_func;
 	db->close_data = fb;
+	db->stride = fb->finfo.line_length;
+	db->parent = NULL;
+	db->damage.enabled = 0;
+	db->damage.count = 0;
 
 	// apply the drawbuffer metatable to it
 	lua_set_ldb_meta(L, -2);
@@ -298,6 +303,8 @@ static int lua_fb_new_framebuffer(lua_State *L) {
 
 
 LUALIB_API int luaopen_ldb_fb(lua_State *L) {
+    ldb_convert_init();
+
     lua_newtable(L);
 
     LUA_T_PUSH_S_S("version", LDB_VERSION)
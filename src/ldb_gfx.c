@@ -2,13 +2,21 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
 
 
 #include "lua.h"
 #include "lauxlib.h"
 
 #include "ldb.h"
+#include "ldb_convert.h"
 #include "ldb_gfx.h"
+#include "ldb_threads.h"
+#include "ldb_dither.h"
+#include "ldb_resample.h"
+#include "ldb_blur.h"
+#include "ldb_convolve.h"
+#include "ldb_mesh.h"
 
 
 #define LUA_T_PUSH_S_N(S, N) lua_pushstring(L, S); lua_pushnumber(L, N); lua_settable(L, -3);
@@ -39,7 +47,7 @@ static int lua_gfx_origin_to_target(lua_State *L) {
 	int w = lua_tointeger(L, 7);
 	int h = lua_tointeger(L, 8);
 
-	// TODO: Allow non-integer scale using bilinear interpolation
+	// (see ldb_gfx.resample for non-integer scaling)
 	int scale_x = lua_tointeger(L, 9);
 	int scale_y = lua_tointeger(L, 10);
 
@@ -66,87 +74,746 @@ static int lua_gfx_origin_to_target(lua_State *L) {
 		}
 	}
 
-	// avoid runtime-checks in hotloop by using COPY_RECT macro(see header) and having alpha-mode and scale constant during compilation
-	if (alpha_mode == 0) {
-		if ((scale_x>1) || (scale_y>1)) {
-			COPY_RECT(0, scale_x, scale_y, origin_db, target_db, target_x, target_y, origin_x, origin_y, w, h)
-		} else {
-			COPY_RECT(0, 1, 1, origin_db, target_db, target_x, target_y, origin_x, origin_y, w, h)
+	db_add_damage(target_db, target_x, target_y, w*scale_x, h*scale_y);
+
+	// clipped once, then converted a row at a time
+	if ((scale_x==1) && (scale_y==1)) {
+		copy_rect_rows(origin_db, target_db, target_x, target_y, origin_x, origin_y, w, h, alpha_mode);
+	} else {
+		copy_rect_scaled_rows(origin_db, target_db, target_x, target_y, origin_x, origin_y, w, h, scale_x, scale_y, alpha_mode);
+	}
+
+	return 0;
+}
+
+
+
+// a row kernel for each compositing mode, so the mode is only selected once per call
+typedef void (*composite_row_func_t)(uint32_t* dst, const uint32_t* src, int n);
+#define COMPOSITE_ROW(NAME) \
+static void composite_row_##NAME(uint32_t* dst, const uint32_t* src, int n) { \
+	for (int i=0; i<n; i++) { \
+		dst[i] = composite_##NAME(dst[i], src[i]); \
+	} \
+}
+COMPOSITE_ROW(src_over)
+COMPOSITE_ROW(dst_over)
+COMPOSITE_ROW(src_in)
+COMPOSITE_ROW(src_out)
+COMPOSITE_ROW(src_atop)
+COMPOSITE_ROW(xor)
+COMPOSITE_ROW(multiply)
+COMPOSITE_ROW(screen)
+COMPOSITE_ROW(add)
+COMPOSITE_ROW(subtract)
+COMPOSITE_ROW(darken)
+COMPOSITE_ROW(lighten)
+
+static const struct {
+	const char* name;
+	composite_row_func_t func;
+} composite_modes[] = {
+	{ "src_over", composite_row_src_over },
+	{ "dst_over", composite_row_dst_over },
+	{ "src_in", composite_row_src_in },
+	{ "src_out", composite_row_src_out },
+	{ "src_atop", composite_row_src_atop },
+	{ "xor", composite_row_xor },
+	{ "multiply", composite_row_multiply },
+	{ "screen", composite_row_screen },
+	{ "add", composite_row_add },
+	{ "subtract", composite_row_subtract },
+	{ "darken", composite_row_darken },
+	{ "lighten", composite_row_lighten },
+	{ NULL, NULL }
+};
+
+// origin pixels for bilinear filtering in transform_blit. A row is unpacked(and premultiplied, or set opaque
+// for formats without alpha) the first time a span samples it.
+typedef struct {
+	const drawbuffer_t* db;
+	unpack_row_func_t unpack;
+	int premultiply;
+	int opaque;
+	uint32_t* px; // w*h pixels
+	uint8_t* ready; // set for each unpacked row
+} blit_rows_t;
+
+// make sure the origin rows sampled for the 16.16 fixed-point v coordinates from v_a to v_b are unpacked
+static void blit_rows_load(blit_rows_t* rows, int64_t v_a, int64_t v_b) {
+	int w = rows->db->w, h = rows->db->h;
+	int64_t y0 = (((v_a < v_b) ? v_a : v_b) - 0x8000) >> 16;
+	int64_t y1 = ((((v_a < v_b) ? v_b : v_a) - 0x8000) >> 16) + 1;
+	y0 = (y0 < 0) ? 0 : ((y0 > h-1) ? h-1 : y0);
+	y1 = (y1 < 0) ? 0 : ((y1 > h-1) ? h-1 : y1);
+	for (int64_t y=y0; y<=y1; y++) {
+		if (rows->ready[y]) {
+			continue;
 		}
-	} else if (alpha_mode == 1) {
-		if ((scale_x>1) || (scale_y>1)) {
-			COPY_RECT(1, scale_x, scale_y, origin_db, target_db, target_x, target_y, origin_x, origin_y, w, h)
-		} else {
-			COPY_RECT(1, 1, 1, origin_db, target_db, target_x, target_y, origin_x, origin_y, w, h)
+		uint32_t* row = rows->px + (size_t)y*w;
+		rows->unpack(db_get_row_ptr(rows->db, y), 0, row, w);
+		if (rows->opaque) {
+			set_row_opaque(row, w);
+		} else if (rows->premultiply) {
+			for (int x=0; x<w; x++) {
+				row[x] = premultiply_pixel(row[x]);
+			}
 		}
-	} else if (alpha_mode == 2) {
-		if ((scale_x>1) || (scale_y>1)) {
-			COPY_RECT(2, scale_x, scale_y, origin_db, target_db, target_x, target_y, origin_x, origin_y, w, h)
-		} else {
-			COPY_RECT(2, 1, 1, origin_db, target_db, target_x, target_y, origin_x, origin_y, w, h)
+		rows->ready[y] = 1;
+	}
+}
+
+// draw the origin_db transformed by the affine matrix m(origin coordinates to target coordinates) to the target_db.
+// Only the span of each target row that is covered by the origin is sampled, by stepping through the
+// origin in 16.16 fixed-point. Nearest samples are read from the origin directly, bilinear filtering
+// only unpacks the origin rows that are sampled. Returns 0 if memory could not be allocated.
+static int transform_blit(const drawbuffer_t* origin_db, drawbuffer_t* target_db, const double m[6], int bilinear, int alpha_mode) {
+	double det = m[0]*m[4] - m[1]*m[3];
+	int ow = origin_db->w, oh = origin_db->h;
+	if ((!origin_db->data) || (!target_db->data) || (ow <= 0) || (oh <= 0)) {
+		return 1;
+	}
+
+	// inverse matrix(target coordinates to origin coordinates)
+	double iu_x = m[4]/det, iu_y = -m[1]/det, iu_0 = (m[1]*m[5] - m[4]*m[2])/det;
+	double iv_x = -m[3]/det, iv_y = m[0]/det, iv_0 = (m[3]*m[2] - m[0]*m[5])/det;
+
+	// bounding box of the transformed origin
+	double bx[4] = { 0, ow, 0, ow };
+	double by[4] = { 0, 0, oh, oh };
+	double x_min = INFINITY, x_max = -INFINITY, y_min = INFINITY, y_max = -INFINITY;
+	for (int i=0; i<4; i++) {
+		double tx = m[0]*bx[i] + m[1]*by[i] + m[2];
+		double ty = m[3]*bx[i] + m[4]*by[i] + m[5];
+		x_min = fmin(x_min, tx);
+		x_max = fmax(x_max, tx);
+		y_min = fmin(y_min, ty);
+		y_max = fmax(y_max, ty);
+	}
+	int y0 = (int)fmax(floor(y_min), 0);
+	int y1 = (int)fmin(ceil(y_max), target_db->h);
+	if ((y0 >= y1) || (x_max <= 0) || (x_min >= target_db->w)) {
+		return 1;
+	}
+
+	// bilinear filtering is done on premultiplied values(so transparent pixels don't bleed their color).
+	// Formats without alpha are opaque, and need no premultiplying.
+	int src_premul = is_premultiplied(origin_db->pxfmt);
+	int src_opaque = !has_alpha(origin_db->pxfmt);
+	int premul = src_premul || bilinear;
+	PIX_FMT origin_fmt = get_straight_pxfmt(origin_db->pxfmt);
+	blit_rows_t rows = { .db = origin_db, .unpack = get_unpack_row_func(origin_fmt), .premultiply = !src_premul, .opaque = src_opaque };
+	if (bilinear) {
+		rows.px = malloc((size_t)ow*oh*sizeof(uint32_t) + oh);
+		if (!rows.px) {
+			return 0;
 		}
+		rows.ready = (uint8_t*)(rows.px + (size_t)ow*oh);
+		memset(rows.ready, 0, oh);
 	}
+	db_add_damage(target_db, (int)fmax(floor(x_min), 0), y0, (int)fmin(ceil(x_max), target_db->w)-(int)fmax(floor(x_min), 0), y1-y0);
+
+	// premultiplied samples are alphablended directly, and converted for copying
+	int blend_premul = premul && (alpha_mode == 2);
+	int copy_premul = premul && (alpha_mode == 0) && is_premultiplied(target_db->pxfmt);
+	PIX_FMT target_fmt = (blend_premul || copy_premul) ? get_straight_pxfmt(target_db->pxfmt) : target_db->pxfmt;
+	int keep_alpha = !is_premultiplied(target_db->pxfmt);
+	unpack_row_func_t unpack_target = get_unpack_row_func(target_fmt);
+	pack_row_func_t pack_target = get_pack_row_func(target_fmt);
+
+	uint32_t s_tmp[LDB_ROW_CHUNK];
+	uint32_t t_tmp[LDB_ROW_CHUNK];
+	for (int y=y0; y<y1; y++) {
+		// origin coordinates at x=-0.5 of this row, and the span covered by the origin
+		double u_row = iu_y*(y+0.5) + iu_0;
+		double v_row = iv_y*(y+0.5) + iv_0;
+		int span_x0 = 0, span_x1 = target_db->w;
+		span_limit(u_row, iu_x, 0, ow, &span_x0, &span_x1);
+		span_limit(v_row, iv_x, 0, oh, &span_x0, &span_x1);
+		uint8_t* t_row = db_get_row_ptr(target_db, y);
+
+		int64_t du = llround(iu_x*65536), dv = llround(iv_x*65536);
+		for (int x=span_x0; x<span_x1; x+=LDB_ROW_CHUNK) {
+			int len = ((span_x1-x) < LDB_ROW_CHUNK) ? (span_x1-x) : LDB_ROW_CHUNK;
+			int64_t u = llround((u_row + iu_x*(x+0.5))*65536);
+			int64_t v = llround((v_row + iv_x*(x+0.5))*65536);
+			if (bilinear) {
+				blit_rows_load(&rows, v, v + dv*(len-1));
+				for (int i=0; i<len; i++) {
+					s_tmp[i] = sample_bilinear(rows.px, ow, oh, u, v);
+					u += du;
+					v += dv;
+				}
+			} else {
+				for (int i=0; i<len; i++) {
+					// clamped, because the span ends are rounded
+					int64_t sx = u >> 16, sy = v >> 16;
+					sx = (sx < 0) ? 0 : ((sx > ow-1) ? ow-1 : sx);
+					sy = (sy < 0) ? 0 : ((sy > oh-1) ? oh-1 : sy);
+					s_tmp[i] = get_px(origin_db->data, origin_db->stride, sx, sy, origin_fmt);
+					u += du;
+					v += dv;
+				}
+				if (src_opaque) {
+					set_row_opaque(s_tmp, len);
+				}
+			}
 
-	return 0;
+			if (premul && (!blend_premul) && (!copy_premul)) {
+				for (int i=0; i<len; i++) {
+					s_tmp[i] = unpremultiply_pixel(s_tmp[i]);
+				}
+			}
+			if (alpha_mode == 0) {
+				pack_target(t_row, x, s_tmp, len);
+				continue;
+			}
+			unpack_target(t_row, x, t_tmp, len);
+			combine_rows(t_tmp, s_tmp, len, alpha_mode, blend_premul, keep_alpha);
+			pack_target(t_row, x, t_tmp, len);
+		}
+	}
+
+	free(rows.px);
+	return 1;
+}
+
+// draw the origin_db to the target_db, transformed by an affine matrix(rotate, scale, shear, translate)
+static int lua_gfx_transform_blit(lua_State *L) {
+	drawbuffer_t *origin_db;
+	LUA_LDB_CHECK_DB(L, 1, origin_db)
+
+	drawbuffer_t *target_db;
+	LUA_LDB_CHECK_DB(L, 2, target_db)
+
+	// matrix {a,b,c,d,e,f}: target_x = a*x + b*y + c, target_y = d*x + e*y + f
+	luaL_checktype(L, 3, LUA_TTABLE);
+	double m[6];
+	for (int i=0; i<6; i++) {
+		lua_rawgeti(L, 3, i+1);
+		m[i] = lua_tonumber(L, -1);
+		lua_pop(L, 1);
+	}
+	double det = m[0]*m[4] - m[1]*m[3];
+	if ((fabs(det) < 1e-12) || (!isfinite(det))) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Matrix is not invertible");
+		return 2;
+	}
+
+	const char* filter_str = luaL_optstring(L, 4, "nearest");
+	int bilinear = 0;
+	if (strcmp(filter_str, "bilinear")==0) {
+		bilinear = 1;
+	} else if (strcmp(filter_str, "nearest")!=0) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Unknown filter: %s", filter_str);
+		return 2;
+	}
+
+	int alpha_mode = 0;
+	if (lua_isstring(L, 5)) {
+		const char* arg_str = lua_tostring(L, 5);
+		if (strcmp(arg_str, "ignorealpha")==0) {
+			alpha_mode = 1;
+		} else if (strcmp(arg_str, "alphablend")==0) {
+			alpha_mode = 2;
+		}
+	}
+
+	if (!transform_blit(origin_db, target_db, m, bilinear, alpha_mode)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// scale a region of the origin_db to a region of the target_db, using a resampling filter
+static int lua_gfx_resample(lua_State *L) {
+	drawbuffer_t *origin_db;
+	LUA_LDB_CHECK_DB(L, 1, origin_db)
+
+	drawbuffer_t *target_db;
+	LUA_LDB_CHECK_DB(L, 2, target_db)
+
+	// the origin region can be fractional
+	double origin_x = luaL_optnumber(L, 3, 0);
+	double origin_y = luaL_optnumber(L, 4, 0);
+	double origin_w = luaL_optnumber(L, 5, origin_db->w);
+	double origin_h = luaL_optnumber(L, 6, origin_db->h);
+
+	int target_x = luaL_optinteger(L, 7, 0);
+	int target_y = luaL_optinteger(L, 8, 0);
+	int target_w = luaL_optinteger(L, 9, target_db->w);
+	int target_h = luaL_optinteger(L, 10, target_db->h);
+
+	const char* filter_str = luaL_optstring(L, 11, "bilinear");
+	LDB_FILTER filter = ldb_filter_from_str(filter_str);
+	if (filter == LDB_FILTER_MAX) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Unknown filter: %s", filter_str);
+		return 2;
+	}
+
+	int threads = luaL_optinteger(L, 12, 1);
+	threads = (threads <= 0) ? ldb_threads_get_cpu_count() : threads;
+
+	if ((origin_w <= 0) || (origin_h <= 0) || (target_w <= 0) || (target_h <= 0)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Invalid region size");
+		return 2;
+	}
+
+	db_add_damage(target_db, target_x, target_y, target_w, target_h);
+	if (!ldb_resample(origin_db, origin_x, origin_y, origin_w, origin_h, target_db, target_x, target_y, target_w, target_h, filter, threads)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// blur a region of the origin_db into the same region of the target_db(can be the origin_db)
+static int lua_gfx_blur(lua_State *L) {
+	drawbuffer_t *origin_db;
+	LUA_LDB_CHECK_DB(L, 1, origin_db)
+
+	drawbuffer_t *target_db;
+	LUA_LDB_CHECK_DB(L, 2, target_db)
+
+	double radius = luaL_checknumber(L, 3);
+	if ((radius < 0) || (radius > LDB_BLUR_MAX_RADIUS)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Invalid radius");
+		return 2;
+	}
+
+	const char* kind_str = luaL_optstring(L, 4, "fast_gaussian");
+	LDB_BLUR kind = ldb_blur_from_str(kind_str);
+	if (kind == LDB_BLUR_MAX) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Unknown blur: %s", kind_str);
+		return 2;
+	}
+
+	int x = luaL_optinteger(L, 5, 0);
+	int y = luaL_optinteger(L, 6, 0);
+	int w = luaL_optinteger(L, 7, origin_db->w);
+	int h = luaL_optinteger(L, 8, origin_db->h);
+
+	int threads = luaL_optinteger(L, 9, 1);
+	threads = (threads <= 0) ? ldb_threads_get_cpu_count() : threads;
+
+	if ((w <= 0) || (h <= 0)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Invalid region size");
+		return 2;
+	}
+
+	db_add_damage(target_db, x, y, w, h);
+	if (!ldb_blur(origin_db, target_db, x, y, w, h, radius, kind, threads)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// convolve a region of the origin_db with a kernel, and store the result in the same region of the target_db
+static int lua_gfx_convolve(lua_State *L) {
+	drawbuffer_t *origin_db;
+	LUA_LDB_CHECK_DB(L, 1, origin_db)
+
+	drawbuffer_t *target_db;
+	LUA_LDB_CHECK_DB(L, 2, target_db)
+
+	// kernel values as a flat list, row by row
+	luaL_checktype(L, 3, LUA_TTABLE);
+	int len = lua_objlen(L, 3);
+	int kw = luaL_optinteger(L, 4, (int)floor(sqrt(len)+0.5));
+	int kh = (kw > 0) ? len/kw : 0;
+	if ((kw < 1) || (kh < 1) || (kw*kh != len) || (kw > LDB_CONVOLVE_MAX_SIZE) || (kh > LDB_CONVOLVE_MAX_SIZE) || (!(kw & 1)) || (!(kh & 1))) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Invalid kernel size");
+		return 2;
+	}
+	double kernel[LDB_CONVOLVE_MAX_SIZE*LDB_CONVOLVE_MAX_SIZE];
+	double sum = 0;
+	for (int i=0; i<len; i++) {
+		lua_rawgeti(L, 3, i+1);
+		kernel[i] = lua_tonumber(L, -1);
+		lua_pop(L, 1);
+		sum += kernel[i];
+	}
+
+	// the divisor defaults to the sum of the kernel values, so the brightness is kept
+	double divisor = luaL_optnumber(L, 5, (sum != 0) ? sum : 1);
+	if (divisor == 0) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Invalid divisor");
+		return 2;
+	}
+	for (int i=0; i<len; i++) {
+		kernel[i] /= divisor;
+		if (!(fabs(kernel[i]) <= LDB_CONVOLVE_MAX_VALUE)) {
+			lua_pushnil(L);
+			lua_pushstring(L, "Kernel values too large");
+			return 2;
+		}
+	}
+	double bias = luaL_optnumber(L, 6, 0);
+
+	const char* edge_str = luaL_optstring(L, 7, "clamp");
+	LDB_EDGE edge = ldb_edge_from_str(edge_str);
+	if (edge == LDB_EDGE_MAX) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Unknown edge mode: %s", edge_str);
+		return 2;
+	}
+
+	int x = luaL_optinteger(L, 8, 0);
+	int y = luaL_optinteger(L, 9, 0);
+	int w = luaL_optinteger(L, 10, origin_db->w);
+	int h = luaL_optinteger(L, 11, origin_db->h);
+
+	int threads = luaL_optinteger(L, 12, 1);
+	threads = (threads <= 0) ? ldb_threads_get_cpu_count() : threads;
+
+	if ((w <= 0) || (h <= 0)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Invalid region size");
+		return 2;
+	}
+
+	db_add_damage(target_db, x, y, w, h);
+	if (!ldb_convolve(origin_db, target_db, x, y, w, h, kernel, kw, kh, bias, edge, threads)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// erode or dilate a region of a 1bpp or 8bpp origin_db, and store the result in the same region of the target_db
+static int lua_gfx_morphology(lua_State *L) {
+	drawbuffer_t *origin_db;
+	LUA_LDB_CHECK_DB(L, 1, origin_db)
+
+	drawbuffer_t *target_db;
+	LUA_LDB_CHECK_DB(L, 2, target_db)
+
+	if ((origin_db->pxfmt != LDB_PXFMT_1BPP) && (origin_db->pxfmt != LDB_PXFMT_8BPP)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Morphology needs a 1bpp or 8bpp drawbuffer");
+		return 2;
+	}
+
+	const char* op = luaL_checkstring(L, 3);
+	int dilate;
+	if (strcmp(op, "dilate")==0) {
+		dilate = 1;
+	} else if (strcmp(op, "erode")==0) {
+		dilate = 0;
+	} else {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Unknown operation: %s", op);
+		return 2;
+	}
+
+	int kw = luaL_optinteger(L, 4, 3);
+	int kh = luaL_optinteger(L, 5, kw);
+	if ((kw < 1) || (kh < 1) || (kw > LDB_CONVOLVE_MAX_SIZE) || (kh > LDB_CONVOLVE_MAX_SIZE) || (!(kw & 1)) || (!(kh & 1))) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Invalid size");
+		return 2;
+	}
+
+	const char* shape_str = luaL_optstring(L, 6, "rect");
+	LDB_MORPH_SHAPE shape = ldb_morph_shape_from_str(shape_str);
+	if (shape == LDB_MORPH_MAX) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Unknown shape: %s", shape_str);
+		return 2;
+	}
+
+	const char* edge_str = luaL_optstring(L, 7, "clamp");
+	LDB_EDGE edge = ldb_edge_from_str(edge_str);
+	if (edge == LDB_EDGE_MAX) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Unknown edge mode: %s", edge_str);
+		return 2;
+	}
+
+	int x = luaL_optinteger(L, 8, 0);
+	int y = luaL_optinteger(L, 9, 0);
+	int w = luaL_optinteger(L, 10, origin_db->w);
+	int h = luaL_optinteger(L, 11, origin_db->h);
+
+	int threads = luaL_optinteger(L, 12, 1);
+	threads = (threads <= 0) ? ldb_threads_get_cpu_count() : threads;
+
+	if ((w <= 0) || (h <= 0)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Invalid region size");
+		return 2;
+	}
+
+	db_add_damage(target_db, x, y, w, h);
+	if (!ldb_morphology(origin_db, target_db, x, y, w, h, dilate, kw, kh, shape, edge, threads)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+
+	lua_pushboolean(L, 1);
+	return 1;
 }
 
+// composite a rectangular region of the origin_db onto the target_db, using a compositing mode
+static int lua_gfx_composite(lua_State *L) {
+	drawbuffer_t *origin_db;
+	LUA_LDB_CHECK_DB(L, 1, origin_db)
+
+	drawbuffer_t *target_db;
+	LUA_LDB_CHECK_DB(L, 2, target_db)
+
+	const char* mode = luaL_checkstring(L, 3);
+	composite_row_func_t composite_row = NULL;
+	for (int i=0; composite_modes[i].name; i++) {
+		if (strcmp(mode, composite_modes[i].name)==0) {
+			composite_row = composite_modes[i].func;
+			break;
+		}
+	}
+	if (!composite_row) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Unknown compositing mode: %s", mode);
+		return 2;
+	}
 
+	int target_x = lua_tointeger(L, 4);
+	int target_y = lua_tointeger(L, 5);
+	int origin_x = lua_tointeger(L, 6);
+	int origin_y = lua_tointeger(L, 7);
+	int w = lua_tointeger(L, 8);
+	int h = lua_tointeger(L, 9);
+	if ((w<=0) || (h<=0)) {
+		w = origin_db->w;
+		h = origin_db->h;
+	}
 
-// utillity function for floyd_steinberg dithering. Increment pixel by error * weight
-static inline void floyd_steinberg_increment_pixel(uint8_t* data, int w, PIX_FMT fmt, int x, int y, uint8_t weight, uint8_t r_err, uint8_t g_err, uint8_t b_err) {
-	uint32_t p = get_px(data, w, x, y, fmt);
-	uint32_t r, g, b, a;
-	UNPACK_RGBA(p,r,g,b,a)
+	if (clip_copy_rect(origin_db, target_db, &target_x, &target_y, &origin_x, &origin_y, &w, &h)) {
+		db_add_damage(target_db, target_x, target_y, w, h);
+		unpack_row_func_t unpack_origin = get_unpack_row_func(origin_db->pxfmt);
+		unpack_row_func_t unpack_target = get_unpack_row_func(target_db->pxfmt);
+		pack_row_func_t pack_target = get_pack_row_func(target_db->pxfmt);
+		uint32_t o_tmp[LDB_ROW_CHUNK];
+		uint32_t t_tmp[LDB_ROW_CHUNK];
+		for (int cy=0; cy<h; cy++) {
+			const uint8_t* o_row = db_get_row_ptr(origin_db, origin_y+cy);
+			uint8_t* t_row = db_get_row_ptr(target_db, target_y+cy);
+			for (int i=0; i<w; i+=LDB_ROW_CHUNK) {
+				int len = ((w-i) < LDB_ROW_CHUNK) ? (w-i) : LDB_ROW_CHUNK;
+				unpack_origin(o_row, origin_x+i, o_tmp, len);
+				unpack_target(t_row, target_x+i, t_tmp, len);
+				composite_row(t_tmp, o_tmp, len);
+				pack_target(t_row, target_x+i, t_tmp, len);
+			}
+		}
+	}
 
-	r += (r_err*weight)>>4;
-	g += (g_err*weight)>>4;
-	b += (b_err*weight)>>4;
-	set_px(data, w, x,y, pack_pixel_rgba(r>255?255:r, g>255?255:g, b>255?255:b, a), fmt);
+	lua_pushboolean(L, 1);
+	return 1;
 }
 
-// perform floyd_steinberg dithering to reduce the color bits per pixel. rmask/gmask/bmask are the pixel bits to keep.
-static inline void floyd_steinberg(const drawbuffer_t* db, uint8_t rmask, uint8_t gmask, uint8_t bmask) {
-	int cx,cy;
-	uint32_t sp,tp;
-	uint8_t r,g,b;
-	uint8_t r_err, g_err, b_err;
 
-	for (cy=0; cy < db->h; cy++) {
-		for (cx=0; cx < db->w; cx++) {
-			sp = get_px(db->data, db->w, cx,cy, db->pxfmt);
-			UNPACK_RGB(sp, r,g,b)
-			tp = pack_pixel_rgb(r&rmask,g&gmask,b&bmask);
-			set_px(db->data, db->w, cx,cy,tp, db->pxfmt);
-			r_err = r&(!rmask);
-			g_err = g&(!gmask);
-			b_err = b&(!bmask);
-			floyd_steinberg_increment_pixel(db->data, db->w, db->pxfmt, cx+1, cy  , 7, r_err, g_err, b_err);
-			floyd_steinberg_increment_pixel(db->data, db->w, db->pxfmt, cx-1, cy+1, 3, r_err, g_err, b_err);
-			floyd_steinberg_increment_pixel(db->data, db->w, db->pxfmt, cx  , cy+1, 5, r_err, g_err, b_err);
-			floyd_steinberg_increment_pixel(db->data, db->w, db->pxfmt, cx+1, cy+1, 1, r_err, g_err, b_err);
+
+// get the dither target from Lua argument i: Either a drawbuffer of the same size as db,
+// or the bpp(1, 8 or 16) to reduce the colors of db to in-place. Returns an error message or NULL.
+static const char* lua_dither_target(lua_State *L, int i, drawbuffer_t* db, drawbuffer_t** target_db, int bits[3], int* gray) {
+	*target_db = db;
+	if (lua_isnumber(L, i)) {
+		int bpp = lua_tointeger(L, i);
+		if (bpp==1) {
+			*gray = ldb_dither_format_bits(LDB_PXFMT_1BPP, bits);
+		} else if (bpp==8) {
+			*gray = ldb_dither_format_bits(LDB_PXFMT_8BPP_RGB332, bits);
+		} else if (bpp==16) {
+			*gray = ldb_dither_format_bits(LDB_PXFMT_16BPP_RGB565, bits);
+		} else {
+			return "Unknown bpp! Dithering is only supported for 1bpp, 8bpp and 16bpp or into a drawbuffer.";
 		}
+		return NULL;
+	}
+	*target_db = (drawbuffer_t *)luaL_checkudata(L, i, LDB_UDATA_NAME);
+	if ((*target_db==NULL) || (!db_is_valid(*target_db))) {
+		return "Target must be a drawbuffer or bpp";
+	} else if (((*target_db)->w != db->w) || ((*target_db)->h != db->h)) {
+		return "Target drawbuffer must have the same size";
 	}
+	*gray = ldb_dither_format_bits((*target_db)->pxfmt, bits);
+	return NULL;
 }
 
-// perform floyd_steinberg dithering on a drawbuffer from Lua
+// perform floyd_steinberg dithering on a drawbuffer from Lua. The colors are reduced in-place to a bpp(1, 8 or 16),
+// or to the leading bits of a bitmask for each channel.
 static int lua_gfx_floyd_steinberg(lua_State *L) {
 	drawbuffer_t *db;
 	LUA_LDB_CHECK_DB(L, 1, db)
 
+	drawbuffer_t *target_db = db;
+	int bits[3];
+	int gray = 0;
 	if (lua_isnumber(L, 3) && lua_isnumber(L, 4)) {
 		// lua arguments 2,3,4 are bitmasks
-		floyd_steinberg(db, lua_tointeger(L, 2), lua_tointeger(L, 3), lua_tointeger(L, 4));
-	} else if (lua_tointeger(L, 2)==1) {
-		floyd_steinberg(db, 0x80, 0x80, 0x80); // 1bpp
-	} else if (lua_tointeger(L, 2)==8) {
-		floyd_steinberg(db, 0xe0, 0xe0, 0xc0); // 8bpp rgb332
-	} else if (lua_tointeger(L, 2)==16) {
-		floyd_steinberg(db, 0xf8, 0xfc, 0xf8); // 16bpp 565
-	} else {
+		for (int c=0; c<3; c++) {
+			int mask = lua_tointeger(L, 2+c);
+			bits[c] = 0;
+			while ((bits[c] < 8) && (mask & (0x80>>bits[c]))) {
+				bits[c]++;
+			}
+		}
+	} else if ((!lua_isnumber(L, 2)) || lua_dither_target(L, 2, db, &target_db, bits, &gray)) {
 		lua_pushnil(L);
 		lua_pushstring(L, "Unknown bpp/no mask! Dithering is only supported for 1bpp, 8bpp and 16bpp or using a bitmask for each channel.");
 		return 2;
 	}
+	if (!ldb_error_diffusion(db, db, bits, gray, NULL, 0, LDB_DIFFUSION_FLOYD_STEINBERG, 0, 1)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+	db_add_damage_all(db);
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// perform error diffusion dithering from Lua. The target is a drawbuffer or bpp(see lua_dither_target),
+// the optional palette is a drawbuffer with a color in each pixel.
+static int lua_gfx_error_diffusion(lua_State *L) {
+	drawbuffer_t *db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	drawbuffer_t *target_db;
+	int bits[3];
+	int gray = 0;
+	const char* err = lua_dither_target(L, 2, db, &target_db, bits, &gray);
+	if (err) {
+		lua_pushnil(L);
+		lua_pushstring(L, err);
+		return 2;
+	}
+
+	const char* kernel_str = luaL_optstring(L, 3, "floyd_steinberg");
+	LDB_DIFFUSION kernel = ldb_diffusion_from_str(kernel_str);
+	if (kernel == LDB_DIFFUSION_MAX) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Unknown error diffusion kernel: %s", kernel_str);
+		return 2;
+	}
+
+	uint32_t palette[LDB_DITHER_PALETTE_MAX];
+	int palette_len = 0;
+	if (!lua_isnoneornil(L, 4)) {
+		drawbuffer_t *palette_db;
+		LUA_LDB_CHECK_DB(L, 4, palette_db)
+		palette_len = palette_db->w*palette_db->h;
+		if ((palette_len <= 0) || (palette_len > LDB_DITHER_PALETTE_MAX)) {
+			lua_pushnil(L);
+			lua_pushstring(L, "Palette must have 1-256 colors");
+			return 2;
+		}
+		for (int y=0; y<palette_db->h; y++) {
+			db_unpack_row(palette_db, 0, y, palette + y*palette_db->w, palette_db->w);
+		}
+		gray = 0;
+	}
+
+	int serpentine = lua_isnoneornil(L, 5) ? 1 : lua_toboolean(L, 5);
+	int threads = luaL_optinteger(L, 6, 1);
+	threads = (threads <= 0) ? ldb_threads_get_cpu_count() : threads;
+
+	if (!ldb_error_diffusion(db, target_db, bits, gray, (palette_len > 0) ? palette : NULL, palette_len, kernel, serpentine, threads)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+	db_add_damage_all(target_db);
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// perform ordered dithering from Lua. The target is a drawbuffer or bpp(see lua_dither_target),
+// the matrix is a Bayer matrix name or a drawbuffer.
+static int lua_gfx_ordered_dither(lua_State *L) {
+	drawbuffer_t *db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	drawbuffer_t *target_db;
+	int bits[3];
+	int gray = 0;
+	const char* err = lua_dither_target(L, 2, db, &target_db, bits, &gray);
+	if (err) {
+		lua_pushnil(L);
+		lua_pushstring(L, err);
+		return 2;
+	}
+
+	int mw, mh;
+	drawbuffer_t *matrix_db = NULL;
+	if (lua_isnoneornil(L, 3) || (lua_type(L, 3) == LUA_TSTRING)) {
+		const char* matrix_str = luaL_optstring(L, 3, "bayer8");
+		mw = ldb_dither_bayer_size_from_str(matrix_str);
+		mh = mw;
+		if (mw == 0) {
+			lua_pushnil(L);
+			lua_pushfstring(L, "Unknown dither matrix: %s", matrix_str);
+			return 2;
+		}
+	} else {
+		LUA_LDB_CHECK_DB(L, 3, matrix_db)
+		mw = matrix_db->w;
+		mh = matrix_db->h;
+		if ((mw <= 0) || (mh <= 0)) {
+			lua_pushnil(L);
+			lua_pushstring(L, "Invalid dither matrix size");
+			return 2;
+		}
+	}
+
+	int threads = luaL_optinteger(L, 4, 1);
+	threads = (threads <= 0) ? ldb_threads_get_cpu_count() : threads;
+
+	uint8_t* matrix = malloc((size_t)mw*mh);
+	if (!matrix) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+	if (matrix_db) {
+		ldb_dither_thresholds_from_db(matrix_db, matrix);
+	} else {
+		ldb_dither_bayer(matrix, mw);
+	}
+	int ok = ldb_ordered_dither(db, target_db, bits, gray, matrix, mw, mh, threads);
+	free(matrix);
+	if (!ok) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+	db_add_damage_all(target_db);
 
 	lua_pushboolean(L, 1);
 	return 1;
@@ -162,28 +829,126 @@ static inline float capsuleSDF(float px, float py, float ax, float ay, float bx,
     return sqrtf(dx * dx + dy * dy) - r;
 }
 
-// draw a smooth line by using a signed distance function to color the border region with reduces alpha(No "jagged edges", but expensive)
-static inline void line_smooth(uint8_t* data, int w, int h, PIX_FMT fmt, float x0, float y0, float x1, float y1, uint32_t p, float radius) {
-	float alpha;
-	int cx, cy;
+// get the x range where the horizontal line at py intersects the circle at cx,cy with radius r. Returns 0 if they don't intersect.
+static inline int circle_row_span(double py, double cx, double cy, double r, double* x0, double* x1) {
+	double dy = py - cy;
+	double d2 = r*r - dy*dy;
+	if ((r < 0) || (d2 < 0)) {
+		return 0;
+	}
+	double dx = sqrt(d2);
+	*x0 = cx - dx;
+	*x1 = cx + dx;
+	return 1;
+}
+
+// get the x range where the horizontal line at py intersects the capsule(all points within distance r of the
+// line from ax,ay to bx,by). The capsule is convex, so this is the range spanned by the intersections with
+// the end circles and the rectangle between them. Returns 0 if they don't intersect.
+static inline int capsule_row_span(double py, double ax, double ay, double bx, double by, double r, double* x0, double* x1) {
+	double lo = INFINITY, hi = -INFINITY, c0, c1;
+	if (circle_row_span(py, ax, ay, r, &c0, &c1)) {
+		lo = fmin(lo, c0);
+		hi = fmax(hi, c1);
+	}
+	if (circle_row_span(py, bx, by, r, &c0, &c1)) {
+		lo = fmin(lo, c0);
+		hi = fmax(hi, c1);
+	}
+	double bax = bx - ax, bay = by - ay, pay = py - ay;
+	double len = sqrt(bax*bax + bay*bay);
+	if ((r >= 0) && (len > 0)) {
+		// projection onto the line 0 <= ((x-ax)*bax + pay*bay)/len^2 <= 1, distance |(x-ax)*bay - pay*bax|/len <= r.
+		// Both are linear in x, so each limits x to a range.
+		double r_lo = -INFINITY, r_hi = INFINITY;
+		if (bax != 0) {
+			double t0 = ax - pay*bay/bax;
+			double t1 = ax + (len*len - pay*bay)/bax;
+			r_lo = fmax(r_lo, fmin(t0, t1));
+			r_hi = fmin(r_hi, fmax(t0, t1));
+		} else if ((pay*bay < 0) || (pay*bay > len*len)) {
+			r_hi = -INFINITY;
+		}
+		if (bay != 0) {
+			double t0 = ax + (pay*bax - r*len)/bay;
+			double t1 = ax + (pay*bax + r*len)/bay;
+			r_lo = fmax(r_lo, fmin(t0, t1));
+			r_hi = fmin(r_hi, fmax(t0, t1));
+		} else if (fabs(pay*bax) > r*len) {
+			r_hi = -INFINITY;
+		}
+		if (r_lo <= r_hi) {
+			lo = fmin(lo, r_lo);
+			hi = fmax(hi, r_hi);
+		}
+	}
+	*x0 = lo;
+	*x1 = hi;
+	return lo <= hi;
+}
+
+// get the pixel range of a row that is drawn with full alpha(inner) or at all(outer) for a shape with a signed distance
+// function, from the ranges where the shape shrunk(inner) or grown(outer) by 0.5 intersects the row.
+// The outer range is rounded outwards and the inner range inwards, so a pixel where the SDF is evaluated with less
+// precision is never drawn with full alpha or skipped.
+// Pixels are sampled at integer coordinates. The ranges are clipped to 0..w-1, and are empty if x0 > x1.
+static inline void sdf_row_ranges(int inner, double in_x0, double in_x1, int outer, double out_x0, double out_x1, int w, int* ix0, int* ix1, int* ox0, int* ox1) {
+	*ix0 = 0;
+	*ix1 = -1;
+	*ox0 = 0;
+	*ox1 = -1;
+	if (outer) {
+		*ox0 = (int)fmax(floor(out_x0), 0);
+		*ox1 = (int)fmin(ceil(out_x1), w-1);
+	}
+	if (inner) {
+		*ix0 = (int)fmax(ceil(in_x0), 0);
+		*ix1 = (int)fmin(floor(in_x1), w-1);
+	}
+}
+
+// draw a smooth line by using a signed distance function to color the border region with reduced alpha(no "jagged edges").
+// For each row, the range where the line is solid is computed analytically and blended at once, and the SDF is only
+// evaluated for the antialiased pixels at the ends of the row.
+static inline void line_smooth(const drawbuffer_t* db, float x0, float y0, float x1, float y1, uint32_t p, float radius) {
+	uint32_t src[LDB_ROW_CHUNK];
 	float a = p & 0xff;
 
-    int x_min = (int)floorf(fminf(x0, x1) - radius);
-    int x_max = (int) ceilf(fmaxf(x0, x1) + radius);
-    int y_min = (int)floorf(fminf(y0, y1) - radius);
-    int y_max = (int) ceilf(fmaxf(y0, y1) + radius);
-
-	// clamp to screen region
-	x_min = (x_min<0) ? 0 : ((x_min>=w) ? w-1 : x_min);
-	x_max = (x_max<0) ? 0 : ((x_max>=w) ? w-1 : x_max);
-	y_min = (y_min<0) ? 0 : ((y_min>=h) ? h-1 : y_min);
-	y_max = (y_max<0) ? 0 : ((y_max>=h) ? h-1 : y_max);
-
-    for (cy = y_min; cy <= y_max; cy++) {
-		for (cx = x_min; cx <= x_max; cx++) {
-			alpha = fmaxf(fminf(0.5f - capsuleSDF(cx, cy, x0, y0, x1, y1, radius), 1.0f), 0.0f)*(float)a;
-			if (alpha>0) {
-				set_px_alphablend(data, w, cx,cy, (p&0xffffff00) | (uint32_t)alpha, fmt);
+	int y_min = (int)floorf(fminf(y0, y1) - radius);
+	int y_max = (int) ceilf(fmaxf(y0, y1) + radius);
+
+	// clip to screen region
+	if ((y_max < 0) || (y_min >= db->h)) {
+		return;
+	}
+	y_min = (y_min<0) ? 0 : y_min;
+	y_max = (y_max>=db->h) ? db->h-1 : y_max;
+
+	for (int cy = y_min; cy <= y_max; cy++) {
+		double in_x0, in_x1, out_x0, out_x1;
+		int inner = capsule_row_span(cy, x0, y0, x1, y1, radius-0.5, &in_x0, &in_x1);
+		int outer = capsule_row_span(cy, x0, y0, x1, y1, radius+0.5, &out_x0, &out_x1);
+		int ix0, ix1, ox0, ox1;
+		sdf_row_ranges(inner, in_x0, in_x1, outer, out_x0, out_x1, db->w, &ix0, &ix1, &ox0, &ox1);
+		uint8_t* row = db_get_row_ptr(db, cy);
+		if (ix0 <= ix1) {
+			blend_row(row, ix0, db->pxfmt, p, ix1-ix0+1);
+		}
+
+		// antialiased pixels left and right of the solid range
+		int band[2][2] = { { ox0, (ix0 <= ix1) ? ix0-1 : ox1 }, { (ix0 <= ix1) ? ix1+1 : ox1+1, ox1 } };
+		for (int b=0; b<2; b++) {
+			for (int cx = band[b][0]; cx <= band[b][1]; cx += LDB_ROW_CHUNK) {
+				int len = ((band[b][1]-cx+1) < LDB_ROW_CHUNK) ? (band[b][1]-cx+1) : LDB_ROW_CHUNK;
+				int visible = 0;
+				for (int i=0; i<len; i++) {
+					float alpha = fmaxf(fminf(0.5f - capsuleSDF(cx+i, cy, x0, y0, x1, y1, radius), 1.0f), 0.0f)*a;
+					src[i] = (p&0xffffff00) | (uint32_t)alpha;
+					visible |= (uint32_t)alpha;
+				}
+				if (visible) {
+					blend_row_src(row, cx, db->pxfmt, src, len);
+				}
 			}
 		}
 	}
@@ -243,6 +1008,23 @@ static inline void db_line(const drawbuffer_t* db, int x0, int y0, int x1, int y
 	}
 }
 
+// draw a line on a drawbuffer and record the damage.
+// If radius>0, draw using capsule signed distance function and alphablending(smooth edge, supports float coordinates),
+// otherwise using Bresenham with the integer coordinates of the pixel-centers.
+static void gfx_line(drawbuffer_t* db, float x0, float y0, float x1, float y1, uint32_t p, float radius, int alphablend) {
+	if (radius > 0) {
+		line_smooth(db, x0, y0, x1, y1, p, radius);
+		db_add_damage_corners(db, floorf(fminf(x0, x1) - radius - 1), floorf(fminf(y0, y1) - radius - 1), ceilf(fmaxf(x0, x1) + radius + 1), ceilf(fmaxf(y0, y1) + radius + 1));
+	} else {
+		int ix0 = floorf(x0+0.5f);
+		int iy0 = floorf(y0+0.5f);
+		int ix1 = floorf(x1+0.5f);
+		int iy1 = floorf(y1+0.5f);
+		db_line(db, ix0, iy0, ix1, iy1, p, alphablend);
+		db_add_damage_corners(db, ix0, iy0, ix1, iy1);
+	}
+}
+
 // draw a line on a drawbuffer from Lua
 static int lua_gfx_line(lua_State *L) {
 	drawbuffer_t* db;
@@ -253,12 +1035,6 @@ static int lua_gfx_line(lua_State *L) {
 	float x1 = lua_tonumber(L, 4);
 	float y1 = lua_tonumber(L, 5);
 
-	// the integer coordinates are for the pixel-centers
-	int ix0 = x0+0.5;
-	int iy0 = y0+0.5;
-	int ix1 = x1+0.5;
-	int iy1 = y1+0.5;
-
 	int r = lua_tointeger(L, 6);
 	int g = lua_tointeger(L, 7);
 	int b = lua_tointeger(L, 8);
@@ -270,95 +1046,133 @@ static int lua_gfx_line(lua_State *L) {
 	}
 	uint32_t tp = pack_pixel_rgba(r,g,b,a);
 
-	float radius;
 	if (lua_isnumber(L, 10)) {
-		// draw using capsule signed distance function and alphablending(smooth edge)
-		// the SDF supports float coordinates in a usefull way
-		radius = lua_tonumber(L, 10);
-		if (radius <= 0) {
-			radius = 1;
-		}
-		line_smooth(db->data, db->w, db->h, db->pxfmt, x0, y0, x1, y1, tp, radius);
-		return 0;
+		// smooth line, with float coordinates
+		float radius = lua_tonumber(L, 10);
+		gfx_line(db, x0, y0, x1, y1, tp, (radius <= 0) ? 1 : radius, 0);
 	} else {
-		// draw using Bresenham
-		db_line(db, ix0, iy0, ix1, iy1, tp, lua_toboolean(L, 10));
-		return 0;
+		gfx_line(db, x0, y0, x1, y1, tp, 0, lua_toboolean(L, 10));
 	}
+	return 0;
 }
 
 
 
-// set xmin,xmax,ymin,ymax to corresponding values in x0,y0,x1,y1, and clamp coordinates to drawbuffer dimensions
-static inline void rectangle_args_prep(const drawbuffer_t* db, int x0, int y0, int x1, int y1, int* xmin, int* xmax, int* ymin, int* ymax) {
-	x0 = (x0<0) ? 0 : x0;
-	x0 = (x0>=db->w) ? (db->w-1) : x0;
-	y0 = (y0<0) ? 0 : y0;
-	y0 = (y0>=db->h) ? (db->h-1) : y0;
-	x1 = (x1<0) ? 0 : x1;
-	x1 = (x1>=db->w) ? (db->w-1) : x1;
-	y1 = (y1<0) ? 0 : y1;
-	y1 = (y1>=db->h) ? (db->h-1) : y1;
+// set xmin,xmax,ymin,ymax to corresponding values in x0,y0,x1,y1(exclusive), and clip them to the drawbuffer dimensions.
+// Returns 0 if the rectangle is not visible.
+static inline int rectangle_args_prep(const drawbuffer_t* db, int x0, int y0, int x1, int y1, int* xmin, int* xmax, int* ymin, int* ymax) {
 	*xmin = (x0<x1) ? x0 : x1;
 	*xmax = (x0<x1) ? x1 : x0;
 	*ymin = (y0<y1) ? y0 : y1;
 	*ymax = (y0<y1) ? y1 : y0;
+	*xmin = (*xmin<0) ? 0 : *xmin;
+	*xmax = (*xmax>db->w) ? db->w : *xmax;
+	*ymin = (*ymin<0) ? 0 : *ymin;
+	*ymax = (*ymax>db->h) ? db->h : *ymax;
+	return (*xmin<*xmax) && (*ymin<*ymax);
 }
 
-static inline void rectangle_fill(uint8_t* data, int w, PIX_FMT fmt, int xmin, int ymin, int xmax, int ymax, uint32_t p) {
-	for (int cy = ymin; cy < ymax; cy++) {
-		for (int cx = xmin; cx < xmax; cx++) {
-			set_px(data, w, cx,cy, p, fmt);
+static inline void rectangle_fill(const drawbuffer_t* db, int xmin, int ymin, int xmax, int ymax, uint32_t p) {
+	if ((xmax <= xmin) || (ymax <= ymin)) {
+		return;
+	}
+	// pack the first row once, then replicate the span to the other rows
+	uint8_t* first_row = db_get_row_ptr(db, ymin);
+	fill_row(first_row, xmin, db->pxfmt, p, xmax-xmin);
+	if (get_bpp(db->pxfmt) < 8) {
+		for (int cy = ymin+1; cy < ymax; cy++) {
+			fill_row(db_get_row_ptr(db, cy), xmin, db->pxfmt, p, xmax-xmin);
 		}
+		return;
+	}
+	size_t bytes_per_px = get_bpp(db->pxfmt)/8;
+	for (int cy = ymin+1; cy < ymax; cy++) {
+		memcpy(db_get_row_ptr(db, cy)+xmin*bytes_per_px, first_row+xmin*bytes_per_px, (xmax-xmin)*bytes_per_px);
 	}
 }
-static inline void rectangle_fill_alphablend(uint8_t* data, int w, PIX_FMT fmt, int xmin, int ymin, int xmax, int ymax, uint32_t p) {
+static inline void rectangle_fill_alphablend(const drawbuffer_t* db, int xmin, int ymin, int xmax, int ymax, uint32_t p) {
+	if (xmax <= xmin) {
+		return;
+	}
 	for (int cy = ymin; cy < ymax; cy++) {
-		for (int cx = xmin; cx < xmax; cx++) {
-			set_px_alphablend(data, w, cx,cy, p, fmt);
-		}
+		blend_row(db_get_row_ptr(db, cy), xmin, db->pxfmt, p, xmax-xmin);
 	}
 }
 static inline void db_rectangle_fill(const drawbuffer_t* db, int x0, int y0, int x1, int y1, uint32_t p, int alphablend) {
 	int xmin,xmax,ymin,ymax;
-	rectangle_args_prep(db, x0,y0,x1,y1, &xmin,&xmax,&ymin,&ymax);
+	if (!rectangle_args_prep(db, x0,y0,x1,y1, &xmin,&xmax,&ymin,&ymax)) {
+		return;
+	}
 
 	if (alphablend) {
-		rectangle_fill_alphablend(db->data, db->w, db->pxfmt, xmin, ymin, xmax,ymax, p);
+		rectangle_fill_alphablend(db, xmin, ymin, xmax,ymax, p);
 	} else {
-		rectangle_fill(db->data, db->w, db->pxfmt, xmin, ymin, xmax,ymax, p);
+		rectangle_fill(db, xmin, ymin, xmax,ymax, p);
 	}
 }
 
-static inline void rectangle_outline(uint8_t* data, int w, PIX_FMT fmt, int xmin, int ymin, int xmax, int ymax, uint32_t p) {
-	for (int cx = xmin; cx < xmax; cx++) {
-		set_px(data, w, cx,ymin, p, fmt);
-		set_px(data, w, cx,ymax, p, fmt);
+// draw the border pixels of the rectangle from x0,y0 to x1,y1(inclusive, sorted). Only the visible parts are drawn.
+static inline void rectangle_outline(const drawbuffer_t* db, int x0, int y0, int x1, int y1, uint32_t p) {
+	int xmin = (x0<0) ? 0 : x0;
+	int xmax = (x1>=db->w) ? db->w-1 : x1;
+	if (xmin <= xmax) {
+		if ((y0>=0) && (y0<db->h)) {
+			fill_row(db_get_row_ptr(db, y0), xmin, db->pxfmt, p, xmax-xmin+1);
+		}
+		if ((y1!=y0) && (y1>=0) && (y1<db->h)) {
+			fill_row(db_get_row_ptr(db, y1), xmin, db->pxfmt, p, xmax-xmin+1);
+		}
 	}
-	for (int cy = ymin; cy < ymax; cy++) {
-		set_px(data, w, xmin,cy, p, fmt);
-		set_px(data, w, xmax,cy, p, fmt);
+	int ymin = (y0+1<0) ? 0 : y0+1;
+	int ymax = (y1-1>=db->h) ? db->h-1 : y1-1;
+	for (int cy = ymin; cy <= ymax; cy++) {
+		db_set_px(db, x0,cy, p);
+		if (x1!=x0) {
+			db_set_px(db, x1,cy, p);
+		}
 	}
 }
-static inline void rectangle_outline_alphablend(uint8_t* data, int w, PIX_FMT fmt, int xmin, int ymin, int xmax, int ymax, uint32_t p) {
-	for (int cx = xmin; cx < xmax; cx++) {
-		set_px_alphablend(data, w, cx,ymin, p, fmt);
-		set_px_alphablend(data, w, cx,ymax, p, fmt);
+static inline void rectangle_outline_alphablend(const drawbuffer_t* db, int x0, int y0, int x1, int y1, uint32_t p) {
+	int xmin = (x0<0) ? 0 : x0;
+	int xmax = (x1>=db->w) ? db->w-1 : x1;
+	if (xmin <= xmax) {
+		if ((y0>=0) && (y0<db->h)) {
+			blend_row(db_get_row_ptr(db, y0), xmin, db->pxfmt, p, xmax-xmin+1);
+		}
+		if ((y1!=y0) && (y1>=0) && (y1<db->h)) {
+			blend_row(db_get_row_ptr(db, y1), xmin, db->pxfmt, p, xmax-xmin+1);
+		}
 	}
-	for (int cy = ymin; cy < ymax; cy++) {
-		set_px_alphablend(data, w, xmin,cy, p, fmt);
-		set_px_alphablend(data, w, xmax,cy, p, fmt);
+	int ymin = (y0+1<0) ? 0 : y0+1;
+	int ymax = (y1-1>=db->h) ? db->h-1 : y1-1;
+	for (int cy = ymin; cy <= ymax; cy++) {
+		db_set_px_alphablend(db, x0,cy, p);
+		if (x1!=x0) {
+			db_set_px_alphablend(db, x1,cy, p);
+		}
 	}
 }
 static inline void db_rectangle_outline(const drawbuffer_t* db, int x0, int y0, int x1, int y1, uint32_t p, int alphablend) {
-	int xmin,xmax,ymin,ymax;
-	rectangle_args_prep(db, x0,y0,x1,y1, &xmin,&xmax,&ymin,&ymax);
+	int xmin = (x0<x1) ? x0 : x1;
+	int xmax = (x0<x1) ? x1 : x0;
+	int ymin = (y0<y1) ? y0 : y1;
+	int ymax = (y0<y1) ? y1 : y0;
 
 	if (alphablend) {
-		rectangle_outline_alphablend(db->data, db->w, db->pxfmt, xmin, ymin, xmax,ymax, p);
+		rectangle_outline_alphablend(db, xmin, ymin, xmax,ymax, p);
+	} else {
+		rectangle_outline(db, xmin, ymin, xmax,ymax, p);
+	}
+}
+
+// draw a rectangle on a drawbuffer and record the damage
+static void gfx_rectangle(drawbuffer_t* db, int x, int y, int w, int h, uint32_t p, int outline, int alphablend) {
+	if (outline) {
+		db_rectangle_outline(db, x, y, x+w, y+h, p, alphablend);
 	} else {
-		rectangle_outline(db->data, db->w, db->pxfmt, xmin, ymin, xmax,ymax, p);
+		db_rectangle_fill(db, x, y, x+w, y+h, p, alphablend);
 	}
+	db_add_damage_corners(db, x, y, x+w, y+h);
 }
 
 // draw a rectangle in a drawbuffer from Lua
@@ -383,14 +1197,7 @@ static int lua_gfx_rectangle(lua_State *L) {
 	}
 	uint32_t p = pack_pixel_rgba(r,g,b,a);
 
-	int outline = lua_toboolean(L, 10);
-	int alphablend = lua_toboolean(L, 11);
-
-	if (outline) {
-		db_rectangle_outline(db, x, y, x+w, y+h, p, alphablend);
-	} else {
-		db_rectangle_fill(db, x, y, x+w, y+h, p, alphablend);
-	}
+	gfx_rectangle(db, x,y, w,h, p, lua_toboolean(L, 10), lua_toboolean(L, 11));
 
 	return 0;
 }
@@ -404,86 +1211,84 @@ static int lua_gfx_rectangle(lua_State *L) {
 
 
 
-// prepare arguments for setting a vertical line. Check agains width to safely set pixels.
-static inline void set_vline_args_prep(int w, float x0, float x1, int* xmin, int* xmax) {
+// prepare arguments for setting a vertical line. Clip against width to safely set pixels, returns 0 if not visible.
+static inline int set_vline_args_prep(int w, float x0, float x1, int* xmin, int* xmax) {
 	*xmin = (x0 < x1) ? x0 : x1;
 	*xmax = (x0 > x1) ? x0 : x1;
+	if ((*xmax < 0) || (*xmin >= w)) {
+		return 0;
+	}
 	*xmin = (*xmin < 0) ? 0 : *xmin;
-	*xmin = (*xmin >= w) ? w-1 : *xmin;
-	*xmax = (*xmax < 0) ? 0 : *xmax;
 	*xmax = (*xmax >= w) ? w-1 : *xmax;
+	return 1;
 }
 
-static inline void set_vline(uint8_t* data, int w, PIX_FMT fmt, int y, float x0, float x1, uint32_t tp) {
+static inline void set_vline(const drawbuffer_t* db, int y, float x0, float x1, uint32_t tp) {
 	int xmin,xmax;
-	set_vline_args_prep(w, x0, x1, &xmin, &xmax);
-	for (int cx=xmin; cx<=xmax; cx++) {
-		set_px(data, w, cx, y, tp, fmt);
+	if (set_vline_args_prep(db->w, x0, x1, &xmin, &xmax)) {
+		fill_row(db_get_row_ptr(db, y), xmin, db->pxfmt, tp, xmax-xmin+1);
 	}
 }
 
-static inline void set_vline_alphablend(uint8_t* data, int w, PIX_FMT fmt, int y, float x0, float x1, uint32_t tp) {
+static inline void set_vline_alphablend(const drawbuffer_t* db, int y, float x0, float x1, uint32_t tp) {
 	int xmin,xmax;
-	set_vline_args_prep(w, x0, x1, &xmin, &xmax);
-	for (int cx=xmin; cx<=xmax; cx++) {
-		set_px_alphablend(data, w, cx, y, tp, fmt);
+	if (set_vline_args_prep(db->w, x0, x1, &xmin, &xmax)) {
+		blend_row(db_get_row_ptr(db, y), xmin, db->pxfmt, tp, xmax-xmin+1);
 	}
 }
 
-// fill the flat(at the top) triangle. vertice y must be ascending.
-static inline void triangle_top(uint8_t* data, int w, int h, PIX_FMT fmt, float x0, float y0, float x1, float y1, float x2, float y2, uint32_t tp, int alphablend) {
-	float slope1 = (x2-x0)/(y2-y0);
-	float slope2 = (x2-x1)/(y2-y1);
-	float cx1 = x2;
-	float cx2 = x2;
+// x of the edge from xa,ya to xb,yb at the row y. Computed for each row(instead of adding the slope), and
+// clamped to the edge, so rounding errors never move a span outside of the triangle.
+static inline float triangle_edge_x(float xa, float ya, float xb, float yb, int y) {
+	if (ya == yb) {
+		return xa;
+	}
+	float x = xa + (xb-xa)*((float)y-ya)/(yb-ya);
+	float x_min = (xa < xb) ? xa : xb;
+	float x_max = (xa < xb) ? xb : xa;
+	return (x < x_min) ? x_min : ((x > x_max) ? x_max : x);
+}
 
-	void (*set_vline_ptr)(uint8_t*, int, PIX_FMT, int, float, float, uint32_t) = &set_vline;
+// fill the flat(at the top) triangle. vertice y must be ascending.
+static inline void triangle_top(const drawbuffer_t* db, float x0, float y0, float x1, float y1, float x2, float y2, uint32_t tp, int alphablend) {
+	void (*set_vline_ptr)(const drawbuffer_t*, int, float, float, uint32_t) = &set_vline;
 	if (alphablend) {
 		set_vline_ptr = &set_vline_alphablend;
 	}
 
 	for (int cy=y2; cy>=y0; cy--) {
-		if ((cy>=0)&&(cy<h)) {
-			set_vline_ptr(data, w, fmt, cy, cx1, cx2, tp);
+		if ((cy>=0)&&(cy<db->h)) {
+			set_vline_ptr(db, cy, triangle_edge_x(x2,y2, x0,y0, cy), triangle_edge_x(x2,y2, x1,y1, cy), tp);
 		}
-		cx1 -= slope1;
-		cx2 -= slope2;
 	}
 }
 
 // fill the flat(at the bottom) triangle. vertice y must be ascending.
-static inline void triangle_bottom(uint8_t* data, int w, int h, PIX_FMT fmt, float x0, float y0, float x1, float y1, float x2, float y2, uint32_t tp, int alphablend) {
-	float slope1 = (x1-x0) / (y1-y0);
-	float slope2 = (x2-x0) / (y2-y0);
-	float cx1 = x0;
-	float cx2 = x0;
-
-	void (*set_vline_ptr)(uint8_t*, int, PIX_FMT, int, float, float, uint32_t) = &set_vline;
+static inline void triangle_bottom(const drawbuffer_t* db, float x0, float y0, float x1, float y1, float x2, float y2, uint32_t tp, int alphablend) {
+	void (*set_vline_ptr)(const drawbuffer_t*, int, float, float, uint32_t) = &set_vline;
 	if (alphablend) {
 		set_vline_ptr = &set_vline_alphablend;
 	}
 
 	for (int cy=y0; cy<=y1; cy++) {
-		if ((cy>=0)&&(cy<h)) {
-			set_vline_ptr(data, w, fmt, cy, cx1, cx2, tp);
+		if ((cy>=0)&&(cy<db->h)) {
+			set_vline_ptr(db, cy, triangle_edge_x(x0,y0, x1,y1, cy), triangle_edge_x(x0,y0, x2,y2, cy), tp);
 		}
-		cx1 += slope1;
-		cx2 += slope2;
 	}
 }
 
 static void triangle_args_prep(int* x0, int* y0, int* x1, int* y1, int* x2, int* y2, int* split) {
 	// sort by y
 	int tmp_x, tmp_y;
-	if (y0 > y2) {
+	if (*y0 > *y2) {
 		tmp_x = *x0; *x0 = *x2; *x2 = tmp_x;
 		tmp_y = *y0; *y0 = *y2; *y2 = tmp_y;
 	}
-	if (y0 > y1) {
+	if (*y0 > *y1) {
 		tmp_x = *x0; *x0 = *x1; *x1 = tmp_x;
 		tmp_y = *y0; *y0 = *y1; *y1 = tmp_y;
 	}
-	if (y1 > y2) {
+	if (*y1 > *y2) {
 		tmp_x = *x1; *x1 = *x2; *x2 = tmp_x;
 		tmp_y = *y1; *y1 = *y2; *y2 = tmp_y;
 	}
@@ -502,15 +1307,25 @@ static inline void triangle(const drawbuffer_t* db, int x0, int y0, int x1, int
 	}
 
 	if (y1==y2) {
-		triangle_bottom(db->data, db->w, db->h, db->pxfmt, x0,y0, x1,y1, x2,y2, tp, alphablend);
+		triangle_bottom(db, x0,y0, x1,y1, x2,y2, tp, alphablend);
 	} else if (y0==y1) {
-		triangle_top(db->data, db->w, db->h, db->pxfmt, x0,y0, x1,y1, x2,y2, tp, alphablend);
+		triangle_top(db, x0,y0, x1,y1, x2,y2, tp, alphablend);
 	} else {
-		triangle_bottom(db->data, db->w, db->h, db->pxfmt, x0,y0, x1,y1, split,y1, tp, alphablend);
-		triangle_top(db->data, db->w, db->h, db->pxfmt, x1,y1, split,y1, x2,y2, tp, alphablend);
+		triangle_bottom(db, x0,y0, x1,y1, split,y1, tp, alphablend);
+		triangle_top(db, x1,y1, split,y1, x2,y2, tp, alphablend);
 	}
 }
 
+// draw a triangle on a drawbuffer and record the damage
+static void gfx_triangle(drawbuffer_t* db, int x0, int y0, int x1, int y1, int x2, int y2, uint32_t p, int alphablend) {
+	triangle(db, x0,y0, x1,y1, x2,y2, p, alphablend);
+	int x_min = (x0<x1) ? x0 : x1;
+	int y_min = (y0<y1) ? y0 : y1;
+	int x_max = (x0>x1) ? x0 : x1;
+	int y_max = (y0>y1) ? y0 : y1;
+	db_add_damage_corners(db, (x_min<x2) ? x_min : x2, (y_min<y2) ? y_min : y2, (x_max>x2) ? x_max : x2, (y_max>y2) ? y_max : y2);
+}
+
 // draw a triangle on a drawbuffer from Lua
 static int lua_gfx_triangle(lua_State *L) {
 	drawbuffer_t *db;
@@ -530,21 +1345,822 @@ static int lua_gfx_triangle(lua_State *L) {
 
 	if ( (r < 0) || (g < 0) || (b < 0) || (a < 0) || (r > 255) || (g > 255) || (b > 255) || (a > 255) ) {
 		lua_pushnil(L);
-		lua_pushstring(L, "invalid r,g,b,a value");
+		lua_pushstring(L, "invalid r,g,b,a value");
+		return 2;
+	}
+
+	gfx_triangle(db, x0,y0, x1,y1, x2,y2, pack_pixel_rgba(r,g,b,a), lua_toboolean(L, 12));
+
+	return 0;
+}
+
+
+
+
+
+
+// add the signed area of the segment x0,y0 - x1,y1(inside one pixel row, 0<=x<=w) to the accumulation buffer.
+// Each cell receives the change of coverage from the previous pixel, so a prefix sum gives the coverage.
+static inline void poly_accumulate_segment(float* acc, float x0, float y0, float x1, float y1, float dir) {
+	float d = (y1-y0)*dir;
+	if (d == 0) {
+		return;
+	}
+	float xa = (x0 < x1) ? x0 : x1;
+	float xb = (x0 < x1) ? x1 : x0;
+	float xa_floor = floorf(xa);
+	float xb_ceil = ceilf(xb);
+	int xa_i = (int)xa_floor;
+	int xb_i = (int)xb_ceil;
+	if (xb_i <= xa_i+1) {
+		// inside a single pixel
+		float xm = 0.5f*(x0+x1) - xa_floor;
+		acc[xa_i] += d - d*xm;
+		acc[xa_i+1] += d*xm;
+		return;
+	}
+	// spans multiple pixels: triangle area in the first and last pixel, linear in between
+	float s = 1.0f/(xb-xa);
+	float xa_f = xa - xa_floor;
+	float a0 = 0.5f*s*(1-xa_f)*(1-xa_f);
+	float xb_f = xb - xb_ceil + 1;
+	float am = 0.5f*s*xb_f*xb_f;
+	acc[xa_i] += d*a0;
+	if (xb_i == xa_i+2) {
+		acc[xa_i+1] += d*(1-a0-am);
+	} else {
+		float a1 = s*(1.5f-xa_f);
+		acc[xa_i+1] += d*(a1-a0);
+		for (int x=xa_i+2; x<xb_i-1; x++) {
+			acc[x] += d*s;
+		}
+		float a2 = a1 + (xb_i-xa_i-3)*s;
+		acc[xb_i-1] += d*(1-a2-am);
+	}
+	acc[xb_i] += d*am;
+}
+
+// accumulate a segment inside one pixel row. Parts left of 0 or right of w are moved to the edge,
+// where they have the same effect on the visible pixels.
+static inline void poly_accumulate_clipped(float* acc, int w, float x0, float y0, float x1, float y1, float dir) {
+	float bounds[2] = { 0, w };
+	for (int i=0; i<2; i++) {
+		float bx = bounds[i];
+		if (((x0 < bx) && (x1 > bx)) || ((x0 > bx) && (x1 < bx))) {
+			float ym = y0 + (y1-y0)*((bx-x0)/(x1-x0));
+			poly_accumulate_clipped(acc, w, x0, y0, bx, ym, dir);
+			poly_accumulate_clipped(acc, w, bx, ym, x1, y1, dir);
+			return;
+		}
+	}
+	x0 = (x0 < 0) ? 0 : ((x0 > w) ? w : x0);
+	x1 = (x1 < 0) ? 0 : ((x1 > w) ? w : x1);
+	poly_accumulate_segment(acc, x0, y0, x1, y1, dir);
+}
+
+// get the first pixel row of an edge, clamped to 0-h
+static inline int poly_edge_row(const poly_edge_t* e, int h) {
+	float y = floorf(e->y0);
+	return (y < 0) ? 0 : ((y > h) ? h : (int)y);
+}
+
+// convert an accumulated winding value to a coverage value(0-255)
+static inline uint32_t poly_coverage(float winding, int evenodd, int antialias) {
+	float c = fabsf(winding);
+	if (evenodd) {
+		c = fmodf(c, 2.0f);
+		c = (c > 1) ? 2-c : c;
+	} else {
+		c = (c > 1) ? 1 : c;
+	}
+	if (!antialias) {
+		return (c >= 0.5f) ? 255 : 0;
+	}
+	return (uint32_t)(c*255 + 0.5f);
+}
+
+// fill the polygon made of one or more closed contours(x,y pairs in pts) using the non-zero or even-odd fill rule.
+// Contour i ends before point ends[i]. All contours are rasterized together, so overlapping contours are drawn once.
+// Uses a sorted active edge table, and accumulates the exact area coverage of each pixel per row.
+// Spans of equal coverage are filled at once(fully covered spans using fill_row, or blend_row if alphablend is set),
+// partially covered pixels are alphablended with the coverage. Returns 0 if memory could not be allocated.
+static int polygon(const drawbuffer_t* db, const float* pts, const int* ends, int contours, uint32_t p, int alphablend, int evenodd, int antialias) {
+	int n = (contours > 0) ? ends[contours-1] : 0;
+	if ((n < 3) || (!db->data)) {
+		return 1;
+	}
+	poly_edge_t* edges = malloc(n*sizeof(poly_edge_t));
+	int* active = malloc(n*sizeof(int));
+	int* order = malloc(n*sizeof(int));
+	int* row_start = calloc(db->h+2, sizeof(int));
+	float* acc = calloc(db->w+2, sizeof(float));
+	if ((!edges) || (!active) || (!order) || (!row_start) || (!acc)) {
+		free(edges);
+		free(active);
+		free(order);
+		free(row_start);
+		free(acc);
+		return 0;
+	}
+
+	// build the edge table(without horizontal edges)
+	int edge_count = 0;
+	float y_min = INFINITY, y_max = -INFINITY;
+	for (int i=0, start=0, contour=0; i<n; i++) {
+		while (i >= ends[contour]) {
+			start = ends[contour++];
+		}
+		int next = (i+1 < ends[contour]) ? i+1 : start;
+		float x0 = pts[i*2], y0 = pts[i*2+1];
+		float x1 = pts[next*2], y1 = pts[next*2+1];
+		if ((y0 == y1) || (!isfinite(x0)) || (!isfinite(y0)) || (!isfinite(x1)) || (!isfinite(y1))) {
+			continue;
+		}
+		poly_edge_t* e = &edges[edge_count++];
+		e->dir = (y0 < y1) ? 1 : -1;
+		e->x0 = (y0 < y1) ? x0 : x1;
+		e->y0 = (y0 < y1) ? y0 : y1;
+		e->x1 = (y0 < y1) ? x1 : x0;
+		e->y1 = (y0 < y1) ? y1 : y0;
+		e->dxdy = (e->x1-e->x0)/(e->y1-e->y0);
+		y_min = (e->y0 < y_min) ? e->y0 : y_min;
+		y_max = (e->y1 > y_max) ? e->y1 : y_max;
+	}
+
+	// sort the edges by their first row(counting sort), edges are activated in this order
+	for (int i=0; i<edge_count; i++) {
+		row_start[poly_edge_row(&edges[i], db->h)+1]++;
+	}
+	for (int y=0; y<=db->h; y++) {
+		row_start[y+1] += row_start[y];
+	}
+	for (int i=0; i<edge_count; i++) {
+		order[row_start[poly_edge_row(&edges[i], db->h)]++] = i;
+	}
+
+	uint32_t a = unpack_pixel_a(p);
+	int y_start = (edge_count && (y_min > 0)) ? (int)floorf(y_min) : 0;
+	int y_end = (edge_count && (y_max < db->h)) ? (int)ceilf(y_max) : db->h;
+	int next_edge = 0, active_count = 0;
+	for (int y=y_start; (y<y_end) && edge_count; y++) {
+		// update the active edges
+		while ((next_edge < edge_count) && (edges[order[next_edge]].y0 < y+1)) {
+			active[active_count++] = order[next_edge++];
+		}
+		int x_min = db->w+1, x_max = -1;
+		for (int i=0; i<active_count; i++) {
+			poly_edge_t* e = &edges[active[i]];
+			if (e->y1 <= y) {
+				active[i--] = active[--active_count];
+				continue;
+			}
+			float ya = (e->y0 > y) ? e->y0 : y;
+			float yb = (e->y1 < y+1) ? e->y1 : y+1;
+			float xa = e->x0 + (ya-e->y0)*e->dxdy;
+			float xb = e->x0 + (yb-e->y0)*e->dxdy;
+			poly_accumulate_clipped(acc, db->w, xa, ya, xb, yb, e->dir);
+			int cx_min = (int)floorf((xa < xb) ? xa : xb);
+			int cx_max = (int)ceilf((xa > xb) ? xa : xb)+1;
+			x_min = (cx_min < x_min) ? cx_min : x_min;
+			x_max = (cx_max > x_max) ? cx_max : x_max;
+		}
+		x_min = (x_min < 0) ? 0 : x_min;
+		x_max = (x_max > db->w+1) ? db->w+1 : x_max;
+
+		// sum up the coverage, and draw spans of equal coverage
+		uint8_t* row = db_get_row_ptr(db, y);
+		float winding = 0;
+		int x = x_min;
+		while (x < x_max) {
+			winding += acc[x];
+			acc[x] = 0;
+			int span_end = x+1;
+			while ((span_end < x_max) && (acc[span_end] == 0)) {
+				span_end++;
+			}
+			int len = ((span_end < db->w) ? span_end : db->w) - x;
+			uint32_t c = poly_coverage(winding, evenodd, antialias);
+			if ((len > 0) && (c == 255)) {
+				if (alphablend) {
+					blend_row(row, x, db->pxfmt, p, len);
+				} else {
+					fill_row(row, x, db->pxfmt, p, len);
+				}
+			} else if ((len > 0) && (c > 0)) {
+				blend_row(row, x, db->pxfmt, (p & 0xffffff00) | div255(a*c), len);
+			}
+			x = span_end;
+		}
+	}
+
+	free(edges);
+	free(active);
+	free(order);
+	free(row_start);
+	free(acc);
+	return 1;
+}
+
+// fill a polygon on a drawbuffer from Lua
+static int lua_gfx_polygon(lua_State *L) {
+	drawbuffer_t *db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	// points as a flat list {x0,y0, x1,y1, ...}
+	luaL_checktype(L, 2, LUA_TTABLE);
+	int n = lua_objlen(L, 2)/2;
+
+	int r = lua_tointeger(L, 3);
+	int g = lua_tointeger(L, 4);
+	int b = lua_tointeger(L, 5);
+	int a = lua_tointeger(L, 6);
+	if ( (r < 0) || (g < 0) || (b < 0) || (a < 0) || (r > 255) || (g > 255) || (b > 255) || (a > 255) ) {
+		lua_pushnil(L);
+		lua_pushstring(L, "invalid r,g,b,a value");
+		return 2;
+	}
+	int alphablend = lua_toboolean(L, 7);
+
+	const char* fill_rule = luaL_optstring(L, 8, "nonzero");
+	int evenodd = 0;
+	if (strcmp(fill_rule, "evenodd")==0) {
+		evenodd = 1;
+	} else if (strcmp(fill_rule, "nonzero")!=0) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Unknown fill rule: %s", fill_rule);
+		return 2;
+	}
+	int antialias = lua_isnoneornil(L, 9) ? 1 : lua_toboolean(L, 9);
+
+	float* pts = malloc((n > 0 ? n : 1)*2*sizeof(float));
+	if (!pts) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+	float x_min = INFINITY, y_min = INFINITY, x_max = -INFINITY, y_max = -INFINITY;
+	for (int i=0; i<n*2; i++) {
+		lua_rawgeti(L, 2, i+1);
+		pts[i] = lua_tonumber(L, -1);
+		lua_pop(L, 1);
+		if (i%2) {
+			y_min = fminf(y_min, pts[i]);
+			y_max = fmaxf(y_max, pts[i]);
+		} else {
+			x_min = fminf(x_min, pts[i]);
+			x_max = fmaxf(x_max, pts[i]);
+		}
+	}
+
+	int ok = polygon(db, pts, &n, 1, pack_pixel_rgba(r,g,b,a), alphablend, evenodd, antialias);
+	free(pts);
+	if (!ok) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+	if (n >= 3) {
+		db_add_damage_corners(db, (int)fmaxf(floorf(x_min), -1), (int)fmaxf(floorf(y_min), -1), (int)fminf(ceilf(x_max), db->w), (int)fminf(ceilf(y_max), db->h));
+	}
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+
+
+
+
+// get a pointer to the data of a string, lightuserdata or integer address(see new_drawbuffer_from_pointer) at idx.
+// For strings, len is set to the number of complete elements of elem_size bytes, otherwise to -1(unknown).
+// Returns NULL if the value is not a buffer.
+static const void* lua_to_buffer(lua_State *L, int idx, size_t elem_size, int* len) {
+	*len = -1;
+	if (lua_type(L, idx) == LUA_TSTRING) {
+		size_t str_len;
+		const char* str = lua_tolstring(L, idx, &str_len);
+		*len = (int)((str_len/elem_size < INT_MAX) ? str_len/elem_size : INT_MAX);
+		return str;
+	} else if (lua_islightuserdata(L, idx)) {
+		return lua_touserdata(L, idx);
+	} else if (lua_type(L, idx) == LUA_TNUMBER) {
+		return (const void*)(uintptr_t)lua_tonumber(L, idx);
+	}
+	return NULL;
+}
+
+// draw a triangle mesh with interpolated vertex colors and an optional depth buffer.
+// If textured is set, the texture drawbuffer is argument 3, and the following arguments are moved by one.
+static int lua_gfx_mesh(lua_State *L, int textured) {
+	drawbuffer_t *db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	drawbuffer_t *depth_db = NULL;
+	if (!lua_isnoneornil(L, 2)) {
+		LUA_LDB_CHECK_DB(L, 2, depth_db)
+		size_t bpp = get_bpp(depth_db->pxfmt);
+		if ((depth_db->w != db->w) || (depth_db->h != db->h) || ((bpp != 16) && (bpp != 32))) {
+			lua_pushnil(L);
+			lua_pushstring(L, "Depth drawbuffer must have the same size, and a 16bpp or 32bpp format");
+			return 2;
+		}
+	}
+
+	drawbuffer_t *texture_db = NULL;
+	if (textured) {
+		LUA_LDB_CHECK_DB(L, 3, texture_db)
+	}
+	int arg = textured ? 4 : 3;
+
+	// vertices and indices are buffers(see lua_to_buffer), or tables of numbers that are converted
+	size_t vertex_size = textured ? sizeof(ldb_textured_vertex_t) : sizeof(ldb_mesh_vertex_t);
+	int vertex_floats = textured ? 10 : 7;
+	ldb_textured_vertex_t* vertices_tmp = NULL;
+	uint32_t* indices_tmp = NULL;
+	int vertex_count, index_count = -1;
+	const void* vertices;
+	const uint32_t* indices = NULL;
+	if (lua_istable(L, arg)) {
+		// x,y,z,r,g,b,a(,u,v,q) per vertex
+		vertex_count = lua_objlen(L, arg)/vertex_floats;
+		vertices = vertices_tmp = malloc((vertex_count ? vertex_count : 1)*vertex_size);
+		for (int i=0; vertices_tmp && (i<vertex_count); i++) {
+			float v[10];
+			for (int j=0; j<vertex_floats; j++) {
+				lua_rawgeti(L, arg, i*vertex_floats+j+1);
+				v[j] = lua_tonumber(L, -1);
+				lua_pop(L, 1);
+			}
+			// also rejects NaN
+			if (!((v[3] >= 0) && (v[3] < 256) && (v[4] >= 0) && (v[4] < 256) && (v[5] >= 0) && (v[5] < 256) && (v[6] >= 0) && (v[6] < 256))) {
+				free(vertices_tmp);
+				lua_pushnil(L);
+				lua_pushstring(L, "invalid r,g,b,a value");
+				return 2;
+			}
+			ldb_textured_vertex_t* vertex = (ldb_textured_vertex_t*)((uint8_t*)vertices_tmp + i*vertex_size);
+			vertex->x = v[0];
+			vertex->y = v[1];
+			vertex->z = v[2];
+			vertex->color = pack_pixel_rgba((int)v[3], (int)v[4], (int)v[5], (int)v[6]);
+			if (textured) {
+				vertex->u = v[7];
+				vertex->v = v[8];
+				vertex->q = v[9];
+			}
+		}
+	} else {
+		vertices = lua_to_buffer(L, arg, vertex_size, &vertex_count);
+		if (!vertices) {
+			lua_pushnil(L);
+			lua_pushfstring(L, "Argument %d must be a table or buffer of vertices!", arg);
+			return 2;
+		}
+	}
+	if (lua_istable(L, arg+1)) {
+		// 3 indices(starting at 0) per triangle
+		index_count = lua_objlen(L, arg+1);
+		indices = indices_tmp = malloc((index_count ? index_count : 1)*sizeof(uint32_t));
+		for (int i=0; indices_tmp && (i<index_count); i++) {
+			lua_rawgeti(L, arg+1, i+1);
+			indices_tmp[i] = lua_tointeger(L, -1);
+			lua_pop(L, 1);
+		}
+	} else if (!lua_isnoneornil(L, arg+1)) {
+		indices = lua_to_buffer(L, arg+1, sizeof(uint32_t), &index_count);
+		if (!indices) {
+			free(vertices_tmp);
+			lua_pushnil(L);
+			lua_pushfstring(L, "Argument %d must be a table or buffer of indices!", arg+1);
+			return 2;
+		}
+	}
+	if ((lua_istable(L, arg) && !vertices_tmp) || (lua_istable(L, arg+1) && !indices_tmp)) {
+		free(vertices_tmp);
+		free(indices_tmp);
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+
+	// the number of triangles defaults to the length of the indices or vertices, and is limited by it if known
+	int max_count = indices ? ((index_count >= 0) ? index_count/3 : -1) : ((vertex_count >= 0) ? vertex_count/3 : -1);
+	int count = luaL_optinteger(L, arg+2, max_count);
+	count = ((max_count >= 0) && (count > max_count)) ? max_count : count;
+	arg += 3;
+
+	// texture sampling options
+	int bilinear = 0, wrap = 0;
+	const char* error = NULL;
+	if (textured) {
+		const char* filter_str = luaL_optstring(L, arg, "nearest");
+		const char* address_str = luaL_optstring(L, arg+1, "clamp");
+		bilinear = (strcmp(filter_str, "bilinear")==0);
+		wrap = (strcmp(address_str, "wrap")==0);
+		if ((!bilinear) && (strcmp(filter_str, "nearest")!=0)) {
+			error = lua_pushfstring(L, "Unknown filter: %s", filter_str);
+		} else if ((!wrap) && (strcmp(address_str, "clamp")!=0)) {
+			error = lua_pushfstring(L, "Unknown address mode: %s", address_str);
+		}
+		arg += 2;
+	}
+
+	int alpha_mode = 0;
+	if (lua_isstring(L, arg)) {
+		const char* arg_str = lua_tostring(L, arg);
+		if (strcmp(arg_str, "ignorealpha")==0) {
+			alpha_mode = 1;
+		} else if (strcmp(arg_str, "alphablend")==0) {
+			alpha_mode = 2;
+		}
+	}
+
+	const char* cull_str = luaL_optstring(L, arg+1, "none");
+	LDB_CULL cull = ldb_cull_from_str(cull_str);
+	if ((!error) && (cull == LDB_CULL_MAX)) {
+		error = lua_pushfstring(L, "Unknown cull mode: %s", cull_str);
+	}
+	if (error) {
+		free(vertices_tmp);
+		free(indices_tmp);
+		lua_pushnil(L);
+		lua_pushstring(L, error);
+		return 2;
+	}
+
+	db_rect_t bounds;
+	int ok;
+	if (textured) {
+		ok = ldb_draw_textured_mesh(db, depth_db, texture_db, vertices, vertex_count, indices, count, bilinear, wrap, alpha_mode, cull, &bounds);
+	} else {
+		ok = ldb_draw_mesh(db, depth_db, vertices, vertex_count, indices, count, alpha_mode, cull, &bounds);
+	}
+	free(vertices_tmp);
+	free(indices_tmp);
+	if (!ok) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+	if ((bounds.x1 > bounds.x0) && (bounds.y1 > bounds.y0)) {
+		db_add_damage(db, bounds.x0, bounds.y0, bounds.x1-bounds.x0, bounds.y1-bounds.y0);
+	}
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+static int lua_gfx_draw_mesh(lua_State *L) {
+	return lua_gfx_mesh(L, 0);
+}
+
+static int lua_gfx_draw_textured_mesh(lua_State *L) {
+	return lua_gfx_mesh(L, 1);
+}
+
+// fill a depth drawbuffer for draw_mesh with a depth value(default 1)
+static int lua_gfx_clear_depth(lua_State *L) {
+	drawbuffer_t *depth_db;
+	LUA_LDB_CHECK_DB(L, 1, depth_db)
+
+	size_t bpp = get_bpp(depth_db->pxfmt);
+	if ((bpp != 16) && (bpp != 32)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Depth drawbuffer must have a 16bpp or 32bpp format");
+		return 2;
+	}
+	ldb_clear_depth(depth_db, luaL_optnumber(L, 2, 1));
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+
+
+
+// append a point to the current contour of the path
+static inline void poly_path_point(poly_path_t* path, float x, float y) {
+	if (path->failed) {
+		return;
+	}
+	if (path->pts_len >= path->pts_cap) {
+		int cap = path->pts_cap ? path->pts_cap*2 : 256;
+		float* pts = realloc(path->pts, cap*2*sizeof(float));
+		if (!pts) {
+			path->failed = 1;
+			return;
+		}
+		path->pts = pts;
+		path->pts_cap = cap;
+	}
+	path->pts[path->pts_len*2] = x;
+	path->pts[path->pts_len*2+1] = y;
+	path->pts_len++;
+}
+
+// end the current contour of the path. The contour is reversed if needed, so that all contours
+// have the same orientation, and overlapping contours are joined by the non-zero fill rule.
+static void poly_path_close(poly_path_t* path) {
+	if (path->failed) {
+		return;
+	}
+	int start = path->ends_len ? path->ends[path->ends_len-1] : 0;
+	float* pts = path->pts;
+	float area = 0;
+	for (int i=start+1; i<path->pts_len-1; i++) {
+		area += (pts[i*2]-pts[start*2])*(pts[i*2+3]-pts[start*2+1]) - (pts[i*2+2]-pts[start*2])*(pts[i*2+1]-pts[start*2+1]);
+	}
+	for (int i=start, j=path->pts_len-1; (area < 0) && (i < j); i++, j--) {
+		float x = pts[i*2], y = pts[i*2+1];
+		pts[i*2] = pts[j*2];
+		pts[i*2+1] = pts[j*2+1];
+		pts[j*2] = x;
+		pts[j*2+1] = y;
+	}
+	if (path->ends_len >= path->ends_cap) {
+		int cap = path->ends_cap ? path->ends_cap*2 : 64;
+		int* ends = realloc(path->ends, cap*sizeof(int));
+		if (!ends) {
+			path->failed = 1;
+			return;
+		}
+		path->ends = ends;
+		path->ends_cap = cap;
+	}
+	path->ends[path->ends_len++] = path->pts_len;
+}
+
+// append the points of a circular arc around cx,cy, from the offset ux,uy rotated by angle(excluding the end point).
+// steps is the number of segments for a full circle.
+static void poly_path_arc(poly_path_t* path, float cx, float cy, float ux, float uy, float angle, int steps) {
+	int n = (int)ceilf(fabsf(angle)*steps/(2*M_PI));
+	n = (n < 1) ? 1 : n;
+	float c = cosf(angle/n), s = sinf(angle/n);
+	for (int i=0; i<n; i++) {
+		poly_path_point(path, cx+ux, cy+uy);
+		float rx = ux*c - uy*s;
+		uy = ux*s + uy*c;
+		ux = rx;
+	}
+}
+
+// add the stroke of a polyline with n distinct points to the path: a quad per segment, and polygons for the joins and caps.
+// Joins are added on the outer side of a corner, and share their edges with the segment quads.
+// If the segments are long enough, they end at the intersection of their inner sides instead of overlapping,
+// so that the contours don't overlap, and the coverage at the edges is exact.
+static void stroke_polyline(poly_path_t* path, const float* pts, int n, float hw, JOIN_TYPE join, CAP_TYPE cap) {
+	// segments for a full circle, so that the error is below 1/32 pixel
+	int steps = (hw > 0.03125f) ? (int)ceilf(M_PI/acosf(1-0.03125f/hw)) : 8;
+	steps = (steps < 8) ? 8 : ((steps > 1024) ? 1024 : steps);
+
+	if (n == 1) {
+		if (cap == LDB_CAP_ROUND) {
+			poly_path_arc(path, pts[0], pts[1], hw, 0, 2*M_PI, steps);
+			poly_path_close(path);
+		} else if (cap == LDB_CAP_SQUARE) {
+			poly_path_point(path, pts[0]-hw, pts[1]-hw);
+			poly_path_point(path, pts[0]+hw, pts[1]-hw);
+			poly_path_point(path, pts[0]+hw, pts[1]+hw);
+			poly_path_point(path, pts[0]-hw, pts[1]+hw);
+			poly_path_close(path);
+		}
+		return;
+	}
+
+	// inner corner at the start of the current segment(on the side start_s of the normal, 0 if none)
+	float start_s = 0, start_x = 0, start_y = 0;
+	float x1 = pts[0], y1 = pts[1];
+	float len = sqrtf((pts[2]-x1)*(pts[2]-x1) + (pts[3]-y1)*(pts[3]-y1));
+	float dx = (pts[2]-x1)/len, dy = (pts[3]-y1)/len;
+	for (int i=0; i<n-1; i++) {
+		float x0 = x1, y0 = y1;
+		x1 = pts[i*2+2];
+		y1 = pts[i*2+3];
+		float nx = -dy*hw, ny = dx*hw;
+
+		// direction of the next segment, and the join at the end of this segment
+		float next_len = 0, next_dx = 0, next_dy = 0;
+		float cross = 0, dot = 1, s = 0, end_s = 0, end_x = 0, end_y = 0;
+		if (i < n-2) {
+			next_len = sqrtf((pts[i*2+4]-x1)*(pts[i*2+4]-x1) + (pts[i*2+5]-y1)*(pts[i*2+5]-y1));
+			next_dx = (pts[i*2+4]-x1)/next_len;
+			next_dy = (pts[i*2+5]-y1)/next_len;
+			cross = dx*next_dy - dy*next_dx;
+			dot = dx*next_dx + dy*next_dy;
+			s = ((fabsf(cross) <= 1e-6f) && (dot > 0)) ? 0 : ((cross > 0) ? -1 : 1);
+			// the inner sides intersect at a distance of hw*tan(angle/2) from the corner
+			if ((s != 0) && (dot > -0.99f) && (hw*fabsf(cross) <= 0.5f*(1+dot)*fminf(len, next_len))) {
+				float m = hw/(1+dot);
+				end_s = -s;
+				end_x = x1 + (dy+next_dy)*s*m;
+				end_y = y1 - (dx+next_dx)*s*m;
+			}
+		}
+
+		// segment quad
+		float sx0 = x0, sy0 = y0, sx1 = x1, sy1 = y1;
+		if (cap == LDB_CAP_SQUARE) {
+			sx0 -= (i == 0) ? dx*hw : 0;
+			sy0 -= (i == 0) ? dy*hw : 0;
+			sx1 += (i == n-2) ? dx*hw : 0;
+			sy1 += (i == n-2) ? dy*hw : 0;
+		}
+		poly_path_point(path, (start_s > 0) ? start_x : sx0+nx, (start_s > 0) ? start_y : sy0+ny);
+		poly_path_point(path, (end_s > 0) ? end_x : sx1+nx, (end_s > 0) ? end_y : sy1+ny);
+		poly_path_point(path, (end_s < 0) ? end_x : sx1-nx, (end_s < 0) ? end_y : sy1-ny);
+		poly_path_point(path, (start_s < 0) ? start_x : sx0-nx, (start_s < 0) ? start_y : sy0-ny);
+		poly_path_close(path);
+
+		// caps
+		if ((cap == LDB_CAP_ROUND) && (i == 0)) {
+			poly_path_arc(path, x0, y0, nx, ny, M_PI, steps);
+			poly_path_point(path, x0-nx, y0-ny);
+			poly_path_close(path);
+		}
+		if ((cap == LDB_CAP_ROUND) && (i == n-2)) {
+			poly_path_arc(path, x1, y1, -nx, -ny, M_PI, steps);
+			poly_path_point(path, x1+nx, y1+ny);
+			poly_path_close(path);
+		}
+
+		// join with the next segment on the outer side, from the inner corner or the vertex
+		if (s != 0) {
+			float ax = nx*s, ay = ny*s;
+			float bx = -next_dy*hw*s, by = next_dx*hw*s;
+			poly_path_point(path, end_s ? end_x : x1, end_s ? end_y : y1);
+			if (join == LDB_JOIN_ROUND) {
+				poly_path_arc(path, x1, y1, ax, ay, atan2f(cross, dot), steps);
+			} else {
+				poly_path_point(path, x1+ax, y1+ay);
+				if ((join == LDB_JOIN_MITER) && (2 < LDB_MITER_LIMIT*LDB_MITER_LIMIT*(1+dot))) {
+					poly_path_point(path, x1+(ax+bx)/(1+dot), y1+(ay+by)/(1+dot));
+				}
+			}
+			poly_path_point(path, x1+bx, y1+by);
+			poly_path_close(path);
+		}
+
+		start_s = end_s;
+		start_x = end_x;
+		start_y = end_y;
+		len = next_len;
+		dx = next_dx;
+		dy = next_dy;
+	}
+}
+
+// stroke a polyline with n points(x,y pairs in pts) using the width, join and cap style.
+// Non-finite points split the polyline, and repeated points are ignored.
+// The stroke is built as a list of contours that is filled at once using the non-zero fill rule, so each pixel is blended once.
+// The bounding box of the stroke is stored in bounds. Returns 0 if memory could not be allocated.
+static int polyline(const drawbuffer_t* db, const float* pts, int n, float width, uint32_t p, JOIN_TYPE join, CAP_TYPE cap, db_rect_t* bounds) {
+	poly_path_t path = { 0 };
+	float* line = malloc((n > 0 ? n : 1)*2*sizeof(float));
+	if (!line) {
+		return 0;
+	}
+	int line_len = 0;
+	for (int i=0; i<=n; i++) {
+		int valid = (i < n) && isfinite(pts[i*2]) && isfinite(pts[i*2+1]);
+		if (valid && line_len && (pts[i*2] == line[line_len*2-2]) && (pts[i*2+1] == line[line_len*2-1])) {
+			continue;
+		} else if (valid) {
+			line[line_len*2] = pts[i*2];
+			line[line_len*2+1] = pts[i*2+1];
+			line_len++;
+		} else if (line_len) {
+			stroke_polyline(&path, line, line_len, width*0.5f, join, cap);
+			line_len = 0;
+		}
+	}
+	free(line);
+
+	float x_min = INFINITY, y_min = INFINITY, x_max = -INFINITY, y_max = -INFINITY;
+	for (int i=0; (!path.failed) && (i<path.pts_len); i++) {
+		x_min = fminf(x_min, path.pts[i*2]);
+		y_min = fminf(y_min, path.pts[i*2+1]);
+		x_max = fmaxf(x_max, path.pts[i*2]);
+		y_max = fmaxf(y_max, path.pts[i*2+1]);
+	}
+	*bounds = (db_rect_t){ 0, 0, 0, 0 };
+	if (x_min <= x_max) {
+		bounds->x0 = (int)fmaxf(floorf(x_min), 0);
+		bounds->y0 = (int)fmaxf(floorf(y_min), 0);
+		bounds->x1 = (int)fminf(ceilf(x_max)+1, db->w);
+		bounds->y1 = (int)fminf(ceilf(y_max)+1, db->h);
+	}
+
+	int ok = (!path.failed) && polygon(db, path.pts, path.ends, path.ends_len, p, 1, 0, 1);
+	free(path.pts);
+	free(path.ends);
+	return ok;
+}
+
+// stroke a polyline on a drawbuffer from Lua
+static int lua_gfx_polyline(lua_State *L) {
+	drawbuffer_t *db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	// points as a flat list {x0,y0, x1,y1, ...}, or a buffer of floats
+	int len = -1;
+	const float* buf = NULL;
+	if (lua_istable(L, 2)) {
+		len = lua_objlen(L, 2)/2;
+	} else {
+		buf = lua_to_buffer(L, 2, 2*sizeof(float), &len);
+		if (!buf) {
+			lua_pushnil(L);
+			lua_pushstring(L, "Points must be a table or buffer");
+			return 2;
+		}
+	}
+	int n = luaL_optinteger(L, 3, len);
+	if ((n < 0) || ((len >= 0) && (n > len))) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Invalid point count");
+		return 2;
+	}
+
+	float width = luaL_checknumber(L, 4);
+	int r = lua_tointeger(L, 5);
+	int g = lua_tointeger(L, 6);
+	int b = lua_tointeger(L, 7);
+	int a = lua_tointeger(L, 8);
+	if ( (r < 0) || (g < 0) || (b < 0) || (a < 0) || (r > 255) || (g > 255) || (b > 255) || (a > 255) ) {
+		lua_pushnil(L);
+		lua_pushstring(L, "invalid r,g,b,a value");
+		return 2;
+	}
+
+	const char* join_str = luaL_optstring(L, 9, "miter");
+	JOIN_TYPE join = LDB_JOIN_MAX;
+	if (strcmp(join_str, "miter")==0) {
+		join = LDB_JOIN_MITER;
+	} else if (strcmp(join_str, "round")==0) {
+		join = LDB_JOIN_ROUND;
+	} else if (strcmp(join_str, "bevel")==0) {
+		join = LDB_JOIN_BEVEL;
+	} else {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Unknown join style: %s", join_str);
+		return 2;
+	}
+	const char* cap_str = luaL_optstring(L, 10, "butt");
+	CAP_TYPE cap = LDB_CAP_MAX;
+	if (strcmp(cap_str, "butt")==0) {
+		cap = LDB_CAP_BUTT;
+	} else if (strcmp(cap_str, "round")==0) {
+		cap = LDB_CAP_ROUND;
+	} else if (strcmp(cap_str, "square")==0) {
+		cap = LDB_CAP_SQUARE;
+	} else {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Unknown cap style: %s", cap_str);
+		return 2;
+	}
+
+	if ((n == 0) || !(width > 0)) {
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+
+	float* pts = (float*)buf;
+	if (!buf) {
+		pts = malloc(n*2*sizeof(float));
+		if (!pts) {
+			lua_pushnil(L);
+			lua_pushstring(L, "Can't allocate memory!");
+			return 2;
+		}
+		for (int i=0; i<n*2; i++) {
+			lua_rawgeti(L, 2, i+1);
+			pts[i] = lua_isnumber(L, -1) ? lua_tonumber(L, -1) : NAN;
+			lua_pop(L, 1);
+		}
+	}
+
+	db_rect_t bounds;
+	int ok = polyline(db, pts, n, width, pack_pixel_rgba(r,g,b,a), join, cap, &bounds);
+	if (!buf) {
+		free(pts);
+	}
+	if (!ok) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
 		return 2;
 	}
+	if ((bounds.x1 > bounds.x0) && (bounds.y1 > bounds.y0)) {
+		db_add_damage(db, bounds.x0, bounds.y0, bounds.x1-bounds.x0, bounds.y1-bounds.y0);
+	}
 
-	int alphablend = lua_toboolean(L, 12);
-	triangle(db, x0,y0, x1,y1, x2,y2, pack_pixel_rgba(r,g,b,a), alphablend);
-
-	return 0;
+	lua_pushboolean(L, 1);
+	return 1;
 }
 
 
 
 
 
-
 static int lua_gfx_set_px_alphablend(lua_State *L) {
 	drawbuffer_t* db;
 	LUA_LDB_CHECK_DB(L, 1, db)
@@ -561,6 +2177,7 @@ static int lua_gfx_set_px_alphablend(lua_State *L) {
 	}
 
 	db_set_px_alphablend(db, x,y, pack_pixel_rgba(r,g,b,a));
+	db_add_damage(db, x,y, 1,1);
 
 	lua_pushboolean(L, 1);
 	return 1;
@@ -612,32 +2229,51 @@ static inline float circleSDF(float px, float py, float cx, float cy, float r) {
     return sqrtf(dx*dx + dy*dy) - r;
 }
 
-static inline void draw_circle_sdf(uint8_t* data, int w, int h, PIX_FMT fmt, float center_x, float center_y, float radius, uint8_t r, uint8_t g, uint8_t b, uint8_t a, int outline) {
-	float alpha, d;
-	uint32_t sp, p;
-	int cx, cy;
+// draw an antialiased circle using a signed distance function. Like line_smooth, the solid range of each row
+// is blended at once, and the SDF is only evaluated at the edges. Outlines are only evaluated in the ring.
+static inline void draw_circle_sdf(const drawbuffer_t* db, float center_x, float center_y, float radius, uint8_t r, uint8_t g, uint8_t b, uint8_t a, int outline) {
+	uint32_t src[LDB_ROW_CHUNK];
 	uint32_t tp = ((uint32_t)r<<24) | ((uint32_t)g<<16) | ((uint32_t)b<<8);
 
-	int x_min = (int)floorf(center_x-radius);
-	int x_max = (int) ceilf(center_x+radius);
-	int y_min = (int)floorf(center_y-radius);
-	int y_max = (int) ceilf(center_y+radius);
-
-	// clamp to screen region
-	x_min = (x_min<0) ? 0 : ((x_min>=w) ? w-1 : x_min);
-	x_max = (x_max<0) ? 0 : ((x_max>=w) ? w-1 : x_max);
-	y_min = (y_min<0) ? 0 : ((y_min>=h) ? h-1 : y_min);
-	y_max = (y_max<0) ? 0 : ((y_max>=h) ? h-1 : y_max);
-
-    for (cy = y_min; cy <= y_max; cy++) {
-		for (cx = x_min; cx <= x_max; cx++) {
-			d = circleSDF(cx, cy, center_x, center_y, radius);
-			if (outline && (d<0)) {
-				d = -d;
-			}
-			alpha = fmaxf(fminf(0.5f - d, 1.0f), 0.0f)*(float)a;
-			if (alpha>0) {
-				set_px_alphablend(data,w,cx,cy,tp | ((uint32_t)alpha),fmt);
+	int y_min = (int)floorf(center_y-radius-0.5f);
+	int y_max = (int) ceilf(center_y+radius+0.5f);
+
+	// clip to screen region
+	if ((y_max < 0) || (y_min >= db->h)) {
+		return;
+	}
+	y_min = (y_min<0) ? 0 : y_min;
+	y_max = (y_max>=db->h) ? db->h-1 : y_max;
+
+	for (int cy = y_min; cy <= y_max; cy++) {
+		double in_x0, in_x1, out_x0, out_x1;
+		int inner = circle_row_span(cy, center_x, center_y, radius-0.5, &in_x0, &in_x1);
+		int outer = circle_row_span(cy, center_x, center_y, radius+0.5, &out_x0, &out_x1);
+		int ix0, ix1, ox0, ox1;
+		sdf_row_ranges(inner, in_x0, in_x1, outer, out_x0, out_x1, db->w, &ix0, &ix1, &ox0, &ox1);
+		uint8_t* row = db_get_row_ptr(db, cy);
+		if ((!outline) && (ix0 <= ix1)) {
+			blend_row(row, ix0, db->pxfmt, tp | a, ix1-ix0+1);
+		}
+
+		// pixels left and right of the inner range(the inside of an outline is empty)
+		int band[2][2] = { { ox0, (ix0 <= ix1) ? ix0-1 : ox1 }, { (ix0 <= ix1) ? ix1+1 : ox1+1, ox1 } };
+		for (int k=0; k<2; k++) {
+			for (int cx = band[k][0]; cx <= band[k][1]; cx += LDB_ROW_CHUNK) {
+				int len = ((band[k][1]-cx+1) < LDB_ROW_CHUNK) ? (band[k][1]-cx+1) : LDB_ROW_CHUNK;
+				int visible = 0;
+				for (int i=0; i<len; i++) {
+					float d = circleSDF(cx+i, cy, center_x, center_y, radius);
+					if (outline && (d<0)) {
+						d = -d;
+					}
+					float alpha = fmaxf(fminf(0.5f - d, 1.0f), 0.0f)*(float)a;
+					src[i] = tp | (uint32_t)alpha;
+					visible |= (uint32_t)alpha;
+				}
+				if (visible) {
+					blend_row_src(row, cx, db->pxfmt, src, len);
+				}
 			}
 		}
 	}
@@ -653,49 +2289,210 @@ static inline void draw_circle_sdf(uint8_t* data, int w, int h, PIX_FMT fmt, flo
 
 
 
-static inline void circle_fill(drawbuffer_t* db, int x, int y, int radius, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-	int r2 = radius * radius;
-	int area = r2 << 2;
-	int rr = radius << 1;
-	int i, tx, ty;
-	for (i = 0; i < area; i++) {
-    	tx = (i % rr) - radius;
-    	ty = (i / rr) - radius;
-    	if (tx * tx + ty * ty <= r2) {
-        	db_set_px_rgba(db, x + tx, y + ty, r,g,b,a);
+// fill the pixels x0 to x1(inclusive) of the row y, clipped to the drawbuffer width
+static inline void span_fill(const drawbuffer_t* db, int y, int x0, int x1, uint32_t p) {
+	x0 = (x0 < 0) ? 0 : x0;
+	x1 = (x1 >= db->w) ? db->w-1 : x1;
+	if (x0 <= x1) {
+		fill_row(db_get_row_ptr(db, y), x0, db->pxfmt, p, x1-x0+1);
+	}
+}
+
+// get the half-width of the row dy of a filled ellipse: the largest h <= max_h with a*h^2 + b*dy^2 <= limit, or -1 if there is none
+static inline int ellipse_row_half(int64_t dy, int64_t a, int64_t b, int64_t limit, int max_h) {
+	int64_t rem = limit - b*dy*dy;
+	if (rem < 0) {
+		return -1;
+	} else if (a == 0) {
+		return max_h;
+	}
+	int64_t h = (int64_t)sqrt((double)rem/(double)a);
+	while ((h < max_h) && (a*(h+1)*(h+1) <= rem)) {
+		h++;
+	}
+	while ((h > 0) && (a*h*h > rem)) {
+		h--;
+	}
+	return (h < max_h) ? (int)h : max_h;
+}
+
+// draw the pixels x,y with (x/rx)^2 + (y/ry)^2 <= 1 around the center cx,cy, using a span per row.
+// Outlines are the pixels of the filled ellipse with a neighbour outside of it, and use up to two spans per row.
+static void ellipse_spans(const drawbuffer_t* db, int cx, int cy, int rx, int ry, uint32_t p, int outline) {
+	if ((rx < 0) || (ry < 0) || (!db->data)) {
+		return;
+	}
+	rx = (rx > 32767) ? 32767 : rx;
+	ry = (ry > 32767) ? 32767 : ry;
+	int64_t a = (int64_t)ry*ry, b = (int64_t)rx*rx, limit = a*b;
+	int y_min = (cy-ry < 0) ? 0 : cy-ry;
+	int y_max = (cy+ry >= db->h) ? db->h-1 : cy+ry;
+	for (int y=y_min; y<=y_max; y++) {
+		int dy = y-cy;
+		int h = ellipse_row_half(dy, a, b, limit, rx);
+		int m = 0;
+		if (outline) {
+			int h_up = (dy > -ry) ? ellipse_row_half(dy-1, a, b, limit, rx) : -1;
+			int h_down = (dy < ry) ? ellipse_row_half(dy+1, a, b, limit, rx) : -1;
+			m = ((h_up < h_down) ? h_up : h_down) + 1;
+			m = (m < h) ? m : h;
+		}
+		if (m == 0) {
+			span_fill(db, y, cx-h, cx+h, p);
+		} else {
+			span_fill(db, y, cx-h, cx-m, p);
+			span_fill(db, y, cx+m, cx+h, p);
+		}
+	}
+}
+
+// draw the pixels with a distance d to the center with inner <= d <= outer, using up to two spans per row
+static void ring_spans(const drawbuffer_t* db, int cx, int cy, int outer, int inner, uint32_t p) {
+	if ((outer < 0) || (!db->data)) {
+		return;
+	}
+	outer = (outer > 32767) ? 32767 : outer;
+	inner = (inner > outer+1) ? outer+1 : inner;
+	int y_min = (cy-outer < 0) ? 0 : cy-outer;
+	int y_max = (cy+outer >= db->h) ? db->h-1 : cy+outer;
+	for (int y=y_min; y<=y_max; y++) {
+		int dy = y-cy;
+		int h = ellipse_row_half(dy, 1, 1, (int64_t)outer*outer, outer);
+		int hole = (inner > 0) ? ellipse_row_half(dy, 1, 1, (int64_t)inner*inner-1, outer) : -1;
+		if (hole < 0) {
+			span_fill(db, y, cx-h, cx+h, p);
+		} else {
+			span_fill(db, y, cx-h, cx-hole-1, p);
+			span_fill(db, y, cx+hole+1, cx+h, p);
 		}
 	}
 }
 
-static inline void circle_set8(drawbuffer_t* db, int x, int y, int cx, int cy, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-	db_set_px_rgba(db, x+cx, y+cy, r,g,b,a);
-    db_set_px_rgba(db, x-cx, y+cy, r,g,b,a);
-    db_set_px_rgba(db, x+cx, y-cy, r,g,b,a);
-    db_set_px_rgba(db, x-cx, y-cy, r,g,b,a);
-    db_set_px_rgba(db, x+cy, y+cx, r,g,b,a);
-    db_set_px_rgba(db, x-cy, y+cx, r,g,b,a);
-    db_set_px_rgba(db, x+cy, y-cx, r,g,b,a);
-    db_set_px_rgba(db, x-cy, y-cx, r,g,b,a);
+// subtract the range b0..b1 from the range a0..a1, and store the remaining(up to 2) ranges in out. Returns the number of ranges.
+static inline int range_subtract(int a0, int a1, int b0, int b1, int out[2][2]) {
+	int n = 0;
+	if (a0 > a1) {
+		return 0;
+	} else if (b0 > b1) {
+		out[0][0] = a0;
+		out[0][1] = a1;
+		return 1;
+	}
+	if (a0 <= ((a1 < b0-1) ? a1 : b0-1)) {
+		out[n][0] = a0;
+		out[n++][1] = (a1 < b0-1) ? a1 : b0-1;
+	}
+	if (((a0 > b1+1) ? a0 : b1+1) <= a1) {
+		out[n][0] = (a0 > b1+1) ? a0 : b1+1;
+		out[n++][1] = a1;
+	}
+	return n;
 }
 
-static inline void circle_outline(drawbuffer_t* db, int x, int y, int radius, uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
-	int cx = 0;
-	int cy = radius;
-    int d = 3 - 2 * radius;
-    circle_set8(db, x, y, cx, cy, r,g,b,a);
-    while (cy >= cx) {
-        cx++;
-        if (d > 0) {
-            cy--;
-            d = d + 4 * (cx - cy) + 10;
-        } else {
-			d = d + 4 * cx + 6;
+// draw an antialiased ring(the area between the circles with the outer and inner radius) using a signed distance function.
+// Like draw_circle_sdf, the solid ranges of each row are blended at once, and the SDF is only evaluated at the edges.
+static void draw_ring_sdf(const drawbuffer_t* db, float center_x, float center_y, float outer, float inner, uint32_t p) {
+	uint32_t src[LDB_ROW_CHUNK];
+	uint32_t tp = p & 0xffffff00;
+	float a = p & 0xff;
+
+	int y_min = (int)floorf(center_y-outer-0.5f);
+	int y_max = (int) ceilf(center_y+outer+0.5f);
+	if ((y_max < 0) || (y_min >= db->h) || (!db->data)) {
+		return;
+	}
+	y_min = (y_min<0) ? 0 : y_min;
+	y_max = (y_max>=db->h) ? db->h-1 : y_max;
+
+	for (int cy = y_min; cy <= y_max; cy++) {
+		// the pixels that are drawn at all(outer range minus the inside of the hole),
+		// and the solid pixels(inner range minus the range that might touch the hole)
+		double x0, x1, x2, x3;
+		int inner_span = circle_row_span(cy, center_x, center_y, outer-0.5, &x0, &x1);
+		int outer_span = circle_row_span(cy, center_x, center_y, outer+0.5, &x2, &x3);
+		int sx0, sx1, ox0, ox1;
+		sdf_row_ranges(inner_span, x0, x1, outer_span, x2, x3, db->w, &sx0, &sx1, &ox0, &ox1);
+		inner_span = circle_row_span(cy, center_x, center_y, inner-0.5, &x0, &x1);
+		outer_span = circle_row_span(cy, center_x, center_y, inner+0.5, &x2, &x3);
+		int zx0, zx1, hx0, hx1;
+		sdf_row_ranges(inner_span, x0, x1, outer_span, x2, x3, db->w, &zx0, &zx1, &hx0, &hx1);
+		int draw[2][2], solid[2][2];
+		int draw_count = range_subtract(ox0, ox1, zx0, zx1, draw);
+		int solid_count = range_subtract(sx0, sx1, hx0, hx1, solid);
+
+		uint8_t* row = db_get_row_ptr(db, cy);
+		for (int k=0; k<draw_count; k++) {
+			int x = draw[k][0];
+			for (int j=0; j<=solid_count; j++) {
+				// pixels before the next solid range(or the end of the range) are evaluated using the SDF
+				int band_end = ((j < solid_count) && (solid[j][0]-1 < draw[k][1])) ? solid[j][0]-1 : draw[k][1];
+				while (x <= band_end) {
+					int len = ((band_end-x+1) < LDB_ROW_CHUNK) ? (band_end-x+1) : LDB_ROW_CHUNK;
+					int visible = 0;
+					for (int i=0; i<len; i++) {
+						float d = circleSDF(x+i, cy, center_x, center_y, 0);
+						d = fmaxf(d-outer, inner-d);
+						float alpha = fmaxf(fminf(0.5f - d, 1.0f), 0.0f)*a;
+						src[i] = tp | (uint32_t)alpha;
+						visible |= (uint32_t)alpha;
+					}
+					if (visible) {
+						blend_row_src(row, x, db->pxfmt, src, len);
+					}
+					x += len;
+				}
+				if (j < solid_count) {
+					int solid_end = (solid[j][1] < draw[k][1]) ? solid[j][1] : draw[k][1];
+					if (x <= solid_end) {
+						blend_row(row, x, db->pxfmt, p, solid_end-x+1);
+						x = solid_end+1;
+					}
+				}
+			}
 		}
-        circle_set8(db, x, y, cx, cy, r,g,b,a);
-    }
+	}
+}
+
+// fill an antialiased ellipse around cx,cy(or draw an 1 pixel wide outline) using the polygon rasterizer.
+// The ellipse is approximated by a polygon with an error below 1/32 pixel. Returns 0 if memory could not be allocated.
+static int draw_ellipse_smooth(const drawbuffer_t* db, float cx, float cy, float rx, float ry, uint32_t p, int outline) {
+	float r_max = ((rx > ry) ? rx : ry) + 0.5f;
+	int steps = (r_max > 0.03125f) ? (int)ceilf(M_PI/acosf(1-0.03125f/r_max)) : 8;
+	steps = (steps < 8) ? 8 : ((steps > 4096) ? 4096 : steps);
+	float* pts = malloc(steps*4*sizeof(float));
+	if (!pts) {
+		return 0;
+	}
+	// the outline is the area between the ellipses grown and shrunk by half a pixel.
+	// The inner ellipse is in the opposite direction, so that the coverage of the hole is subtracted.
+	float grow = outline ? 0.5f : 0;
+	int ends[2] = { steps, steps*2 };
+	int contours = (outline && (rx > 0.5f) && (ry > 0.5f)) ? 2 : 1;
+	for (int i=0; i<steps; i++) {
+		float c = cosf(i*2*M_PI/steps), s = sinf(i*2*M_PI/steps);
+		pts[i*2] = cx + c*(rx+grow);
+		pts[i*2+1] = cy + s*(ry+grow);
+		pts[(steps*2-1-i)*2] = cx + c*(rx-grow);
+		pts[(steps*2-1-i)*2+1] = cy + s*(ry-grow);
+	}
+	int ok = polygon(db, pts, ends, contours, p, 1, 0, 1);
+	free(pts);
+	return ok;
 }
 
 
+// draw a circle on a drawbuffer and record the damage. Alphablended circles are drawn using a signed distance function(smooth edge).
+static void gfx_circle(drawbuffer_t* db, int x, int y, int radius, uint32_t p, int outline, int alphablend) {
+	uint8_t r,g,b,a;
+	UNPACK_RGBA(p, r,g,b,a)
+	if (alphablend) {
+		draw_circle_sdf(db, x,y, radius, r,g,b,a, outline);
+	} else {
+		ellipse_spans(db, x,y, radius, radius, p, outline);
+	}
+	db_add_damage_corners(db, x-radius-1, y-radius-1, x+radius+1, y+radius+1);
+}
+
 static int lua_gfx_circle(lua_State *L) {
 	drawbuffer_t* db;
 	LUA_LDB_CHECK_DB(L, 1, db)
@@ -715,44 +2512,588 @@ static int lua_gfx_circle(lua_State *L) {
 		return 2;
 	}
 
-	int outline = lua_toboolean(L, 9);
+	gfx_circle(db, x,y, radius, pack_pixel_rgba(r,g,b,a), lua_toboolean(L, 9), lua_toboolean(L, 10));
+
+	return 0;
+}
+
+// draw an ellipse on a drawbuffer from Lua. Like circles, alphablended ellipses have a smooth edge.
+static int lua_gfx_ellipse(lua_State *L) {
+	drawbuffer_t* db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	int x = lua_tointeger(L, 2);
+	int y = lua_tointeger(L, 3);
+	int rx = lua_tointeger(L, 4);
+	int ry = lua_tointeger(L, 5);
+
+	int r = lua_tointeger(L, 6);
+	int g = lua_tointeger(L, 7);
+	int b = lua_tointeger(L, 8);
+	int a = lua_tointeger(L, 9);
+	if ( (r < 0) || (g < 0) || (b < 0) || (a < 0) || (r > 255) || (g > 255) || (b > 255) || (a > 255) ) {
+		lua_pushnil(L);
+		lua_pushstring(L, "invalid r,g,b,a value");
+		return 2;
+	}
+	int outline = lua_toboolean(L, 10);
+	int alphablend = lua_toboolean(L, 11);
+
+	if ((rx < 0) || (ry < 0)) {
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	if (!alphablend) {
+		ellipse_spans(db, x,y, rx,ry, pack_pixel_rgba(r,g,b,a), outline);
+	} else if (!draw_ellipse_smooth(db, x+0.5f,y+0.5f, rx,ry, pack_pixel_rgba(r,g,b,a), outline)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+	db_add_damage_corners(db, x-rx-1, y-ry-1, x+rx+1, y+ry+1);
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// draw a filled ring(the area between two circles) on a drawbuffer from Lua. Alphablended rings have a smooth edge.
+static int lua_gfx_ring(lua_State *L) {
+	drawbuffer_t* db;
+	LUA_LDB_CHECK_DB(L, 1, db)
+
+	int x = lua_tointeger(L, 2);
+	int y = lua_tointeger(L, 3);
+	int outer = lua_tointeger(L, 4);
+	int inner = lua_tointeger(L, 5);
+
+	int r = lua_tointeger(L, 6);
+	int g = lua_tointeger(L, 7);
+	int b = lua_tointeger(L, 8);
+	int a = lua_tointeger(L, 9);
+	if ( (r < 0) || (g < 0) || (b < 0) || (a < 0) || (r > 255) || (g > 255) || (b > 255) || (a > 255) ) {
+		lua_pushnil(L);
+		lua_pushstring(L, "invalid r,g,b,a value");
+		return 2;
+	}
 	int alphablend = lua_toboolean(L, 10);
 
-	if (outline) {
-		if (alphablend) {
-			draw_circle_sdf(db->data, db->w, db->h, db->pxfmt, x,y, radius, r,g,b,a, 1);
-		} else {
-			circle_outline(db, x,y, radius, r,g,b,a);
-		}
+	if (!alphablend) {
+		ring_spans(db, x,y, outer, inner, pack_pixel_rgba(r,g,b,a));
+	} else if (inner > 0) {
+		draw_ring_sdf(db, x,y, outer, inner, pack_pixel_rgba(r,g,b,a));
 	} else {
-		if (alphablend) {
-			draw_circle_sdf(db->data, db->w, db->h, db->pxfmt, x,y, radius, r,g,b,a, 0);
-		} else {
-			circle_fill(db, x,y, radius, r,g,b,a);
+		draw_circle_sdf(db, x,y, outer, r,g,b,a, 0);
+	}
+	db_add_damage_corners(db, x-outer-1, y-outer-1, x+outer+1, y+outer+1);
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+
+
+// make room for n more commands at the end of the command list. Returns a pointer to the first new(zeroed) command, or NULL.
+static cmd_t* cmd_list_append(cmd_list_t* cmd_list, int n) {
+	if ((n < 0) || (cmd_list->len > INT_MAX/2 - n)) {
+		return NULL;
+	}
+	int new_len = cmd_list->len + n;
+	if (new_len > cmd_list->capacity) {
+		// grow exponentially, so appending single commands is cheap
+		int new_capacity = (cmd_list->capacity > 0) ? cmd_list->capacity : 64;
+		while (new_capacity < new_len) {
+			new_capacity *= 2;
+		}
+		cmd_t* cmds = realloc(cmd_list->cmds, (size_t)new_capacity*sizeof(cmd_t));
+		if (!cmds) {
+			return NULL;
 		}
+		cmd_list->cmds = cmds;
+		cmd_list->capacity = new_capacity;
 	}
+	cmd_t* cmd = &cmd_list->cmds[cmd_list->len];
+	memset(cmd, 0, (size_t)n*sizeof(cmd_t));
+	cmd_list->len = new_len;
+	return cmd;
+}
 
-	return 0;
+// execute a single command on the drawbuffer. Unknown commands are ignored.
+static inline void cmd_execute(drawbuffer_t* db, const cmd_t* cmd) {
+	int alphablend = cmd->flags & LDB_CMD_FLAG_ALPHABLEND;
+	int outline = cmd->flags & LDB_CMD_FLAG_OUTLINE;
+	const int32_t* a = cmd->args;
+	switch (cmd->type) {
+		case LDB_CMD_SET_PX:
+			if ((a[0]>=0) && (a[1]>=0) && (a[0]<db->w) && (a[1]<db->h)) {
+				if (alphablend) {
+					db_set_px_alphablend(db, a[0],a[1], cmd->color);
+				} else {
+					db_set_px(db, a[0],a[1], cmd->color);
+				}
+				db_add_damage(db, a[0],a[1], 1,1);
+			}
+			break;
+		case LDB_CMD_LINE:
+			gfx_line(db, a[0],a[1], a[2],a[3], cmd->color, a[4], alphablend);
+			break;
+		case LDB_CMD_RECTANGLE:
+			gfx_rectangle(db, a[0],a[1], a[2],a[3], cmd->color, outline, alphablend);
+			break;
+		case LDB_CMD_TRIANGLE:
+			gfx_triangle(db, a[0],a[1], a[2],a[3], a[4],a[5], cmd->color, alphablend);
+			break;
+		case LDB_CMD_CIRCLE:
+			gfx_circle(db, a[0],a[1], a[2], cmd->color, outline, alphablend);
+			break;
+		default:
+			break;
+	}
+}
+
+// get the bounding box of the pixels a command might change(inclusive). Returns 0 if the command doesn't draw.
+static inline int cmd_get_bounds(const cmd_t* cmd, int* x_min, int* y_min, int* x_max, int* y_max) {
+	const int32_t* a = cmd->args;
+	int margin = 0;
+	switch (cmd->type) {
+		case LDB_CMD_SET_PX:
+			*x_min = a[0]; *x_max = a[0];
+			*y_min = a[1]; *y_max = a[1];
+			return 1;
+		case LDB_CMD_LINE:
+			// smooth lines are drawn up to radius+0.5 pixels from the line
+			margin = (a[4] > 0) ? a[4]+1 : 0;
+			*x_min = ((a[0]<a[2]) ? a[0] : a[2]) - margin;
+			*x_max = ((a[0]>a[2]) ? a[0] : a[2]) + margin;
+			*y_min = ((a[1]<a[3]) ? a[1] : a[3]) - margin;
+			*y_max = ((a[1]>a[3]) ? a[1] : a[3]) + margin;
+			return 1;
+		case LDB_CMD_RECTANGLE:
+			*x_min = (a[2]<0) ? a[0]+a[2] : a[0];
+			*x_max = (a[2]<0) ? a[0] : a[0]+a[2];
+			*y_min = (a[3]<0) ? a[1]+a[3] : a[1];
+			*y_max = (a[3]<0) ? a[1] : a[1]+a[3];
+			return 1;
+		case LDB_CMD_TRIANGLE:
+			// the edges are interpolated using floats, so they might be off by one pixel
+			*x_min = (a[0]<a[2]) ? a[0] : a[2];
+			*x_min = ((*x_min<a[4]) ? *x_min : a[4]) - 1;
+			*x_max = (a[0]>a[2]) ? a[0] : a[2];
+			*x_max = ((*x_max>a[4]) ? *x_max : a[4]) + 1;
+			*y_min = (a[1]<a[3]) ? a[1] : a[3];
+			*y_min = ((*y_min<a[5]) ? *y_min : a[5]) - 1;
+			*y_max = (a[1]>a[3]) ? a[1] : a[3];
+			*y_max = ((*y_max>a[5]) ? *y_max : a[5]) + 1;
+			return 1;
+		case LDB_CMD_CIRCLE:
+			*x_min = a[0]-a[2]-1; *x_max = a[0]+a[2]+1;
+			*y_min = a[1]-a[2]-1; *y_max = a[1]+a[2]+1;
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+// move a command vertically by dy pixels
+static inline void cmd_translate_y(cmd_t* cmd, int dy) {
+	switch (cmd->type) {
+		case LDB_CMD_TRIANGLE:
+			cmd->args[5] += dy;
+			/* fall through */
+		case LDB_CMD_LINE:
+			cmd->args[3] += dy;
+			/* fall through */
+		default:
+			cmd->args[1] += dy;
+	}
 }
 
 
 
+// number of rows per tile for multithreaded command list execution
+#define CMD_TILE_H 32
+
+// commands binned into tiles of CMD_TILE_H rows for multithreaded execution
+typedef struct {
+	drawbuffer_t* db;
+	const cmd_t* cmds;
+	int* tile_starts; // index of the first entry of each tile in tile_cmds(tile_count+1 entries)
+	int* tile_cmds; // command indices, in order, for each tile
+} cmd_tiles_t;
+
+// execute the commands of a tile. The tile is a full-width view of the drawbuffer rows, so commands are rasterized
+// the same as on the whole drawbuffer. Tiles don't share memory, so they can be drawn in parallel.
+static void cmd_tile_execute(void* arg, int tile) {
+	cmd_tiles_t* tiles = (cmd_tiles_t*)arg;
+	const drawbuffer_t* db = tiles->db;
+	int tile_y = tile*CMD_TILE_H;
+
+	drawbuffer_t tile_db = *db;
+	tile_db.h = ((db->h-tile_y) < CMD_TILE_H) ? (db->h-tile_y) : CMD_TILE_H;
+	tile_db.data = db_get_row_ptr(db, tile_y);
+	tile_db.parent = NULL;
+	tile_db.damage.enabled = 0; // the damage is recorded after all tiles are done
+
+	for (int i=tiles->tile_starts[tile]; i<tiles->tile_starts[tile+1]; i++) {
+		cmd_t cmd = tiles->cmds[tiles->tile_cmds[i]];
+		cmd_translate_y(&cmd, -tile_y);
+		cmd_execute(&tile_db, &cmd);
+	}
+}
+
+// execute the commands on the drawbuffer using num_threads threads.
+// The commands are binned into tiles of rows, and the tiles are drawn in parallel(commands within a tile in order).
+// Returns 0 if memory allocation failed.
+static int cmd_execute_threaded(drawbuffer_t* db, const cmd_t* cmds, int len, int num_threads) {
+	int tile_count = (db->h + CMD_TILE_H-1) / CMD_TILE_H;
+	int x_min, y_min, x_max, y_max;
+
+	// count the commands per tile
+	int* tile_starts = calloc(tile_count+1, sizeof(int));
+	if (!tile_starts) {
+		return 0;
+	}
+	size_t total = 0;
+	for (int i=0; i<len; i++) {
+		if (!cmd_get_bounds(&cmds[i], &x_min, &y_min, &x_max, &y_max) || (y_max < 0) || (y_min >= db->h) || (x_max < 0) || (x_min >= db->w)) {
+			continue;
+		}
+		int tile_min = (y_min < 0) ? 0 : y_min/CMD_TILE_H;
+		int tile_max = (y_max >= db->h) ? tile_count-1 : y_max/CMD_TILE_H;
+		for (int tile=tile_min; tile<=tile_max; tile++) {
+			tile_starts[tile+1]++;
+		}
+		total += tile_max-tile_min+1;
+	}
+	if (total > INT_MAX) {
+		free(tile_starts);
+		return 0;
+	}
+	for (int tile=0; tile<tile_count; tile++) {
+		tile_starts[tile+1] += tile_starts[tile];
+	}
+
+	// bin the command indices into the tiles, keeping the order
+	int* tile_cmds = malloc((total ? total : 1)*sizeof(int));
+	int* tile_fill = malloc(tile_count*sizeof(int));
+	if ((!tile_cmds) || (!tile_fill)) {
+		free(tile_starts);
+		free(tile_cmds);
+		free(tile_fill);
+		return 0;
+	}
+	memcpy(tile_fill, tile_starts, tile_count*sizeof(int));
+	for (int i=0; i<len; i++) {
+		if (!cmd_get_bounds(&cmds[i], &x_min, &y_min, &x_max, &y_max) || (y_max < 0) || (y_min >= db->h) || (x_max < 0) || (x_min >= db->w)) {
+			continue;
+		}
+		int tile_min = (y_min < 0) ? 0 : y_min/CMD_TILE_H;
+		int tile_max = (y_max >= db->h) ? tile_count-1 : y_max/CMD_TILE_H;
+		for (int tile=tile_min; tile<=tile_max; tile++) {
+			tile_cmds[tile_fill[tile]++] = i;
+		}
+	}
+	free(tile_fill);
+
+	cmd_tiles_t tiles = { .db = db, .cmds = cmds, .tile_starts = tile_starts, .tile_cmds = tile_cmds };
+	ldb_threads_run(num_threads, tile_count, cmd_tile_execute, &tiles);
+
+	free(tile_starts);
+	free(tile_cmds);
+
+	// record the damage of all commands
+	if (db->damage.enabled || (db->parent && db->parent->damage.enabled)) {
+		for (int i=0; i<len; i++) {
+			if (cmd_get_bounds(&cmds[i], &x_min, &y_min, &x_max, &y_max)) {
+				db_add_damage_corners(db, x_min, y_min, x_max, y_max);
+			}
+		}
+	}
+	return 1;
+}
+
+// read the r,g,b,a values at the Lua stack index i..i+3 into p. Returns 0 if invalid.
+static inline int cmd_list_check_color(lua_State *L, int i, uint32_t* p) {
+	int r = lua_tointeger(L, i);
+	int g = lua_tointeger(L, i+1);
+	int b = lua_tointeger(L, i+2);
+	int a = lua_tointeger(L, i+3);
+	if ( (r < 0) || (g < 0) || (b < 0) || (a < 0) || (r > 255) || (g > 255) || (b > 255) || (a > 255) ) {
+		return 0;
+	}
+	*p = pack_pixel_rgba(r,g,b,a);
+	return 1;
+}
+
+// append a command with the color at the stack index color_i and nargs integer arguments starting at stack index 2.
+// The arguments are in the same order as the ldb_gfx function, with the drawbuffer replaced by the command list.
+static int cmd_list_append_lua(lua_State *L, CMD_TYPE type, int nargs, int color_i, uint8_t flags) {
+	cmd_list_t *cmd_list;
+	CHECK_CMD_LIST(L, 1, cmd_list)
+
+	uint32_t p;
+	if (!cmd_list_check_color(L, color_i, &p)) {
+		lua_pushnil(L);
+		lua_pushstring(L, "invalid r,g,b,a value");
+		return 2;
+	}
+
+	cmd_t* cmd = cmd_list_append(cmd_list, 1);
+	if (!cmd) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+	cmd->type = type;
+	cmd->flags = flags;
+	cmd->color = p;
+	for (int i=0; i<nargs; i++) {
+		cmd->args[i] = lua_tointeger(L, 2+i);
+	}
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// append a set_px command(x,y, r,g,b,a, alphablend)
+static int lua_cmd_list_set_px(lua_State *L) {
+	return cmd_list_append_lua(L, LDB_CMD_SET_PX, 2, 4, lua_toboolean(L, 8) ? LDB_CMD_FLAG_ALPHABLEND : 0);
+}
+
+// append a line command(x0,y0, x1,y1, r,g,b,a, alphablend or radius), like ldb_gfx.line but with integer coordinates and radius
+static int lua_cmd_list_line(lua_State *L) {
+	if (!lua_isnumber(L, 10)) {
+		return cmd_list_append_lua(L, LDB_CMD_LINE, 4, 6, lua_toboolean(L, 10) ? LDB_CMD_FLAG_ALPHABLEND : 0);
+	}
+
+	// smooth line, the radius is the 5th argument of the command
+	int radius = ceilf(lua_tonumber(L, 10));
+	int ret = cmd_list_append_lua(L, LDB_CMD_LINE, 4, 6, 0);
+	// on failure, nil and an error message are returned
+	if (lua_isboolean(L, -1) && lua_toboolean(L, -1)) {
+		cmd_list_t *cmd_list = (cmd_list_t *)lua_touserdata(L, 1);
+		cmd_list->cmds[cmd_list->len-1].args[4] = (radius <= 0) ? 1 : radius;
+	}
+	return ret;
+}
+
+// append a rectangle command(x,y, w,h, r,g,b,a, outline, alphablend)
+static int lua_cmd_list_rectangle(lua_State *L) {
+	return cmd_list_append_lua(L, LDB_CMD_RECTANGLE, 4, 6, (lua_toboolean(L, 10) ? LDB_CMD_FLAG_OUTLINE : 0) | (lua_toboolean(L, 11) ? LDB_CMD_FLAG_ALPHABLEND : 0));
+}
+
+// append a triangle command(x0,y0, x1,y1, x2,y2, r,g,b,a, alphablend)
+static int lua_cmd_list_triangle(lua_State *L) {
+	return cmd_list_append_lua(L, LDB_CMD_TRIANGLE, 6, 8, lua_toboolean(L, 12) ? LDB_CMD_FLAG_ALPHABLEND : 0);
+}
+
+// append a circle command(x,y, radius, r,g,b,a, outline, alphablend)
+static int lua_cmd_list_circle(lua_State *L) {
+	return cmd_list_append_lua(L, LDB_CMD_CIRCLE, 3, 5, (lua_toboolean(L, 9) ? LDB_CMD_FLAG_OUTLINE : 0) | (lua_toboolean(L, 10) ? LDB_CMD_FLAG_ALPHABLEND : 0));
+}
+
+// execute all commands in the command list on the drawbuffer, in order.
+// If threads is >1(or 0 for the number of CPUs), the drawbuffer is split into tiles that are drawn in parallel.
+static int lua_cmd_list_execute(lua_State *L) {
+	cmd_list_t *cmd_list;
+	CHECK_CMD_LIST(L, 1, cmd_list)
+	drawbuffer_t *db;
+	LUA_LDB_CHECK_DB(L, 2, db)
+
+	int threads = luaL_optinteger(L, 3, 1);
+	threads = (threads <= 0) ? ldb_threads_get_cpu_count() : threads;
+
+	if ((threads > 1) && (db->h > CMD_TILE_H) && cmd_execute_threaded(db, cmd_list->cmds, cmd_list->len, threads)) {
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+
+	for (int i=0; i<cmd_list->len; i++) {
+		cmd_execute(db, &cmd_list->cmds[i]);
+	}
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// return the number of commands in the command list
+static int lua_cmd_list_len(lua_State *L) {
+	cmd_list_t *cmd_list;
+	CHECK_CMD_LIST(L, 1, cmd_list)
+
+	lua_pushinteger(L, cmd_list->len);
+	return 1;
+}
+
+// remove all commands from the command list(the memory is kept for reuse)
+static int lua_cmd_list_clear(lua_State *L) {
+	cmd_list_t *cmd_list;
+	CHECK_CMD_LIST(L, 1, cmd_list)
+
+	cmd_list->len = 0;
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// return the encoded commands as a string
+static int lua_cmd_list_dump_data(lua_State *L) {
+	cmd_list_t *cmd_list;
+	CHECK_CMD_LIST(L, 1, cmd_list)
+
+	lua_pushlstring(L, (const char*)cmd_list->cmds, (size_t)cmd_list->len*sizeof(cmd_t));
+	return 1;
+}
+
+// append encoded commands from a string(e.g. from dump_data)
+static int lua_cmd_list_append_data(lua_State *L) {
+	cmd_list_t *cmd_list;
+	CHECK_CMD_LIST(L, 1, cmd_list)
+
+	size_t str_len = 0;
+	const char* str = lua_tolstring(L, 2, &str_len);
+	if ((!str) || (str_len % sizeof(cmd_t))) {
+		lua_pushnil(L);
+		lua_pushfstring(L, "Argument 2 must be a string with a length that is a multiple of %d", (int)sizeof(cmd_t));
+		return 2;
+	}
+
+	cmd_t* cmd = cmd_list_append(cmd_list, str_len/sizeof(cmd_t));
+	if (!cmd) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+	memcpy(cmd, str, str_len);
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+// append n zeroed(LDB_CMD_NOP) commands, and return a pointer(lightuserdata) to the first one, to be filled using the LuaJIT FFI.
+// The pointer is only valid until the next command is appended.
+static int lua_cmd_list_append_pointer(lua_State *L) {
+	cmd_list_t *cmd_list;
+	CHECK_CMD_LIST(L, 1, cmd_list)
+
+	int n = luaL_checkinteger(L, 2);
+	cmd_t* cmd = cmd_list_append(cmd_list, n);
+	if (!cmd) {
+		lua_pushnil(L);
+		lua_pushstring(L, "Can't allocate memory!");
+		return 2;
+	}
+
+	lua_pushlightuserdata(L, cmd);
+	return 1;
+}
+
+// free the memory used by the command list. Automatically called by the Lua GC
+static int lua_cmd_list_close(lua_State *L) {
+	cmd_list_t *cmd_list = (cmd_list_t *)luaL_checkudata(L, 1, LDB_CMD_LIST_UDATA_NAME);
+	if (cmd_list->capacity >= 0) {
+		free(cmd_list->cmds);
+		cmd_list->cmds = NULL;
+		cmd_list->len = 0;
+		cmd_list->capacity = -1;
+	}
+
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+static int lua_cmd_list_tostring(lua_State *L) {
+	cmd_list_t *cmd_list;
+	CHECK_CMD_LIST(L, 1, cmd_list)
+
+	lua_pushfstring(L, "Command list: %d commands", cmd_list->len);
+	return 1;
+}
+
+// create a new, empty command list
+static int lua_gfx_new_command_list(lua_State *L) {
+	cmd_list_t *cmd_list = (cmd_list_t *)lua_newuserdata(L, sizeof(cmd_list_t));
+	cmd_list->cmds = NULL;
+	cmd_list->len = 0;
+	cmd_list->capacity = 0;
+
+	// push/create metatable for command list userdata. The same metatable is used for every command list instance.
+	if (luaL_newmetatable(L, LDB_CMD_LIST_UDATA_NAME)) {
+		lua_pushstring(L, "__index");
+		lua_newtable(L);
+		LUA_T_PUSH_S_CF("set_px", lua_cmd_list_set_px)
+		LUA_T_PUSH_S_CF("line", lua_cmd_list_line)
+		LUA_T_PUSH_S_CF("rectangle", lua_cmd_list_rectangle)
+		LUA_T_PUSH_S_CF("triangle", lua_cmd_list_triangle)
+		LUA_T_PUSH_S_CF("circle", lua_cmd_list_circle)
+		LUA_T_PUSH_S_CF("execute", lua_cmd_list_execute)
+		LUA_T_PUSH_S_CF("len", lua_cmd_list_len)
+		LUA_T_PUSH_S_CF("clear", lua_cmd_list_clear)
+		LUA_T_PUSH_S_CF("dump_data", lua_cmd_list_dump_data)
+		LUA_T_PUSH_S_CF("append_data", lua_cmd_list_append_data)
+		LUA_T_PUSH_S_CF("append_pointer", lua_cmd_list_append_pointer)
+		LUA_T_PUSH_S_CF("close", lua_cmd_list_close)
+		LUA_T_PUSH_S_CF("tostring", lua_cmd_list_tostring)
+		lua_settable(L, -3);
+
+		LUA_T_PUSH_S_CF("__gc", lua_cmd_list_close)
+		LUA_T_PUSH_S_CF("__tostring", lua_cmd_list_tostring)
+	}
+	lua_setmetatable(L, -2);
+
+	return 1;
+}
+
+
 
 
 // when the module is require()'ed, return a table with the module functions
 LUALIB_API int luaopen_ldb_gfx(lua_State *L) {
+	ldb_convert_init();
+
 	lua_newtable(L);
 
 	LUA_T_PUSH_S_S("version", LDB_VERSION)
 	LUA_T_PUSH_S_CF("origin_to_target", lua_gfx_origin_to_target)
+	LUA_T_PUSH_S_CF("composite", lua_gfx_composite)
+	LUA_T_PUSH_S_CF("resample", lua_gfx_resample)
+	LUA_T_PUSH_S_CF("blur", lua_gfx_blur)
+	LUA_T_PUSH_S_CF("convolve", lua_gfx_convolve)
+	LUA_T_PUSH_S_CF("morphology", lua_gfx_morphology)
+	LUA_T_PUSH_S_CF("transform_blit", lua_gfx_transform_blit)
+	LUA_T_PUSH_S_CF("polygon", lua_gfx_polygon)
+	LUA_T_PUSH_S_CF("polyline", lua_gfx_polyline)
+	LUA_T_PUSH_S_CF("draw_mesh", lua_gfx_draw_mesh)
+	LUA_T_PUSH_S_CF("draw_textured_mesh", lua_gfx_draw_textured_mesh)
+	LUA_T_PUSH_S_CF("clear_depth", lua_gfx_clear_depth)
 	LUA_T_PUSH_S_CF("line", lua_gfx_line)
 	LUA_T_PUSH_S_CF("rectangle", lua_gfx_rectangle)
 	LUA_T_PUSH_S_CF("triangle", lua_gfx_triangle)
 	LUA_T_PUSH_S_CF("set_px_alphablend", lua_gfx_set_px_alphablend)
 	LUA_T_PUSH_S_CF("circle", lua_gfx_circle)
+	LUA_T_PUSH_S_CF("ellipse", lua_gfx_ellipse)
+	LUA_T_PUSH_S_CF("ring", lua_gfx_ring)
 	LUA_T_PUSH_S_CF("floyd_steinberg", lua_gfx_floyd_steinberg)
+	LUA_T_PUSH_S_CF("ordered_dither", lua_gfx_ordered_dither)
+	LUA_T_PUSH_S_CF("error_diffusion", lua_gfx_error_diffusion)
 	LUA_T_PUSH_S_CF("rgb_to_hsv", lua_gfx_rgb_to_hsv)
 	LUA_T_PUSH_S_CF("hsv_to_rgb", lua_gfx_hsv_to_rgb)
+	LUA_T_PUSH_S_CF("new_command_list", lua_gfx_new_command_list)
+	LUA_T_PUSH_S_I("command_size", sizeof(cmd_t))
+	LUA_T_PUSH_S_I("mesh_vertex_size", sizeof(ldb_mesh_vertex_t))
+	LUA_T_PUSH_S_I("textured_vertex_size", sizeof(ldb_textured_vertex_t))
+
+	// command types and flags, for encoding commands using the FFI
+	lua_pushstring(L, "commands");
+	lua_newtable(L);
+	LUA_T_PUSH_S_I("nop", LDB_CMD_NOP)
+	LUA_T_PUSH_S_I("set_px", LDB_CMD_SET_PX)
+	LUA_T_PUSH_S_I("line", LDB_CMD_LINE)
+	LUA_T_PUSH_S_I("rectangle", LDB_CMD_RECTANGLE)
+	LUA_T_PUSH_S_I("triangle", LDB_CMD_TRIANGLE)
+	LUA_T_PUSH_S_I("circle", LDB_CMD_CIRCLE)
+	LUA_T_PUSH_S_I("flag_alphablend", LDB_CMD_FLAG_ALPHABLEND)
+	LUA_T_PUSH_S_I("flag_outline", LDB_CMD_FLAG_OUTLINE)
+	lua_settable(L, -3);
 
 	return 1;
 }
@@ -1,76 +1,395 @@
 #ifndef LUA_LDB_GFX_H
 #define LUA_LDB_GFX_H
 
+#define LDB_CMD_LIST_UDATA_NAME "command_list"
 
-// Macro to set a pixel with compile-time parameters specifying alpha-blending and scale
-// Keep ALPHA and SX,SY compile-time constant!
-#define SET_PX(ALPHA,SX,SY, DB,X,Y,P) \
-for (int __scy=0; __scy<SY; __scy++) { for (int __scx=0; __scx<SX; __scx++) { \
-	if (ALPHA==1) { db_set_px_ignorealpha(DB, X+__scx, Y+__scy, P); } \
-	else if (ALPHA==2) { db_set_px_alphablend(DB, X+__scx, Y+__scy, P); } \
-	else { db_set_px(DB, X+__scx, Y+__scy, P); } } }
+// check if a Lua stack index contains an open command list, return to lua with an error if not.
+#define CHECK_CMD_LIST(L, I, D) D=(cmd_list_t *)luaL_checkudata(L, I, LDB_CMD_LIST_UDATA_NAME); if ((D==NULL) || (D->capacity<0)) { lua_pushnil(L); lua_pushfstring(L, "Argument %d must be a command list", I); return 2; }
 
-// Macro to copy a rectangular region with compile-time parameters specifying alpha-blending and scale
-// Keep ALPHA and SX,SY compile-time constant!
-#define COPY_RECT(ALPHA,SX,SY, O_DB,T_DB, TX,TY, OX,OY, W,H) \
-for (int __cy=0; __cy<H; __cy++) { for (int __cx=0; __cx<W; __cx++) { \
-	uint32_t __p = db_get_px(O_DB, OX+__cx, OY+__cy); \
-	SET_PX(ALPHA, SX,SY, T_DB, (TX+__cx),(TY+__cy), __p) } }
+// command types for command lists
+typedef enum {
+	LDB_CMD_NOP, // ignored
+	LDB_CMD_SET_PX, // args: x,y
+	LDB_CMD_LINE, // args: x0,y0, x1,y1, radius(0 for Bresenham, otherwise smooth)
+	LDB_CMD_RECTANGLE, // args: x,y, w,h
+	LDB_CMD_TRIANGLE, // args: x0,y0, x1,y1, x2,y2
+	LDB_CMD_CIRCLE, // args: x,y, radius
 
+	LDB_CMD_MAX,
+} CMD_TYPE;
 
-// Mix the colors based on the alph value of the target pixel
-static inline uint32_t alphablend(uint32_t sp, uint32_t tp) {
-	uint8_t s_r,s_g,s_b,s_a; // source pixel
-	uint8_t t_r,t_g,t_b,t_a; // target pixel
+// command flags
+#define LDB_CMD_FLAG_ALPHABLEND 1
+#define LDB_CMD_FLAG_OUTLINE 2
 
-	t_a = unpack_pixel_a(tp);
-	if (t_a==0) {
-		return sp; // target alpha=0, keep source pixel unmodified
-	}
-	UNPACK_RGB(tp, t_r,t_g,t_b)
+// a single drawing command, encoded as 32 bytes(native byte order) so commands can be written directly using the LuaJIT FFI
+typedef struct {
+	uint8_t type; // CMD_TYPE
+	uint8_t flags; // LDB_CMD_FLAG_*
+	uint16_t reserved;
+	uint32_t color; // internal pixel value(r<<24 | g<<16 | b<<8 | a)
+	int32_t args[6];
+} cmd_t;
 
-	s_a = unpack_pixel_a(sp);
-	if (t_a==0xff) {
-		return pack_pixel_rgba(t_r, t_g, t_b, s_a); // target alpha=1, set to target pixel(but keep alpha of source)
-	}
-	UNPACK_RGB(sp, s_r,s_g,s_b)
+// a list of drawing commands, executed on a drawbuffer at once. capacity is -1 if the command list was closed.
+typedef struct {
+	cmd_t* cmds;
+	int len;
+	int capacity;
+} cmd_list_t;
+
+
+// an edge of a polygon(y0 < y1), dir is +1 if the edge points down, -1 if up
+typedef struct {
+	float x0, y0, x1, y1;
+	float dxdy;
+	float dir;
+} poly_edge_t;
+
+// a growing list of closed polygon contours(see polygon), contour i ends before point ends[i].
+// failed is set if memory could not be allocated.
+typedef struct {
+	float* pts;
+	int* ends;
+	int pts_len, pts_cap;
+	int ends_len, ends_cap;
+	int failed;
+} poly_path_t;
+
+// line join styles for polylines
+typedef enum {
+	LDB_JOIN_MITER,
+	LDB_JOIN_ROUND,
+	LDB_JOIN_BEVEL,
+
+	LDB_JOIN_MAX,
+} JOIN_TYPE;
+
+// line cap styles for polylines
+typedef enum {
+	LDB_CAP_BUTT,
+	LDB_CAP_ROUND,
+	LDB_CAP_SQUARE,
 
-	float alpha = ((float)t_a)/255.0;
-	float ialpha = 1-alpha;
+	LDB_CAP_MAX,
+} CAP_TYPE;
 
-	uint8_t r,g,b,a;
-	r = t_r*alpha + s_r*ialpha;
-	g = t_g*alpha + s_g*ialpha;
-	b = t_b*alpha + s_b*ialpha;
-	a = s_a; // TODO: Is this right?
+// miter joins longer than this(relative to the stroke width) are drawn as bevel joins
+#define LDB_MITER_LIMIT 4.0f
 
-	return pack_pixel_rgba(r,g,b,a);
+
+// Mix the colors based on the alpha value of the target pixel tp(see blend_pixel)
+static inline uint32_t alphablend(uint32_t sp, uint32_t tp) {
+	return blend_pixel(sp, tp);
 }
 
 // Set a pixel by mixing the color values using alpha-blending. Does not modify the alpha channel of the drawbuffer.
-static inline void set_px_alphablend(uint8_t* data, int w, int x, int y, uint32_t p, PIX_FMT fmt) {
-	uint32_t sp = get_px(data, w, x,y, fmt);
+static inline void set_px_alphablend(uint8_t* data, int stride, int x, int y, uint32_t p, PIX_FMT fmt) {
+	uint32_t sp = get_px(data, stride, x,y, fmt);
 	uint32_t tp = alphablend(sp, p);
-	set_px(data, w, x, y, tp, fmt);
+	set_px(data, stride, x, y, tp, fmt);
 }
 static inline void db_set_px_alphablend(const drawbuffer_t* target_db, int x, int y, uint32_t p) {
 	if ((x<0) || (y<0) || (x>=target_db->w) || (y>=target_db->h) || (!target_db->data)) {
 		return;
 	}
-	set_px_alphablend(target_db->data, target_db->w, x, y, p, target_db->pxfmt);
+	set_px_alphablend(target_db->data, target_db->stride, x, y, p, target_db->pxfmt);
 }
 
 // Set a pixel only if the alpha-value is >0
-static inline void set_px_ignorealpha(uint8_t* data, int w, int x, int y, uint32_t p, PIX_FMT fmt) {
+static inline void set_px_ignorealpha(uint8_t* data, int stride, int x, int y, uint32_t p, PIX_FMT fmt) {
 	if (unpack_pixel_a(p)) {
-		set_px(data, w, x, y, p, fmt);
+		set_px(data, stride, x, y, p, fmt);
 	}
 }
 static inline void db_set_px_ignorealpha(const drawbuffer_t* target_db, int x, int y, uint32_t p) {
 	if ((x<0) || (y<0) || (x>=target_db->w) || (y>=target_db->h) || (!target_db->data)) {
 		return;
 	}
-	set_px_ignorealpha(target_db->data, target_db->w, x, y, p, target_db->pxfmt);
+	set_px_ignorealpha(target_db->data, target_db->stride, x, y, p, target_db->pxfmt);
+}
+
+// Mix the pixel p into n pixels of a row using alpha-blending, starting at x
+static inline void blend_row(uint8_t* row, int x, PIX_FMT fmt, uint32_t p, int n) {
+	unpack_row_func_t unpack_row = get_unpack_row_func(fmt);
+	pack_row_func_t pack_row = get_pack_row_func(fmt);
+	uint32_t tmp[LDB_ROW_CHUNK];
+	if (unpack_pixel_a(p) == 0) {
+		return;
+	}
+	for (int i=0; i<n; i+=LDB_ROW_CHUNK) {
+		int len = ((n-i) < LDB_ROW_CHUNK) ? (n-i) : LDB_ROW_CHUNK;
+		unpack_row(row, x+i, tmp, len);
+		ldb_blend_row_color(tmp, p, len);
+		pack_row(row, x+i, tmp, len);
+	}
+}
+
+// Mix the n pixels in src into a row using alpha-blending(each with it's own alpha value), starting at x
+static inline void blend_row_src(uint8_t* row, int x, PIX_FMT fmt, const uint32_t* src, int n) {
+	unpack_row_func_t unpack_row = get_unpack_row_func(fmt);
+	pack_row_func_t pack_row = get_pack_row_func(fmt);
+	uint32_t tmp[LDB_ROW_CHUNK];
+	for (int i=0; i<n; i+=LDB_ROW_CHUNK) {
+		int len = ((n-i) < LDB_ROW_CHUNK) ? (n-i) : LDB_ROW_CHUNK;
+		unpack_row(row, x+i, tmp, len);
+		ldb_blend_row(tmp, src+i, len);
+		pack_row(row, x+i, tmp, len);
+	}
+}
+
+// divide x(0..255*255) by 255, rounded to the nearest value
+static inline uint32_t div255(uint32_t x) {
+	x += 128;
+	return (x + (x>>8)) >> 8;
+}
+
+// Compositing functions. d is the target pixel, s the origin pixel(both non-premultiplied).
+// The Porter-Duff operators compute the result using premultiplied values: c*a = cs*sa*fa + cd*da*fb, a = sa*fa + da*fb,
+// with the factors fa, fb of the operator.
+// The blend modes use the separable blend function B(cs, cd) for the overlapping region, and "source over" compositing:
+// c*a = cs*sa*(1-da) + cd*da*(1-sa) + sa*da*B(cs, cd), a = sa + da - sa*da
+// The non-premultiplied result color is computed from the exact sums(c = c*a / a), so it's only rounded once.
+#define COMPOSITE_PD(NAME, FA, FB) \
+static inline uint32_t composite_##NAME(uint32_t d, uint32_t s) { \
+	uint32_t sa = s & 0xff, da = d & 0xff; \
+	uint32_t wa = sa*(FA), wb = da*(FB); \
+	uint32_t den = wa + wb; \
+	if (den == 0) { return 0; } \
+	uint32_t r = div255(den); \
+	for (int shift=8; shift<32; shift+=8) { \
+		uint32_t num = ((s>>shift) & 0xff)*wa + ((d>>shift) & 0xff)*wb; \
+		r |= ((num + den/2) / den) << shift; \
+	} \
+	return r; \
+}
+COMPOSITE_PD(src_over, 255, 255-sa)
+COMPOSITE_PD(dst_over, 255-da, 255)
+COMPOSITE_PD(src_in, da, 0)
+COMPOSITE_PD(src_out, 255-da, 0)
+COMPOSITE_PD(src_atop, da, 255-sa)
+COMPOSITE_PD(xor, 255-da, 255-sa)
+
+#define COMPOSITE_BLEND(NAME, B) \
+static inline uint32_t composite_##NAME(uint32_t d, uint32_t s) { \
+	uint32_t sa = s & 0xff, da = d & 0xff; \
+	uint32_t ws = sa*(255-da), wd = da*(255-sa), wb = sa*da; \
+	uint32_t den = ws + wd + wb; \
+	if (den == 0) { return 0; } \
+	uint32_t r = div255(den); \
+	for (int shift=8; shift<32; shift+=8) { \
+		int32_t cs = (s>>shift) & 0xff, cd = (d>>shift) & 0xff; \
+		uint32_t num = cs*ws + cd*wd + (uint32_t)(B)*wb; \
+		r |= ((num + den/2) / den) << shift; \
+	} \
+	return r; \
+}
+COMPOSITE_BLEND(multiply, div255(cs*cd))
+COMPOSITE_BLEND(screen, cs + cd - (int32_t)div255(cs*cd))
+COMPOSITE_BLEND(add, (cs+cd > 255) ? 255 : cs+cd)
+COMPOSITE_BLEND(subtract, (cd-cs < 0) ? 0 : cd-cs)
+COMPOSITE_BLEND(darken, (cs < cd) ? cs : cd)
+COMPOSITE_BLEND(lighten, (cs > cd) ? cs : cd)
+
+// clip a w*h region copied from ox,oy in the origin to tx,ty in the target to the bounds of both drawbuffers.
+// returns 0 if nothing is visible.
+static inline int clip_copy_rect(const drawbuffer_t* origin_db, const drawbuffer_t* target_db, int* tx, int* ty, int* ox, int* oy, int* w, int* h) {
+	if (*ox < 0) { *tx -= *ox; *w += *ox; *ox = 0; }
+	if (*oy < 0) { *ty -= *oy; *h += *oy; *oy = 0; }
+	if (*tx < 0) { *ox -= *tx; *w += *tx; *tx = 0; }
+	if (*ty < 0) { *oy -= *ty; *h += *ty; *ty = 0; }
+	if (*ox + *w > origin_db->w) { *w = origin_db->w - *ox; }
+	if (*oy + *h > origin_db->h) { *h = origin_db->h - *oy; }
+	if (*tx + *w > target_db->w) { *w = target_db->w - *tx; }
+	if (*ty + *h > target_db->h) { *h = target_db->h - *ty; }
+	return (*w > 0) && (*h > 0);
+}
+
+// combine a row of origin pixels into a row of target pixels(alpha_mode 1 or 2, see copy_rect_rows)
+static inline void combine_rows(uint32_t* t_tmp, const uint32_t* o_tmp, int len, int alpha_mode, int premul, int keep_alpha) {
+	if (alpha_mode == 1) {
+		for (int j=0; j<len; j++) {
+			t_tmp[j] = unpack_pixel_a(o_tmp[j]) ? o_tmp[j] : t_tmp[j];
+		}
+	} else if (premul) {
+		ldb_blend_row_premul(t_tmp, o_tmp, len, keep_alpha);
+	} else {
+		ldb_blend_row(t_tmp, o_tmp, len);
+	}
+}
+
+// copy a rectangular region(unscaled), using the row kernels once per row and chunk.
+// alpha_mode is 0 for copy, 1 for ignorealpha, 2 for alphablend
+static inline void copy_rect_rows(const drawbuffer_t* origin_db, const drawbuffer_t* target_db, int tx, int ty, int ox, int oy, int w, int h, int alpha_mode) {
+	if (!clip_copy_rect(origin_db, target_db, &tx, &ty, &ox, &oy, &w, &h)) {
+		return;
+	}
+
+	if (alpha_mode == 0) {
+		for (int cy=0; cy<h; cy++) {
+			ldb_convert_row(db_get_row_ptr(origin_db, oy+cy), ox, origin_db->pxfmt, db_get_row_ptr(target_db, ty+cy), tx, target_db->pxfmt, w);
+		}
+		return;
+	}
+
+	// alphablending a premultiplied origin uses the premultiplied values directly(and the target values, if premultiplied)
+	int premul = (alpha_mode == 2) && is_premultiplied(origin_db->pxfmt);
+	PIX_FMT origin_fmt = premul ? get_straight_pxfmt(origin_db->pxfmt) : origin_db->pxfmt;
+	PIX_FMT target_fmt = premul ? get_straight_pxfmt(target_db->pxfmt) : target_db->pxfmt;
+	int keep_alpha = !is_premultiplied(target_db->pxfmt);
+
+	unpack_row_func_t unpack_origin = get_unpack_row_func(origin_fmt);
+	unpack_row_func_t unpack_target = get_unpack_row_func(target_fmt);
+	pack_row_func_t pack_target = get_pack_row_func(target_fmt);
+	uint32_t o_tmp[LDB_ROW_CHUNK];
+	uint32_t t_tmp[LDB_ROW_CHUNK];
+	for (int cy=0; cy<h; cy++) {
+		const uint8_t* o_row = db_get_row_ptr(origin_db, oy+cy);
+		uint8_t* t_row = db_get_row_ptr(target_db, ty+cy);
+		for (int i=0; i<w; i+=LDB_ROW_CHUNK) {
+			int len = ((w-i) < LDB_ROW_CHUNK) ? (w-i) : LDB_ROW_CHUNK;
+			unpack_origin(o_row, ox+i, o_tmp, len);
+			unpack_target(t_row, tx+i, t_tmp, len);
+			combine_rows(t_tmp, o_tmp, len, alpha_mode, premul, keep_alpha);
+			pack_target(t_row, tx+i, t_tmp, len);
+		}
+	}
+}
+
+// copy a rectangular region, enlarging every origin pixel to a sx*sy block in the target.
+// Each visible origin row is unpacked and expanded once. When copying, it's packed into the
+// first target row, and the other sy-1 rows are copied from it as whole rows.
+static inline void copy_rect_scaled_rows(const drawbuffer_t* origin_db, const drawbuffer_t* target_db, int tx, int ty, int ox, int oy, int w, int h, int sx, int sy, int alpha_mode) {
+	// clip to the origin(in origin pixels), then to the target(in target pixels)
+	int64_t t_x = tx, t_y = ty;
+	if (ox < 0) { t_x -= (int64_t)ox*sx; w += ox; ox = 0; }
+	if (oy < 0) { t_y -= (int64_t)oy*sy; h += oy; oy = 0; }
+	if (ox + w > origin_db->w) { w = origin_db->w - ox; }
+	if (oy + h > origin_db->h) { h = origin_db->h - oy; }
+	if ((w <= 0) || (h <= 0) || (!origin_db->data) || (!target_db->data)) {
+		return;
+	}
+	int64_t x1 = t_x + (int64_t)w*sx;
+	int64_t y1 = t_y + (int64_t)h*sy;
+	int x_start = (t_x < 0) ? 0 : ((t_x < target_db->w) ? (int)t_x : target_db->w);
+	int y_start = (t_y < 0) ? 0 : ((t_y < target_db->h) ? (int)t_y : target_db->h);
+	int x_end = (x1 < target_db->w) ? (int)x1 : target_db->w;
+	int y_end = (y1 < target_db->h) ? (int)y1 : target_db->h;
+	if ((x_start >= x_end) || (y_start >= y_end)) {
+		return;
+	}
+
+	int premul = (alpha_mode == 2) && is_premultiplied(origin_db->pxfmt);
+	PIX_FMT origin_fmt = premul ? get_straight_pxfmt(origin_db->pxfmt) : origin_db->pxfmt;
+	PIX_FMT target_fmt = premul ? get_straight_pxfmt(target_db->pxfmt) : target_db->pxfmt;
+	int keep_alpha = !is_premultiplied(target_db->pxfmt);
+
+	unpack_row_func_t unpack_origin = get_unpack_row_func(origin_fmt);
+	unpack_row_func_t unpack_target = get_unpack_row_func(target_fmt);
+	pack_row_func_t pack_target = get_pack_row_func(target_fmt);
+
+	// whole rows can only be copied if pixels are byte-aligned
+	size_t bpp = get_bpp(target_db->pxfmt);
+	int copy_rows = (alpha_mode == 0) && (bpp >= 8);
+	size_t row_offset = (size_t)x_start*(bpp/8);
+	size_t row_bytes = (size_t)(x_end-x_start)*(bpp/8);
+
+	uint32_t o_tmp[LDB_ROW_CHUNK];
+	uint32_t s_tmp[LDB_ROW_CHUNK];
+	uint32_t t_tmp[LDB_ROW_CHUNK];
+	for (int y=y_start; y<y_end; ) {
+		// all target rows y..block_end-1 come from the same origin row
+		int o_y = oy + (int)((y-t_y)/sy);
+		int64_t block_end = t_y + (int64_t)(o_y-oy+1)*sy;
+		int y_next = (block_end < y_end) ? (int)block_end : y_end;
+		const uint8_t* o_row = db_get_row_ptr(origin_db, o_y);
+
+		if (copy_rows && (sx == 1)) {
+			ldb_convert_row(o_row, ox+(int)(x_start-t_x), origin_db->pxfmt, db_get_row_ptr(target_db, y), x_start, target_db->pxfmt, x_end-x_start);
+		} else {
+			for (int x=x_start; x<x_end; x+=LDB_ROW_CHUNK) {
+				int len = ((x_end-x) < LDB_ROW_CHUNK) ? (x_end-x) : LDB_ROW_CHUNK;
+				// expand the origin pixels of this chunk horizontally
+				int o_x = ox + (int)((x-t_x)/sx);
+				int o_len = ox + (int)((x+len-1-t_x)/sx) - o_x + 1;
+				unpack_origin(o_row, o_x, o_tmp, o_len);
+				int phase = (int)((x-t_x)%sx);
+				for (int j=0, k=0; j<len; j++) {
+					s_tmp[j] = o_tmp[k];
+					if (++phase == sx) {
+						phase = 0;
+						k++;
+					}
+				}
+
+				if (copy_rows) {
+					pack_target(db_get_row_ptr(target_db, y), x, s_tmp, len);
+					continue;
+				}
+				for (int cy=y; cy<y_next; cy++) {
+					uint8_t* t_row = db_get_row_ptr(target_db, cy);
+					if (alpha_mode == 0) {
+						pack_target(t_row, x, s_tmp, len);
+						continue;
+					}
+					unpack_target(t_row, x, t_tmp, len);
+					combine_rows(t_tmp, s_tmp, len, alpha_mode, premul, keep_alpha);
+					pack_target(t_row, x, t_tmp, len);
+				}
+			}
+		}
+
+		if (copy_rows) {
+			const uint8_t* first_row = db_get_row_ptr(target_db, y) + row_offset;
+			for (int cy=y+1; cy<y_next; cy++) {
+				memcpy(db_get_row_ptr(target_db, cy) + row_offset, first_row, row_bytes);
+			}
+		}
+		y = y_next;
+	}
+}
+
+// interpolate between the pixels p0 and p1(internal pixel format), f is the weight of p1(0-255)
+static inline uint32_t lerp_pixel(uint32_t p0, uint32_t p1, uint32_t f) {
+	uint32_t rb = ((p0 & 0xff00ff00) >> 8)*(256-f) + ((p1 & 0xff00ff00) >> 8)*f + 0x00800080;
+	uint32_t ga = (p0 & 0x00ff00ff)*(256-f) + (p1 & 0x00ff00ff)*f + 0x00800080;
+	return (rb & 0xff00ff00) | ((ga >> 8) & 0x00ff00ff);
+}
+
+// sample the w*h pixels at px using bilinear interpolation. u,v are 16.16 fixed-point coordinates of the
+// sample point(pixel centers are at .5), pixels outside are clamped to the edge.
+static inline uint32_t sample_bilinear(const uint32_t* px, int w, int h, int64_t u, int64_t v) {
+	u -= 0x8000;
+	v -= 0x8000;
+	int64_t x0 = u >> 16, y0 = v >> 16;
+	uint32_t fx = (u >> 8) & 0xff, fy = (v >> 8) & 0xff;
+	int64_t x1 = (x0+1 > w-1) ? w-1 : ((x0+1 < 0) ? 0 : x0+1);
+	int64_t y1 = (y0+1 > h-1) ? h-1 : ((y0+1 < 0) ? 0 : y0+1);
+	x0 = (x0 > w-1) ? w-1 : ((x0 < 0) ? 0 : x0);
+	y0 = (y0 > h-1) ? h-1 : ((y0 < 0) ? 0 : y0);
+	uint32_t top = lerp_pixel(px[y0*w+x0], px[y0*w+x1], fx);
+	uint32_t bottom = lerp_pixel(px[y1*w+x0], px[y1*w+x1], fx);
+	return lerp_pixel(top, bottom, fy);
+}
+
+// get the range x_min <= x < x_max of integer x, for which lo <= p0 + (x+0.5)*dp < hi.
+// Only narrows the range passed in x_min, x_max.
+static inline void span_limit(double p0, double dp, double lo, double hi, int* x_min, int* x_max) {
+	int a, b;
+	if (dp > 0) {
+		a = (int)fmax(fmin(ceil((lo-p0)/dp - 0.5), INT_MAX), INT_MIN);
+		b = (int)fmax(fmin(ceil((hi-p0)/dp - 0.5), INT_MAX), INT_MIN);
+	} else if (dp < 0) {
+		a = (int)fmax(fmin(floor((hi-p0)/dp - 0.5)+1, INT_MAX), INT_MIN);
+		b = (int)fmax(fmin(floor((lo-p0)/dp - 0.5)+1, INT_MAX), INT_MIN);
+	} else if ((p0 >= lo) && (p0 < hi)) {
+		return;
+	} else {
+		*x_max = *x_min;
+		return;
+	}
+	*x_min = (a > *x_min) ? a : *x_min;
+	*x_max = (b < *x_max) ? b : *x_max;
 }
 
 // Convert rgb <-> hsv
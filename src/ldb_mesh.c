@@ -0,0 +1,455 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+#include "lua.h"
+
+#include "ldb.h"
+#include "ldb_convert.h"
+#include "ldb_gfx.h"
+#include "ldb_mesh.h"
+
+// Triangle mesh rasterizer.
+// Vertices are snapped to 1/16 pixel, and coverage is decided by three
+// integer edge functions per triangle(half-space test), evaluated at pixel
+// centers using the top-left fill rule, so triangles that share an edge
+// never overlap or leave gaps. The bounding box is walked in 2x2 pixel quads,
+// and quads outside the triangle are rejected with a single test(of each edge
+// function at the quad pixel where it is largest).
+// Colors and depth are interpolated linearly in screen-space. Texture
+// coordinates are interpolated divided by w(as u*q, v*q and q), and divided by
+// the interpolated q per pixel, which makes them perspective-correct.
+// Textures are unpacked once per call(premultiplied for bilinear filtering).
+// The target rows touched by a quad row are unpacked once, shaded, and packed again.
+
+// number of sub-pixel bits of the snapped vertex coordinates
+#define MESH_SUBPIXEL_BITS 4
+#define MESH_SUBPIXEL (1<<MESH_SUBPIXEL_BITS)
+
+static const char* cull_names[LDB_CULL_MAX] = { "none", "back", "front" };
+
+// an attribute that is interpolated linearly across a triangle: value = base + dx*x + dy*y
+typedef struct {
+	float base, dx, dy;
+} mesh_plane_t;
+
+// unpacked texture for the rasterizer
+typedef struct {
+	uint32_t* px; // premultiplied if bilinear is set
+	int w, h;
+	int bilinear;
+	int wrap;
+} mesh_texture_t;
+
+// depth buffer access for the rasterizer
+typedef struct {
+	uint8_t* data;
+	int stride;
+	int is_float;
+} mesh_depth_t;
+
+
+
+LDB_CULL ldb_cull_from_str(const char* str) {
+	for (int i=0; i<LDB_CULL_MAX; i++) {
+		if (strcmp(str, cull_names[i])==0) {
+			return (LDB_CULL)i;
+		}
+	}
+	return LDB_CULL_MAX;
+}
+
+// setup the plane for an attribute with the values a0,a1,a2 at the vertices(relative to vertex 0, area is twice the triangle area)
+static inline mesh_plane_t mesh_plane(double a0, double a1, double a2, double x0, double y0, double dx1, double dy1, double dx2, double dy2, double area) {
+	mesh_plane_t plane;
+	double dx = ((a1-a0)*dy2 - (a2-a0)*dy1) / area;
+	double dy = ((a2-a0)*dx1 - (a1-a0)*dx2) / area;
+	plane.dx = dx;
+	plane.dy = dy;
+	// value at pixel coordinate 0,0(the pixel center is added when sampling)
+	plane.base = a0 - dx*x0 - dy*y0;
+	return plane;
+}
+
+// evaluate a plane at the center of the pixel x,y
+static inline float mesh_plane_at(const mesh_plane_t* plane, int x, int y) {
+	return plane->base + plane->dx*(x+0.5f) + plane->dy*(y+0.5f);
+}
+
+// convert an interpolated color channel to 0-255
+static inline uint32_t mesh_channel(float v) {
+	v = (v < 0) ? 0 : ((v > 255) ? 255 : v);
+	return (uint32_t)(v+0.5f);
+}
+
+// multiply the color channels of the pixels p and c
+static inline uint32_t mesh_modulate(uint32_t p, uint32_t c) {
+	return pack_pixel_rgba(
+		div255(unpack_pixel_r(p)*unpack_pixel_r(c)),
+		div255(unpack_pixel_g(p)*unpack_pixel_g(c)),
+		div255(unpack_pixel_b(p)*unpack_pixel_b(c)),
+		div255(unpack_pixel_a(p)*unpack_pixel_a(c))
+	);
+}
+
+// wrap the integer coordinate x into 0 <= x < w
+static inline int64_t mesh_wrap(int64_t x, int w) {
+	x %= w;
+	return (x < 0) ? x+w : x;
+}
+
+// sample the texture at the texel coordinates u,v
+static inline uint32_t mesh_sample(const mesh_texture_t* tex, float u, float v) {
+	// limit the range before converting to fixed-point(also handles NaN)
+	if (tex->wrap) {
+		u = (fabsf(u) < 1e6f) ? u - floorf(u/tex->w)*tex->w : 0;
+		v = (fabsf(v) < 1e6f) ? v - floorf(v/tex->h)*tex->h : 0;
+	} else {
+		u = (u > -1) ? ((u < tex->w+1) ? u : tex->w+1) : -1;
+		v = (v > -1) ? ((v < tex->h+1) ? v : tex->h+1) : -1;
+	}
+	int64_t fu = (int64_t)floorf(u*65536.0f);
+	int64_t fv = (int64_t)floorf(v*65536.0f);
+	if (!tex->bilinear) {
+		int64_t x = fu >> 16, y = fv >> 16;
+		if (tex->wrap) {
+			x = mesh_wrap(x, tex->w);
+			y = mesh_wrap(y, tex->h);
+		} else {
+			x = (x < 0) ? 0 : ((x > tex->w-1) ? tex->w-1 : x);
+			y = (y < 0) ? 0 : ((y > tex->h-1) ? tex->h-1 : y);
+		}
+		return tex->px[y*tex->w+x];
+	}
+	if (!tex->wrap) {
+		return unpremultiply_pixel(sample_bilinear(tex->px, tex->w, tex->h, fu, fv));
+	}
+	fu -= 0x8000;
+	fv -= 0x8000;
+	uint32_t fx = (fu >> 8) & 0xff, fy = (fv >> 8) & 0xff;
+	int64_t x0 = mesh_wrap(fu >> 16, tex->w), y0 = mesh_wrap(fv >> 16, tex->h);
+	int64_t x1 = (x0+1 == tex->w) ? 0 : x0+1;
+	int64_t y1 = (y0+1 == tex->h) ? 0 : y0+1;
+	uint32_t top = lerp_pixel(tex->px[y0*tex->w+x0], tex->px[y0*tex->w+x1], fx);
+	uint32_t bottom = lerp_pixel(tex->px[y1*tex->w+x0], tex->px[y1*tex->w+x1], fx);
+	return unpremultiply_pixel(lerp_pixel(top, bottom, fy));
+}
+
+// depth test for pixel x,y. Returns 1 and updates the depth buffer if z is closer.
+static inline int mesh_depth_test(const mesh_depth_t* depth, int x, int y, float z) {
+	uint8_t* row = depth->data + (size_t)y*depth->stride;
+	if (depth->is_float) {
+		float* d = (float*)row + x;
+		if (z < *d) {
+			*d = z;
+			return 1;
+		}
+		return 0;
+	}
+	uint16_t* d = (uint16_t*)row + x;
+	float zc = (z < 0) ? 0 : ((z > 1) ? 1 : z);
+	uint16_t zi = (uint16_t)(zc*65535.0f+0.5f);
+	if (zi < *d) {
+		*d = zi;
+		return 1;
+	}
+	return 0;
+}
+
+// draw a single triangle, textured if tex is not NULL. rows is a temporary buffer for two target rows.
+static void mesh_triangle(const drawbuffer_t* db, const mesh_depth_t* depth, const mesh_texture_t* tex, uint32_t* rows, const ldb_textured_vertex_t* v0, const ldb_textured_vertex_t* v1, const ldb_textured_vertex_t* v2, int alpha_mode, LDB_CULL cull, db_rect_t* bounds) {
+	const ldb_textured_vertex_t* v[3] = { v0, v1, v2 };
+	int64_t X[3], Y[3];
+	for (int i=0; i<3; i++) {
+		// also rejects NaN
+		if (!((fabsf(v[i]->x) <= LDB_MESH_MAX_COORD) && (fabsf(v[i]->y) <= LDB_MESH_MAX_COORD))) {
+			return;
+		}
+		if (tex && !(v[i]->q > 0)) {
+			return;
+		}
+		X[i] = lrintf(v[i]->x * MESH_SUBPIXEL);
+		Y[i] = lrintf(v[i]->y * MESH_SUBPIXEL);
+	}
+
+	// twice the signed area, positive for clockwise(front-facing) triangles
+	int64_t area = (X[1]-X[0])*(Y[2]-Y[0]) - (X[2]-X[0])*(Y[1]-Y[0]);
+	if ((area == 0) || ((cull == LDB_CULL_BACK) && (area < 0)) || ((cull == LDB_CULL_FRONT) && (area > 0))) {
+		return;
+	}
+	if (area < 0) {
+		// make clockwise, so the inside is where all edge functions are positive
+		const ldb_textured_vertex_t* tv = v[1]; v[1] = v[2]; v[2] = tv;
+		int64_t t = X[1]; X[1] = X[2]; X[2] = t;
+		t = Y[1]; Y[1] = Y[2]; Y[2] = t;
+		area = -area;
+	}
+
+	// bounding box in pixels, clipped to the drawbuffer. Starts at an even pixel for the 2x2 quads.
+	int64_t x_min = X[0], x_max = X[0], y_min = Y[0], y_max = Y[0];
+	for (int i=1; i<3; i++) {
+		x_min = (X[i] < x_min) ? X[i] : x_min;
+		x_max = (X[i] > x_max) ? X[i] : x_max;
+		y_min = (Y[i] < y_min) ? Y[i] : y_min;
+		y_max = (Y[i] > y_max) ? Y[i] : y_max;
+	}
+	int x_start = (int)(x_min >> MESH_SUBPIXEL_BITS);
+	int y_start = (int)(y_min >> MESH_SUBPIXEL_BITS);
+	int x_end = (int)((x_max + MESH_SUBPIXEL-1) >> MESH_SUBPIXEL_BITS);
+	int y_end = (int)((y_max + MESH_SUBPIXEL-1) >> MESH_SUBPIXEL_BITS);
+	x_start = (x_start < 0) ? 0 : (x_start & ~1);
+	y_start = (y_start < 0) ? 0 : (y_start & ~1);
+	x_end = (x_end > db->w) ? db->w : x_end;
+	y_end = (y_end > db->h) ? db->h : y_end;
+	if ((x_start >= x_end) || (y_start >= y_end)) {
+		return;
+	}
+
+	// edge functions at the pixel center of x_start,y_start, with steps per pixel.
+	// Edge i goes from vertex i to vertex i+1. Pixels on an edge are only drawn for top and left edges,
+	// which is done by subtracting 1 from the other edge functions, so the test is e>=0 for all edges.
+	int64_t e_row[3], e_dx[3], e_dy[3], e_in[3];
+	int64_t px = (int64_t)x_start*MESH_SUBPIXEL + MESH_SUBPIXEL/2;
+	int64_t py = (int64_t)y_start*MESH_SUBPIXEL + MESH_SUBPIXEL/2;
+	for (int i=0; i<3; i++) {
+		int j = (i+1)%3;
+		int64_t dx = X[j]-X[i];
+		int64_t dy = Y[j]-Y[i];
+		int top_left = ((dy == 0) && (dx > 0)) || (dy < 0);
+		e_row[i] = dx*(py-Y[i]) - dy*(px-X[i]) - (top_left ? 0 : 1);
+		e_dx[i] = -dy*MESH_SUBPIXEL;
+		e_dy[i] = dx*MESH_SUBPIXEL;
+		// offset from the top-left pixel of a quad to its pixel where edge function i is largest
+		e_in[i] = ((e_dx[i] > 0) ? e_dx[i] : 0) + ((e_dy[i] > 0) ? e_dy[i] : 0);
+	}
+
+	// attribute planes(in pixel coordinates)
+	double fx0 = (double)X[0]/MESH_SUBPIXEL, fy0 = (double)Y[0]/MESH_SUBPIXEL;
+	double dx1 = (double)(X[1]-X[0])/MESH_SUBPIXEL, dy1 = (double)(Y[1]-Y[0])/MESH_SUBPIXEL;
+	double dx2 = (double)(X[2]-X[0])/MESH_SUBPIXEL, dy2 = (double)(Y[2]-Y[0])/MESH_SUBPIXEL;
+	double farea = (double)area/(MESH_SUBPIXEL*MESH_SUBPIXEL);
+	mesh_plane_t planes[8];
+	for (int c=0; c<4; c++) {
+		int shift = 24-c*8;
+		planes[c] = mesh_plane((v[0]->color>>shift)&0xff, (v[1]->color>>shift)&0xff, (v[2]->color>>shift)&0xff, fx0, fy0, dx1, dy1, dx2, dy2, farea);
+	}
+	planes[4] = mesh_plane(v[0]->z, v[1]->z, v[2]->z, fx0, fy0, dx1, dy1, dx2, dy2, farea);
+	// the texture color is only modulated if a vertex color is not white
+	int modulate = 0;
+	if (tex) {
+		planes[5] = mesh_plane(v[0]->u*v[0]->q, v[1]->u*v[1]->q, v[2]->u*v[2]->q, fx0, fy0, dx1, dy1, dx2, dy2, farea);
+		planes[6] = mesh_plane(v[0]->v*v[0]->q, v[1]->v*v[1]->q, v[2]->v*v[2]->q, fx0, fy0, dx1, dy1, dx2, dy2, farea);
+		planes[7] = mesh_plane(v[0]->q, v[1]->q, v[2]->q, fx0, fy0, dx1, dy1, dx2, dy2, farea);
+		modulate = (v[0]->color != 0xffffffff) || (v[1]->color != 0xffffffff) || (v[2]->color != 0xffffffff);
+	}
+
+	unpack_row_func_t unpack_row = get_unpack_row_func(db->pxfmt);
+	pack_row_func_t pack_row = get_pack_row_func(db->pxfmt);
+	int drawn = 0;
+	for (int qy=y_start; qy<y_end; qy+=2) {
+		int row_count = ((qy+1) < y_end) ? 2 : 1;
+		int64_t e[3] = { e_row[0], e_row[1], e_row[2] };
+		int first = -1, last = -1;
+		for (int qx=x_start; qx<x_end; qx+=2) {
+			// coverage mask of the 4 pixels of the quad. The quad is outside the triangle if
+			// an edge function is negative even at the pixel of the quad where it is largest.
+			int mask = 0;
+			if (((e[0]+e_in[0]) | (e[1]+e_in[1]) | (e[2]+e_in[2])) >= 0) {
+				for (int i=0; i<4; i++) {
+					int ox = i&1, oy = i>>1;
+					int64_t t0 = e[0] + ox*e_dx[0] + oy*e_dy[0];
+					int64_t t1 = e[1] + ox*e_dx[1] + oy*e_dy[1];
+					int64_t t2 = e[2] + ox*e_dx[2] + oy*e_dy[2];
+					mask |= ((t0|t1|t2) >= 0) << i;
+				}
+			}
+			if (qx+1 >= x_end) {
+				mask &= 0x5;
+			}
+			if (row_count == 1) {
+				mask &= 0x3;
+			}
+			e[0] += 2*e_dx[0];
+			e[1] += 2*e_dx[1];
+			e[2] += 2*e_dx[2];
+			if (!mask) {
+				continue;
+			}
+			if (first < 0) {
+				// the part of the rows left of the first covered quad is not touched
+				first = qx;
+				for (int r=0; r<row_count; r++) {
+					unpack_row(db_get_row_ptr(db, qy+r), qx, rows+r*db->w+qx, x_end-qx);
+				}
+			}
+			last = qx;
+
+			for (int i=0; i<4; i++) {
+				if (!(mask & (1<<i))) {
+					continue;
+				}
+				int x = qx+(i&1), y = qy+(i>>1);
+				uint32_t p = 0xffffffff;
+				if ((!tex) || modulate) {
+					p = pack_pixel_rgba(
+						mesh_channel(mesh_plane_at(&planes[0], x, y)),
+						mesh_channel(mesh_plane_at(&planes[1], x, y)),
+						mesh_channel(mesh_plane_at(&planes[2], x, y)),
+						mesh_channel(mesh_plane_at(&planes[3], x, y))
+					);
+				}
+				if (tex) {
+					float q = 1.0f / mesh_plane_at(&planes[7], x, y);
+					uint32_t tp = mesh_sample(tex, mesh_plane_at(&planes[5], x, y)*q, mesh_plane_at(&planes[6], x, y)*q);
+					p = modulate ? mesh_modulate(tp, p) : tp;
+				}
+				if ((alpha_mode == 1) && (!unpack_pixel_a(p))) {
+					continue;
+				}
+				if (depth && !mesh_depth_test(depth, x, y, mesh_plane_at(&planes[4], x, y))) {
+					continue;
+				}
+				uint32_t* t = &rows[(i>>1)*db->w + x];
+				*t = (alpha_mode == 2) ? alphablend(p, *t) : p;
+			}
+		}
+		for (int i=0; i<3; i++) {
+			e_row[i] += 2*e_dy[i];
+		}
+		if (first >= 0) {
+			int len = ((last+2) < x_end) ? (last+2-first) : (x_end-first);
+			for (int r=0; r<row_count; r++) {
+				pack_row(db_get_row_ptr(db, qy+r), first, rows+r*db->w+first, len);
+			}
+			drawn = 1;
+		}
+	}
+
+	if (drawn) {
+		bounds->x0 = (x_start < bounds->x0) ? x_start : bounds->x0;
+		bounds->y0 = (y_start < bounds->y0) ? y_start : bounds->y0;
+		bounds->x1 = (x_end > bounds->x1) ? x_end : bounds->x1;
+		bounds->y1 = (y_end > bounds->y1) ? y_end : bounds->y1;
+	}
+}
+
+// draw the triangles using vertices of vertex_size bytes, converted by the function get_vertex.
+static int mesh_draw(const drawbuffer_t* db, const drawbuffer_t* depth_db, const mesh_texture_t* tex, const void* vertices, int vertex_count, size_t vertex_size, void (*get_vertex)(const void*, ldb_textured_vertex_t*), const uint32_t* indices, int count, int alpha_mode, LDB_CULL cull, db_rect_t* bounds) {
+	mesh_depth_t depth_buf;
+	mesh_depth_t* depth = NULL;
+	if (depth_db) {
+		depth_buf.data = depth_db->data;
+		depth_buf.stride = depth_db->stride;
+		depth_buf.is_float = (get_bpp(depth_db->pxfmt) == 32);
+		depth = &depth_buf;
+	}
+
+	uint32_t* rows = malloc(2*(size_t)db->w*sizeof(uint32_t));
+	if (!rows) {
+		return 0;
+	}
+
+	const uint8_t* vertex_data = vertices;
+	for (int i=0; i<count; i++) {
+		uint32_t idx[3] = { i*3, i*3+1, i*3+2 };
+		if (indices) {
+			idx[0] = indices[i*3];
+			idx[1] = indices[i*3+1];
+			idx[2] = indices[i*3+2];
+		}
+		if ((vertex_count >= 0) && ((idx[0] >= (uint32_t)vertex_count) || (idx[1] >= (uint32_t)vertex_count) || (idx[2] >= (uint32_t)vertex_count))) {
+			continue;
+		}
+		ldb_textured_vertex_t v[3];
+		for (int j=0; j<3; j++) {
+			get_vertex(vertex_data + idx[j]*vertex_size, &v[j]);
+		}
+		mesh_triangle(db, depth, tex, rows, &v[0], &v[1], &v[2], alpha_mode, cull, bounds);
+	}
+
+	free(rows);
+	return 1;
+}
+
+static void get_mesh_vertex(const void* data, ldb_textured_vertex_t* v) {
+	const ldb_mesh_vertex_t* mv = data;
+	v->x = mv->x;
+	v->y = mv->y;
+	v->z = mv->z;
+	v->color = mv->color;
+	v->u = 0;
+	v->v = 0;
+	v->q = 1;
+}
+
+static void get_textured_vertex(const void* data, ldb_textured_vertex_t* v) {
+	memcpy(v, data, sizeof(ldb_textured_vertex_t));
+}
+
+// set bounds to an empty rectangle, that is extended by mesh_triangle
+static inline void mesh_bounds_init(const drawbuffer_t* db, db_rect_t* bounds) {
+	bounds->x0 = db->w;
+	bounds->y0 = db->h;
+	bounds->x1 = 0;
+	bounds->y1 = 0;
+}
+
+int ldb_draw_mesh(const drawbuffer_t* db, const drawbuffer_t* depth_db, const ldb_mesh_vertex_t* vertices, int vertex_count, const uint32_t* indices, int count, int alpha_mode, LDB_CULL cull, db_rect_t* bounds) {
+	mesh_bounds_init(db, bounds);
+	if ((count <= 0) || (!db->data)) {
+		return 1;
+	}
+	return mesh_draw(db, depth_db, NULL, vertices, vertex_count, sizeof(ldb_mesh_vertex_t), get_mesh_vertex, indices, count, alpha_mode, cull, bounds);
+}
+
+int ldb_draw_textured_mesh(const drawbuffer_t* db, const drawbuffer_t* depth_db, const drawbuffer_t* texture_db, const ldb_textured_vertex_t* vertices, int vertex_count, const uint32_t* indices, int count, int bilinear, int wrap, int alpha_mode, LDB_CULL cull, db_rect_t* bounds) {
+	mesh_bounds_init(db, bounds);
+	if ((count <= 0) || (!db->data) || (!texture_db->data) || (texture_db->w <= 0) || (texture_db->h <= 0)) {
+		return 1;
+	}
+
+	// unpack the texture once, premultiplied for bilinear filtering. Formats without alpha are opaque.
+	mesh_texture_t tex;
+	tex.w = texture_db->w;
+	tex.h = texture_db->h;
+	tex.bilinear = bilinear;
+	tex.wrap = wrap;
+	tex.px = malloc((size_t)tex.w*tex.h*sizeof(uint32_t));
+	if (!tex.px) {
+		return 0;
+	}
+	unpack_row_func_t unpack_texture = get_unpack_row_func(bilinear ? get_straight_pxfmt(texture_db->pxfmt) : texture_db->pxfmt);
+	for (int y=0; y<tex.h; y++) {
+		uint32_t* row = tex.px + (size_t)y*tex.w;
+		unpack_texture(db_get_row_ptr(texture_db, y), 0, row, tex.w);
+		if (!has_alpha(texture_db->pxfmt)) {
+			set_row_opaque(row, tex.w);
+		} else if (bilinear && !is_premultiplied(texture_db->pxfmt)) {
+			for (int x=0; x<tex.w; x++) {
+				row[x] = premultiply_pixel(row[x]);
+			}
+		}
+	}
+
+	int ok = mesh_draw(db, depth_db, &tex, vertices, vertex_count, sizeof(ldb_textured_vertex_t), get_textured_vertex, indices, count, alpha_mode, cull, bounds);
+	free(tex.px);
+	return ok;
+}
+
+void ldb_clear_depth(const drawbuffer_t* depth_db, float z) {
+	int is_float = (get_bpp(depth_db->pxfmt) == 32);
+	float zc = (z < 0) ? 0 : ((z > 1) ? 1 : z);
+	uint16_t zi = (uint16_t)(zc*65535.0f+0.5f);
+	for (int y=0; y<depth_db->h; y++) {
+		uint8_t* row = db_get_row_ptr(depth_db, y);
+		for (int x=0; x<depth_db->w; x++) {
+			if (is_float) {
+				((float*)row)[x] = z;
+			} else {
+				((uint16_t*)row)[x] = zi;
+			}
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef LUA_LDB_MESH_H
+#define LUA_LDB_MESH_H
+
+#include "ldb.h"
+
+// a screen-space vertex of a triangle mesh(16 bytes, native byte order)
+typedef struct {
+	float x, y; // position in pixels
+	float z; // depth, smaller values are closer
+	uint32_t color; // r<<24 | g<<16 | b<<8 | a
+} ldb_mesh_vertex_t;
+
+// a screen-space vertex of a textured triangle mesh(28 bytes, native byte order).
+// The first members are the same as ldb_mesh_vertex_t.
+typedef struct {
+	float x, y; // position in pixels
+	float z; // depth, smaller values are closer
+	uint32_t color; // r<<24 | g<<16 | b<<8 | a, multiplied with the texture color
+	float u, v; // texture coordinates in texels
+	float q; // 1/w of the vertex for perspective-correct texture coordinates(1 for affine interpolation)
+} ldb_textured_vertex_t;
+
+// which triangles to skip. Front-facing triangles have their vertices in clockwise order on screen(y pointing down).
+typedef enum {
+	LDB_CULL_NONE,
+	LDB_CULL_BACK,
+	LDB_CULL_FRONT,
+
+	LDB_CULL_MAX,
+} LDB_CULL;
+
+// vertex coordinates must be within +-LDB_MESH_MAX_COORD pixels, triangles outside are skipped
+#define LDB_MESH_MAX_COORD 16384
+
+// get a cull mode by name("none", "back", "front"). Returns LDB_CULL_MAX if unknown.
+LDB_CULL ldb_cull_from_str(const char* str);
+
+// draw count triangles with colors interpolated between the vertices.
+// If indices is NULL, the vertices are used in order(3 per triangle), otherwise
+// the 3 indices per triangle select the vertices. If vertex_count is >=0, triangles with out-of-range indices are skipped.
+// alpha_mode is 0 for copy, 1 for ignorealpha(transparent pixels are skipped), 2 for alphablend.
+// If depth_db is not NULL, it must have the same size as db, and is used as a depth buffer:
+// pixels are only drawn if their z value is smaller than the value in the depth buffer, which is updated.
+// 32bpp depth_db formats store a float per pixel, 16bpp formats an integer(z from 0 to 1 is mapped to 0-65535).
+// The bounding box of all drawn triangles is stored in bounds(can be empty).
+// Returns 0 if memory could not be allocated.
+int ldb_draw_mesh(const drawbuffer_t* db, const drawbuffer_t* depth_db, const ldb_mesh_vertex_t* vertices, int vertex_count, const uint32_t* indices, int count, int alpha_mode, LDB_CULL cull, db_rect_t* bounds);
+
+// draw count textured triangles, sampling the texture_db using nearest or bilinear filtering.
+// Texture coordinates outside the texture are clamped to the edge, or wrapped around if wrap is set.
+// The texture color is multiplied with the interpolated vertex color.
+// Triangles with a q value <=0 are skipped. See ldb_draw_mesh for the other arguments.
+int ldb_draw_textured_mesh(const drawbuffer_t* db, const drawbuffer_t* depth_db, const drawbuffer_t* texture_db, const ldb_textured_vertex_t* vertices, int vertex_count, const uint32_t* indices, int count, int bilinear, int wrap, int alpha_mode, LDB_CULL cull, db_rect_t* bounds);
+
+// fill the depth drawbuffer with the depth value z(for a 16bpp depth_db, z is clamped to 0-1)
+void ldb_clear_depth(const drawbuffer_t* depth_db, float z);
+
+
+#endif
@@ -0,0 +1,189 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "ldb_pool.h"
+
+// Pixel memory pool.
+// Allocations are rounded up to a size class(4 classes per power of two, so
+// at most 25% is wasted), and freed memory is kept in a per-class free list
+// for reuse, up to max_bytes_held bytes.
+// Large allocations are mmap()'ed, using huge pages if available.
+// The pool is shared by all Lua states in the process(e.g. effil threads),
+// so it's protected by a mutex.
+
+// number of size classes: 4 for sizes up to 256 bytes, then 4 per power of two up to 2^48
+#define POOL_CLASSES (4+(48-8)*4)
+
+// size of a huge page, mmap() lengths are rounded to this
+#define POOL_HUGE_PAGE_SIZE (2*1024*1024)
+
+// free memory blocks are linked using their first bytes
+typedef struct pool_block_t {
+	struct pool_block_t* next;
+} pool_block_t;
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pool_block_t* pool_free_lists[POOL_CLASSES];
+static ldb_pool_stats_t pool_stats = { .max_bytes_held = LDB_POOL_DEFAULT_MAX_HELD };
+
+
+
+// get the size class index for a length, and the rounded-up class size. Returns -1 if too large.
+static int pool_get_class(size_t len, size_t* class_size) {
+	if (len <= 256) {
+		size_t sub = (len <= LDB_POOL_ALIGN) ? 0 : (len-1)/LDB_POOL_ALIGN;
+		*class_size = (sub+1)*LDB_POOL_ALIGN;
+		return (int)sub;
+	}
+	// 2^e < len <= 2^(e+1), split in 4 steps of 2^(e-2)
+	int e = 63 - __builtin_clzll((unsigned long long)(len-1));
+	if (e >= 48) {
+		return -1;
+	}
+	size_t step = (size_t)1 << (e-2);
+	size_t steps = (len-1)/step + 1; // 5..8
+	*class_size = steps*step;
+	return 4 + (e-8)*4 + (int)(steps-5);
+}
+
+// get the size of a size class(inverse of pool_get_class)
+static size_t pool_class_size(int class_idx) {
+	if (class_idx < 4) {
+		return (size_t)(class_idx+1)*LDB_POOL_ALIGN;
+	}
+	int e = 8 + (class_idx-4)/4;
+	return (size_t)((class_idx-4)%4 + 5) << (e-2);
+}
+
+// length of the mapping for mmap()'ed allocations
+static inline size_t pool_map_len(size_t class_size) {
+	return (class_size + POOL_HUGE_PAGE_SIZE-1) & ~((size_t)POOL_HUGE_PAGE_SIZE-1);
+}
+
+// allocate new memory for a size class
+static void* pool_alloc_new(size_t class_size) {
+	if (class_size >= LDB_POOL_MMAP_THRESHOLD) {
+		size_t map_len = pool_map_len(class_size);
+		void* ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		// explicit huge pages(only works if huge pages are reserved)
+		ptr = mmap(NULL, map_len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+#endif
+		if (ptr == MAP_FAILED) {
+			ptr = mmap(NULL, map_len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+			if (ptr == MAP_FAILED) {
+				return NULL;
+			}
+#ifdef MADV_HUGEPAGE
+			// transparent huge pages
+			madvise(ptr, map_len, MADV_HUGEPAGE);
+#endif
+		}
+		return ptr;
+	}
+	void* ptr = NULL;
+	if (posix_memalign(&ptr, LDB_POOL_ALIGN, class_size)) {
+		return NULL;
+	}
+	return ptr;
+}
+
+// return memory of a size class to the system
+static void pool_release(void* ptr, size_t class_size) {
+	if (class_size >= LDB_POOL_MMAP_THRESHOLD) {
+		munmap(ptr, pool_map_len(class_size));
+	} else {
+		free(ptr);
+	}
+}
+
+// release memory from the free lists until bytes_held <= max_held. Call with mutex locked.
+static void pool_shrink(size_t max_held) {
+	// release the largest blocks first
+	for (int i=POOL_CLASSES-1; (i>=0) && (pool_stats.bytes_held > max_held); i--) {
+		while (pool_free_lists[i] && (pool_stats.bytes_held > max_held)) {
+			pool_block_t* block = pool_free_lists[i];
+			pool_free_lists[i] = block->next;
+			size_t class_size = pool_class_size(i);
+			pool_stats.bytes_held -= class_size;
+			pool_release(block, class_size);
+		}
+	}
+}
+
+
+
+void* ldb_pool_alloc(size_t len) {
+	size_t class_size;
+	int class_idx = pool_get_class(len, &class_size);
+	if (class_idx < 0) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&pool_mutex);
+	pool_block_t* block = pool_free_lists[class_idx];
+	if (block) {
+		pool_free_lists[class_idx] = block->next;
+		pool_stats.bytes_held -= class_size;
+		pool_stats.bytes_in_use += class_size;
+		pool_stats.hits++;
+		pthread_mutex_unlock(&pool_mutex);
+		return block;
+	}
+	pool_stats.misses++;
+	pthread_mutex_unlock(&pool_mutex);
+
+	void* ptr = pool_alloc_new(class_size);
+	if (ptr) {
+		pthread_mutex_lock(&pool_mutex);
+		pool_stats.bytes_in_use += class_size;
+		pthread_mutex_unlock(&pool_mutex);
+	}
+	return ptr;
+}
+
+void ldb_pool_free(void* ptr, size_t len) {
+	size_t class_size;
+	if (!ptr) {
+		return;
+	}
+	int class_idx = pool_get_class(len, &class_size);
+
+	pthread_mutex_lock(&pool_mutex);
+	pool_stats.bytes_in_use -= class_size;
+	if (pool_stats.bytes_held + class_size <= pool_stats.max_bytes_held) {
+		pool_block_t* block = (pool_block_t*)ptr;
+		block->next = pool_free_lists[class_idx];
+		pool_free_lists[class_idx] = block;
+		pool_stats.bytes_held += class_size;
+		ptr = NULL;
+	}
+	pthread_mutex_unlock(&pool_mutex);
+
+	if (ptr) {
+		pool_release(ptr, class_size);
+	}
+}
+
+void ldb_pool_trim(void) {
+	pthread_mutex_lock(&pool_mutex);
+	pool_shrink(0);
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+void ldb_pool_set_max_held(size_t max_held) {
+	pthread_mutex_lock(&pool_mutex);
+	pool_stats.max_bytes_held = max_held;
+	pool_shrink(max_held);
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+void ldb_pool_get_stats(ldb_pool_stats_t* stats) {
+	pthread_mutex_lock(&pool_mutex);
+	*stats = pool_stats;
+	pthread_mutex_unlock(&pool_mutex);
+}
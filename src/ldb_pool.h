@@ -0,0 +1,41 @@
+#ifndef LUA_LDB_POOL_H
+#define LUA_LDB_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// alignment of all pool allocations(cache line, and enough for AVX2 loads)
+#define LDB_POOL_ALIGN 64
+
+// allocations of at least this size are mmap()'ed and use huge pages if possible
+#define LDB_POOL_MMAP_THRESHOLD (2*1024*1024)
+
+// default maximum number of bytes kept in the pool for reuse
+#define LDB_POOL_DEFAULT_MAX_HELD (64*1024*1024)
+
+// statistics about the pool usage
+typedef struct {
+	uint64_t hits; // allocations served from the pool
+	uint64_t misses; // allocations that needed new memory
+	size_t bytes_held; // bytes of free memory kept in the pool for reuse
+	size_t bytes_in_use; // bytes currently allocated from the pool
+	size_t max_bytes_held; // limit for bytes_held
+} ldb_pool_stats_t;
+
+// allocate len bytes of LDB_POOL_ALIGN-aligned memory. Returns NULL on failure.
+void* ldb_pool_alloc(size_t len);
+
+// return memory allocated with ldb_pool_alloc to the pool. len must be the len used for allocation.
+void ldb_pool_free(void* ptr, size_t len);
+
+// release all memory held by the pool
+void ldb_pool_trim(void);
+
+// set the maximum number of bytes kept in the pool(0 disables reuse). Releases memory if needed.
+void ldb_pool_set_max_held(size_t max_held);
+
+// get a copy of the pool statistics
+void ldb_pool_get_stats(ldb_pool_stats_t* stats);
+
+
+#endif
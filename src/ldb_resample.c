@@ -0,0 +1,319 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "lua.h"
+
+#include "ldb.h"
+#include "ldb_convert.h"
+#include "ldb_threads.h"
+#include "ldb_resample.h"
+
+// Separable resampling.
+// The filter weights are computed once per output column and row, as 16 bit
+// fixed-point values(see LDB_FILTER_BITS) that sum up to exactly 1. When
+// downscaling, the filter is widened by the scale factor, so every source
+// pixel contributes.
+// The output rows are split into bands. For each band, the needed source rows
+// are filtered horizontally into a temporary buffer, then each output row is
+// filtered vertically from it. Bands are independent, and can run in parallel.
+
+// maximum number of output rows in a band
+#define RESAMPLE_BAND_H 64
+
+// maximum number of source rows filtered horizontally for a band(limits the temporary buffer size)
+#define RESAMPLE_BAND_SRC_H 256
+
+static const char* filter_names[LDB_FILTER_MAX] = { "bilinear", "bicubic", "lanczos", "area" };
+
+// precomputed weights for the output pixels of one axis
+typedef struct {
+	int* offsets; // first source pixel for each output pixel
+	int16_t* weights; // taps weights for each output pixel
+	int taps; // always even(for the SIMD kernels), unused taps have weight 0
+} filter_axis_t;
+
+typedef struct {
+	const drawbuffer_t* src_db;
+	const drawbuffer_t* dst_db;
+	filter_axis_t h;
+	filter_axis_t v;
+	int x, y, w, h_rows; // visible region of the target
+	int src_x, src_w; // range of source pixels needed for a row
+	int band_h;
+	uint32_t recip[256]; // ceil(2^24/a) for unpremultiply_row
+	int failed;
+} resample_job_t;
+
+
+
+static double sinc(double x) {
+	if (x == 0) {
+		return 1;
+	}
+	x *= M_PI;
+	return sin(x) / x;
+}
+
+// filter function and radius
+static double filter_kernel(LDB_FILTER filter, double x) {
+	x = fabs(x);
+	switch (filter) {
+		case LDB_FILTER_BILINEAR:
+			return (x < 1) ? 1-x : 0;
+		case LDB_FILTER_BICUBIC:
+			// Keys cubic with a=-0.5(Catmull-Rom)
+			if (x < 1) {
+				return (1.5*x - 2.5)*x*x + 1;
+			} else if (x < 2) {
+				return ((-0.5*x + 2.5)*x - 4)*x + 2;
+			}
+			return 0;
+		case LDB_FILTER_LANCZOS:
+			return (x < 3) ? sinc(x)*sinc(x/3) : 0;
+		default:
+			return 0;
+	}
+}
+static double filter_radius(LDB_FILTER filter) {
+	switch (filter) {
+		case LDB_FILTER_BICUBIC: return 2;
+		case LDB_FILTER_LANCZOS: return 3;
+		default: return 1;
+	}
+}
+
+static void filter_axis_free(filter_axis_t* axis) {
+	free(axis->offsets);
+	free(axis->weights);
+	axis->offsets = NULL;
+	axis->weights = NULL;
+}
+
+// compute the weights for count output pixels, starting at output pixel first, when scaling
+// the source range s0..s0+slen to out_len pixels. Returns 0 on allocation failure.
+static int filter_axis_init(filter_axis_t* axis, LDB_FILTER filter, double s0, double slen, int src_len, int out_len, int first, int count) {
+	double scale = slen / out_len;
+	double fs = (scale > 1) ? scale : 1;
+	// the area filter uses the coverage of the output pixel, the others are widened when downscaling
+	double support = (filter == LDB_FILTER_AREA) ? scale/2 : filter_radius(filter)*fs;
+	int max_taps = (int)ceil(support*2) + 2;
+
+	double* w = malloc(max_taps*sizeof(double));
+	int16_t* q = malloc((size_t)count*max_taps*sizeof(int16_t));
+	axis->offsets = malloc(count*sizeof(int));
+	if ((!w) || (!q) || (!axis->offsets)) {
+		free(w);
+		free(q);
+		filter_axis_free(axis);
+		return 0;
+	}
+
+	int taps = 1;
+	for (int i=0; i<count; i++) {
+		double c = s0 + (first+i+0.5)*scale;
+		int j0 = (int)floor(c - support);
+		int j1 = (int)ceil(c + support);
+		int lo = (j0 < 0) ? 0 : ((j0 > src_len-1) ? src_len-1 : j0);
+		int hi = (j1-1 < 0) ? 0 : ((j1-1 > src_len-1) ? src_len-1 : j1-1);
+		int n = hi-lo+1;
+		double sum = 0;
+		memset(w, 0, max_taps*sizeof(double));
+		for (int j=j0; j<j1; j++) {
+			double v;
+			if (filter == LDB_FILTER_AREA) {
+				double a = (c-support > j) ? c-support : j;
+				double b = (c+support < j+1) ? c+support : j+1;
+				v = (b > a) ? b-a : 0;
+			} else {
+				v = filter_kernel(filter, (j+0.5-c)/fs);
+			}
+			// pixels outside the source are clamped to the edge
+			int k = ((j < lo) ? lo : ((j > hi) ? hi : j)) - lo;
+			w[k] += v;
+			sum += v;
+		}
+
+		// normalize and quantize, the rounding error is added to the largest weight
+		int16_t* qi = q + (size_t)i*max_taps;
+		if (sum == 0) {
+			// output pixel between two source pixels with a point filter
+			w[0] = 1;
+			sum = 1;
+		}
+		int total = 0, max_k = 0;
+		for (int k=0; k<n; k++) {
+			qi[k] = (int16_t)lrint(w[k] / sum * (1<<LDB_FILTER_BITS));
+			total += qi[k];
+			max_k = (qi[k] > qi[max_k]) ? k : max_k;
+		}
+		qi[max_k] += (1<<LDB_FILTER_BITS) - total;
+
+		// skip zero weights at the start and end
+		int a = 0, b = n-1;
+		while ((a < b) && (qi[a] == 0)) { a++; }
+		while ((b > a) && (qi[b] == 0)) { b--; }
+		memmove(qi, qi+a, (b-a+1)*sizeof(int16_t));
+		memset(qi+(b-a+1), 0, (max_taps-(b-a+1))*sizeof(int16_t));
+		axis->offsets[i] = lo+a;
+		taps = (b-a+1 > taps) ? b-a+1 : taps;
+	}
+	taps = (taps+1) & ~1;
+	free(w);
+
+	// copy to the final taps per pixel
+	axis->taps = taps;
+	axis->weights = malloc((size_t)count*taps*sizeof(int16_t));
+	if (!axis->weights) {
+		free(q);
+		filter_axis_free(axis);
+		return 0;
+	}
+	for (int i=0; i<count; i++) {
+		for (int k=0; k<taps; k++) {
+			axis->weights[(size_t)i*taps+k] = (k < max_taps) ? q[(size_t)i*max_taps+k] : 0;
+		}
+	}
+	free(q);
+	return 1;
+}
+
+// filter the output rows of a band
+static void resample_band(void* arg, int index) {
+	resample_job_t* job = (resample_job_t*)arg;
+	const drawbuffer_t* src_db = job->src_db;
+	const drawbuffer_t* dst_db = job->dst_db;
+	int r0 = index*job->band_h;
+	int r1 = (r0+job->band_h < job->h_rows) ? r0+job->band_h : job->h_rows;
+
+	// source rows needed for this band
+	int sy0 = job->v.offsets[r0], sy1 = 0;
+	for (int r=r0; r<r1; r++) {
+		sy0 = (job->v.offsets[r] < sy0) ? job->v.offsets[r] : sy0;
+		sy1 = (job->v.offsets[r]+job->v.taps > sy1) ? job->v.offsets[r]+job->v.taps : sy1;
+	}
+	sy1 = (sy1 > src_db->h) ? src_db->h : sy1;
+
+	int w = job->w;
+	uint32_t* tmp = malloc(((size_t)(sy1-sy0)*w + job->src_w + w)*sizeof(uint32_t));
+	const uint32_t** rows = malloc(job->v.taps*sizeof(uint32_t*));
+	if ((!tmp) || (!rows)) {
+		free(tmp);
+		free(rows);
+		__atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	uint32_t* src_row = tmp + (size_t)(sy1-sy0)*w;
+	uint32_t* out_row = src_row + job->src_w;
+
+	// premultiplied formats are filtered as they are, others are premultiplied first.
+	// Formats without alpha are opaque.
+	int src_premul = is_premultiplied(src_db->pxfmt);
+	int src_alpha = has_alpha(src_db->pxfmt);
+	int dst_premul = is_premultiplied(dst_db->pxfmt);
+	unpack_row_func_t unpack_src = get_unpack_row_func(get_straight_pxfmt(src_db->pxfmt));
+	pack_row_func_t pack_dst = get_pack_row_func(get_straight_pxfmt(dst_db->pxfmt));
+
+	// horizontal pass, pixels past the right edge of the source have weight 0
+	int src_n = (job->src_x + job->src_w > src_db->w) ? src_db->w - job->src_x : job->src_w;
+	memset(src_row+src_n, 0, (job->src_w-src_n)*sizeof(uint32_t));
+	for (int y=sy0; y<sy1; y++) {
+		unpack_src(db_get_row_ptr(src_db, y), job->src_x, src_row, src_n);
+		if (!src_alpha) {
+			set_row_opaque(src_row, src_n);
+		} else if ((!src_premul) && (!row_is_opaque(src_row, src_n))) {
+			for (int i=0; i<src_n; i++) {
+				src_row[i] = premultiply_pixel(src_row[i]);
+			}
+		}
+		ldb_filter_row_h(tmp + (size_t)(y-sy0)*w, src_row, job->h.offsets, job->h.weights, job->h.taps, w);
+	}
+
+	// vertical pass, rows past the bottom edge have weight 0
+	for (int r=r0; r<r1; r++) {
+		for (int k=0; k<job->v.taps; k++) {
+			int y = job->v.offsets[r]+k;
+			y = (y > sy1-1) ? sy1-1 : y;
+			rows[k] = tmp + (size_t)(y-sy0)*w;
+		}
+		ldb_filter_row_v(out_row, rows, job->v.weights + (size_t)r*job->v.taps, job->v.taps, w);
+		if (dst_premul) {
+			// filters with negative weights can produce color values larger than alpha
+			for (int i=0; i<w; i++) {
+				uint32_t p = out_row[i], a = p & 0xff;
+				uint32_t cr = p>>24, cg = (p>>16) & 0xff, cb = (p>>8) & 0xff;
+				out_row[i] = (((cr>a)?a:cr)<<24) | (((cg>a)?a:cg)<<16) | (((cb>a)?a:cb)<<8) | a;
+			}
+		} else if (!row_is_opaque(out_row, w)) {
+			unpremultiply_row(out_row, w, job->recip);
+		}
+		pack_dst(db_get_row_ptr(dst_db, job->y+r), job->x, out_row, w);
+	}
+
+	free(rows);
+	free(tmp);
+}
+
+
+
+LDB_FILTER ldb_filter_from_str(const char* str) {
+	for (int i=0; i<LDB_FILTER_MAX; i++) {
+		if (strcmp(str, filter_names[i])==0) {
+			return (LDB_FILTER)i;
+		}
+	}
+	return LDB_FILTER_MAX;
+}
+
+int ldb_resample(const drawbuffer_t* src_db, double sx, double sy, double sw, double sh, const drawbuffer_t* dst_db, int dx, int dy, int dw, int dh, LDB_FILTER filter, int num_threads) {
+	if ((!src_db->data) || (!dst_db->data) || (src_db->w <= 0) || (src_db->h <= 0) || (sw <= 0) || (sh <= 0) || (dw <= 0) || (dh <= 0)) {
+		return 1;
+	}
+
+	// clip the target region
+	resample_job_t job = { .src_db = src_db, .dst_db = dst_db };
+	job.x = (dx < 0) ? 0 : dx;
+	job.y = (dy < 0) ? 0 : dy;
+	int x1 = ((int64_t)dx+dw > dst_db->w) ? dst_db->w : dx+dw;
+	int y1 = ((int64_t)dy+dh > dst_db->h) ? dst_db->h : dy+dh;
+	job.w = x1-job.x;
+	job.h_rows = y1-job.y;
+	if ((job.w <= 0) || (job.h_rows <= 0)) {
+		return 1;
+	}
+
+	if (!filter_axis_init(&job.h, filter, sx, sw, src_db->w, dw, job.x-dx, job.w)) {
+		return 0;
+	}
+	if (!filter_axis_init(&job.v, filter, sy, sh, src_db->h, dh, job.y-dy, job.h_rows)) {
+		filter_axis_free(&job.h);
+		return 0;
+	}
+
+	// source columns needed for a row, the horizontal offsets are made relative to it
+	job.src_x = job.h.offsets[0];
+	int src_x1 = 0;
+	for (int i=0; i<job.w; i++) {
+		job.src_x = (job.h.offsets[i] < job.src_x) ? job.h.offsets[i] : job.src_x;
+		src_x1 = (job.h.offsets[i]+job.h.taps > src_x1) ? job.h.offsets[i]+job.h.taps : src_x1;
+	}
+	job.src_w = src_x1-job.src_x;
+	for (int i=0; i<job.w; i++) {
+		job.h.offsets[i] -= job.src_x;
+	}
+
+	for (int a=1; a<256; a++) {
+		job.recip[a] = ((1<<24) + a-1) / a;
+	}
+
+	double scale_y = sh / dh;
+	job.band_h = (scale_y > 1) ? (int)(RESAMPLE_BAND_SRC_H / scale_y) : RESAMPLE_BAND_H;
+	job.band_h = (job.band_h < 1) ? 1 : ((job.band_h > RESAMPLE_BAND_H) ? RESAMPLE_BAND_H : job.band_h);
+	int bands = (job.h_rows + job.band_h-1) / job.band_h;
+	ldb_threads_run(num_threads, bands, resample_band, &job);
+
+	filter_axis_free(&job.h);
+	filter_axis_free(&job.v);
+	return !job.failed;
+}
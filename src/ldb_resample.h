@@ -0,0 +1,26 @@
+#ifndef LUA_LDB_RESAMPLE_H
+#define LUA_LDB_RESAMPLE_H
+
+#include "ldb.h"
+
+// resampling filters
+typedef enum {
+	LDB_FILTER_BILINEAR,
+	LDB_FILTER_BICUBIC,
+	LDB_FILTER_LANCZOS,
+	LDB_FILTER_AREA,
+
+	LDB_FILTER_MAX,
+} LDB_FILTER;
+
+// get a filter by name("bilinear", "bicubic", "lanczos", "area"). Returns LDB_FILTER_MAX if unknown.
+LDB_FILTER ldb_filter_from_str(const char* str);
+
+// scale the region sx,sy,sw,sh(in pixels, can be fractional) of src_db to the region dx,dy,dw,dh of dst_db,
+// using up to num_threads threads. Filtering is done on premultiplied values, so transparent pixels
+// don't bleed their color. Pixels outside the src_db are clamped to the edge, the dst region is clipped.
+// Returns 0 if memory could not be allocated.
+int ldb_resample(const drawbuffer_t* src_db, double sx, double sy, double sw, double sh, const drawbuffer_t* dst_db, int dx, int dy, int dw, int dh, LDB_FILTER filter, int num_threads);
+
+
+#endif
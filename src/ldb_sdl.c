@@ -2,6 +2,7 @@
 #include "lauxlib.h"
 
 #include "ldb.h"
+#include "ldb_convert.h"
 #include "ldb_sdl.h"
 
 #include <SDL2/SDL.h>
@@ -24,6 +25,40 @@ static inline void sdl2fb_set_px(sdl2fb_t* sdl2fb, int x, int y, uint32_t sdl_p)
 }
 
 
+// get the drawbuffer pixel format with the same memory layout as the SDL pixel format, or LDB_PXFMT_MAX if there is none
+static PIX_FMT sdl_format_to_pxfmt(uint32_t sdl_fmt) {
+	switch (sdl_fmt) {
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+		case SDL_PIXELFORMAT_ARGB8888:
+		case SDL_PIXELFORMAT_RGB888:
+			return LDB_PXFMT_32BPP_BGRA;
+		case SDL_PIXELFORMAT_ABGR8888:
+		case SDL_PIXELFORMAT_BGR888:
+			return LDB_PXFMT_32BPP_RGBA;
+		case SDL_PIXELFORMAT_RGBA8888:
+			return LDB_PXFMT_32BPP_ABGR;
+		case SDL_PIXELFORMAT_BGRA8888:
+			return LDB_PXFMT_32BPP_ARGB;
+#else
+		case SDL_PIXELFORMAT_ARGB8888:
+			return LDB_PXFMT_32BPP_ARGB;
+		case SDL_PIXELFORMAT_ABGR8888:
+			return LDB_PXFMT_32BPP_ABGR;
+		case SDL_PIXELFORMAT_RGBA8888:
+			return LDB_PXFMT_32BPP_RGBA;
+		case SDL_PIXELFORMAT_BGRA8888:
+			return LDB_PXFMT_32BPP_BGRA;
+#endif
+		case SDL_PIXELFORMAT_RGB24:
+			return LDB_PXFMT_24BPP_RGB;
+		case SDL_PIXELFORMAT_BGR24:
+			return LDB_PXFMT_24BPP_BGR;
+		default:
+			return LDB_PXFMT_MAX;
+	}
+}
+
+
 static int lua_sdl2fb_tostring(lua_State *L) {
     sdl2fb_t *sdl2fb = (sdl2fb_t*)luaL_checkudata(L, 1, LDB_SDL_UDATA_NAME);
 	if (sdl2fb==NULL) {
@@ -203,29 +238,68 @@ static int lua_sdl2fb_draw_from_drawbuffer(lua_State *L) {
     int x = lua_tointeger(L, 3);
     int y = lua_tointeger(L, 4);
     int cx,cy;
-    uint32_t sp, sdl_p;
+    uint32_t tmp[LDB_ROW_CHUNK];
+
+	// visible region of the drawbuffer on the screen
+	int x_min = (x<0) ? -x : 0;
+	int y_min = (y<0) ? -y : 0;
+	int x_max = (x+db->w > sdl2fb->w) ? sdl2fb->w-x : db->w;
+	int y_max = (y+db->h > sdl2fb->h) ? sdl2fb->h-y : db->h;
+	PIX_FMT screen_fmt = sdl_format_to_pxfmt(screen->format->format);
+
+	// only copy the changed regions if damage tracking is enabled
+	db_rect_t rects[LDB_DAMAGE_MAX_RECTS];
+	SDL_Rect update_rects[LDB_DAMAGE_MAX_RECTS];
+	int update_count = 0;
+	int rect_count = db_get_damage_rects(db, rects);
 
 	SDL_LockSurface(screen);
 
-	if ( (x==0) && (y==0) && (db->pxfmt == LDB_PXFMT_32BPP_ABGR) && (screen->w == db->w) && (screen->h == db->h) ) {
-		SDL_ConvertPixels(screen->w, screen->h, SDL_PIXELFORMAT_RGBA8888, db->data, db->w*4, screen->format->format, screen->pixels, screen->pitch);
+	if ( (x==0) && (y==0) && (db->pxfmt == LDB_PXFMT_32BPP_ABGR) && (screen->w == db->w) && (screen->h == db->h) && (!db->damage.enabled) ) {
+		SDL_ConvertPixels(screen->w, screen->h, SDL_PIXELFORMAT_RGBA8888, db->data, db->stride, screen->format->format, screen->pixels, screen->pitch);
 	} else {
-		for (cy=0; cy < db->h; cy++) {
-	        for (cx=0; cx < db->w; cx++) {
-	            if (x+cx < 0 || y+cy < 0 || x+cx >= sdl2fb->w || y+cy >= sdl2fb->h) {
-	                continue;
-	            } else {
-					sp = get_px(db->data, db->w, cx,cy, db->pxfmt);
-					sdl_p = SDL_MapRGBA(screen->format, (sp&0xFF000000)>>24, (sp&0x00FF0000)>>16, (sp&0x0000FF00)>>8, sp&0xff);
-					sdl2fb_set_px(sdl2fb, cx+x,cy+y, sdl_p);
-	            }
-	        }
-	    }
+		unpack_row_func_t unpack_row = get_unpack_row_func(db->pxfmt);
+		for (int i=0; i<rect_count; i++) {
+			// clip the rectangle to the visible region
+			int rx_min = (rects[i].x0 > x_min) ? rects[i].x0 : x_min;
+			int ry_min = (rects[i].y0 > y_min) ? rects[i].y0 : y_min;
+			int rx_max = (rects[i].x1 < x_max) ? rects[i].x1 : x_max;
+			int ry_max = (rects[i].y1 < y_max) ? rects[i].y1 : y_max;
+			if ((rx_min >= rx_max) || (ry_min >= ry_max)) {
+				continue;
+			}
+			update_rects[update_count++] = (SDL_Rect){ x+rx_min, y+ry_min, rx_max-rx_min, ry_max-ry_min };
+
+			if (screen_fmt != LDB_PXFMT_MAX) {
+				// the screen memory layout matches a drawbuffer pixel format, convert a row at a time
+				for (cy=ry_min; cy < ry_max; cy++) {
+					ldb_convert_row(db_get_row_ptr(db, cy), rx_min, db->pxfmt, (uint8_t*)screen->pixels + (y+cy)*screen->pitch, x+rx_min, screen_fmt, rx_max-rx_min);
+				}
+			} else {
+				for (cy=ry_min; cy < ry_max; cy++) {
+					for (cx=rx_min; cx < rx_max; cx+=LDB_ROW_CHUNK) {
+						int len = ((rx_max-cx) < LDB_ROW_CHUNK) ? (rx_max-cx) : LDB_ROW_CHUNK;
+						unpack_row(db_get_row_ptr(db, cy), cx, tmp, len);
+						for (int j=0; j<len; j++) {
+							uint32_t sp = tmp[j];
+							sdl2fb_set_px(sdl2fb, cx+j+x,cy+y, SDL_MapRGBA(screen->format, (sp&0xFF000000)>>24, (sp&0x00FF0000)>>16, (sp&0x0000FF00)>>8, sp&0xff));
+						}
+					}
+				}
+			}
+		}
 	}
 
 	SDL_UnlockSurface(screen);
 
-    SDL_UpdateWindowSurface(window);
+	if (db->damage.enabled) {
+		if (update_count > 0) {
+			SDL_UpdateWindowSurfaceRects(window, update_rects, update_count);
+		}
+		db_reset_damage(db);
+	} else {
+		SDL_UpdateWindowSurface(window);
+	}
 
     return 0;
 
@@ -256,11 +330,18 @@ static int lua_sdl2fb_get_drawbuffer(lua_State *L) {
 	db->w = sdl2fb->w;
 	db->h = sdl2fb->h;
 
-	// TODO: Check pixel format and pitch from SDL surface for compabillity, maybe suppoprt all pixel formats supported by ldb.
-	db->pxfmt = LDB_PXFMT_32BPP_BGRA;
+	// TODO: Support SDL surface formats that have no matching drawbuffer pixel format
+	db->pxfmt = sdl_format_to_pxfmt(sdl2fb->screen->format->format);
+	if (db->pxfmt == LDB_PXFMT_MAX) {
+		db->pxfmt = LDB_PXFMT_32BPP_BGRA;
+	}
 	db->data = sdl2fb->screen->pixels;
 	db->close_func = &sdl2db_close_func;
 	db->close_data = sdl2fb;
+	db->stride = sdl2fb->screen->pitch;
+	db->parent = NULL;
+	db->damage.enabled = 0;
+	db->damage.count = 0;
 
 	// apply the drawbuffer metatable to it
 	lua_set_ldb_meta(L, -2);
@@ -269,11 +350,31 @@ static int lua_sdl2fb_get_drawbuffer(lua_State *L) {
 	return 1;
 }
 
+// update the window from the window surface drawbuffer.
+// If the drawbuffer is passed and tracks damage, only the changed regions are updated, and the damage is reset.
 static int lua_sdl2fb_update_drawbuffer(lua_State *L) {
 	sdl2fb_t *sdl2fb;
 	CHECK_SDL2FB(L, 1, sdl2fb)
 
 	SDL_Window *window = sdl2fb->window;
+
+	if (!lua_isnoneornil(L, 2)) {
+		drawbuffer_t *db;
+		LUA_LDB_CHECK_DB(L, 2, db)
+		if (db->damage.enabled) {
+			SDL_Rect update_rects[LDB_DAMAGE_MAX_RECTS];
+			for (int i=0; i<db->damage.count; i++) {
+				db_rect_t r = db->damage.rects[i];
+				update_rects[i] = (SDL_Rect){ r.x0, r.y0, r.x1-r.x0, r.y1-r.y0 };
+			}
+			if (db->damage.count > 0) {
+				SDL_UpdateWindowSurfaceRects(window, update_rects, db->damage.count);
+			}
+			db_reset_damage(db);
+			return 0;
+		}
+	}
+
 	SDL_UpdateWindowSurface(window);
 
 	return 0;
@@ -366,6 +467,8 @@ static int lua_sdl_new_sdl2fb(lua_State *L) {
 
 
 LUALIB_API int luaopen_ldb_sdl(lua_State *L) {
+    ldb_convert_init();
+
     lua_newtable(L);
 
     LUA_T_PUSH_S_S("version", LDB_VERSION)
@@ -0,0 +1,120 @@
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "ldb_threads.h"
+
+// Worker thread pool.
+// The worker threads are started when first needed, and then wait for jobs.
+// A job is a number of tasks, and all threads of a job(including the calling
+// thread) take the next task index from a shared counter until all tasks are
+// taken. Only one job runs at a time.
+
+// protects the job variables below
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+// signaled when a new job is started, and when all workers finished the job
+static pthread_cond_t pool_start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done_cond = PTHREAD_COND_INITIALIZER;
+// only one job at a time(e.g. from multiple Lua states in different threads)
+static pthread_mutex_t pool_job_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t pool_threads[LDB_THREADS_MAX];
+static int pool_thread_count;
+
+// the current job
+static unsigned int job_generation;
+static ldb_task_func_t job_func;
+static void* job_arg;
+static int job_count;
+static int job_next;
+static int job_workers; // worker threads that take part in the job(the first job_workers workers)
+static int job_running; // worker threads still working on the job
+
+
+
+// run tasks of the current job until all are taken
+static void pool_run_tasks(void) {
+	int i;
+	while ((i = __atomic_fetch_add(&job_next, 1, __ATOMIC_RELAXED)) < job_count) {
+		job_func(job_arg, i);
+	}
+}
+
+static void* pool_worker(void* data) {
+	int worker_index = (int)(intptr_t)data;
+	unsigned int last_generation = 0;
+
+	pthread_mutex_lock(&pool_mutex);
+	while (1) {
+		while (job_generation == last_generation) {
+			pthread_cond_wait(&pool_start_cond, &pool_mutex);
+		}
+		last_generation = job_generation;
+		if (worker_index >= job_workers) {
+			// not needed for this job
+			continue;
+		}
+
+		pthread_mutex_unlock(&pool_mutex);
+		pool_run_tasks();
+		pthread_mutex_lock(&pool_mutex);
+
+		job_running--;
+		if (job_running == 0) {
+			pthread_cond_signal(&pool_done_cond);
+		}
+	}
+	return NULL;
+}
+
+
+
+int ldb_threads_get_cpu_count(void) {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (int)count : 1;
+}
+
+void ldb_threads_run(int num_threads, int count, ldb_task_func_t func, void* arg) {
+	int workers = num_threads-1;
+	workers = (workers > LDB_THREADS_MAX-1) ? LDB_THREADS_MAX-1 : workers;
+	workers = (workers > count-1) ? count-1 : workers;
+	if (workers <= 0) {
+		for (int i=0; i<count; i++) {
+			func(arg, i);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&pool_job_mutex);
+	pthread_mutex_lock(&pool_mutex);
+
+	// start more worker threads if needed
+	while (pool_thread_count < workers) {
+		if (pthread_create(&pool_threads[pool_thread_count], NULL, pool_worker, (void*)(intptr_t)pool_thread_count)) {
+			break;
+		}
+		pthread_detach(pool_threads[pool_thread_count]);
+		pool_thread_count++;
+	}
+	workers = (workers > pool_thread_count) ? pool_thread_count : workers;
+
+	job_func = func;
+	job_arg = arg;
+	job_count = count;
+	job_next = 0;
+	job_workers = workers;
+	job_running = workers;
+	job_generation++;
+	pthread_cond_broadcast(&pool_start_cond);
+	pthread_mutex_unlock(&pool_mutex);
+
+	// the calling thread works on the job too
+	pool_run_tasks();
+
+	pthread_mutex_lock(&pool_mutex);
+	while (job_running > 0) {
+		pthread_cond_wait(&pool_done_cond, &pool_mutex);
+	}
+	pthread_mutex_unlock(&pool_mutex);
+	pthread_mutex_unlock(&pool_job_mutex);
+}
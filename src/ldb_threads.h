@@ -0,0 +1,20 @@
+#ifndef LUA_LDB_THREADS_H
+#define LUA_LDB_THREADS_H
+
+// maximum number of threads used to run tasks(including the calling thread)
+#define LDB_THREADS_MAX 64
+
+// function called for each task index
+typedef void (*ldb_task_func_t)(void* arg, int index);
+
+// get the number of online CPUs
+int ldb_threads_get_cpu_count(void);
+
+// run func(arg, i) for each i=0..count-1, using up to num_threads threads(the calling thread and a
+// fixed pool of worker threads, started on first use). The tasks are started in ascending order, so a task
+// can wait for the progress of a task with a lower index, but the order in which they finish is not defined.
+// Blocks until all tasks are done.
+void ldb_threads_run(int num_threads, int count, ldb_task_func_t func, void* arg);
+
+
+#endif
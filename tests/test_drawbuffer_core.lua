@@ -6,6 +6,9 @@ local lu = require("luaunit")
 local w,h = 100,100
 local px_fmt = "rgba8888"
 
+-- all supported pixel formats
+local all_px_fmts = { "bit", "byte", "rgb332", "rgb565", "bgr565", "rgb888", "bgr888", "rgba8888", "argb8888", "abgr8888", "bgra8888", "rgba8888_premul", "bgra8888_premul" }
+
 function test_drawbuffer_basic()
 	-- test the basics: loading the C module, create a drawbuffer, query info about it, close it
 	local ldb_core = require("ldb_core")
@@ -53,6 +56,304 @@ function test_drawbuffer_clear()
 	lu.assertEquals(drawbuffer:dump_data(), ("\211\227\233\241"):rep(w*h))
 end
 
+function test_drawbuffer_clear_formats()
+	-- clear should set the same pixel value as set_px, in every pixel format
+	local ldb_core = require("ldb_core")
+	-- distinct values, and equal values(memset fast path for some formats)
+	local colors = { {211,227,233,241}, {100,100,100,100} }
+	for _,fmt in ipairs(all_px_fmts) do
+		for _,color in ipairs(colors) do
+			local drawbuffer = ldb_core.new_drawbuffer(w,h,fmt)
+			local reference = ldb_core.new_drawbuffer(1,1,fmt)
+			lu.assertEvalToTrue(reference:set_px(0,0, unpack(color)))
+			local r,g,b,a = reference:get_px(0,0)
+
+			lu.assertEvalToTrue(drawbuffer:clear(unpack(color)))
+			for y=0, h-1 do
+				for x=0, w-1 do
+					lu.assertEquals({drawbuffer:get_px(x,y)}, {r,g,b,a})
+				end
+			end
+		end
+	end
+end
+
+function test_drawbuffer_convert_into()
+	-- converting should have the same result as copying every pixel using get_px/set_px, for every pair of pixel formats
+	local ldb_core = require("ldb_core")
+	local cw,ch = 37,5 -- not a multiple of the SIMD width
+	for _,src_fmt in ipairs(all_px_fmts) do
+		local src = ldb_core.new_drawbuffer(cw,ch,src_fmt)
+		for y=0, ch-1 do
+			for x=0, cw-1 do
+				src:set_px(x,y, (x*7)%256, (y*31)%256, (x*y)%256, (x+y*3)%256)
+			end
+		end
+		for _,dst_fmt in ipairs(all_px_fmts) do
+			local dst = ldb_core.new_drawbuffer(cw,ch,dst_fmt)
+			local reference = ldb_core.new_drawbuffer(cw,ch,dst_fmt)
+			-- new drawbuffers are not initialized, and the padding bits of 1bpp rows are never written
+			local zero = string.rep("\0", #dst:dump_data())
+			dst:load_data(zero)
+			reference:load_data(zero)
+			for y=0, ch-1 do
+				for x=0, cw-1 do
+					reference:set_px(x,y, src:get_px(x,y))
+				end
+			end
+
+			lu.assertEvalToTrue(src:convert_into(dst))
+			lu.assertEquals(dst:dump_data(), reference:dump_data())
+
+			dst:clear(0,0,0,0)
+			lu.assertEvalToTrue(ldb_core.convert(src, dst))
+			lu.assertEquals(dst:dump_data(), reference:dump_data())
+		end
+	end
+
+	-- dimensions must match
+	lu.assertEvalToFalse(ldb_core.new_drawbuffer(2,2):convert_into(ldb_core.new_drawbuffer(2,3)))
+end
+
+function test_drawbuffer_premultiplied()
+	-- premultiplied pixel formats store the r,g,b values multiplied by alpha, but get_px/set_px use non-premultiplied values
+	local ldb_core = require("ldb_core")
+	local drawbuffer = ldb_core.new_drawbuffer(2,1,"rgba8888_premul")
+	lu.assertEquals(drawbuffer:tostring(), "32bpp premultiplied RGBA Drawbuffer: 2x1")
+	drawbuffer:set_px(0,0, 255,128,0,128)
+	drawbuffer:set_px(1,0, 10,20,30,255)
+	lu.assertEquals(drawbuffer:dump_data(), string.char(128,64,0,128, 10,20,30,255))
+	lu.assertEquals({drawbuffer:get_px(0,0)}, {255,128,0,128})
+	lu.assertEquals({drawbuffer:get_px(1,0)}, {10,20,30,255})
+
+	drawbuffer = ldb_core.new_drawbuffer(1,1,"bgra8888_premul")
+	drawbuffer:set_px(0,0, 255,128,0,128)
+	lu.assertEquals(drawbuffer:dump_data(), string.char(0,64,128,128))
+
+	-- a pixel with alpha=0 has no color
+	drawbuffer:set_px(0,0, 255,255,255,0)
+	lu.assertEquals({drawbuffer:get_px(0,0)}, {0,0,0,0})
+end
+
+function test_drawbuffer_stride()
+	-- the stride is the length of a row in bytes. 1bpp rows are padded to a full byte.
+	local ldb_core = require("ldb_core")
+	lu.assertEquals(ldb_core.new_drawbuffer(10,3,"rgba8888"):stride(), 40)
+	lu.assertEquals(ldb_core.new_drawbuffer(10,3,"rgb888"):stride(), 30)
+	lu.assertEquals(ldb_core.new_drawbuffer(10,3,"bit"):stride(), 2)
+	lu.assertEquals(ldb_core.new_drawbuffer(10,3,"bit"):bytes_len(), 6)
+
+	-- pixels in different rows of a 1bpp drawbuffer must not overlap
+	local drawbuffer = ldb_core.new_drawbuffer(10,3,"bit")
+	drawbuffer:clear(0,0,0,0)
+	drawbuffer:set_px(9,0, 255,255,255,255)
+	lu.assertEquals({drawbuffer:get_px(9,0)}, {255,255,255,255})
+	lu.assertEquals({drawbuffer:get_px(0,1)}, {0,0,0,0})
+	lu.assertEquals({drawbuffer:get_px(1,1)}, {0,0,0,0})
+end
+
+function test_drawbuffer_view()
+	-- a view shares the memory of a region of the parent drawbuffer
+	local ldb_core = require("ldb_core")
+	for _,fmt in ipairs(all_px_fmts) do
+		local parent = ldb_core.new_drawbuffer(w,h,fmt)
+		parent:clear(0,0,0,0)
+
+		local view = parent:view(16,7, 20,10)
+		lu.assertEvalToTrue(view)
+		lu.assertEquals(view:width(), 20)
+		lu.assertEquals(view:height(), 10)
+		lu.assertEquals(view:pixel_format(), fmt)
+		lu.assertEquals(view:stride(), parent:stride())
+
+		-- drawing in the view modifies the parent, and only inside the view region
+		lu.assertEvalToTrue(view:clear(255,255,255,255))
+		local r,g,b,a = parent:get_px(16,7)
+		lu.assertEquals({view:get_px(0,0)}, {r,g,b,a})
+		lu.assertEquals({parent:get_px(35,16)}, {r,g,b,a})
+		lu.assertNotEquals({parent:get_px(15,7)}, {r,g,b,a})
+		lu.assertNotEquals({parent:get_px(36,16)}, {r,g,b,a})
+		lu.assertNotEquals({parent:get_px(16,17)}, {r,g,b,a})
+
+		-- dump_data only returns the pixels of the view region
+		lu.assertEquals(#view:dump_data(), view:bytes_len())
+		local copy = ldb_core.new_drawbuffer(20,10,fmt)
+		lu.assertEvalToTrue(copy:load_data(view:dump_data()))
+		lu.assertEquals(copy:dump_data(), view:dump_data())
+
+		-- closing the view does not close the parent, closing the parent invalidates all views
+		local view2 = view:view(8,1)
+		lu.assertEquals(view2:width(), 12)
+		lu.assertEvalToTrue(view:close())
+		lu.assertEvalToTrue(parent:width())
+		lu.assertEvalToTrue(view2:width())
+		lu.assertEvalToTrue(parent:close())
+		lu.assertEvalToFalse(view2:width())
+		lu.assertEvalToFalse(view2:get_px(0,0))
+	end
+
+	-- the last byte of a 1bpp view row also contains pixels of the parent, that are not changed or returned
+	local parent = ldb_core.new_drawbuffer(16,2,"bit")
+	parent:clear(255,255,255,255)
+	local view = parent:view(0,0, 5,2)
+	lu.assertEquals(view:dump_data(), string.char(0x1f, 0x1f))
+	lu.assertEvalToTrue(view:load_data(string.char(0, 0xff)))
+	lu.assertEquals(parent:get_px(4,0), 0)
+	lu.assertEquals(parent:get_px(5,0), 255)
+	lu.assertEquals(parent:get_px(4,1), 255)
+	lu.assertEquals(parent:get_px(8,0), 255)
+	lu.assertEquals(view:dump_data(), string.char(0, 0x1f))
+
+	-- the view region must be inside the drawbuffer
+	local parent = ldb_core.new_drawbuffer(w,h,px_fmt)
+	lu.assertEvalToFalse(parent:view(-1,0, 10,10))
+	lu.assertEvalToFalse(parent:view(w-9,0, 10,10))
+	lu.assertEvalToFalse(parent:view(0,h, 1,1))
+
+	-- 1bpp views must start at a byte boundary
+	lu.assertEvalToFalse(ldb_core.new_drawbuffer(w,h,"bit"):view(3,0, 8,8))
+end
+
+function test_drawbuffer_view_keeps_parent()
+	-- the parent drawbuffer must not be collected while a view exists
+	local ldb_core = require("ldb_core")
+	local view = ldb_core.new_drawbuffer(w,h,px_fmt):view(0,0, 10,10)
+	collectgarbage()
+	collectgarbage()
+	lu.assertEvalToTrue(view:clear(1,2,3,4))
+	lu.assertEquals({view:get_px(9,9)}, {1,2,3,4})
+end
+
+function test_drawbuffer_pointer()
+	-- a drawbuffer created from the pointer of another drawbuffer shares the memory
+	local ldb_core = require("ldb_core")
+	local drawbuffer = ldb_core.new_drawbuffer(w,h,px_fmt)
+	drawbuffer:clear(0,0,0,0)
+
+	local ptr, len, stride = drawbuffer:get_pointer()
+	lu.assertEquals(type(ptr), "userdata")
+	lu.assertEquals(len, drawbuffer:bytes_len())
+	lu.assertEquals(stride, drawbuffer:stride())
+
+	local shared = ldb_core.new_drawbuffer_from_pointer(ptr, w,h, px_fmt, stride, drawbuffer)
+	lu.assertEvalToTrue(shared)
+	lu.assertEquals(shared:stride(), stride)
+	lu.assertEvalToTrue(shared:set_px(3,4, 1,2,3,4))
+	lu.assertEquals({drawbuffer:get_px(3,4)}, {1,2,3,4})
+
+	-- use a larger stride to address a region of the drawbuffer
+	local half = ldb_core.new_drawbuffer_from_pointer(ptr, w/2,h/2, px_fmt, stride, drawbuffer)
+	lu.assertEquals({half:get_px(3,4)}, {1,2,3,4})
+
+	-- closing does not free the memory, closing the drawbuffer that owns the memory invalidates the shared drawbuffers
+	lu.assertEvalToTrue(shared:close())
+	lu.assertEquals({drawbuffer:get_px(3,4)}, {1,2,3,4})
+	lu.assertEvalToTrue(drawbuffer:close())
+	lu.assertEvalToFalse(half:width())
+
+	-- invalid arguments
+	local other = ldb_core.new_drawbuffer(w,h,px_fmt)
+	ptr = other:get_pointer()
+	lu.assertEvalToFalse(ldb_core.new_drawbuffer_from_pointer(nil, w,h, px_fmt))
+	lu.assertEvalToFalse(ldb_core.new_drawbuffer_from_pointer(ptr, w,h, "invalid"))
+	lu.assertEvalToFalse(ldb_core.new_drawbuffer_from_pointer(ptr, w,h, px_fmt, w*4-1))
+end
+
+function test_drawbuffer_pool()
+	-- closed drawbuffer memory is reused for new drawbuffers of a similar size
+	local ldb_core = require("ldb_core")
+	-- other drawbuffers being collected would change the pool statistics
+	collectgarbage()
+	collectgarbage("stop")
+	ldb_core.pool_trim()
+	lu.assertEquals(ldb_core.pool_stats().bytes_held, 0)
+
+	local drawbuffer = ldb_core.new_drawbuffer(w,h,px_fmt)
+	lu.assertEvalToTrue(drawbuffer:close())
+	local stats = ldb_core.pool_stats()
+	lu.assertTrue(stats.bytes_held >= w*h*4)
+
+	local hits = stats.hits
+	drawbuffer = ldb_core.new_drawbuffer(w,h-1,px_fmt)
+	lu.assertEquals(ldb_core.pool_stats().hits, hits+1)
+	lu.assertEquals(ldb_core.pool_stats().bytes_held, 0)
+	lu.assertEvalToTrue(drawbuffer:clear(1,2,3,4))
+
+	-- with max_bytes_held=0 memory is not kept
+	local max_held = stats.max_bytes_held
+	lu.assertEvalToTrue(ldb_core.pool_set_max_held(0))
+	drawbuffer:close()
+	lu.assertEquals(ldb_core.pool_stats().bytes_held, 0)
+	lu.assertEvalToTrue(ldb_core.pool_set_max_held(max_held))
+	collectgarbage("restart")
+end
+
+function test_drawbuffer_memory_stats()
+	-- pixel memory is tracked per pixel format
+	local ldb_core = require("ldb_core")
+	collectgarbage()
+	local before = ldb_core.memory_stats()
+	lu.assertEquals(type(before.formats[px_fmt]), "table")
+
+	local drawbuffer = ldb_core.new_drawbuffer(w,h,px_fmt)
+	local view = drawbuffer:view(0,0,w/2,h/2)
+	local stats = ldb_core.memory_stats()
+	lu.assertEquals(stats.bytes, before.bytes+w*h*4)
+	lu.assertEquals(stats.formats[px_fmt].bytes, before.formats[px_fmt].bytes+w*h*4)
+	lu.assertTrue(stats.peak_bytes >= stats.bytes)
+	lu.assertTrue(stats.formats[px_fmt].peak_bytes >= stats.formats[px_fmt].bytes)
+
+	view:close()
+	drawbuffer:close()
+	lu.assertEquals(ldb_core.memory_stats().formats[px_fmt].bytes, before.formats[px_fmt].bytes)
+end
+
+function test_drawbuffer_damage()
+	-- changed regions are recorded if damage tracking is enabled
+	local ldb_core = require("ldb_core")
+	local drawbuffer = ldb_core.new_drawbuffer(w,h,px_fmt)
+	lu.assertEvalToFalse(drawbuffer:get_damage())
+
+	-- enabling marks the entire drawbuffer as changed
+	lu.assertEvalToTrue(drawbuffer:track_damage(true))
+	lu.assertEquals(drawbuffer:get_damage(), {{x=0,y=0,w=w,h=h}})
+	lu.assertEvalToTrue(drawbuffer:reset_damage())
+	lu.assertEquals(drawbuffer:get_damage(), {})
+
+	-- adjacent pixels are merged
+	drawbuffer:set_px(10,20, 255,255,255,255)
+	drawbuffer:set_px(11,20, 255,255,255,255)
+	drawbuffer:set_px(50,60, 255,255,255,255)
+	lu.assertEquals(drawbuffer:get_damage(), {{x=10,y=20,w=2,h=1},{x=50,y=60,w=1,h=1}})
+
+	-- the number of rectangles is limited, but they always cover the changes
+	drawbuffer:reset_damage()
+	for i=0, 19 do
+		drawbuffer:set_px(i*5,i*5, 255,255,255,255)
+	end
+	local damage = drawbuffer:get_damage()
+	lu.assertTrue(#damage <= 8)
+	for i=0, 19 do
+		local covered = false
+		for _,rect in ipairs(damage) do
+			covered = covered or ((i*5>=rect.x) and (i*5<rect.x+rect.w) and (i*5>=rect.y) and (i*5<rect.y+rect.h))
+		end
+		lu.assertTrue(covered)
+	end
+
+	-- changes to a view are recorded in the parent, clipped to the drawbuffer
+	drawbuffer:reset_damage()
+	local view = drawbuffer:view(30,40, 10,10)
+	view:set_px(1,2, 255,255,255,255)
+	lu.assertEquals(drawbuffer:get_damage(), {{x=31,y=42,w=1,h=1}})
+	drawbuffer:reset_damage()
+	lu.assertEvalToTrue(drawbuffer:add_damage(-10,-10,20,20))
+	lu.assertEquals(drawbuffer:get_damage(), {{x=0,y=0,w=10,h=10}})
+
+	lu.assertEvalToTrue(drawbuffer:track_damage(false))
+	lu.assertEvalToFalse(drawbuffer:get_damage())
+end
+
 function test_drawbuffer_load_data()
 	local ldb_core = require("ldb_core")
 	local drawbuffer = ldb_core.new_drawbuffer(w,h,px_fmt)
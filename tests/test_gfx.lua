@@ -6,6 +6,26 @@ local lu = require("luaunit")
 local width,height = 100,100
 local px_fmt = "rgba8888"
 
+-- draw a w*h pattern using draw(origin, target, num_threads) with 1 and 4 threads into two cleared
+-- target drawbuffers, and check that the results are the same. Returns the origin and the first target.
+local function assert_threads_equal(w,h, target_w,target_h, target_fmt, draw)
+	local ldb_core = require("ldb_core")
+	local origin = ldb_core.new_drawbuffer(w,h,px_fmt)
+	for y=0, h-1 do
+		for x=0, w-1 do
+			origin:set_px(x,y, (x*37)%256, (y*91)%256, (x*y)%256, 255)
+		end
+	end
+	local target_a = ldb_core.new_drawbuffer(target_w,target_h,target_fmt)
+	local target_b = ldb_core.new_drawbuffer(target_w,target_h,target_fmt)
+	target_a:clear(0,0,0,0)
+	target_b:clear(0,0,0,0)
+	draw(origin, target_a, 1)
+	draw(origin, target_b, 4)
+	lu.assertEquals(target_a:dump_data(), target_b:dump_data())
+	return origin, target_a
+end
+
 -- ignore test_* global functions used by luacheck
 --luacheck: ignore test[%w_]+
 
@@ -47,6 +67,573 @@ function test_gfx_set_px_alphablend()
 end
 
 
+function test_gfx_alphablend_rounding()
+	-- alphablending uses exact integer math, rounded to the nearest value
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local drawbuffer = ldb_core.new_drawbuffer(width,height,px_fmt)
+
+	for _,alpha in ipairs({ 1, 64, 127, 128, 200, 254 }) do
+		drawbuffer:clear(10,100,250,33)
+		ldb_gfx.set_px_alphablend(drawbuffer, 0,0, 255,0,128, alpha)
+		local r,g,b,a = drawbuffer:get_px(0,0)
+		local function mix(s, d)
+			return math.floor((s*alpha + d*(255-alpha))/255 + 0.5)
+		end
+		lu.assertEquals({r,g,b,a}, {mix(255,10), mix(0,100), mix(128,250), 33})
+
+		-- filled rectangles blend the same as single pixels
+		ldb_gfx.rectangle(drawbuffer, 0,0, width,height, 255,0,128,alpha, false, true)
+		local r2,g2,b2 = drawbuffer:get_px(width-1,height-1)
+		lu.assertEquals({r2,g2,b2}, {mix(255,10), mix(0,100), mix(128,250)})
+	end
+end
+
+function test_gfx_alphablend_premultiplied()
+	-- alphablending from a premultiplied drawbuffer gives the same result as from a non-premultiplied drawbuffer
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local origin = ldb_core.new_drawbuffer(2,1,"rgba8888")
+	origin:set_px(0,0, 200,100,50,128)
+	origin:set_px(1,0, 20,40,60,0)
+	local origin_premul = ldb_core.new_drawbuffer(2,1,"rgba8888_premul")
+	lu.assertEvalToTrue(origin:convert_into(origin_premul))
+
+	for _,target_fmt in ipairs({ "rgba8888", "bgr888", "bgra8888" }) do
+		for _,bg in ipairs({ 0, 255 }) do
+			local target_a = ldb_core.new_drawbuffer(2,1,target_fmt)
+			local target_b = ldb_core.new_drawbuffer(2,1,target_fmt)
+			target_a:clear(bg,bg,bg,255)
+			target_b:clear(bg,bg,bg,255)
+			ldb_gfx.origin_to_target(origin, target_a, 0,0, 0,0, 2,1, 1,1, "alphablend")
+			ldb_gfx.origin_to_target(origin_premul, target_b, 0,0, 0,0, 2,1, 1,1, "alphablend")
+			lu.assertEquals(target_b:dump_data(), target_a:dump_data())
+			local r,g,b = target_b:get_px(1,0)
+			lu.assertEquals({r,g,b}, {bg,bg,bg})
+		end
+	end
+
+	-- premultiplied targets also blend the alpha value
+	local target = ldb_core.new_drawbuffer(1,1,"rgba8888_premul")
+	target:clear(0,0,0,0)
+	ldb_gfx.origin_to_target(origin_premul, target, 0,0, 0,0, 1,1, 1,1, "alphablend")
+	lu.assertEquals(target:dump_data(), string.char(100,50,25,128))
+end
+
+function test_gfx_composite()
+	-- compositing computes the color and alpha value of the result
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local origin = ldb_core.new_drawbuffer(2,1,px_fmt)
+	origin:set_px(0,0, 255,0,0,255)
+	origin:set_px(1,0, 0,0,255,0)
+	local target = ldb_core.new_drawbuffer(2,1,px_fmt)
+
+	local function composite(mode, r,g,b,a)
+		target:clear(r,g,b,a)
+		lu.assertEvalToTrue(ldb_gfx.composite(origin, target, mode))
+		return { target:get_px(0,0) }, { target:get_px(1,0) }
+	end
+
+	local p0, p1 = composite("src_over", 0,255,0,128)
+	lu.assertEquals(p0, {255,0,0,255})
+	lu.assertEquals(p1, {0,255,0,128})
+	p0, p1 = composite("dst_over", 0,255,0,255)
+	lu.assertEquals(p0, {0,255,0,255})
+	p0, p1 = composite("src_in", 0,255,0,0)
+	lu.assertEquals(p0, {0,0,0,0})
+	p0, p1 = composite("src_out", 0,255,0,0)
+	lu.assertEquals(p0, {255,0,0,255})
+	lu.assertEquals(p1, {0,0,0,0})
+	p0 = composite("xor", 0,255,0,255)
+	lu.assertEquals(p0, {0,0,0,0})
+	p0 = composite("multiply", 128,255,255,255)
+	lu.assertEquals(p0, {128,0,0,255})
+	p0 = composite("screen", 0,128,0,255)
+	lu.assertEquals(p0, {255,128,0,255})
+	p0 = composite("add", 10,20,30,255)
+	lu.assertEquals(p0, {255,20,30,255})
+	p0 = composite("subtract", 10,20,30,255)
+	lu.assertEquals(p0, {0,20,30,255})
+	p0 = composite("darken", 10,20,30,255)
+	lu.assertEquals(p0, {10,0,0,255})
+	p0 = composite("lighten", 10,20,30,255)
+	lu.assertEquals(p0, {255,20,30,255})
+
+	-- src_over on an opaque target is the same as alphablending
+	origin:set_px(0,0, 200,100,50,77)
+	local target_b = ldb_core.new_drawbuffer(2,1,px_fmt)
+	target:clear(10,20,30,255)
+	target_b:clear(10,20,30,255)
+	ldb_gfx.composite(origin, target, "src_over")
+	ldb_gfx.origin_to_target(origin, target_b, 0,0, 0,0, 2,1, 1,1, "alphablend")
+	lu.assertEquals(target:dump_data(), target_b:dump_data())
+
+	lu.assertEvalToFalse(ldb_gfx.composite(origin, target, "unknown"))
+end
+
+function test_gfx_resample()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local origin = ldb_core.new_drawbuffer(30,20,px_fmt)
+	local target = ldb_core.new_drawbuffer(70,45,px_fmt)
+
+	-- a constant color stays the same when scaling up and down, with every filter
+	origin:clear(10,200,30,255)
+	for _,filter in ipairs({"bilinear", "bicubic", "lanczos", "area"}) do
+		lu.assertEvalToTrue(ldb_gfx.resample(origin, target, nil,nil,nil,nil, nil,nil,nil,nil, filter))
+		lu.assertEquals({target:get_px(0,0)}, {10,200,30,255})
+		lu.assertEquals({target:get_px(69,44)}, {10,200,30,255})
+		lu.assertEvalToTrue(ldb_gfx.resample(origin, target, 0,0,30,20, 5,5,7,3, filter))
+		lu.assertEquals({target:get_px(11,7)}, {10,200,30,255})
+	end
+
+	-- area downscaling averages the pixels, without the color of transparent pixels
+	local small = ldb_core.new_drawbuffer(1,1,px_fmt)
+	origin:clear(0,0,0,255)
+	origin:set_px(0,0, 255,255,255,255)
+	origin:set_px(1,1, 255,255,255,255)
+	ldb_gfx.resample(origin, small, 0,0,2,2, 0,0,1,1, "area")
+	lu.assertEquals({small:get_px(0,0)}, {128,128,128,255})
+	origin:set_px(1,0, 0,255,0,0)
+	origin:set_px(0,1, 0,255,0,0)
+	ldb_gfx.resample(origin, small, 0,0,2,2, 0,0,1,1, "area")
+	lu.assertEquals({small:get_px(0,0)}, {255,255,255,128})
+
+	-- formats without alpha are opaque
+	local origin_rgb = ldb_core.new_drawbuffer(30,20,"rgb888")
+	local target_rgb = ldb_core.new_drawbuffer(70,45,"rgb888")
+	origin_rgb:clear(10,200,30,255)
+	ldb_gfx.resample(origin_rgb, target_rgb, nil,nil,nil,nil, nil,nil,nil,nil, "bicubic")
+	lu.assertEquals({target_rgb:get_px(35,20)}, {origin_rgb:get_px(0,0)})
+	ldb_gfx.resample(origin_rgb, target, nil,nil,nil,nil, nil,nil,nil,nil, "bicubic")
+	lu.assertEquals({target:get_px(35,20)}, {10,200,30,255})
+
+	-- the result does not depend on the number of threads
+	assert_threads_equal(30,20, 70,45, px_fmt, function(o, t, threads)
+		ldb_gfx.resample(o, t, 1.5,2.25,25,15, -3,-2,80,50, "lanczos", threads)
+	end)
+
+	lu.assertEvalToFalse(ldb_gfx.resample(origin, target, nil,nil,nil,nil, nil,nil,nil,nil, "unknown"))
+end
+
+function test_gfx_blur()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local origin = ldb_core.new_drawbuffer(40,30,px_fmt)
+	local target = ldb_core.new_drawbuffer(40,30,px_fmt)
+
+	-- a constant color stays the same with every kind
+	origin:clear(10,200,30,255)
+	for _,kind in ipairs({"box", "fast_gaussian", "gaussian"}) do
+		lu.assertEvalToTrue(ldb_gfx.blur(origin, target, 5, kind))
+		lu.assertEquals({target:get_px(0,0)}, {10,200,30,255})
+		lu.assertEquals({target:get_px(39,29)}, {10,200,30,255})
+	end
+
+	-- a box blur averages the (2*radius+1)^2 pixels around a pixel
+	origin:clear(0,0,0,255)
+	origin:set_px(10,10, 255,255,255,255)
+	ldb_gfx.blur(origin, target, 1, "box")
+	lu.assertEquals({target:get_px(11,9)}, {28,28,28,255})
+	lu.assertEquals({target:get_px(12,10)}, {0,0,0,255})
+
+	-- blurring in-place only changes the region
+	origin:clear(0,0,0,255)
+	origin:set_px(10,10, 255,255,255,255)
+	ldb_gfx.blur(origin, origin, 2, "gaussian", 8,8,10,10)
+	lu.assertEquals({origin:get_px(7,10)}, {0,0,0,255})
+	lu.assertNotEquals({origin:get_px(8,10)}, {0,0,0,255})
+
+	-- the color of transparent pixels does not bleed
+	origin:clear(0,255,0,0)
+	origin:set_px(20,20, 255,0,0,255)
+	ldb_gfx.blur(origin, target, 1, "box")
+	local r,g,b,a = target:get_px(21,21)
+	lu.assertEquals({r,g,b}, {255,0,0})
+	lu.assertTrue(a > 0 and a < 255)
+
+	-- the result does not depend on the number of threads
+	for _,kind in ipairs({"box", "fast_gaussian", "gaussian"}) do
+		assert_threads_equal(40,30, 40,30, px_fmt, function(o, t, threads)
+			ldb_gfx.blur(o, t, 3.5, kind, 3,2,30,25, threads)
+		end)
+	end
+
+	lu.assertEvalToFalse(ldb_gfx.blur(origin, target, 1, "unknown"))
+	lu.assertEvalToFalse(ldb_gfx.blur(origin, target, -1))
+end
+
+function test_gfx_convolve()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local origin = ldb_core.new_drawbuffer(40,30,px_fmt)
+	local target = ldb_core.new_drawbuffer(40,30,px_fmt)
+
+	-- sharpening(integer kernel) and smoothing(float kernel) keep a constant color
+	origin:clear(10,200,30,255)
+	lu.assertEvalToTrue(ldb_gfx.convolve(origin, target, { 0,-1,0, -1,5,-1, 0,-1,0 }))
+	lu.assertEquals({target:get_px(20,15)}, {10,200,30,255})
+	lu.assertEvalToTrue(ldb_gfx.convolve(origin, target, { 0.25,0.5,0.25 }, 3))
+	lu.assertEquals({target:get_px(39,29)}, {10,200,30,255})
+
+	-- sobel edge detection with a bias, only the r,g,b channels are convolved
+	origin:clear(0,0,0,200)
+	for y=0, 29 do
+		for x=20, 39 do
+			origin:set_px(x,y, 40,40,40,200)
+		end
+	end
+	ldb_gfx.convolve(origin, target, { -1,0,1, -2,0,2, -1,0,1 }, 3, 8, 128)
+	lu.assertEquals({target:get_px(10,10)}, {128,128,128,200})
+	lu.assertEquals({target:get_px(19,10)}, {148,148,148,200})
+	lu.assertEquals({target:get_px(20,10)}, {148,148,148,200})
+
+	-- edge modes
+	origin:clear(0,0,0,255)
+	origin:set_px(39,29, 255,255,255,255)
+	local box = { 1,1,1, 1,1,1, 1,1,1 }
+	ldb_gfx.convolve(origin, target, box, 3, 9, 0, "clamp")
+	lu.assertEquals({target:get_px(0,0)}, {0,0,0,255})
+	ldb_gfx.convolve(origin, target, box, 3, 9, 0, "wrap")
+	lu.assertEquals({target:get_px(0,0)}, {28,28,28,255})
+	origin:clear(90,90,90,255)
+	ldb_gfx.convolve(origin, target, box, 3, 9, 0, "zero")
+	lu.assertEquals({target:get_px(0,0)}, {40,40,40,255})
+	lu.assertEquals({target:get_px(1,1)}, {90,90,90,255})
+
+	-- convolving in-place only changes the region
+	origin:clear(0,0,0,255)
+	origin:set_px(10,10, 255,255,255,255)
+	ldb_gfx.convolve(origin, origin, box, 3, 9, 0, "clamp", 8,8,10,10)
+	lu.assertEquals({origin:get_px(11,11)}, {28,28,28,255})
+	lu.assertEquals({origin:get_px(7,10)}, {0,0,0,255})
+
+	-- premultiplied pixels are converted if only the origin or the target is premultiplied
+	local identity = { 0,0,0, 0,1,0, 0,0,0 }
+	local origin_premul = ldb_core.new_drawbuffer(40,30,"rgba8888_premul")
+	local target_premul = ldb_core.new_drawbuffer(40,30,"rgba8888_premul")
+	origin_premul:clear(200,100,50,128)
+	ldb_gfx.convolve(origin_premul, target, identity)
+	lu.assertEquals({target:get_px(5,5)}, {origin_premul:get_px(5,5)})
+	origin:clear(200,100,50,128)
+	ldb_gfx.convolve(origin, target_premul, identity)
+	lu.assertEquals({target_premul:get_px(5,5)}, {origin_premul:get_px(5,5)})
+
+	-- the result does not depend on the number of threads
+	local gauss = { 1,4,6,4,1, 4,16,24,16,4, 6,24,36,24,6, 4,16,24,16,4, 1,4,6,4,1 }
+	assert_threads_equal(40,30, 40,30, px_fmt, function(o, t, threads)
+		ldb_gfx.convolve(o, t, gauss, 5, nil, 0, "wrap", 3,2,30,25, threads)
+	end)
+
+	lu.assertEvalToFalse(ldb_gfx.convolve(origin, target, { 1,1,1,1 }))
+	lu.assertEvalToFalse(ldb_gfx.convolve(origin, target, box, 3, 0))
+	lu.assertEvalToFalse(ldb_gfx.convolve(origin, target, box, 3, 9, 0, "unknown"))
+end
+
+function test_gfx_morphology()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local origin = ldb_core.new_drawbuffer(20,20,"byte")
+	local target = ldb_core.new_drawbuffer(20,20,"byte")
+
+	-- dilating a single pixel results in the structuring element
+	origin:clear(0,0,0,0)
+	origin:set_px(10,10, 200,200,200,200)
+	lu.assertEvalToTrue(ldb_gfx.morphology(origin, target, "dilate", 3))
+	lu.assertEquals({target:get_px(9,11)}, {200,200,200,200})
+	lu.assertEquals({target:get_px(12,10)}, {0,0,0,0})
+	ldb_gfx.morphology(origin, target, "dilate", 3, 3, "cross")
+	lu.assertEquals({target:get_px(10,11)}, {200,200,200,200})
+	lu.assertEquals({target:get_px(9,11)}, {0,0,0,0})
+	ldb_gfx.morphology(origin, target, "dilate", 5, 3, "ellipse")
+	lu.assertEquals({target:get_px(12,10)}, {200,200,200,200})
+	lu.assertEquals({target:get_px(12,11)}, {0,0,0,0})
+
+	-- eroding removes it again
+	ldb_gfx.morphology(origin, target, "dilate", 3)
+	ldb_gfx.morphology(target, target, "erode", 3)
+	lu.assertEquals(target:dump_data(), origin:dump_data())
+
+	-- 1bpp drawbuffers, with a 1bpp and a rgba target
+	local origin_bit = ldb_core.new_drawbuffer(20,20,"bit")
+	local target_bit = ldb_core.new_drawbuffer(20,20,"bit")
+	origin_bit:clear(255,255,255,255)
+	origin_bit:set_px(0,0, 0,0,0,0)
+	ldb_gfx.morphology(origin_bit, target_bit, "erode", 3)
+	lu.assertEquals(target_bit:get_px(1,1), 0)
+	lu.assertTrue(target_bit:get_px(2,2) > 0)
+	ldb_gfx.morphology(origin_bit, target_bit, "erode", 3, 3, "rect", "zero")
+	lu.assertEquals(target_bit:get_px(19,10), 0)
+	local target_rgba = ldb_core.new_drawbuffer(20,20,px_fmt)
+	ldb_gfx.morphology(origin_bit, target_rgba, "erode", 3)
+	lu.assertEquals({target_rgba:get_px(1,1)}, {0,0,0,0})
+	lu.assertEquals({target_rgba:get_px(2,2)}, {255,255,255,255})
+
+	-- the gray value is premultiplied for premultiplied targets
+	local target_premul = ldb_core.new_drawbuffer(20,20,"rgba8888_premul")
+	local reference = ldb_core.new_drawbuffer(1,1,"rgba8888_premul")
+	reference:set_px(0,0, 200,200,200,200)
+	ldb_gfx.morphology(origin, target_premul, "dilate", 3)
+	lu.assertEquals({target_premul:get_px(9,11)}, {reference:get_px(0,0)})
+
+	lu.assertEvalToFalse(ldb_gfx.morphology(target_rgba, target, "erode"))
+	lu.assertEvalToFalse(ldb_gfx.morphology(origin, target, "open"))
+	lu.assertEvalToFalse(ldb_gfx.morphology(origin, target, "erode", 4))
+	lu.assertEvalToFalse(ldb_gfx.morphology(origin, target, "erode", 3, 3, "circle"))
+end
+
+function test_gfx_transform_blit()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local origin = ldb_core.new_drawbuffer(3,2,px_fmt)
+	for y=0, 1 do
+		for x=0, 2 do
+			origin:set_px(x,y, x*80,y*80,0,255)
+		end
+	end
+	local target = ldb_core.new_drawbuffer(width,height,px_fmt)
+	local target_b = ldb_core.new_drawbuffer(width,height,px_fmt)
+
+	-- a translation is the same as origin_to_target, for every alpha mode
+	for _,alpha_mode in ipairs({"copy", "ignorealpha", "alphablend"}) do
+		target:clear(10,20,30,40)
+		target_b:clear(10,20,30,40)
+		lu.assertEvalToTrue(ldb_gfx.transform_blit(origin, target, {1,0,-1, 0,1,5}, "nearest", alpha_mode))
+		ldb_gfx.origin_to_target(origin, target_b, -1,5, 0,0,3,2, 1,1, alpha_mode)
+		lu.assertEquals(target:dump_data(), target_b:dump_data())
+	end
+
+	-- rotate by 90 degrees: origin x,y is drawn at 1-y,x
+	target:clear(0,0,0,0)
+	ldb_gfx.transform_blit(origin, target, {0,-1,2, 1,0,0})
+	for y=0, 1 do
+		for x=0, 2 do
+			lu.assertEquals({target:get_px(1-y,x)}, {origin:get_px(x,y)})
+		end
+	end
+	lu.assertEquals({target:get_px(2,0)}, {0,0,0,0})
+
+	-- bilinear sampling keeps a constant color
+	origin:clear(12,34,56,255)
+	target:clear(0,0,0,0)
+	local a = 0.3
+	ldb_gfx.transform_blit(origin, target, {math.cos(a)*10,-math.sin(a)*10,50, math.sin(a)*10,math.cos(a)*10,20}, "bilinear")
+	lu.assertEquals({target:get_px(50,25)}, {12,34,56,255})
+
+	-- origins without alpha are opaque, with every filter
+	local origin_rgb = ldb_core.new_drawbuffer(3,2,"rgb888")
+	origin_rgb:clear(12,34,56,255)
+	for _,filter in ipairs({"nearest", "bilinear"}) do
+		target:clear(0,0,0,0)
+		ldb_gfx.transform_blit(origin_rgb, target, {10,0,0, 0,10,0}, filter, "alphablend")
+		lu.assertEquals({target:get_px(15,10)}, {12,34,56,0})
+	end
+
+	lu.assertEvalToFalse(ldb_gfx.transform_blit(origin, target, {1,2,0, 2,4,0}))
+	lu.assertEvalToFalse(ldb_gfx.transform_blit(origin, target, {1,0,0, 0,1,0}, "unknown"))
+end
+
+function test_gfx_polygon()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local db = ldb_core.new_drawbuffer(width,height,px_fmt)
+
+	-- a square on pixel boundaries is filled exactly
+	db:clear(0,0,0,255)
+	lu.assertEvalToTrue(ldb_gfx.polygon(db, {10,10, 20,10, 20,20, 10,20}, 255,255,255,255))
+	lu.assertEquals({db:get_px(10,10)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(19,19)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(9,10)}, {0,0,0,255})
+	lu.assertEquals({db:get_px(20,19)}, {0,0,0,255})
+
+	-- edges on pixel centers cover half of the pixel
+	db:clear(0,0,0,255)
+	ldb_gfx.polygon(db, {10.5,10, 20,10, 20,20, 10.5,20}, 255,255,255,255)
+	local r = db:get_px(10,15)
+	lu.assertTrue(math.abs(r-128) <= 1)
+	lu.assertEquals({db:get_px(11,15)}, {255,255,255,255})
+
+	-- without antialiasing, pixels are either set or not
+	db:clear(0,0,0,255)
+	ldb_gfx.polygon(db, {10.6,10, 20,10, 20,20, 10.6,20}, 255,255,255,255, false, "nonzero", false)
+	lu.assertEquals({db:get_px(10,15)}, {0,0,0,255})
+
+	-- two overlapping squares in the same direction: the overlap is a hole for evenodd, but not for nonzero
+	local points = {10,10, 30,10, 30,30, 10,30, 10,10, 20,20, 40,20, 40,40, 20,40, 20,20}
+	db:clear(0,0,0,255)
+	ldb_gfx.polygon(db, points, 255,255,255,255, false, "evenodd")
+	lu.assertEquals({db:get_px(25,25)}, {0,0,0,255})
+	lu.assertEquals({db:get_px(15,15)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(35,35)}, {255,255,255,255})
+	db:clear(0,0,0,255)
+	ldb_gfx.polygon(db, points, 255,255,255,255, false, "nonzero")
+	lu.assertEquals({db:get_px(25,25)}, {255,255,255,255})
+
+	-- polygons are clipped to the drawbuffer
+	db:clear(0,0,0,255)
+	lu.assertEvalToTrue(ldb_gfx.polygon(db, {-50,-50, 150,-50, 150,150, -50,150}, 255,0,0,255))
+	lu.assertEquals({db:get_px(0,0)}, {255,0,0,255})
+	lu.assertEquals({db:get_px(width-1,height-1)}, {255,0,0,255})
+
+	lu.assertEvalToFalse(ldb_gfx.polygon(db, {0,0, 1,0, 1,1}, 255,0,0,255, false, "unknown"))
+	lu.assertEvalToFalse(ldb_gfx.polygon(db, {0,0, 1,0, 1,1}, 256,0,0,255))
+end
+
+function test_gfx_polyline()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local db = ldb_core.new_drawbuffer(width,height,px_fmt)
+
+	-- a horizontal line on pixel boundaries is drawn exactly
+	db:clear(0,0,0,255)
+	lu.assertEvalToTrue(ldb_gfx.polyline(db, {10,20, 30,20}, nil, 2, 255,255,255,255))
+	lu.assertEquals({db:get_px(10,19)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(29,20)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(9,20)}, {0,0,0,255})
+	lu.assertEquals({db:get_px(30,20)}, {0,0,0,255})
+	lu.assertEquals({db:get_px(20,21)}, {0,0,0,255})
+
+	-- square caps extend the line by half the width
+	db:clear(0,0,0,255)
+	ldb_gfx.polyline(db, {10,20, 30,20}, nil, 2, 255,255,255,255, "miter", "square")
+	lu.assertEquals({db:get_px(9,20)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(8,20)}, {0,0,0,255})
+
+	-- every pixel is blended once, even at joints and crossings
+	db:clear(0,0,0,255)
+	ldb_gfx.polyline(db, {10,10, 40,40, 10,40, 40,10}, nil, 4, 255,255,255,128)
+	local r,g,b,a = db:get_px(20,20)
+	lu.assertEquals({db:get_px(25,25)}, {r,g,b,a})
+	lu.assertEquals({db:get_px(25,39)}, {r,g,b,a})
+	lu.assertEquals({db:get_px(10,39)}, {r,g,b,a})
+
+	-- miter joins extend the corner, bevel joins cut it off
+	db:clear(0,0,0,255)
+	ldb_gfx.polyline(db, {10,10, 30,10, 30,30}, nil, 4, 255,255,255,255, "miter")
+	lu.assertEquals({db:get_px(31,8)}, {255,255,255,255})
+	db:clear(0,0,0,255)
+	ldb_gfx.polyline(db, {10,10, 30,10, 30,30}, nil, 4, 255,255,255,255, "bevel")
+	lu.assertEquals({db:get_px(31,8)}, {0,0,0,255})
+	lu.assertEquals({db:get_px(30,10)}, {255,255,255,255})
+
+	-- NaN coordinates split the polyline, only n points are used
+	db:clear(0,0,0,255)
+	ldb_gfx.polyline(db, {10,10, 20,10, 0/0,0/0, 30,10, 40,10, 50,10, 60,10}, 5, 2, 255,255,255,255)
+	lu.assertEquals({db:get_px(15,10)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(25,10)}, {0,0,0,255})
+	lu.assertEquals({db:get_px(35,10)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(55,10)}, {0,0,0,255})
+
+	lu.assertEvalToFalse(ldb_gfx.polyline(db, {0,0, 1,1}, nil, 1, 255,0,0,255, "unknown"))
+	lu.assertEvalToFalse(ldb_gfx.polyline(db, {0,0, 1,1}, nil, 1, 255,0,0,255, "miter", "unknown"))
+	lu.assertEvalToFalse(ldb_gfx.polyline(db, {0,0, 1,1}, 3, 1, 255,0,0,255))
+end
+
+function test_gfx_draw_mesh()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local db = ldb_core.new_drawbuffer(width,height,px_fmt)
+
+	-- a quad made from two triangles that share an edge: every pixel is drawn exactly once
+	local vertices = {
+		10,10,0.5, 255,0,0,128,
+		30,10,0.5, 255,0,0,128,
+		30,30,0.5, 255,0,0,128,
+		10,30,0.5, 255,0,0,128,
+	}
+	db:clear(0,0,0,255)
+	lu.assertEvalToTrue(ldb_gfx.draw_mesh(db, nil, vertices, {0,1,2, 0,2,3}, nil, "alphablend"))
+	local r,g,b,a = db:get_px(10,10)
+	lu.assertEquals({db:get_px(20,20)}, {r,g,b,a})
+	lu.assertEquals({db:get_px(29,29)}, {r,g,b,a})
+	lu.assertEquals({db:get_px(11,28)}, {r,g,b,a})
+	lu.assertEquals({db:get_px(30,30)}, {0,0,0,255})
+
+	-- the closer triangle wins, independent of the drawing order
+	local triangles = {
+		0,0,0.2, 0,255,0,255,   50,0,0.2, 0,255,0,255,   0,50,0.2, 0,255,0,255,
+		0,0,0.8, 0,0,255,255,   50,0,0.8, 0,0,255,255,   0,50,0.8, 0,0,255,255,
+	}
+	for _,depth_fmt in ipairs({"rgba8888", "rgb565"}) do
+		local depth_db = ldb_core.new_drawbuffer(width,height,depth_fmt)
+		lu.assertEvalToTrue(ldb_gfx.clear_depth(depth_db))
+		db:clear(0,0,0,255)
+		ldb_gfx.draw_mesh(db, depth_db, triangles)
+		lu.assertEquals({db:get_px(10,10)}, {0,255,0,255})
+	end
+
+	-- back-facing(counter-clockwise) triangles can be skipped
+	db:clear(0,0,0,255)
+	ldb_gfx.draw_mesh(db, nil, triangles, {0,2,1}, 1, nil, "back")
+	lu.assertEquals({db:get_px(10,10)}, {0,0,0,255})
+	ldb_gfx.draw_mesh(db, nil, triangles, {0,1,2}, 1, nil, "back")
+	lu.assertEquals({db:get_px(10,10)}, {0,255,0,255})
+
+	lu.assertEvalToFalse(ldb_gfx.draw_mesh(db, ldb_core.new_drawbuffer(10,10,"rgba8888"), triangles))
+	lu.assertEvalToFalse(ldb_gfx.draw_mesh(db, nil, triangles, nil, nil, nil, "unknown"))
+
+	-- vertex colors outside of 0-255 are rejected, and nothing is drawn
+	db:clear(0,0,0,255)
+	for _,color in ipairs({ {256,0,0,255}, {0,-1,0,255}, {0,0,0,0/0} }) do
+		local r,g,b,a = unpack(color)
+		local invalid = { 0,0,0.5, 0,0,0,255,   50,0,0.5, r,g,b,a,   0,50,0.5, 0,0,0,255 }
+		lu.assertEvalToFalse(ldb_gfx.draw_mesh(db, nil, invalid))
+		lu.assertEquals({db:get_px(10,10)}, {0,0,0,255})
+	end
+end
+
+function test_gfx_draw_textured_mesh()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local texture = ldb_core.new_drawbuffer(4,4,px_fmt)
+	for y=0, 3 do
+		for x=0, 3 do
+			texture:set_px(x,y, x*60,y*60,0,255)
+		end
+	end
+	local db = ldb_core.new_drawbuffer(width,height,px_fmt)
+
+	-- a quad with texture coordinates matching the pixels draws the texture unchanged
+	local function quad(x,y,w,h, u0,v0,u1,v1)
+		return {
+			x,y,0, 255,255,255,255, u0,v0,1,
+			x+w,y,0, 255,255,255,255, u1,v0,1,
+			x+w,y+h,0, 255,255,255,255, u1,v1,1,
+			x,y+h,0, 255,255,255,255, u0,v1,1,
+		}
+	end
+	for _,filter in ipairs({"nearest", "bilinear"}) do
+		db:clear(0,0,0,0)
+		lu.assertEvalToTrue(ldb_gfx.draw_textured_mesh(db, nil, texture, quad(10,20,4,4, 0,0,4,4), {0,1,2, 0,2,3}, nil, filter))
+		for y=0, 3 do
+			for x=0, 3 do
+				lu.assertEquals({db:get_px(10+x,20+y)}, {texture:get_px(x,y)})
+			end
+		end
+		lu.assertEquals({db:get_px(14,20)}, {0,0,0,0})
+	end
+
+	-- texture coordinates outside the texture are clamped or wrapped
+	db:clear(0,0,0,0)
+	ldb_gfx.draw_textured_mesh(db, nil, texture, quad(0,0,8,4, 0,0,8,4), {0,1,2, 0,2,3}, nil, "nearest", "clamp")
+	lu.assertEquals({db:get_px(6,1)}, {texture:get_px(3,1)})
+	ldb_gfx.draw_textured_mesh(db, nil, texture, quad(0,0,8,4, 0,0,8,4), {0,1,2, 0,2,3}, nil, "nearest", "wrap")
+	lu.assertEquals({db:get_px(6,1)}, {texture:get_px(2,1)})
+
+	-- the texture color is multiplied with the vertex color
+	texture:clear(200,100,50,255)
+	local vertices = quad(0,0,8,8, 0,0,4,4)
+	for i=0, 3 do
+		vertices[i*10+5] = 0
+	end
+	ldb_gfx.draw_textured_mesh(db, nil, texture, vertices, {0,1,2, 0,2,3})
+	lu.assertEquals({db:get_px(4,4)}, {200,0,50,255})
+
+	lu.assertEvalToFalse(ldb_gfx.draw_textured_mesh(db, nil, texture, vertices, nil, nil, "unknown"))
+	lu.assertEvalToFalse(ldb_gfx.draw_textured_mesh(db, nil, texture, vertices, nil, nil, "nearest", "unknown"))
+end
+
 function test_gfx_hsv_to_rgb()
 	local ldb_gfx = require("ldb_gfx")
 
@@ -247,6 +834,386 @@ function test_gfx_origin_to_target()
 end
 
 
+function test_gfx_origin_to_target_formats()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local formats = { "rgb565", "bgr565", "rgb888", "bgr888", "rgba8888", "argb8888", "abgr8888", "bgra8888", "rgba8888_premul", "bgra8888_premul" }
+
+	-- copying between pixel formats should produce the same pixel values as set_px in the target format
+	for _,origin_fmt in ipairs(formats) do
+		for _,target_fmt in ipairs(formats) do
+			local origin_db = ldb_core.new_drawbuffer(width,height,origin_fmt)
+			origin_db:clear(0,0,0,0)
+			origin_db:set_px(3,5, 211,227,233,241)
+			local target_db = ldb_core.new_drawbuffer(width,height,target_fmt)
+			target_db:clear(0,0,0,0)
+
+			-- copy with a negative offset, so that the region is clipped
+			ldb_gfx.origin_to_target(origin_db, target_db, -2,-4)
+
+			local reference = ldb_core.new_drawbuffer(1,1,target_fmt)
+			reference:set_px(0,0, origin_db:get_px(3,5))
+			lu.assertEquals({target_db:get_px(1,1)}, {reference:get_px(0,0)})
+			lu.assertEquals({target_db:get_px(0,0)}, {0,0,0,0})
+		end
+	end
+end
+
+
+function test_gfx_origin_to_target_scaled()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+
+	local origin_db = ldb_core.new_drawbuffer(2,2,px_fmt)
+	origin_db:set_px(0,0, 255,0,0,255)
+	origin_db:set_px(1,0, 0,255,0,255)
+	origin_db:set_px(0,1, 0,0,255,255)
+	origin_db:set_px(1,1, 255,255,255,255)
+
+	for _,alpha_mode in ipairs({"copy", "ignorealpha", "alphablend"}) do
+		local target_db = ldb_core.new_drawbuffer(width,height,px_fmt)
+		target_db:clear(0,0,0,0)
+
+		-- every origin pixel becomes a 3x2 block, starting left of the target(clipped)
+		ldb_gfx.origin_to_target(origin_db, target_db, -1,1, 0,0, 2,2, 3,2, alpha_mode)
+		for y=0, 4 do
+			for x=0, 5 do
+				local expected = {0,0,0,0}
+				if (y>=1) and (y<5) and (x<5) then
+					local r,g,b,a = origin_db:get_px(math.floor((x+1)/3), math.floor((y-1)/2))
+					expected = {r,g,b,(alpha_mode=="alphablend") and 0 or a}
+				end
+				lu.assertEquals({target_db:get_px(x,y)}, expected)
+			end
+		end
+	end
+end
+
+function test_gfx_circles()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local db = ldb_core.new_drawbuffer(width,height,px_fmt)
+
+	-- filled circles are symmetric, and contain the pixels with x^2+y^2 <= radius^2
+	db:clear(0,0,0,255)
+	ldb_gfx.circle(db, 50,50, 10, 255,255,255,255)
+	lu.assertEquals({db:get_px(40,50)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(60,50)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(50,60)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(57,57)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(58,57)}, {0,0,0,255})
+	lu.assertEquals({db:get_px(61,50)}, {0,0,0,255})
+
+	-- outlines are the pixels with a neighbour outside the circle
+	db:clear(0,0,0,255)
+	ldb_gfx.circle(db, 50,50, 10, 255,255,255,255, true)
+	lu.assertEquals({db:get_px(60,50)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(57,57)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(59,50)}, {0,0,0,255})
+	lu.assertEquals({db:get_px(50,50)}, {0,0,0,255})
+
+	db:clear(0,0,0,255)
+	lu.assertEvalToTrue(ldb_gfx.ellipse(db, 50,50, 20,10, 255,255,255,255))
+	lu.assertEquals({db:get_px(70,50)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(50,60)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(71,50)}, {0,0,0,255})
+	lu.assertEquals({db:get_px(50,61)}, {0,0,0,255})
+	lu.assertEquals({db:get_px(69,55)}, {0,0,0,255})
+
+	-- antialiased ellipses are solid inside, and partially covered at the edge
+	db:clear(0,0,0,255)
+	lu.assertEvalToTrue(ldb_gfx.ellipse(db, 50,50, 20,10, 255,255,255,255, false, true))
+	lu.assertEquals({db:get_px(50,50)}, {255,255,255,255})
+	local r = db:get_px(70,50)
+	lu.assertTrue((r > 0) and (r < 255))
+	lu.assertEquals({db:get_px(72,50)}, {0,0,0,255})
+
+	db:clear(0,0,0,255)
+	lu.assertEvalToTrue(ldb_gfx.ring(db, 50,50, 10,5, 255,255,255,255))
+	lu.assertEquals({db:get_px(50,50)}, {0,0,0,255})
+	lu.assertEquals({db:get_px(54,50)}, {0,0,0,255})
+	lu.assertEquals({db:get_px(55,50)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(60,50)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(61,50)}, {0,0,0,255})
+
+	db:clear(0,0,0,255)
+	ldb_gfx.ring(db, 50,50, 10,5, 255,255,255,255, true)
+	lu.assertEquals({db:get_px(50,50)}, {0,0,0,255})
+	lu.assertEquals({db:get_px(57,50)}, {255,255,255,255})
+	lu.assertEquals({db:get_px(60,50)}, {127,127,127,255})
+	lu.assertEquals({db:get_px(55,50)}, {127,127,127,255})
+end
+
+function test_gfx_smooth_shapes()
+	-- antialiased circles and lines: solid inside, partial alpha at the edge
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local drawbuffer = ldb_core.new_drawbuffer(width,height,px_fmt)
+
+	drawbuffer:clear(0,0,0,255)
+	ldb_gfx.circle(drawbuffer, 50,50, 20, 255,255,255,255, false, true)
+	lu.assertEquals({drawbuffer:get_px(50,50)}, {255,255,255,255})
+	lu.assertEquals({drawbuffer:get_px(69,50)}, {255,255,255,255})
+	lu.assertEquals({drawbuffer:get_px(70,50)}, {127,127,127,255})
+	lu.assertEquals({drawbuffer:get_px(71,50)}, {0,0,0,255})
+
+	-- outlines are empty inside
+	drawbuffer:clear(0,0,0,255)
+	ldb_gfx.circle(drawbuffer, 50,50, 20, 255,255,255,255, true, true)
+	lu.assertEquals({drawbuffer:get_px(50,50)}, {0,0,0,255})
+	lu.assertEquals({drawbuffer:get_px(50,70)}, {127,127,127,255})
+
+	drawbuffer:clear(0,0,0,255)
+	ldb_gfx.line(drawbuffer, 10,50, 90,50, 255,255,255,255, 3)
+	lu.assertEquals({drawbuffer:get_px(50,50)}, {255,255,255,255})
+	lu.assertEquals({drawbuffer:get_px(50,52)}, {255,255,255,255})
+	lu.assertEquals({drawbuffer:get_px(50,53)}, {127,127,127,255})
+	lu.assertEquals({drawbuffer:get_px(50,54)}, {0,0,0,255})
+	lu.assertEquals({drawbuffer:get_px(93,50)}, {127,127,127,255})
+end
+
+function test_gfx_ordered_dither()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local origin = ldb_core.new_drawbuffer(16,16,px_fmt)
+	local target = ldb_core.new_drawbuffer(16,16,"rgb565")
+
+	-- black and white are not dithered
+	origin:clear(255,255,255,255)
+	lu.assertEvalToTrue(ldb_gfx.ordered_dither(origin, target))
+	lu.assertEquals({target:get_px(3,5)}, {248,252,248,0})
+	origin:clear(0,0,0,255)
+	ldb_gfx.ordered_dither(origin, target, "bayer4")
+	lu.assertEquals({target:get_px(3,5)}, {0,0,0,0})
+
+	-- the average of the quantized levels is the original value
+	origin:clear(100,100,100,255)
+	ldb_gfx.ordered_dither(origin, target, "bayer8")
+	local sum_r, sum_g = 0,0
+	for y=0, 15 do
+		for x=0, 15 do
+			local r,g = target:get_px(x,y)
+			sum_r = sum_r + (r/8)*255/31
+			sum_g = sum_g + (g/4)*255/63
+		end
+	end
+	lu.assertAlmostEquals(sum_r/256, 100, 1)
+	lu.assertAlmostEquals(sum_g/256, 100, 1)
+
+	-- 1bpp targets are black or white by luminance
+	local target_bit = ldb_core.new_drawbuffer(16,16,"bit")
+	origin:clear(128,128,128,255)
+	ldb_gfx.ordered_dither(origin, target_bit, "bayer2")
+	local white = 0
+	for y=0, 15 do
+		for x=0, 15 do
+			if target_bit:get_px(x,y) > 0 then
+				white = white + 1
+			end
+		end
+	end
+	lu.assertEquals(white, 128)
+
+	-- in-place dithering keeps the pixel format and alpha values
+	for y=0, 15 do
+		for x=0, 15 do
+			origin:set_px(x,y, (x*37)%256, (y*91)%256, (x*y)%256, 100)
+		end
+	end
+	lu.assertEvalToTrue(ldb_gfx.ordered_dither(origin, 8))
+	local r,g,b,a = origin:get_px(7,9)
+	lu.assertEquals({r%32, g%32, b%64, a}, {0,0,0,100})
+
+	-- a drawbuffer as threshold matrix, the result does not depend on the number of threads
+	local matrix = ldb_core.new_drawbuffer(5,3,px_fmt)
+	for y=0, 2 do
+		for x=0, 4 do
+			matrix:set_px(x,y, ((x*3+y*5)*17)%256, 0,0,255)
+		end
+	end
+	local _,target_a = assert_threads_equal(300,70, 300,70, "rgb332", function(o, t, threads)
+		ldb_gfx.ordered_dither(o, t, matrix, threads)
+	end)
+
+	lu.assertEvalToFalse(ldb_gfx.ordered_dither(origin, target_a))
+	lu.assertEvalToFalse(ldb_gfx.ordered_dither(origin, target, "unknown"))
+	lu.assertEvalToFalse(ldb_gfx.ordered_dither(origin, 4))
+end
+
+function test_gfx_error_diffusion()
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local origin = ldb_core.new_drawbuffer(32,32,px_fmt)
+	local target = ldb_core.new_drawbuffer(32,32,"bit")
+
+	-- the error is distributed, so the average brightness is kept
+	origin:clear(64,64,64,255)
+	for _,kernel in ipairs({"floyd_steinberg", "sierra", "jarvis"}) do
+		lu.assertEvalToTrue(ldb_gfx.error_diffusion(origin, target, kernel))
+		local white = 0
+		for y=0, 31 do
+			for x=0, 31 do
+				if target:get_px(x,y) > 0 then
+					white = white + 1
+				end
+			end
+		end
+		lu.assertAlmostEquals(white, 1024/4, 20)
+	end
+
+	-- a palette into a 8bpp target stores the palette index
+	local palette = ldb_core.new_drawbuffer(3,1,px_fmt)
+	palette:set_px(0,0, 0,0,0,255)
+	palette:set_px(1,0, 255,0,0,255)
+	palette:set_px(2,0, 0,0,255,255)
+	local target_index = ldb_core.new_drawbuffer(32,32,"byte")
+	origin:clear(255,0,0,255)
+	origin:set_px(5,7, 0,0,250,255)
+	lu.assertEvalToTrue(ldb_gfx.error_diffusion(origin, target_index, "atkinson", palette))
+	lu.assertEquals(target_index:get_px(4,7), 1)
+	lu.assertEquals(target_index:get_px(5,7), 2)
+
+	-- in raster order, the result does not depend on the number of threads
+	local origin_large, target_a = assert_threads_equal(300,70, 300,70, "rgb565", function(o, t, threads)
+		ldb_gfx.error_diffusion(o, t, "jarvis", nil, false, threads)
+	end)
+
+	-- in-place dithering keeps the pixel format
+	lu.assertEvalToTrue(ldb_gfx.floyd_steinberg(origin_large, 16))
+	local r,g,b = origin_large:get_px(123,45)
+	lu.assertEquals({r%8, g%4, b%8}, {0,0,0})
+
+	lu.assertEvalToFalse(ldb_gfx.error_diffusion(origin, target, "unknown"))
+	lu.assertEvalToFalse(ldb_gfx.error_diffusion(origin, target_a))
+end
+
+function test_gfx_damage()
+	-- every pixel changed by a drawing function must be inside the damage region
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local drawbuffer = ldb_core.new_drawbuffer(width,height,px_fmt)
+	local origin = ldb_core.new_drawbuffer(10,10,px_fmt)
+	origin:clear(255,0,0,255)
+	drawbuffer:track_damage(true)
+
+	local draw_funcs = {
+		function() ldb_gfx.line(drawbuffer, 90,5, 10,20, 255,255,255,255) end,
+		function() ldb_gfx.line(drawbuffer, 10,50, 30,60, 255,255,255,255, 3) end,
+		function() ldb_gfx.rectangle(drawbuffer, 40,40, -10,5, 255,255,255,255) end,
+		function() ldb_gfx.rectangle(drawbuffer, 5,70, 20,20, 255,255,255,255, true) end,
+		function() ldb_gfx.triangle(drawbuffer, 50,90, 70,60, 99,99, 255,255,255,255) end,
+		function() ldb_gfx.circle(drawbuffer, 60,30, 10, 255,255,255,255) end,
+		function() ldb_gfx.circle(drawbuffer, 20,30, 8, 255,255,255,255, true, true) end,
+		function() ldb_gfx.set_px_alphablend(drawbuffer, 3,4, 255,255,255,255) end,
+		function() ldb_gfx.origin_to_target(origin, drawbuffer, 80,80, 0,0, 10,10, 2) end,
+	}
+	for _,draw_func in ipairs(draw_funcs) do
+		drawbuffer:clear(0,0,0,0)
+		drawbuffer:reset_damage()
+		draw_func()
+		local damage = drawbuffer:get_damage()
+		lu.assertTrue(#damage > 0)
+		for y=0, height-1 do
+			for x=0, width-1 do
+				local r = drawbuffer:get_px(x,y)
+				if r ~= 0 then
+					local covered = false
+					for _,rect in ipairs(damage) do
+						covered = covered or ((x>=rect.x) and (x<rect.x+rect.w) and (y>=rect.y) and (y<rect.y+rect.h))
+					end
+					lu.assertTrue(covered)
+				end
+			end
+		end
+	end
+end
+
+function test_gfx_command_list()
+	-- executing a command list draws the same as calling the ldb_gfx functions
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local drawbuffer_a = ldb_core.new_drawbuffer(width,height,px_fmt)
+	local drawbuffer_b = ldb_core.new_drawbuffer(width,height,px_fmt)
+	drawbuffer_a:clear(0,0,0,255)
+	drawbuffer_b:clear(0,0,0,255)
+
+	local command_list = ldb_gfx.new_command_list()
+	lu.assertEvalToTrue(command_list)
+	lu.assertEquals(command_list:len(), 0)
+
+	local draw_calls = {
+		{ "line", 90,5, 10,20, 255,0,0,255 },
+		{ "line", 10,50, 30,60, 0,255,0,128, 3 },
+		{ "rectangle", 40,40, -10,5, 0,0,255,255 },
+		{ "rectangle", 5,70, 20,20, 255,255,0,128, true, true },
+		{ "triangle", 50,90, 70,60, 99,99, 255,0,255,255 },
+		{ "circle", 60,30, 10, 0,255,255,255 },
+		{ "circle", 20,30, 8, 255,255,255,200, true, true },
+	}
+	for _,draw_call in ipairs(draw_calls) do
+		local name = draw_call[1]
+		lu.assertEvalToTrue(command_list[name](command_list, unpack(draw_call, 2)))
+		ldb_gfx[name](drawbuffer_b, unpack(draw_call, 2))
+	end
+	lu.assertEvalToTrue(command_list:set_px(1,2, 255,255,255,255))
+	drawbuffer_b:set_px(1,2, 255,255,255,255)
+	lu.assertEquals(command_list:len(), #draw_calls+1)
+
+	lu.assertEvalToTrue(command_list:execute(drawbuffer_a))
+	lu.assertEvalToTrue(drawbuffer_a:dump_data() == drawbuffer_b:dump_data())
+
+	-- the encoded commands can be copied to another command list
+	local data = command_list:dump_data()
+	lu.assertEquals(#data, command_list:len()*ldb_gfx.command_size)
+	local copy = ldb_gfx.new_command_list()
+	lu.assertEvalToTrue(copy:append_data(data))
+	lu.assertEquals(copy:dump_data(), data)
+	lu.assertEvalToFalse(copy:append_data("x"))
+	lu.assertEvalToFalse(copy:line(0,0, 1,1, 256,0,0,0))
+
+	-- a smooth line with an invalid color is not appended, and does not change the previous command
+	local smooth = ldb_gfx.new_command_list()
+	lu.assertEvalToFalse(smooth:line(0,0, 1,1, 256,0,0,0, 3))
+	lu.assertEquals(smooth:len(), 0)
+	lu.assertEvalToTrue(smooth:line(0,0, 1,1, 255,0,0,255, 3))
+	local smooth_data = smooth:dump_data()
+	lu.assertEvalToFalse(smooth:line(0,0, 1,1, 0,0,0,-1, 7))
+	lu.assertEquals(smooth:dump_data(), smooth_data)
+	lu.assertEvalToTrue(smooth:close())
+	lu.assertEvalToFalse(smooth:line(0,0, 1,1, 255,0,0,255, 3))
+
+	lu.assertEvalToTrue(command_list:clear())
+	lu.assertEquals(command_list:len(), 0)
+	lu.assertEvalToTrue(command_list:close())
+	lu.assertEvalToFalse(command_list:len())
+end
+
+function test_gfx_command_list_threads()
+	-- executing a command list using multiple threads draws the same as executing it in a single thread
+	local ldb_core = require("ldb_core")
+	local ldb_gfx = require("ldb_gfx")
+	local drawbuffer_a = ldb_core.new_drawbuffer(width,height,px_fmt)
+	local drawbuffer_b = ldb_core.new_drawbuffer(width,height,px_fmt)
+	drawbuffer_a:clear(0,0,0,255)
+	drawbuffer_b:clear(0,0,0,255)
+
+	local command_list = ldb_gfx.new_command_list()
+	for i=0, 50 do
+		command_list:line(i*2,-10, width-i,height+10, 255,i*5,0,128, true)
+		command_list:line(i,i*2, width-i*2,i, 0,255,i*5,128, 2)
+		command_list:rectangle(i*2-20,i*2-20, 30,-30, i*5,0,255,100, i%2==0, true)
+		command_list:triangle(i,0, width-i,i*2, i*2,height-i, 255,255,i*5,60, true)
+		command_list:circle(width-i*2,i*2, i%20, 0,i*5,255,180, i%2==0, true)
+	end
+
+	lu.assertEvalToTrue(command_list:execute(drawbuffer_a))
+	lu.assertEvalToTrue(command_list:execute(drawbuffer_b, 4))
+	lu.assertEvalToTrue(drawbuffer_a:dump_data() == drawbuffer_b:dump_data())
+	lu.assertEvalToTrue(command_list:execute(drawbuffer_a))
+	lu.assertEvalToTrue(command_list:execute(drawbuffer_b, 0))
+	lu.assertEvalToTrue(drawbuffer_a:dump_data() == drawbuffer_b:dump_data())
+end
+
 -- TODO: test lines p1==p1, 1px wide/tall, etc.
 -- TODO: Also test alphablending mode for lines
 -- TODO: test rectangle, circles